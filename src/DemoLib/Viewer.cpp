@@ -58,6 +58,7 @@ Viewer::Viewer(const int w, const int h, const char *local_dir, const AppParams
         s.use_bindless = !nobindless;
         s.use_tex_compression = !nocompression;
         s.use_spatial_cache = _app_params.use_spatial_cache;
+        s.reprojection_max_samples = _app_params.reprojection;
         s.validation_level = _app_params.validation_level;
         if (gpu_mode == 0) {
             ray_renderer.reset(Ray::CreateRenderer(s, log.get(), Ray::RendererCPU));
@@ -30,6 +30,8 @@ struct AppParams {
     int camera_index = -1; // -1 means 'use camera set in scene description'
     float regularize_alpha = 0.03f;
     int time_limit = -1;
+    float frame_budget = 0.0f; // in milliseconds, zero means fixed number of passes per frame
+    int reprojection = 0;      // samples carried over after camera move, zero disables
 #ifndef NDEBUG
     int validation_level = 2;
 #else
@@ -12,6 +12,8 @@
 #include <sstream>
 #include <utility>
 
+#include <sys/stat.h>
+
 #include <Ray/Log.h>
 #include <Ray/RendererBase.h>
 #include <Sys/AssetFile.h>
@@ -50,6 +52,60 @@ bool ends_with(const std::string &value, const std::string &ending) {
     return std::equal(ending.rbegin(), ending.rend(), value.rbegin());
 }
 
+const uint32_t CompiledFileMagic = 0x4e435352; // 'RSCN'
+
+// Precedes scene blob in compiled file, keeps it 16-byte aligned
+struct compiled_file_header_t {
+    uint32_t magic;
+    int32_t max_tex_res;
+    uint64_t source_hash;
+};
+static_assert(sizeof(compiled_file_header_t) == 16, "!");
+
+uint64_t hash_combine(uint64_t hash, const void *data, const size_t size) {
+    // FNV-1a
+    const auto *bytes = reinterpret_cast<const uint8_t *>(data);
+    for (size_t i = 0; i < size; ++i) {
+        hash = (hash ^ bytes[i]) * 0x100000001b3ull;
+    }
+    return hash;
+}
+
+// Mixes in size and modification time of every file referenced by scene description
+uint64_t hash_referenced_files(uint64_t hash, const JsElement &js_el) {
+    if (js_el.type() == JsType::String) {
+        struct stat file_stat = {};
+        if (stat(js_el.as_str().val.c_str(), &file_stat) == 0) {
+            const int64_t size = int64_t(file_stat.st_size), mtime = int64_t(file_stat.st_mtime);
+            hash = hash_combine(hash, &size, sizeof(size));
+            hash = hash_combine(hash, &mtime, sizeof(mtime));
+        }
+    } else if (js_el.type() == JsType::Array) {
+        for (const JsElement &el : js_el.as_arr().elements) {
+            hash = hash_referenced_files(hash, el);
+        }
+    } else if (js_el.type() == JsType::Object) {
+        for (const auto &el : js_el.as_obj().elements) {
+            hash = hash_referenced_files(hash, el.second);
+        }
+    }
+    return hash;
+}
+
+uint64_t scene_source_hash(const JsObject &js_scene) {
+    std::ostringstream ss;
+    js_scene.Write(ss);
+    const std::string scene_text = ss.str();
+
+    uint64_t hash = hash_combine(0xcbf29ce484222325ull, scene_text.data(), scene_text.size());
+    for (const auto &el : js_scene.elements) {
+        if (el.first != "compiled") {
+            hash = hash_referenced_files(hash, el.second);
+        }
+    }
+    return hash;
+}
+
 //	the following constants were copied directly off the MSDN website
 
 //	The dwFlags member of the original DDSURFACEDESC2 structure
@@ -254,6 +310,24 @@ std::unique_ptr<Ray::SceneBase> LoadScene(Ray::RendererBase *r, const JsObject &
                                           Sys::ThreadPool *threads, int camera_index) {
     auto new_scene = std::unique_ptr<Ray::SceneBase>(r->CreateScene());
 
+    // Precompiled scene allows to skip parsing and preprocessing entirely, it is only used if it was produced from
+    // the same description, assets and texture resolution limit
+    std::string compiled_name;
+    uint64_t source_hash = 0;
+    if (js_scene.Has("compiled")) {
+        compiled_name = js_scene.at("compiled").as_str().val.c_str();
+        source_hash = scene_source_hash(js_scene);
+        if (LoadCompiledScene(new_scene.get(), compiled_name.c_str(), max_tex_res, source_hash)) {
+            if (camera_index != -1) {
+                // cameras are added in order, handle matches the index
+                new_scene->set_current_cam(Ray::CameraHandle{uint32_t(camera_index)});
+            }
+            return new_scene;
+        }
+        // start from scratch
+        new_scene.reset(r->CreateScene());
+    }
+
     std::vector<Ray::CameraHandle> cameras;
     std::map<std::string, Ray::TextureHandle> textures;
     std::map<std::string, std::pair<Ray::MaterialHandle, bool>> materials;
@@ -1814,9 +1888,61 @@ std::unique_ptr<Ray::SceneBase> LoadScene(Ray::RendererBase *r, const JsObject &
     using namespace std::placeholders;
     new_scene->Finalize(std::bind(&Sys::ThreadPool::ParallelFor<Ray::ParallelForFunction>, threads, _1, _2, _3));
 
+    if (!compiled_name.empty() &&
+        !SaveCompiledScene(new_scene.get(), compiled_name.c_str(), max_tex_res, source_hash)) {
+        r->log()->Warning("Failed to write compiled scene %s", compiled_name.c_str());
+    }
+
     return new_scene;
 }
 
+bool SaveCompiledScene(const Ray::SceneBase *scene, const char *file_name, const int max_tex_res,
+                       const uint64_t source_hash) {
+    std::vector<uint8_t> data;
+    if (!scene->SaveCompiled(data)) {
+        return false;
+    }
+
+    compiled_file_header_t header = {};
+    header.magic = CompiledFileMagic;
+    header.max_tex_res = max_tex_res;
+    header.source_hash = source_hash;
+
+    std::ofstream out_file(file_name, std::ios::binary);
+    out_file.write((const char *)&header, sizeof(header));
+    out_file.write((const char *)data.data(), data.size());
+    return out_file.good();
+}
+
+bool LoadCompiledScene(Ray::SceneBase *scene, const char *file_name, const int max_tex_res,
+                       const uint64_t source_hash) {
+    std::ifstream in_file(file_name, std::ios::binary | std::ios::ate);
+    if (!in_file) {
+        return false;
+    }
+    const size_t file_size = size_t(in_file.tellg());
+    in_file.seekg(0, std::ios::beg);
+
+    compiled_file_header_t header = {};
+    if (file_size < sizeof(header) || !in_file.read((char *)&header, sizeof(header)) ||
+        header.magic != CompiledFileMagic || header.max_tex_res != max_tex_res || header.source_hash != source_hash) {
+        // compiled file is outdated
+        return false;
+    }
+    const size_t data_size = file_size - sizeof(header);
+
+    // NOTE: blob is expected to be 16-byte aligned
+    struct alignas(16) chunk_t {
+        uint8_t data[16];
+    };
+    std::unique_ptr<chunk_t[]> data(new chunk_t[(data_size + 15) / 16]);
+    if (!in_file.read((char *)data.get(), data_size)) {
+        return false;
+    }
+
+    return scene->LoadCompiled(Ray::Span<const uint8_t>((const uint8_t *)data.get(), data_size));
+}
+
 std::tuple<std::vector<float>, std::vector<unsigned>, std::vector<unsigned>> LoadOBJ(const char *file_name) {
     std::vector<float> attrs;
     std::vector<unsigned> indices;
@@ -20,6 +20,10 @@ class ThreadPool;
 std::unique_ptr<Ray::SceneBase> LoadScene(Ray::RendererBase *r, const JsObject &js_scene, int max_tex_res,
                                           Sys::ThreadPool *threads, int camera_index = -1);
 
+// Compiled file is tagged with texture resolution limit and hash of scene description (and files it references)
+bool SaveCompiledScene(const Ray::SceneBase *scene, const char *file_name, int max_tex_res, uint64_t source_hash);
+bool LoadCompiledScene(Ray::SceneBase *scene, const char *file_name, int max_tex_res, uint64_t source_hash);
+
 std::tuple<std::vector<float>, std::vector<unsigned>, std::vector<unsigned>> LoadOBJ(const char *file_name);
 std::tuple<std::vector<float>, std::vector<unsigned>, std::vector<unsigned>> LoadBIN(const char *file_name);
 
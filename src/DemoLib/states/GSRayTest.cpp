@@ -211,6 +211,23 @@ void GSRayTest::UpdateRegionContexts() {
         }
 #endif
     }
+
+    region_ptrs_.clear();
+    for (auto &ctxs : region_contexts_) {
+        for (auto &ctx : ctxs) {
+            region_ptrs_.push_back(&ctx);
+        }
+    }
+
+    frame_budget_.reset();
+    if (viewer_->app_params.frame_budget > 0.0f && Ray::RendererSupportsMultithreading(rt)) {
+        Ray::frame_budget_desc_t desc;
+        desc.budget_ms = viewer_->app_params.frame_budget;
+        if (viewer_->app_params.max_samples != -1) {
+            desc.max_samples = viewer_->app_params.max_samples;
+        }
+        frame_budget_ = std::make_unique<Ray::FrameBudgetController>(desc);
+    }
 }
 
 void GSRayTest::UpdateEnvironment(const Ren::Vec3f &sun_dir) {
@@ -433,11 +450,19 @@ void GSRayTest::Draw(const uint64_t dt_us) {
             ray_renderer_->ResolveSpatialCache(
                 *ray_scene_, std::bind(&Sys::ThreadPool::ParallelFor<Ray::ParallelForFunction>, threads_, _1, _2, _3));
         }
-        for (int i = 0; i < app_params.iteration_steps; ++i) {
-            if (denoise_image && i == app_params.iteration_steps - 1) {
-                threads_->Enqueue(*render_and_denoise_tasks_).wait();
-            } else {
-                threads_->Enqueue(*render_tasks_).wait();
+        if (frame_budget_ && !denoise_image) {
+            // regions get as many samples as fit into frame budget (converged ones are skipped)
+            using namespace std::placeholders;
+            frame_budget_->RenderFrame(
+                *ray_renderer_, *ray_scene_, region_ptrs_,
+                std::bind(&Sys::ThreadPool::ParallelFor<Ray::ParallelForFunction>, threads_, _1, _2, _3));
+        } else {
+            for (int i = 0; i < app_params.iteration_steps; ++i) {
+                if (denoise_image && i == app_params.iteration_steps - 1) {
+                    threads_->Enqueue(*render_and_denoise_tasks_).wait();
+                } else {
+                    threads_->Enqueue(*render_tasks_).wait();
+                }
             }
         }
     } else {
@@ -973,6 +998,14 @@ void GSRayTest::Draw(const uint64_t dt_us) {
         stats5 += "time:  ";
         stats5 += std::to_string(cur_time_stat_ms_);
         stats5 += " ms";
+        if (frame_budget_) {
+            const Ray::frame_budget_stats_t &fb_stats = frame_budget_->stats();
+            stats5 += " (";
+            stats5 += std::to_string(int(fb_stats.samples_per_second / 1000.0));
+            stats5 += "K samples/s, ";
+            stats5 += std::to_string(fb_stats.overruns_count);
+            stats5 += " overruns)";
+        }
 
         font_->DrawText(ui_renderer_, stats1.c_str(), Ren::Vec2f{-1, 1 - 1 * font_height}, ui_root_);
         font_->DrawText(ui_renderer_, stats2.c_str(), Ren::Vec2f{-1, 1 - 2 * font_height}, ui_root_);
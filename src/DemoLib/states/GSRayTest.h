@@ -1,5 +1,6 @@
 #pragma once
 
+#include <Ray/FrameBudget.h>
 #include <Ray/RendererBase.h>
 #include <Sys/SmallVector.h>
 
@@ -68,6 +69,8 @@ class GSRayTest : public GameState {
     std::vector<Ray::RendererBase::stats_t> stats_;
 
     std::vector<Sys::SmallVector<Ray::RegionContext, 128>> region_contexts_;
+    std::vector<Ray::RegionContext *> region_ptrs_;
+    std::unique_ptr<Ray::FrameBudgetController> frame_budget_;
 
     void UpdateRegionContexts();
     void UpdateEnvironment(const Ren::Vec3f &sun_dir);
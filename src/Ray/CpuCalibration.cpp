@@ -0,0 +1,303 @@
+#include "CpuCalibration.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#if defined(__linux__) && (defined(__arm__) || defined(__aarch64__))
+#include <sys/auxv.h>
+#endif
+
+#include "Ray.h"
+#include "internal/simd/detect.h"
+
+namespace Ray {
+namespace {
+// Image is split into enough tiles to keep all threads of parallel_for busy
+const int BenchmarkRes = 256, BenchmarkTileRes = 32;
+const int BenchmarkWarmupIterations = 2, BenchmarkIterations = 8;
+
+const eRendererType CalibrationCandidates[] = {eRendererType::Reference,  eRendererType::SIMD_SSE2,
+                                               eRendererType::SIMD_SSE41, eRendererType::SIMD_AVX,
+                                               eRendererType::SIMD_AVX2,  eRendererType::SIMD_AVX512,
+                                               eRendererType::SIMD_NEON};
+
+std::mutex g_calibration_mtx;
+// CPU model does not change while process is running, so in-memory results are not keyed
+std::map<eRendererType, double> g_measured_rays_per_second;
+
+bool IsSupportedByCpu(const eRendererType rt) {
+#if !defined(__arm__) && !defined(__aarch64__) && !defined(_M_ARM) && !defined(_M_ARM64)
+    const CpuFeatures features = GetCpuFeatures();
+    switch (rt) {
+    case eRendererType::Reference:
+        return true;
+    case eRendererType::SIMD_SSE2:
+        return features.sse2_supported;
+    case eRendererType::SIMD_SSE41:
+        return features.sse41_supported;
+    case eRendererType::SIMD_AVX:
+        return features.avx_supported;
+    case eRendererType::SIMD_AVX2:
+        return features.avx2_supported;
+    case eRendererType::SIMD_AVX512:
+        return features.avx512_supported;
+    default:
+        return false;
+    }
+#else
+    return rt == eRendererType::Reference || rt == eRendererType::SIMD_NEON;
+#endif
+}
+
+// Vector extensions may be masked by OS or hypervisor, so the same model can end up with different backends
+std::string CpuFeaturesName() {
+    std::string ret;
+#if defined(__linux__) && (defined(__arm__) || defined(__aarch64__))
+    char buf[32];
+    snprintf(buf, sizeof(buf), "HWCAP %llx", (unsigned long long)getauxval(AT_HWCAP));
+    ret = buf;
+#else
+    for (const eRendererType rt : CalibrationCandidates) {
+        if (rt != eRendererType::Reference && IsSupportedByCpu(rt)) {
+            ret += ret.empty() ? "" : " ";
+            ret += RendererTypeName(rt);
+        }
+    }
+#endif
+    return ret;
+}
+
+// Results of different library versions are not comparable
+std::string CacheKey() {
+    return std::string(GetCpuModelName()) + " [" + CpuFeaturesName() + "] (" + Version() + ")";
+}
+
+void LoadCachedResults(const char *cache_path, std::map<eRendererType, double> &out_results) {
+    std::ifstream in(cache_path);
+    const std::string key = CacheKey();
+
+    // each line is "<cpu model>;<renderer name>;<rays per second>"
+    std::string line;
+    while (std::getline(in, line)) {
+        const size_t n1 = line.find(';'), n2 = line.rfind(';');
+        if (n1 == std::string::npos || n1 == n2 || line.compare(0, n1, key) != 0 || n1 != key.length()) {
+            continue;
+        }
+        const std::string name = line.substr(n1 + 1, n2 - n1 - 1);
+        const double rays_per_second = atof(line.c_str() + n2 + 1);
+        const eRendererType rt = RendererTypeFromName(name.c_str());
+        if (strcmp(RendererTypeName(rt), name.c_str()) == 0 && rays_per_second > 0.0) {
+            out_results[rt] = rays_per_second;
+        }
+    }
+}
+
+bool SaveCachedResults(const char *cache_path, const std::map<eRendererType, double> &results) {
+    const std::string key = CacheKey();
+
+    // keep entries of other CPU models (file can be shared between hosts)
+    std::vector<std::string> lines;
+    {
+        std::ifstream in(cache_path);
+        std::string line;
+        while (std::getline(in, line)) {
+            if (!line.empty() && (line.compare(0, key.length(), key) != 0 || line[key.length()] != ';')) {
+                lines.push_back(line);
+            }
+        }
+    }
+    for (const auto &r : results) {
+        std::ostringstream ss;
+        ss << key << ';' << RendererTypeName(r.first) << ';' << std::llround(r.second);
+        lines.push_back(ss.str());
+    }
+
+    std::ofstream out(cache_path, std::ios::trunc);
+    for (const std::string &line : lines) {
+        out << line << '\n';
+    }
+    return out.good();
+}
+
+void SetupBenchmarkScene(SceneBase &scene) {
+    // Tessellated sphere lying on a plane, lit by environment and sphere light
+    const int SegmentsX = 32, SegmentsY = 16;
+
+    std::vector<float> positions, normals, uvs;
+    std::vector<uint32_t> indices;
+    for (int j = 0; j <= SegmentsY; ++j) {
+        const float theta = 3.14159265f * float(j) / SegmentsY;
+        for (int i = 0; i <= SegmentsX; ++i) {
+            const float phi = 2.0f * 3.14159265f * float(i) / SegmentsX;
+            const float n[3] = {std::sin(theta) * std::cos(phi), std::cos(theta), std::sin(theta) * std::sin(phi)};
+            positions.insert(end(positions), {n[0], n[1] + 1.0f, n[2]});
+            normals.insert(end(normals), n, n + 3);
+            uvs.push_back(float(i) / SegmentsX);
+            uvs.push_back(float(j) / SegmentsY);
+        }
+    }
+    for (int j = 0; j < SegmentsY; ++j) {
+        for (int i = 0; i < SegmentsX; ++i) {
+            const uint32_t i0 = j * (SegmentsX + 1) + i, i1 = i0 + 1, i2 = i0 + SegmentsX + 1, i3 = i2 + 1;
+            indices.insert(end(indices), {i0, i1, i2, i2, i1, i3});
+        }
+    }
+    const uint32_t sphere_indices_count = uint32_t(indices.size());
+
+    const uint32_t plane_start = uint32_t(positions.size() / 3);
+    positions.insert(end(positions), {-8.0f, 0.0f, -8.0f, 8.0f, 0.0f, -8.0f, -8.0f, 0.0f, 8.0f, 8.0f, 0.0f, 8.0f});
+    normals.insert(end(normals), {0.0f, 1.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 1.0f, 0.0f});
+    uvs.insert(end(uvs), {0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 1.0f, 1.0f, 1.0f});
+    indices.insert(end(indices), {plane_start, plane_start + 2, plane_start + 1, plane_start + 1, plane_start + 2,
+                                  plane_start + 3});
+
+    shading_node_desc_t mat_desc;
+    mat_desc.type = eShadingNode::Diffuse;
+    mat_desc.base_color[0] = 0.8f;
+    mat_desc.base_color[1] = 0.2f;
+    mat_desc.base_color[2] = 0.2f;
+    const MaterialHandle sphere_mat = scene.AddMaterial(mat_desc);
+    mat_desc.base_color[0] = mat_desc.base_color[1] = mat_desc.base_color[2] = 0.5f;
+    const MaterialHandle plane_mat = scene.AddMaterial(mat_desc);
+
+    mesh_desc_t mesh_desc;
+    mesh_desc.prim_type = ePrimType::TriangleList;
+    mesh_desc.vtx_positions = {positions, 0, 3};
+    mesh_desc.vtx_normals = {normals, 0, 3};
+    mesh_desc.vtx_uvs = {uvs, 0, 2};
+    mesh_desc.vtx_indices = indices;
+
+    const mat_group_desc_t groups[] = {{sphere_mat, 0, sphere_indices_count},
+                                       {plane_mat, sphere_indices_count, indices.size() - sphere_indices_count}};
+    mesh_desc.groups = groups;
+
+    const MeshHandle mesh = scene.AddMesh(mesh_desc);
+
+    static const float identity[16] = {1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f,
+                                       0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f};
+    scene.AddMeshInstance(mesh, identity);
+
+    sphere_light_desc_t light_desc;
+    light_desc.color[0] = light_desc.color[1] = light_desc.color[2] = 20.0f;
+    light_desc.position[0] = 2.0f;
+    light_desc.position[1] = 4.0f;
+    light_desc.position[2] = 2.0f;
+    light_desc.radius = 0.5f;
+    scene.AddLight(light_desc);
+
+    environment_desc_t env_desc;
+    env_desc.env_col[0] = env_desc.env_col[1] = env_desc.env_col[2] = 0.25f;
+    scene.SetEnvironment(env_desc);
+
+    camera_desc_t cam_desc;
+    cam_desc.origin[1] = 1.5f;
+    cam_desc.origin[2] = 4.0f;
+    cam_desc.fwd[1] = -0.19611614f;
+    cam_desc.fwd[2] = -0.98058068f;
+    cam_desc.fov = 45.0f;
+    scene.set_current_cam(scene.AddCamera(cam_desc));
+
+    scene.Finalize();
+}
+
+void RenderTiles(RendererBase &renderer, const SceneBase &scene, std::vector<RegionContext> &regions,
+                 const int iterations, const std::function<void(int, int, ParallelForFunction &&)> &parallel_for) {
+    parallel_for(0, int(regions.size()), [&](const int i) {
+        for (int j = 0; j < iterations; ++j) {
+            renderer.RenderScene(scene, regions[i]);
+        }
+    });
+}
+
+double BenchmarkRenderer(const eRendererType rt,
+                         const std::function<void(int, int, ParallelForFunction &&)> &parallel_for) {
+    settings_t s;
+    s.w = s.h = BenchmarkRes;
+
+    std::unique_ptr<RendererBase> renderer(CreateRenderer(s, &g_null_log, rt));
+    if (!renderer || renderer->type() != rt) {
+        return 0.0;
+    }
+
+    std::unique_ptr<SceneBase> scene(renderer->CreateScene());
+    SetupBenchmarkScene(*scene);
+
+    std::vector<RegionContext> regions;
+    for (int y = 0; y < BenchmarkRes; y += BenchmarkTileRes) {
+        for (int x = 0; x < BenchmarkRes; x += BenchmarkTileRes) {
+            regions.emplace_back(rect_t{x, y, BenchmarkTileRes, BenchmarkTileRes});
+        }
+    }
+
+    RenderTiles(*renderer, *scene, regions, BenchmarkWarmupIterations, parallel_for);
+    renderer->ResetStats();
+
+    const auto t1 = std::chrono::high_resolution_clock::now();
+    RenderTiles(*renderer, *scene, regions, BenchmarkIterations, parallel_for);
+    const double elapsed_s = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - t1).count();
+
+    RendererBase::stats_t st;
+    renderer->GetStats(st);
+
+    return elapsed_s > 0.0 ? double(st.primary_rays_count) / elapsed_s : 0.0;
+}
+} // namespace
+} // namespace Ray
+
+int Ray::CalibrateCPURenderers(ILog *log, const Bitmask<eRendererType> enabled_types, const char *cache_path,
+                               cpu_benchmark_result_t out_results[], const int capacity,
+                               const std::function<void(int, int, ParallelForFunction &&)> &parallel_for) {
+    std::lock_guard<std::mutex> _(g_calibration_mtx);
+
+    if (cache_path) {
+        LoadCachedResults(cache_path, g_measured_rays_per_second);
+    }
+
+    bool cache_dirty = false;
+    std::vector<cpu_benchmark_result_t> results;
+    for (const eRendererType rt : CalibrationCandidates) {
+        if (!(enabled_types & rt) || !IsSupportedByCpu(rt)) {
+            continue;
+        }
+
+        auto it = g_measured_rays_per_second.find(rt);
+        if (it == end(g_measured_rays_per_second)) {
+            const double rays_per_second = BenchmarkRenderer(rt, parallel_for);
+            if (rays_per_second <= 0.0) {
+                // backend was not compiled in
+                continue;
+            }
+            it = g_measured_rays_per_second.emplace(rt, rays_per_second).first;
+            cache_dirty = true;
+        }
+
+        log->Info("Ray: %-6s backend traces %.2f Mrays/sec on %s", RendererTypeName(rt), it->second * 1e-6,
+                  GetCpuModelName());
+        results.push_back({rt, it->second});
+    }
+
+    if (cache_dirty && cache_path && !SaveCachedResults(cache_path, g_measured_rays_per_second)) {
+        log->Warning("Ray: Failed to write calibration cache %s", cache_path);
+    }
+
+    std::stable_sort(begin(results), end(results),
+                     [](const cpu_benchmark_result_t &lhs, const cpu_benchmark_result_t &rhs) {
+                         return lhs.rays_per_second > rhs.rays_per_second;
+                     });
+
+    const int count = std::min(capacity, int(results.size()));
+    std::copy(begin(results), begin(results) + count, out_results);
+    return count;
+}
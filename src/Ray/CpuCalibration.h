@@ -0,0 +1,34 @@
+#pragma once
+
+#include "RendererBase.h"
+
+/**
+  @file CpuCalibration.h
+*/
+
+namespace Ray {
+class ILog;
+
+/// Measured performance of CPU backend
+struct cpu_benchmark_result_t {
+    eRendererType type = eRendererType::Reference;
+    double rays_per_second = 0.0; ///< Primary rays traced per second on built-in scene (all threads of parallel_for)
+};
+
+/** @brief Benchmarks CPU backends by rendering built-in scene with each of them
+    Scene is rendered in tiles distributed with parallel_for, threaded one should be passed so that wide vector
+    instructions are measured under the same load (and clock speed) as in real use. Results are cached per CPU model
+    and its supported extensions in memory and (optionally) on disk, so each host type is measured only once.
+    The fastest backend may differ between hosts (e.g. because of frequency throttling of wide vector instructions)
+    @param log output log
+    @param enabled_types backends to consider (GPU backends and ones not supported by current CPU are skipped)
+    @param cache_path text file with cached results, can be shared between hosts (nullptr to keep results in memory)
+    @param out_results output results, sorted from the fastest backend to the slowest one
+    @param capacity capacity of previous parameter array
+    @param parallel_for function used to render benchmark tiles in parallel
+    @return number of results written into out_results
+*/
+int CalibrateCPURenderers(
+    ILog *log, Bitmask<eRendererType> enabled_types, const char *cache_path, cpu_benchmark_result_t out_results[],
+    int capacity, const std::function<void(int, int, ParallelForFunction &&)> &parallel_for = parallel_for_serial);
+} // namespace Ray
@@ -0,0 +1,176 @@
+#include "FrameBudget.h"
+
+#include <algorithm>
+#include <chrono>
+
+namespace Ray {
+namespace {
+int pending_pixels(const RegionContext &region) {
+    if (region.iteration == 0 || region.active_pixels < 0) {
+        // accumulation has just started (active pixels may be left from previous one)
+        return region.rect().w * region.rect().h;
+    }
+    return region.active_pixels;
+}
+
+bool needs_samples(const RegionContext &region, const int max_samples) {
+    return (max_samples <= 0 || region.iteration < max_samples) && pending_pixels(region) != 0;
+}
+} // namespace
+} // namespace Ray
+
+void Ray::FrameBudgetController::Reset() {
+    stats_ = {};
+    costs_.clear();
+    parallelism_ = 1.0;
+}
+
+bool Ray::FrameBudgetController::RenderFrame(
+    RendererBase &renderer, const SceneBase &scene, Span<RegionContext *const> regions,
+    const std::function<void(int, int, ParallelForFunction &&)> &parallel_for) {
+    using namespace std::chrono;
+
+    if (costs_.size() != size_t(regions.size())) {
+        Reset();
+        costs_.resize(regions.size());
+    }
+
+    double mean_us_per_pixel = 0.0;
+    int measured_count = 0;
+    for (const region_cost_t &cost : costs_) {
+        if (cost.us_per_pixel >= 0.0) {
+            mean_us_per_pixel += cost.us_per_pixel;
+            ++measured_count;
+        }
+    }
+    if (measured_count) {
+        mean_us_per_pixel /= measured_count;
+    }
+
+    planned_regions_.clear();
+    planned_samples_.assign(regions.size(), 0);
+
+    std::vector<int> candidates;
+    for (int i = 0; i < int(regions.size()); ++i) {
+        if (needs_samples(*regions[i], desc_.max_samples)) {
+            candidates.push_back(i);
+        }
+    }
+    // regions that lag behind go first, the ones with more work left win ties
+    std::stable_sort(begin(candidates), end(candidates), [&regions](const int lhs, const int rhs) {
+        if (regions[lhs]->iteration != regions[rhs]->iteration) {
+            return regions[lhs]->iteration < regions[rhs]->iteration;
+        }
+        return pending_pixels(*regions[lhs]) > pending_pixels(*regions[rhs]);
+    });
+
+    const double budget_us = 1000.0 * double(desc_.budget_ms);
+    // measurements are noisy, some headroom is left to avoid overrunning every other frame
+    const double planned_budget_us = 0.9 * budget_us;
+    // summed time of all regions that is expected to fit into frame when they are spread over workers
+    const double total_budget_us = planned_budget_us * parallelism_;
+
+    double planned_us = 0.0;
+    bool fits = true;
+    for (int pass = 0; pass < std::max(desc_.max_frame_samples, 1) && fits; ++pass) {
+        for (const int i : candidates) {
+            const RegionContext &region = *regions[i];
+            if (desc_.max_samples > 0 && region.iteration + pass >= desc_.max_samples) {
+                continue;
+            }
+            if (!measured_count) {
+                // nothing is known yet, every region gets single sample to measure its cost
+                planned_samples_[i] = 1;
+                fits = false;
+                continue;
+            }
+
+            const double us_per_pixel = costs_[i].us_per_pixel >= 0.0 ? costs_[i].us_per_pixel : mean_us_per_pixel;
+            const double region_us = us_per_pixel * pending_pixels(region);
+            // samples of single region are rendered sequentially, they can not be spread over workers
+            const bool region_fits = double(planned_samples_[i] + 1) * region_us <= planned_budget_us;
+            if ((planned_us + region_us > total_budget_us || !region_fits) && planned_us > 0.0) {
+                // lower priority regions do not jump ahead
+                fits = false;
+                break;
+            }
+
+            ++planned_samples_[i];
+            planned_us += std::max(region_us, 1e-3);
+        }
+    }
+
+    for (const int i : candidates) {
+        if (planned_samples_[i]) {
+            planned_regions_.push_back(i);
+        }
+    }
+
+    const auto render_region = [&](const int j) {
+        const int i = planned_regions_[j];
+        RegionContext &region = *regions[i];
+        region_cost_t &cost = costs_[i];
+
+        cost.last_us = 0.0;
+        cost.last_pixel_samples = 0;
+        cost.last_samples = 0;
+        for (int k = 0; k < planned_samples_[i] && needs_samples(region, desc_.max_samples); ++k) {
+            const int pixels = pending_pixels(region);
+
+            const auto time_start = high_resolution_clock::now();
+            renderer.RenderScene(scene, region);
+            const double region_us = duration<double, std::micro>(high_resolution_clock::now() - time_start).count();
+
+            cost.last_us += region_us;
+            cost.last_pixel_samples += pixels;
+            ++cost.last_samples;
+
+            const double us_per_pixel = region_us / std::max(pixels, 1);
+            if (cost.us_per_pixel < 0.0) {
+                cost.us_per_pixel = us_per_pixel;
+            } else {
+                cost.us_per_pixel = 0.75 * cost.us_per_pixel + 0.25 * us_per_pixel;
+            }
+        }
+    };
+
+    const auto frame_start = high_resolution_clock::now();
+    if (RendererSupportsMultithreading(renderer.type())) {
+        parallel_for(0, int(planned_regions_.size()), render_region);
+    } else {
+        parallel_for_serial(0, int(planned_regions_.size()), render_region);
+    }
+    const double frame_us = duration<double, std::micro>(high_resolution_clock::now() - frame_start).count();
+
+    stats_.frame_ms = float(0.001 * frame_us);
+    stats_.predicted_ms = measured_count ? float(0.001 * planned_us / parallelism_) : 0.0f;
+    stats_.regions_rendered = stats_.region_samples = 0;
+    stats_.regions_skipped = int(regions.size() - candidates.size());
+    stats_.regions_deferred = int(candidates.size() - planned_regions_.size());
+    stats_.pixel_samples = 0;
+
+    double summed_us = 0.0;
+    for (const int i : planned_regions_) {
+        const region_cost_t &cost = costs_[i];
+        summed_us += cost.last_us;
+        stats_.regions_rendered += (cost.last_samples != 0) ? 1 : 0;
+        stats_.region_samples += cost.last_samples;
+        stats_.pixel_samples += cost.last_pixel_samples;
+    }
+    stats_.samples_per_second = frame_us > 0.0 ? 1e6 * double(stats_.pixel_samples) / frame_us : 0.0;
+
+    ++stats_.frames_count;
+    if (frame_us > budget_us) {
+        ++stats_.overruns_count;
+    }
+
+    if (frame_us > 0.0 && summed_us > 0.0) {
+        const double measured = std::max(summed_us / frame_us, 1.0);
+        // too few regions can not occupy all workers, this is not a reason to expect less parallelism
+        if (measured > parallelism_ || double(planned_regions_.size()) > parallelism_) {
+            parallelism_ = 0.5 * (parallelism_ + measured);
+        }
+    }
+
+    return !planned_regions_.empty();
+}
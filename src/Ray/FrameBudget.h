@@ -0,0 +1,77 @@
+#pragma once
+
+#include <vector>
+
+#include "RendererBase.h"
+#include "SceneBase.h"
+#include "Span.h"
+
+/**
+  @file FrameBudget.h
+*/
+
+namespace Ray {
+/// Interactive rendering parameters
+struct frame_budget_desc_t {
+    float budget_ms = 16.0f;   ///< Wall time that single frame is allowed to take
+    int max_samples = 0;       ///< Samples per pixel after which region is not rendered anymore (zero - no limit)
+    int max_frame_samples = 4; ///< Maximum number of samples added to single region during one frame
+};
+
+/// Statistics of rendered frames
+struct frame_budget_stats_t {
+    float frame_ms = 0.0f;                ///< Wall time of last frame
+    float predicted_ms = 0.0f;            ///< Expected time of last frame (zero if regions cost was not known)
+    int regions_rendered = 0;             ///< Number of regions that got at least one sample during last frame
+    int regions_skipped = 0;              ///< Number of regions that did not need samples (converged)
+    int regions_deferred = 0;             ///< Number of regions that needed samples, but did not fit into budget
+    int region_samples = 0;               ///< Number of RenderScene calls during last frame
+    unsigned long long pixel_samples = 0; ///< Number of pixel samples rendered during last frame
+    double samples_per_second = 0.0;      ///< Pixel samples per second achieved during last frame
+    int frames_count = 0;                 ///< Total number of rendered frames
+    int overruns_count = 0;               ///< Total number of frames that took longer than budget
+};
+
+/** Renders regions progressively, each call adds as many samples as fit into frame time budget.
+    Cost of each region is measured when it is rendered, regions that have converged (or reached sample limit) are
+    skipped, the ones with fewer samples are preferred. Accumulation is restarted by clearing renderer and regions as
+    usual, measured cost is kept.
+*/
+class FrameBudgetController {
+    frame_budget_desc_t desc_;
+    frame_budget_stats_t stats_;
+
+    struct region_cost_t {
+        double us_per_pixel = -1.0; ///< Time of one pixel sample (negative when not measured yet)
+        double last_us = 0.0;       ///< Time that region took during last frame
+        unsigned long long last_pixel_samples = 0;
+        int last_samples = 0;
+    };
+    std::vector<region_cost_t> costs_;
+    std::vector<int> planned_samples_, planned_regions_;
+    double parallelism_ = 1.0; ///< Ratio of summed region time to wall time (how many regions run concurrently)
+
+  public:
+    explicit FrameBudgetController(const frame_budget_desc_t &desc) : desc_(desc) {}
+
+    const frame_budget_desc_t &desc() const { return desc_; }
+    const frame_budget_stats_t &stats() const { return stats_; }
+
+    /// Changes frame time budget (measured costs are kept)
+    void set_budget_ms(const float budget_ms) { desc_.budget_ms = budget_ms; }
+
+    /// Drops measured costs and statistics (should be called when set of regions changes)
+    void Reset();
+
+    /** @brief Renders next frame
+        @param renderer renderer to use
+        @param scene scene to render
+        @param regions regions to render, must stay the same between calls (otherwise Reset must be called)
+        @param parallel_for function used to render regions in parallel (ignored for renderers that do not support
+               multithreading)
+        @return false when all regions have converged and nothing was rendered
+    */
+    bool RenderFrame(RendererBase &renderer, const SceneBase &scene, Span<RegionContext *const> regions,
+                     const std::function<void(int, int, ParallelForFunction &&)> &parallel_for = parallel_for_serial);
+};
+} // namespace Ray
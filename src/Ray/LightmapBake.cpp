@@ -0,0 +1,87 @@
+#include "LightmapBake.h"
+
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+#include "Log.h"
+
+bool Ray::BakeLightmapAtlas(RendererBase &renderer, SceneBase &scene, const lightmap_bake_desc_t &desc,
+                            const std::function<void(int, int, ParallelForFunction &&)> &parallel_for) {
+    ILog *log = renderer.log();
+    if (!RendererSupportsMultithreading(renderer.type())) {
+        log->Error("Lightmap baking is not supported by %s renderer", RendererTypeName(renderer.type()));
+        return false;
+    }
+
+    camera_desc_t cam_desc;
+    scene.GetCamera(scene.current_cam(), cam_desc);
+    if (cam_desc.type != eCamType::Geo || cam_desc.mi_index != 0xffffffff) {
+        log->Error("Lightmap baking requires geometry camera without mesh instance");
+        return false;
+    }
+
+    if (desc.max_samples <= 0 || !scene.SetLightmapAtlas(desc.items)) {
+        log->Error("Invalid lightmap atlas");
+        return false;
+    }
+
+    const std::pair<int, int> fb_size = renderer.size();
+    const int w = fb_size.first, h = fb_size.second;
+
+    // Texels covered by each row are approximated by rectangles of instances, rows without instances are skipped
+    std::vector<int> row_weight(h, 0), row_x_beg(h, w), row_x_end(h, 0);
+    for (const atlas_item_desc_t &item : desc.items) {
+        const int x_beg = std::max(item.rect.x, 0), x_end = std::min(item.rect.x + item.rect.w, w);
+        for (int y = std::max(item.rect.y, 0); y < std::min(item.rect.y + item.rect.h, h) && x_beg < x_end; ++y) {
+            row_weight[y] += x_end - x_beg;
+            row_x_beg[y] = std::min(row_x_beg[y], x_beg);
+            row_x_end[y] = std::max(row_x_end[y], x_end);
+        }
+    }
+
+    long long total_weight = 0;
+    for (const int weight : row_weight) {
+        total_weight += weight;
+    }
+
+    // Several strips per thread, so threads that finish early can pick up remaining work
+    int strips_count = desc.strips_count;
+    if (strips_count <= 0) {
+        strips_count = 4 * std::max(int(std::thread::hardware_concurrency()), 1);
+    }
+    const long long strip_weight = std::max((total_weight + strips_count - 1) / strips_count, 1ll);
+
+    std::vector<RegionContext> regions;
+    for (int y = 0; y < h;) {
+        if (row_weight[y] == 0) {
+            ++y;
+            continue;
+        }
+
+        const int y_beg = y;
+        int x_beg = w, x_end = 0;
+        long long weight = 0;
+        while (y < h && row_weight[y] != 0 && weight < strip_weight) {
+            weight += row_weight[y];
+            x_beg = std::min(x_beg, row_x_beg[y]);
+            x_end = std::max(x_end, row_x_end[y]);
+            ++y;
+        }
+
+        regions.emplace_back(rect_t{x_beg, y_beg, x_end - x_beg, y - y_beg});
+    }
+
+    log->Info("Lightmap bake: %i instances, %i strips", int(desc.items.size()), int(regions.size()));
+
+    renderer.Clear({});
+
+    parallel_for(0, int(regions.size()), [&](const int i) {
+        RegionContext &region = regions[i];
+        while (region.iteration < desc.max_samples && region.active_pixels != 0) {
+            renderer.RenderScene(scene, region);
+        }
+    });
+
+    return true;
+}
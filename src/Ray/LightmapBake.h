@@ -0,0 +1,30 @@
+#pragma once
+
+#include "RendererBase.h"
+#include "SceneBase.h"
+
+/**
+  @file LightmapBake.h
+*/
+
+namespace Ray {
+/// Lightmap atlas baking description
+struct lightmap_bake_desc_t {
+    Span<const atlas_item_desc_t> items; ///< Placement of mesh instances (renderer framebuffer is used as atlas)
+    int max_samples = 256;               ///< Samples per texel after which texel is finished regardless of its variance
+    int strips_count = 0;                ///< Number of independently rendered strips (0 - chosen automatically)
+};
+
+/** @brief Bakes lightmaps of multiple mesh instances into shared atlas in a single pass (CPU only)
+    Current camera of the scene must be geometry camera without mesh instance. Atlas is split into horizontal strips
+    with approximately equal amount of covered texels, strips are rendered independently until all their texels
+    converge (according to camera variance threshold) or reach maximum number of samples.
+    @param renderer renderer to use, its framebuffer receives the atlas
+    @param scene scene to render
+    @param desc baking description
+    @param parallel_for function used to render strips in parallel
+    @return true on success
+*/
+bool BakeLightmapAtlas(RendererBase &renderer, SceneBase &scene, const lightmap_bake_desc_t &desc,
+                       const std::function<void(int, int, ParallelForFunction &&)> &parallel_for = parallel_for_serial);
+} // namespace Ray
@@ -51,7 +51,8 @@ extern const std::pair<uint32_t, const char *> KnownGPUVendors[] = {
 extern const int KnownGPUVendorsCount = 4;
 } // namespace Ray
 
-Ray::RendererBase *Ray::CreateRenderer(const settings_t &s, ILog *log, const Bitmask<eRendererType> enabled_types) {
+Ray::RendererBase *Ray::CreateRenderer(const settings_t &s, ILog *log, const Bitmask<eRendererType> enabled_types,
+                                       const std::function<void(int, int, ParallelForFunction &&)> &parallel_for) {
 #if defined(ENABLE_VK_IMPL)
     if (enabled_types & eRendererType::Vulkan) {
         log->Info("Ray: Creating Vulkan renderer %ix%i", s.w, s.h);
@@ -72,6 +73,16 @@ Ray::RendererBase *Ray::CreateRenderer(const settings_t &s, ILog *log, const Bit
         }
     }
 #endif // defined(ENABLE_DX_IMPL) && defined(_WIN32)
+    if (s.use_cpu_calibration && (enabled_types & RendererCPU)) {
+        // AVX512 is left out of default set because of frequency throttling, measurement tells whether it pays off
+        cpu_benchmark_result_t fastest;
+        if (CalibrateCPURenderers(log, enabled_types | eRendererType::SIMD_AVX512, s.cpu_calibration_cache, &fastest,
+                                  1, parallel_for) == 1) {
+            settings_t calibrated_s = s;
+            calibrated_s.use_cpu_calibration = false;
+            return CreateRenderer(calibrated_s, log, fastest.type);
+        }
+    }
 #if !defined(__arm__) && !defined(__aarch64__) && !defined(_M_ARM) && !defined(_M_ARM64)
 #ifdef ENABLE_SIMD_IMPL
     const CpuFeatures features = GetCpuFeatures();
@@ -1,8 +1,12 @@
 #pragma once
 
 #include "Config.h"
+#include "CpuCalibration.h"
+#include "FrameBudget.h"
+#include "LightmapBake.h"
 #include "Log.h"
 #include "RendererBase.h"
+#include "TiledRender.h"
 
 /**
   @file Ray.h
@@ -20,10 +24,16 @@ const Bitmask<eRendererType> DefaultEnabledRenderTypes =
     eRendererType::SIMD_AVX2 | eRendererType::SIMD_NEON | eRendererType::Vulkan | eRendererType::DirectX12;
 
 /** @brief Creates renderer
+    @param s renderer settings
+    @param log output log
+    @param enabled_types backends to try, AVX512 is also considered when CPU calibration is enabled
+    @param parallel_for function used to benchmark CPU backends when CPU calibration is enabled
     @return pointer to created renderer
 */
-RendererBase *CreateRenderer(const settings_t &s, ILog *log = &g_null_log,
-                             Bitmask<eRendererType> enabled_types = DefaultEnabledRenderTypes);
+RendererBase *
+CreateRenderer(const settings_t &s, ILog *log = &g_null_log,
+               Bitmask<eRendererType> enabled_types = DefaultEnabledRenderTypes,
+               const std::function<void(int, int, ParallelForFunction &&)> &parallel_for = parallel_for_serial);
 
 /** @brief Queries available GPU devices
     @param log output log
@@ -30,7 +30,8 @@ enum class eRendererType : uint32_t {
 // All CPU renderers
 const Bitmask<eRendererType> RendererCPU = Bitmask<eRendererType>{eRendererType::Reference} | eRendererType::SIMD_SSE2 |
                                            eRendererType::SIMD_SSE41 | eRendererType::SIMD_NEON |
-                                           eRendererType::SIMD_AVX | eRendererType::SIMD_AVX2;
+                                           eRendererType::SIMD_AVX | eRendererType::SIMD_AVX2 |
+                                           eRendererType::SIMD_AVX512;
 // All GPU renderers
 const Bitmask<eRendererType> RendererGPU = Bitmask<eRendererType>{eRendererType::Vulkan} | eRendererType::DirectX12;
 
@@ -50,6 +51,38 @@ struct settings_t {
     bool use_hwrt = true;
     bool use_bindless = true;
     bool use_spatial_cache = false;
+    bool use_material_sort = false; ///< Repack secondary hits by material before shading (CPU only)
+    /// Count distinct materials of secondary ray packets for stats (extra pass over hits per bounce), it is also done
+    /// when material sorting is enabled (CPU only)
+    bool use_packet_stats = false;
+    /// Reorder secondary rays (by origin cell and direction) and shadow rays (by origin cell) before tracing (CPU only)
+    bool use_ray_sort = true;
+    /// Composition of secondary ray sorting key: bits per axis of origin grid cell (0-8) and bits per octahedral
+    /// coordinate of direction (0-8, limited so that key fits 32 bits) (CPU only)
+    int ray_sort_origin_bits = 8, ray_sort_dir_bits = 4;
+    /// Find primary hits of pinhole camera by rasterizing scene triangles instead of tracing camera rays, rays with
+    /// depth of field and other camera types are always traced (CPU only)
+    bool use_raster_primary = false;
+    /// Number of first samples per pixel, whose primary hits are kept between renders, accumulation restarted after
+    /// material or light change does not trace camera rays again (only view and scene geometry invalidate it, costs
+    /// 24 bytes per pixel per sample) (CPU only)
+    int primary_hit_cache_samples = 0;
+    /// Number of reduced resolution levels (each halves resolution per axis) rendered after accumulation restart,
+    /// coarsest level goes first, preview samples are upsampled guided by depth and normals (CPU only)
+    int preview_levels = 0;
+    /// Time budget of preview frame of single region in milliseconds, preview moves to finer level only if it is
+    /// expected to fit (zero means that every level gets one frame) (CPU only)
+    float preview_budget_ms = 0.0f;
+    /// Maximum number of samples per pixel carried over to the next accumulation when renderer is cleared (e.g. after
+    /// camera move), previous image is reprojected into new view using depth and normals, disoccluded pixels start
+    /// from scratch (zero disables, costs 54 bytes per pixel, unavailable with compact framebuffer) (CPU only)
+    int reprojection_max_samples = 0;
+    bool use_vtx_compression = false; ///< Store vertex normals and uvs in compact form (CPU only)
+    bool use_compact_framebuffer = false; ///< Keep minimal set of full-resolution buffers, for huge images (CPU only)
+    /// Benchmark supported CPU backends on creation and pick the fastest one (AVX512 backend is measured too, even if
+    /// it was not enabled)
+    bool use_cpu_calibration = false;
+    const char *cpu_calibration_cache = nullptr; ///< File where calibration results are kept per CPU model
     int validation_level = 0;
 };
 
@@ -64,12 +97,26 @@ class RegionContext {
     int iteration = 0; ///< Number of rendered samples per pixel
     int cache_iteration = 0;
 
+    /// Placement of region inside of output image which may be larger than renderer framebuffer (used for tiled
+    /// rendering with perspective camera, CPU only). Zero image size means that region is placed into framebuffer as
+    /// is
+    int image_offset[2] = {}, image_size[2] = {};
+    int active_pixels = -1; ///< Number of pixels that still require samples after last iteration (CPU only)
+    /// Resolution level of next preview frame, -1 before the first one, 0 when full resolution accumulation has
+    /// started (CPU only)
+    int preview_level = -1;
+    int preview_iteration = 0; ///< Number of preview samples rendered at current level (CPU only)
+
     explicit RegionContext(const rect_t &rect) : rect_(rect) {}
 
     const rect_t &rect() const { return rect_; }
 
     /// Clear region context (used to start again)
-    void Clear() { iteration = 0; }
+    void Clear() {
+        iteration = 0;
+        preview_level = -1;
+        preview_iteration = 0;
+    }
 };
 
 class ILog;
@@ -104,7 +151,8 @@ class RendererBase {
     /// Returns pointer to 'raw' untonemapped image
     virtual color_data_rgba_t get_raw_pixels_ref() const = 0;
 
-    /// Returns pointer to auxiliary image buffers
+    /// Returns pointer to auxiliary image buffers (null pointer and zero pitch if buffer is not allocated, e.g. with
+    /// compact framebuffer until denoising was requested)
     virtual color_data_rgba_t get_aux_pixels_ref(eAUXBuffer buf) const = 0;
 
     /// Returns pointer to SH data
@@ -176,6 +224,18 @@ class RendererBase {
         unsigned long long time_denoise_us;
         unsigned long long time_cache_update_us;
         unsigned long long time_cache_resolve_us;
+        unsigned long long time_shadow_sort_us; // shadow rays sorting of all bounces (not included into shadow times)
+        // primary rays utilization of SIMD lanes (CPU only)
+        unsigned long long primary_rays_count;        // number of pixels that required sample
+        unsigned long long primary_lanes_uncompacted; // lanes that would be occupied by full pixel blocks
+        unsigned long long primary_lanes_compacted;   // lanes that were occupied after packing of active pixels
+        // material coherence of secondary ray packets (CPU only), last element accumulates all deeper bounces,
+        // materials are only counted when packet stats or material sorting are enabled
+        unsigned long long secondary_packets_count[4];
+        unsigned long long secondary_packet_materials[4]; // sum of distinct materials over all packets
+        // ray sorting cost and traversal time of secondary rays per bounce (CPU only), same layout as above
+        unsigned long long secondary_bounce_sort_us[4];
+        unsigned long long secondary_bounce_trace_us[4];
     };
     virtual void GetStats(stats_t &st) = 0;
     virtual void ResetStats() = 0;
@@ -4,6 +4,7 @@
 #include <cstdint>
 
 #include <functional>
+#include <vector>
 
 #include "Span.h"
 #include "Types.h"
@@ -289,7 +290,7 @@ struct camera_desc_t {
     int lens_blades = 0;                 ///< Bokeh shape
     float clip_start = 0;                ///< Clip start
     float clip_end = 3.402823466e+30F;   ///< Clip end
-    uint32_t mi_index = 0xffffffff,      ///< Index of mesh instance
+    uint32_t mi_index = 0xffffffff,      ///< Index of mesh instance (geometry cam renders lightmap atlas if not set)
         uv_index = 0;                    ///< UV layer used by geometry cam
     bool lighting_only = false;          ///< Render lightmap only
     bool skip_direct_lighting = false;   ///< Render indirect light contribution only
@@ -353,6 +354,12 @@ struct environment_desc_t {
     atmosphere_params_t atmosphere;                ///< Atmosphere parameters
 };
 
+/// Placement of mesh instance inside of lightmap atlas
+struct atlas_item_desc_t {
+    MeshInstanceHandle mi; ///< Mesh instance
+    rect_t rect;           ///< Atlas texels which UV range [0, 1] of mesh instance is mapped to
+};
+
 class ILog;
 
 using ParallelForFunction = std::function<void(int)>;
@@ -455,12 +462,40 @@ class SceneBase {
     */
     virtual MeshInstanceHandle AddMeshInstance(const mesh_instance_desc_t &mi) = 0;
 
+    /** @brief Adds multiple mesh instances to a scene
+        @param mis array of mesh instance descriptions
+        @param out_handles array of new mesh instance handles (same size as mis)
+        @param parallel_for function used to process instances in parallel
+
+        Acceleration structure is rebuilt during Finalize call.
+    */
+    virtual void AddMeshInstances(Span<const mesh_instance_desc_t> mis, Span<MeshInstanceHandle> out_handles,
+                                  const std::function<void(int, int, ParallelForFunction &&)> &parallel_for =
+                                      parallel_for_serial) {
+        for (ptrdiff_t i = 0; i < mis.size(); ++i) {
+            out_handles[i] = AddMeshInstance(mis[i]);
+        }
+    }
+
     /** @brief Sets mesh instance transformation
         @param mi mesh instance handle
         @param xform array of 16 floats holding transformation matrix
     */
     virtual void SetMeshInstanceTransform(MeshInstanceHandle mi, const float *xform) = 0;
 
+    /** @brief Sets transformation of multiple mesh instances
+        @param mis array of mesh instance handles (must not contain duplicates, instances are updated in parallel)
+        @param xforms array of transformation matrices (16 floats per instance)
+        @param parallel_for function used to process instances in parallel
+    */
+    virtual void SetMeshInstanceTransforms(Span<const MeshInstanceHandle> mis, const float *xforms,
+                                           const std::function<void(int, int, ParallelForFunction &&)>
+                                               &parallel_for = parallel_for_serial) {
+        for (ptrdiff_t i = 0; i < mis.size(); ++i) {
+            SetMeshInstanceTransform(mis[i], &xforms[16 * i]);
+        }
+    }
+
     /** @brief Removes mesh instance from scene
         @param mi mesh instance handle
 
@@ -506,6 +541,31 @@ class SceneBase {
     */
     virtual void set_current_cam(CameraHandle i) = 0;
 
+    /** @brief Writes finalized scene into flat binary blob
+        @param out_data output blob
+        @return false if backend does not support compiled scenes
+
+        Blob contains everything that is produced by scene preprocessing (acceleration structures, light tree,
+        environment importance map, compressed textures), so it can be loaded back with almost no parsing.
+        Blob is only compatible with the same library version and scene settings (wide BVH, texture compression).
+    */
+    virtual bool SaveCompiled(std::vector<uint8_t> &out_data) const { return false; }
+
+    /** @brief Populates empty scene from blob written by SaveCompiled
+        @param data blob data (can point to memory-mapped file, expected to be 16-byte aligned)
+        @return true on success
+
+        Scene is ready for rendering after successful load, there is no need to call Finalize.
+        Scene is left in undefined state on failure and should be discarded.
+    */
+    virtual bool LoadCompiled(Span<const uint8_t> data) { return false; }
+
+    /** @brief Sets lightmap atlas layout which is rendered by geometry camera without mesh instance
+        @param items placement of mesh instances (rectangles are expected to not overlap)
+        @return false if backend does not support atlas rendering
+    */
+    virtual bool SetLightmapAtlas(Span<const atlas_item_desc_t> items) { return false; }
+
     /// Overall triangle count in scene
     virtual uint32_t triangle_count() const = 0;
 
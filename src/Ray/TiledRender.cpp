@@ -0,0 +1,227 @@
+#include "TiledRender.h"
+
+#include <cstring>
+
+#include <algorithm>
+#include <fstream>
+#include <vector>
+
+#include "Log.h"
+
+namespace Ray {
+namespace {
+// File layout: header, one 'finished' byte per tile, tiles data (each tile is padded to full size to have fixed offset)
+const char TiledImageMagic[4] = {'R', 'T', 'I', 'L'};
+const uint32_t TiledImageVersion = 1;
+
+struct tiled_image_header_t {
+    char magic[4];
+    uint32_t version;
+    uint32_t w, h, tile_size, tiles_count;
+};
+static_assert(sizeof(tiled_image_header_t) == 24, "!");
+
+std::streamoff tile_data_offset(const tiled_image_header_t &header, const int tile) {
+    const std::streamoff tile_bytes = std::streamoff(header.tile_size) * header.tile_size * sizeof(color_rgba_t);
+    return std::streamoff(sizeof(tiled_image_header_t)) + header.tiles_count + tile * tile_bytes;
+}
+
+bool read_header(std::istream &in, tiled_image_header_t &out_header) {
+    in.read((char *)&out_header, sizeof(tiled_image_header_t));
+    if (!in.good() || memcmp(out_header.magic, TiledImageMagic, 4) != 0 || out_header.version != TiledImageVersion ||
+        out_header.tile_size == 0) {
+        return false;
+    }
+    const uint32_t tiles_x = (out_header.w + out_header.tile_size - 1) / out_header.tile_size,
+                   tiles_y = (out_header.h + out_header.tile_size - 1) / out_header.tile_size;
+    return out_header.tiles_count == tiles_x * tiles_y;
+}
+} // namespace
+} // namespace Ray
+
+bool Ray::RenderTiled(RendererBase &renderer, const SceneBase &scene, const tiled_render_desc_t &desc,
+                      const std::function<void(int, int, ParallelForFunction &&)> &parallel_for) {
+    ILog *log = renderer.log();
+    if (!RendererSupportsMultithreading(renderer.type())) {
+        log->Error("Tiled rendering is not supported by %s renderer", RendererTypeName(renderer.type()));
+        return false;
+    }
+
+    camera_desc_t cam_desc;
+    scene.GetCamera(scene.current_cam(), cam_desc);
+    if (cam_desc.type != eCamType::Persp) {
+        log->Error("Tiled rendering is only supported with perspective camera");
+        return false;
+    }
+
+    const std::pair<int, int> fb_size = renderer.size();
+    const int slots_x = fb_size.first / desc.tile_size, slots_y = fb_size.second / desc.tile_size;
+    if (desc.w <= 0 || desc.h <= 0 || desc.tile_size <= 0 || slots_x == 0 || slots_y == 0) {
+        log->Error("Invalid tiled rendering parameters (image %ix%i, tile %i, framebuffer %ix%i)", desc.w, desc.h,
+                   desc.tile_size, fb_size.first, fb_size.second);
+        return false;
+    }
+
+    const int tiles_x = (desc.w + desc.tile_size - 1) / desc.tile_size,
+              tiles_y = (desc.h + desc.tile_size - 1) / desc.tile_size;
+
+    tiled_image_header_t header = {};
+    memcpy(header.magic, TiledImageMagic, 4);
+    header.version = TiledImageVersion;
+    header.w = uint32_t(desc.w);
+    header.h = uint32_t(desc.h);
+    header.tile_size = uint32_t(desc.tile_size);
+    header.tiles_count = uint32_t(tiles_x * tiles_y);
+
+    std::vector<uint8_t> finished(header.tiles_count, 0);
+
+    std::fstream file(desc.file_path, std::ios::in | std::ios::out | std::ios::binary);
+    { // try to resume
+        tiled_image_header_t existing = {};
+        if (file.is_open() && read_header(file, existing) && memcmp(&existing, &header, sizeof(header)) == 0) {
+            file.read((char *)finished.data(), finished.size());
+        } else {
+            file.close();
+        }
+    }
+
+    if (!file.is_open() || !file.good()) {
+        std::fill(begin(finished), end(finished), 0);
+
+        file.clear();
+        file.open(desc.file_path, std::ios::in | std::ios::out | std::ios::binary | std::ios::trunc);
+        if (!file.is_open()) {
+            log->Error("Failed to open %s", desc.file_path);
+            return false;
+        }
+        file.write((const char *)&header, sizeof(header));
+        file.write((const char *)finished.data(), finished.size());
+        // reserve space for all tiles (unfinished ones are read as zeroes)
+        file.seekp(tile_data_offset(header, int(header.tiles_count)) - 1);
+        file.put(0);
+        file.flush();
+    }
+
+    std::vector<int> pending_tiles;
+    for (int i = 0; i < int(header.tiles_count); ++i) {
+        if (!finished[i]) {
+            pending_tiles.push_back(i);
+        }
+    }
+    log->Info("Tiled render: %i of %i tiles left", int(pending_tiles.size()), int(header.tiles_count));
+
+    const int slots_count = slots_x * slots_y;
+    std::vector<RegionContext> regions;
+    std::vector<color_rgba_t> tile_data(desc.tile_size * desc.tile_size);
+
+    for (int batch_start = 0; batch_start < int(pending_tiles.size()); batch_start += slots_count) {
+        const int batch_size = std::min(slots_count, int(pending_tiles.size()) - batch_start);
+
+        // accumulation state of previous batch is discarded
+        renderer.Clear({});
+
+        regions.clear();
+        for (int i = 0; i < batch_size; ++i) {
+            const int tile = pending_tiles[batch_start + i];
+            const int tile_x = (tile % tiles_x) * desc.tile_size, tile_y = (tile / tiles_x) * desc.tile_size;
+            const int slot_x = (i % slots_x) * desc.tile_size, slot_y = (i / slots_x) * desc.tile_size;
+
+            regions.emplace_back(rect_t{slot_x, slot_y, std::min(desc.tile_size, desc.w - tile_x),
+                                        std::min(desc.tile_size, desc.h - tile_y)});
+            RegionContext &region = regions.back();
+            region.image_offset[0] = tile_x;
+            region.image_offset[1] = tile_y;
+            region.image_size[0] = desc.w;
+            region.image_size[1] = desc.h;
+        }
+
+        parallel_for(0, batch_size, [&](const int i) {
+            RegionContext &region = regions[i];
+            while (region.iteration < desc.max_samples && region.active_pixels != 0) {
+                renderer.RenderScene(scene, region);
+            }
+        });
+
+        const color_data_rgba_t pixels = renderer.get_raw_pixels_ref();
+        for (int i = 0; i < batch_size; ++i) {
+            const int tile = pending_tiles[batch_start + i];
+            const rect_t &r = regions[i].rect();
+
+            std::fill(begin(tile_data), end(tile_data), color_rgba_t{});
+            for (int y = 0; y < r.h; ++y) {
+                memcpy(&tile_data[y * desc.tile_size], &pixels.ptr[(r.y + y) * pixels.pitch + r.x],
+                       r.w * sizeof(color_rgba_t));
+            }
+
+            // data goes first, so interrupted write leaves tile unfinished
+            file.seekp(tile_data_offset(header, tile));
+            file.write((const char *)tile_data.data(), tile_data.size() * sizeof(color_rgba_t));
+            file.flush();
+
+            finished[tile] = 1;
+            file.seekp(std::streamoff(sizeof(tiled_image_header_t)) + tile);
+            file.put(char(1));
+            file.flush();
+        }
+
+        if (!file.good()) {
+            log->Error("Failed to write %s", desc.file_path);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool Ray::ReadTiledImageInfo(const char *file_path, tiled_image_info_t &out_info) {
+    std::ifstream file(file_path, std::ios::binary);
+    tiled_image_header_t header = {};
+    if (!file.is_open() || !read_header(file, header)) {
+        return false;
+    }
+
+    std::vector<uint8_t> finished(header.tiles_count);
+    file.read((char *)finished.data(), finished.size());
+    if (!file.good()) {
+        return false;
+    }
+
+    out_info.w = int(header.w);
+    out_info.h = int(header.h);
+    out_info.tile_size = int(header.tile_size);
+    out_info.tiles_total = int(header.tiles_count);
+    out_info.tiles_finished = int(std::count(begin(finished), end(finished), 1));
+
+    return true;
+}
+
+bool Ray::ReadTiledImageRegion(const char *file_path, const rect_t &r, color_rgba_t out_pixels[]) {
+    std::ifstream file(file_path, std::ios::binary);
+    tiled_image_header_t header = {};
+    if (!file.is_open() || !read_header(file, header)) {
+        return false;
+    }
+    if (r.x < 0 || r.y < 0 || r.x + r.w > int(header.w) || r.y + r.h > int(header.h)) {
+        return false;
+    }
+
+    const int tile_size = int(header.tile_size), tiles_x = (int(header.w) + tile_size - 1) / tile_size;
+    for (int y = r.y; y < r.y + r.h; ++y) {
+        for (int x = r.x; x < r.x + r.w;) {
+            // read contiguous part of the row that belongs to a single tile
+            const int tile = (y / tile_size) * tiles_x + (x / tile_size);
+            const int count = std::min(tile_size - (x % tile_size), r.x + r.w - x);
+
+            file.seekg(tile_data_offset(header, tile) +
+                       std::streamoff((y % tile_size) * tile_size + (x % tile_size)) * sizeof(color_rgba_t));
+            file.read((char *)&out_pixels[(y - r.y) * r.w + (x - r.x)], count * sizeof(color_rgba_t));
+            if (!file.good()) {
+                return false;
+            }
+
+            x += count;
+        }
+    }
+
+    return true;
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include "RendererBase.h"
+#include "SceneBase.h"
+
+/**
+  @file TiledRender.h
+*/
+
+namespace Ray {
+/// Out-of-core rendering description
+struct tiled_render_desc_t {
+    int w = 0, h = 0;                ///< Output image resolution (not limited by renderer framebuffer size)
+    int tile_size = 256;             ///< Tile resolution, renderer framebuffer is split into slots of this size
+    int max_samples = 256;           ///< Samples per pixel after which tile is written regardless of its variance
+    const char *file_path = nullptr; ///< Output file, partially finished render is resumed from it
+};
+
+/// Tiled image file properties
+struct tiled_image_info_t {
+    int w = 0, h = 0;
+    int tile_size = 0;
+    int tiles_total = 0, tiles_finished = 0;
+};
+
+/** @brief Renders image which is potentially much larger than renderer framebuffer (CPU only)
+    Framebuffer holds only tiles that are currently rendered, tiles are written to the file as soon as they converge
+    (or reach maximum number of samples). Already finished tiles of existing file are skipped.
+    @param renderer renderer to use, its framebuffer must fit at least one tile
+    @param scene scene to render (current camera must be perspective one)
+    @param desc rendering description
+    @param parallel_for function used to render tiles that are in flight in parallel
+    @return true on success
+*/
+bool RenderTiled(RendererBase &renderer, const SceneBase &scene, const tiled_render_desc_t &desc,
+                 const std::function<void(int, int, ParallelForFunction &&)> &parallel_for = parallel_for_serial);
+
+/** @brief Reads properties of tiled image file
+    @param file_path path to file
+    @param out_info output properties
+    @return true on success
+*/
+bool ReadTiledImageInfo(const char *file_path, tiled_image_info_t &out_info);
+
+/** @brief Reads rectangle of tiled image file (unfinished tiles are read as zeroes)
+    @param file_path path to file
+    @param r rectangle to read
+    @param out_pixels output pixels (r.w * r.h)
+    @return true on success
+*/
+bool ReadTiledImageRegion(const char *file_path, const rect_t &r, color_rgba_t out_pixels[]);
+} // namespace Ray
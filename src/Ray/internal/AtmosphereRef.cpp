@@ -889,6 +889,26 @@ Ray::Ref::fvec4 Ray::Ref::IntegrateScattering(const atmosphere_params_t &params,
     return total_radiance;
 }
 
+void Ray::Ref::IntegrateSkyRow(const atmosphere_params_t &params, Span<const float> transmittance_lut,
+                               Span<const float> multiscatter_lut, const float light_dir[3], const float light_angle,
+                               const float light_col[3], const int y, const float cos_theta, const float sin_theta,
+                               Span<const float> cos_phi, Span<const float> sin_phi, float inout_color[]) {
+    const fvec4 ray_start = {0.0f, params.viewpoint_height, 0.0f, 0.0f};
+    const fvec4 _light_dir = {light_dir[0], light_dir[1], light_dir[2], 0.0f},
+                _light_col = {light_col[0], light_col[1], light_col[2], 0.0f};
+
+    for (int x = 0; x < int(cos_phi.size()); ++x) {
+        const uint32_t px_hash = hash((x << 16) | y);
+        const fvec4 ray_dir = {sin_theta * cos_phi[x], cos_theta, sin_theta * sin_phi[x], 0.0f};
+
+        const fvec4 color = IntegrateScattering(params, ray_start, ray_dir, MAX_DIST, _light_dir, light_angle,
+                                                _light_col, transmittance_lut, multiscatter_lut, px_hash);
+        inout_color[3 * x + 0] += color.get<0>();
+        inout_color[3 * x + 1] += color.get<1>();
+        inout_color[3 * x + 2] += color.get<2>();
+    }
+}
+
 void Ray::Ref::UvToLutTransmittanceParams(const atmosphere_params_t &params, const fvec2 uv, float &view_height,
                                           float &view_zenith_cos_angle) {
     const float top_radius = params.planet_radius + params.atmosphere_height;
@@ -19,6 +19,15 @@ fvec4 IntegrateScattering(const atmosphere_params_t &params, fvec4 ray_start, co
                           const fvec4 &light_dir, float light_angle, const fvec4 &light_color,
                           Span<const float> transmittance_lut, Span<const float> multiscatter_lut, uint32_t rand_hash);
 
+// Accumulates radiance of one latlong row of sky texture lit by a single light (row is given by per-column angles)
+void IntegrateSkyRow(const atmosphere_params_t &params, Span<const float> transmittance_lut,
+                     Span<const float> multiscatter_lut, const float light_dir[3], float light_angle,
+                     const float light_col[3], int y, float cos_theta, float sin_theta, Span<const float> cos_phi,
+                     Span<const float> sin_phi, float inout_color[]);
+
+// Value noise used for stars (exposed to let SIMD backends reproduce the same star field)
+float stars_noise(const fvec4 &p);
+
 // Transmittance LUT function parameterisation from Bruneton 2017
 // https://github.com/ebruneton/precomputed_atmospheric_scattering
 void UvToLutTransmittanceParams(const atmosphere_params_t &params, fvec2 uv, float &view_height,
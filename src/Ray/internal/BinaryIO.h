@@ -0,0 +1,111 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+#include <type_traits>
+#include <vector>
+
+#include "../Span.h"
+
+namespace Ray {
+// Minimal helpers for flat binary blobs. Arrays are padded to 16 bytes, so data can be used directly
+// when the blob is memory-mapped (no per-element parsing is required)
+class BinaryWriter {
+    std::vector<uint8_t> &out_;
+
+  public:
+    static const size_t ArrayAlignment = 16;
+
+    explicit BinaryWriter(std::vector<uint8_t> &out) : out_(out) {}
+
+    size_t pos() const { return out_.size(); }
+
+    void Write(const void *data, const size_t size) {
+        const size_t pos = out_.size();
+        out_.resize(pos + size);
+        if (size) {
+            memcpy(&out_[pos], data, size);
+        }
+    }
+
+    template <typename T> void Write(const T &val) {
+        static_assert(std::is_trivially_copyable<T>::value, "!");
+        Write(&val, sizeof(T));
+    }
+
+    void Align() { out_.resize(ArrayAlignment * ((out_.size() + ArrayAlignment - 1) / ArrayAlignment), 0); }
+
+    template <typename T> void WriteArray(const T *data, const uint32_t count) {
+        static_assert(std::is_trivially_copyable<T>::value, "!");
+        Write(count);
+        Align();
+        Write(data, count * sizeof(T));
+    }
+    template <typename T> void WriteArray(Span<const T> data) { WriteArray(data.data(), uint32_t(data.size())); }
+};
+
+class BinaryReader {
+    Span<const uint8_t> data_;
+    size_t pos_ = 0;
+    bool failed_ = false;
+
+  public:
+    explicit BinaryReader(Span<const uint8_t> data) : data_(data) {}
+
+    bool failed() const { return failed_; }
+    bool at_end() const { return pos_ == size_t(data_.size()); }
+
+    // Used by readers of nested structures to report inconsistent data, all following reads fail too
+    void SetFailed() { failed_ = true; }
+
+    // Returns pointer to the next 'size' bytes and advances, nullptr if there is not enough data
+    const uint8_t *Skip(const size_t size) {
+        if (failed_ || pos_ + size > size_t(data_.size())) {
+            failed_ = true;
+            return nullptr;
+        }
+        const uint8_t *ret = data_.data() + pos_;
+        pos_ += size;
+        return ret;
+    }
+
+    bool Read(void *out_data, const size_t size) {
+        const uint8_t *src = Skip(size);
+        if (src && size) {
+            memcpy(out_data, src, size);
+        }
+        return src != nullptr;
+    }
+
+    template <typename T> bool Read(T &out_val) {
+        static_assert(std::is_trivially_copyable<T>::value, "!");
+        return Read(&out_val, sizeof(T));
+    }
+
+    void Align() {
+        const size_t aligned =
+            BinaryWriter::ArrayAlignment * ((pos_ + BinaryWriter::ArrayAlignment - 1) / BinaryWriter::ArrayAlignment);
+        Skip(aligned - pos_);
+    }
+
+    // Returns array stored in-place (no copy is made)
+    template <typename T> Span<const T> ReadArray() {
+        static_assert(std::is_trivially_copyable<T>::value, "!");
+        uint32_t count = 0;
+        Read(count);
+        Align();
+        const uint8_t *data = Skip(count * sizeof(T));
+        if (!data) {
+            return {};
+        }
+        return Span<const T>(reinterpret_cast<const T *>(data), count);
+    }
+
+    template <typename T, typename Alloc> bool ReadArray(std::vector<T, Alloc> &out_vec) {
+        const Span<const T> arr = ReadArray<T>();
+        out_vec.assign(arr.begin(), arr.end());
+        return !failed_;
+    }
+};
+} // namespace Ray
@@ -79,8 +79,9 @@ const int SPECULAR_TEXTURE = 4;
 const int MIX_MAT1 = 3;
 const int MIX_MAT2 = 4;
 
-const int MATERIAL_SOLID_BIT = 32768;  // 0b1000000000000000
-const int MATERIAL_INDEX_BITS = 16383; // 0b0011111111111111
+const int MATERIAL_SOLID_BIT = 32768;       // 0b1000000000000000
+const int MATERIAL_TRANSPARENT_BIT = 16384; // 0b0100000000000000 (fully transparent for shadow rays)
+const int MATERIAL_INDEX_BITS = 16383;      // 0b0011111111111111
 
 const uint MAT_FLAG_IMP_SAMPLE = (1u << 0u);
 const uint MAT_FLAG_MIX_ADD = (1u << 1u);
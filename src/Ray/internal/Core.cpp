@@ -6,10 +6,12 @@
 #include <cmath>
 #include <cstring>
 
+#include <algorithm>
 #include <deque>
 #include <vector>
 
 #include "BVHSplit.h"
+#include "TextureUtils.h"
 
 namespace Ray {
 #include "precomputed/__pmj02_samples.inl"
@@ -155,6 +157,354 @@ uint32_t Ray::EncodeOctDir(const float d[3]) {
     return (uint32_t(x) << 16) | y;
 }
 
+uint32_t Ray::GetRaySortKey(const float o[3], const float d[3], const float root_min[3], const float cell_size[3],
+                            const int origin_bits, const int dir_bits) {
+    assert(origin_bits >= 0 && origin_bits <= 8 && dir_bits >= 0 && 3 * origin_bits + 2 * dir_bits <= 32);
+
+    uint32_t origin_key = 0;
+    if (origin_bits) {
+        uint32_t cell[3];
+        for (int i = 0; i < 3; ++i) {
+            const float f = (o[i] - root_min[i]) / cell_size[i];
+            cell[i] = uint32_t(f > 0.0f ? (f < 255.0f ? f : 255.0f) : 0.0f) >> (8 - origin_bits);
+        }
+        origin_key = (uint32_t(morton_table_256[cell[1]]) << 2) | (uint32_t(morton_table_256[cell[2]]) << 1) |
+                     (uint32_t(morton_table_256[cell[0]]) << 0);
+    }
+
+    // same octahedral mapping as in EncodeOctDir, but quantized to requested precision
+    const float denom = fabsf(d[0]) + fabsf(d[1]) + fabsf(d[2]);
+    float u = d[0] / denom, v = d[1] / denom;
+    if (d[2] < 0.0f) {
+        const float _u = u;
+        u = (1.0f - fabsf(v)) * copysignf(1.0f, _u);
+        v = (1.0f - fabsf(_u)) * copysignf(1.0f, v);
+    }
+    const float scale = 0.5f * float(1u << dir_bits);
+    const int max_val = int(1u << dir_bits) - 1;
+    const uint32_t ui = uint32_t(std::min(std::max(int((u + 1.0f) * scale), 0), max_val)),
+                   vi = uint32_t(std::min(std::max(int((v + 1.0f) * scale), 0), max_val));
+    const uint32_t dir_key = (ui << dir_bits) | vi;
+
+    return (dir_key << (3 * origin_bits)) | origin_key;
+}
+
+Ray::Span<const Ray::texel_sample_t> Ray::GetTexelMapRow(const texel_map_t &map, const int y, const int x_beg,
+                                                          const int x_end) {
+    const texel_sample_t *row_beg = map.texels.data() + map.row_offsets[y],
+                         *row_end = map.texels.data() + map.row_offsets[y + 1];
+    // y part is the same for the whole row, so packed coordinates are compared directly
+    const auto cmp = [](const texel_sample_t &t, const uint32_t xy) { return t.xy < xy; };
+    const texel_sample_t *beg = std::lower_bound(row_beg, row_end, (uint32_t(x_beg) << 16) | uint32_t(y), cmp),
+                         *end = std::lower_bound(beg, row_end, (uint32_t(x_end) << 16) | uint32_t(y), cmp);
+    return Span<const texel_sample_t>{beg, end};
+}
+
+bool Ray::InitRasterCamera(const camera_t &cam, const int w, const int h, raster_cam_t &out_rc) {
+    if (cam.type != eCamType::Persp || cam.fstop > 0.0f) {
+        return false;
+    }
+
+    memcpy(out_rc.origin, cam.origin, 3 * sizeof(float));
+    memcpy(out_rc.fwd, cam.fwd, 3 * sizeof(float));
+    memcpy(out_rc.side, cam.side, 3 * sizeof(float));
+    memcpy(out_rc.up, cam.up, 3 * sizeof(float));
+    out_rc.clip_start = cam.clip_start;
+
+    // inverse of pixel direction calculation of GeneratePrimaryRays
+    const float temp = tanf(0.5f * cam.fov * PI / 180.0f);
+    out_rc.scale[0] = float(h) / (2.0f * temp);
+    out_rc.scale[1] = -float(h) / (2.0f * temp);
+    out_rc.offset[0] = 0.5f * float(w) - cam.shift[0] * float(h);
+    out_rc.offset[1] = (0.5f + cam.shift[1]) * float(h);
+
+    // box filter keeps samples inside of pixel, others spread them up to 1.5 of filter width (see UpdateFilterTable)
+    out_rc.margin = 2;
+    if (cam.filter != ePixelFilter::Box) {
+        out_rc.margin += int(ceilf(1.5f * cam.filter_width));
+    }
+
+    return true;
+}
+
+bool Ray::GetRasterBounds(const raster_cam_t &rc, const float points[][3], const int count, const rect_t &r,
+                          rect_t &out_rect, float &out_min_t) {
+    float min_p[2] = {FLT_MAX, FLT_MAX}, max_p[2] = {-FLT_MAX, -FLT_MAX}, min_z = FLT_MAX;
+    for (int i = 0; i < count; ++i) {
+        const float q[3] = {points[i][0] - rc.origin[0], points[i][1] - rc.origin[1], points[i][2] - rc.origin[2]};
+        const float z = q[0] * rc.fwd[0] + q[1] * rc.fwd[1] + q[2] * rc.fwd[2];
+        if (z < FLT_EPS) {
+            // projection is unbounded
+            out_rect = r;
+            out_min_t = 0.0f;
+            return r.w > 0 && r.h > 0;
+        }
+        min_z = fminf(min_z, z);
+        const float inv_z = 1.0f / z;
+        const float p[2] = {
+            rc.offset[0] + rc.scale[0] * (q[0] * rc.side[0] + q[1] * rc.side[1] + q[2] * rc.side[2]) * inv_z,
+            rc.offset[1] + rc.scale[1] * (q[0] * rc.up[0] + q[1] * rc.up[1] + q[2] * rc.up[2]) * inv_z};
+        for (int j = 0; j < 2; ++j) {
+            min_p[j] = fminf(min_p[j], p[j]);
+            max_p[j] = fmaxf(max_p[j], p[j]);
+        }
+    }
+
+    // values are clamped before conversion to avoid integer overflow
+    const int x0 = int(floorf(clamp(min_p[0], float(r.x - 1), float(r.x + r.w + 1)))) - rc.margin,
+              x1 = int(floorf(clamp(max_p[0], float(r.x - 1), float(r.x + r.w + 1)))) + rc.margin + 1;
+    const int y0 = int(floorf(clamp(min_p[1], float(r.y - 1), float(r.y + r.h + 1)))) - rc.margin,
+              y1 = int(floorf(clamp(max_p[1], float(r.y - 1), float(r.y + r.h + 1)))) + rc.margin + 1;
+
+    out_rect.x = std::max(x0, r.x);
+    out_rect.y = std::max(y0, r.y);
+    out_rect.w = std::min(x1, r.x + r.w) - out_rect.x;
+    out_rect.h = std::min(y1, r.y + r.h) - out_rect.y;
+
+    // Depth of hit point is clip_start + t * dot(d, fwd) and direction is normalized, so t is never less than
+    // (depth - clip_start). Bound is relaxed slightly to stay conservative with respect to rounding
+    out_min_t = std::max(0.99999f * min_z - rc.clip_start, 0.0f);
+
+    return out_rect.w > 0 && out_rect.h > 0;
+}
+
+bool Ray::GetTriGroupRasterBounds(const raster_cam_t &rc, const float xform[12], const uint32_t *tri_indices,
+                                  const uint32_t *vtx_indices, const vertex_data_t &vertices,
+                                  const uint32_t group_index, const rect_t &r, rect_t &out_rect,
+                                  float &out_min_t) {
+    float points[24][3];
+    for (int i = 0; i < 8; ++i) {
+        // padding lanes repeat valid triangle
+        const uint32_t tri = tri_indices[group_index * 8 + i];
+        for (int j = 0; j < 3; ++j) {
+            const vertex_t v = vertices[vtx_indices[tri * 3 + j]];
+            float *p = points[i * 3 + j];
+            p[0] = xform[0] * v.p[0] + xform[3] * v.p[1] + xform[6] * v.p[2] + xform[9];
+            p[1] = xform[1] * v.p[0] + xform[4] * v.p[1] + xform[7] * v.p[2] + xform[10];
+            p[2] = xform[2] * v.p[0] + xform[5] * v.p[1] + xform[8] * v.p[2] + xform[11];
+        }
+    }
+    return GetRasterBounds(rc, points, 24, r, out_rect, out_min_t);
+}
+
+void Ray::UpdateRasterTiles(const rect_t &r, const rect_t &dirty, raster_scratch_t &scratch) {
+    const int tiles_w = (r.w + RasterTileSize - 1) / RasterTileSize;
+    const int tiles_h = (r.h + RasterTileSize - 1) / RasterTileSize;
+    scratch.tile_max_t.resize(size_t(tiles_w) * tiles_h, FLT_MAX);
+
+    const int tx_beg = (dirty.x - r.x) / RasterTileSize, tx_end = (dirty.x + dirty.w - r.x - 1) / RasterTileSize;
+    const int ty_beg = (dirty.y - r.y) / RasterTileSize, ty_end = (dirty.y + dirty.h - r.y - 1) / RasterTileSize;
+    for (int ty = ty_beg; ty <= ty_end; ++ty) {
+        for (int tx = tx_beg; tx <= tx_end; ++tx) {
+            float max_t = -FLT_MAX;
+            for (int y = ty * RasterTileSize; y < std::min((ty + 1) * RasterTileSize, r.h); ++y) {
+                for (int x = tx * RasterTileSize; x < std::min((tx + 1) * RasterTileSize, r.w); ++x) {
+                    const int i = scratch.px_rays[y * r.w + x];
+                    if (i != -1) {
+                        max_t = fmaxf(max_t, scratch.hits[i].t);
+                    }
+                }
+            }
+            scratch.tile_max_t[ty * tiles_w + tx] = max_t;
+        }
+    }
+}
+
+bool Ray::IsRasterOccluded(const rect_t &r, const rect_t &bounds, const float min_t,
+                           const raster_scratch_t &scratch) {
+    const int tiles_w = (r.w + RasterTileSize - 1) / RasterTileSize;
+
+    const int tx_beg = (bounds.x - r.x) / RasterTileSize, tx_end = (bounds.x + bounds.w - r.x - 1) / RasterTileSize;
+    const int ty_beg = (bounds.y - r.y) / RasterTileSize, ty_end = (bounds.y + bounds.h - r.y - 1) / RasterTileSize;
+    for (int ty = ty_beg; ty <= ty_end; ++ty) {
+        for (int tx = tx_beg; tx <= tx_end; ++tx) {
+            if (scratch.tile_max_t[ty * tiles_w + tx] > min_t) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+void Ray::GatherRasterInstances(const raster_cam_t &rc, const rect_t &r, const wbvh_node_t *nodes,
+                                const uint32_t root_index, const mesh_instance_t *mesh_instances,
+                                const uint32_t *mi_indices, raster_scratch_t &scratch) {
+    scratch.instances.clear();
+    scratch.node_stack.assign(1, root_index);
+
+    const auto get_bounds = [&](const float bbox_min[3], const float bbox_max[3], rect_t &out_rect,
+                                float &out_min_t) {
+        float corners[8][3];
+        for (int i = 0; i < 8; ++i) {
+            corners[i][0] = (i & 1) ? bbox_max[0] : bbox_min[0];
+            corners[i][1] = (i & 2) ? bbox_max[1] : bbox_min[1];
+            corners[i][2] = (i & 4) ? bbox_max[2] : bbox_min[2];
+        }
+        return GetRasterBounds(rc, corners, 8, r, out_rect, out_min_t) &&
+               !IsRasterOccluded(r, out_rect, out_min_t, scratch);
+    };
+
+    while (!scratch.node_stack.empty()) {
+        const wbvh_node_t &node = nodes[scratch.node_stack.back()];
+        scratch.node_stack.pop_back();
+
+        rect_t bounds;
+        float min_t;
+        if (node.child[0] & LEAF_NODE_BIT) {
+            const uint32_t prim_index = (node.child[0] & PRIM_INDEX_BITS);
+            for (uint32_t i = prim_index; i < prim_index + node.child[1]; ++i) {
+                const mesh_instance_t &mi = mesh_instances[mi_indices[i]];
+                if ((mi.ray_visibility & RAY_TYPE_CAMERA_BIT) != 0 &&
+                    get_bounds(mi.bbox_min, mi.bbox_max, bounds, min_t)) {
+                    scratch.instances.emplace_back(min_t, mi_indices[i]);
+                }
+            }
+        } else {
+            for (int i = 0; i < 8; ++i) {
+                if (node.child[i] == 0x7fffffff) {
+                    continue;
+                }
+                const float bbox_min[3] = {node.bbox_min[0][i], node.bbox_min[1][i], node.bbox_min[2][i]},
+                            bbox_max[3] = {node.bbox_max[0][i], node.bbox_max[1][i], node.bbox_max[2][i]};
+                if (get_bounds(bbox_min, bbox_max, bounds, min_t)) {
+                    scratch.node_stack.push_back(node.child[i]);
+                }
+            }
+        }
+    }
+
+    // closest instances go first, so that farther ones are more likely to be rejected by depth
+    std::sort(begin(scratch.instances), end(scratch.instances));
+}
+
+void Ray::RasterizeTriGroups(const raster_cam_t &rc, const rect_t &r, const scene_data_t &sc,
+                             const uint32_t root_index, Span<const uint32_t> mi_indices,
+                             const RasterIntersectFunction intersect, raster_scratch_t &scratch) {
+    const std::vector<int> &px_rays = scratch.px_rays;
+
+    UpdateRasterTiles(r, r, scratch);
+    GatherRasterInstances(rc, r, sc.wnodes, root_index, sc.mesh_instances, mi_indices.data(), scratch);
+
+    for (const std::pair<float, uint32_t> &candidate : scratch.instances) {
+        const uint32_t mi_index = candidate.second;
+        const mesh_instance_t &mi = sc.mesh_instances[mi_index];
+
+        float corners[8][3];
+        for (int i = 0; i < 8; ++i) {
+            corners[i][0] = (i & 1) ? mi.bbox_max[0] : mi.bbox_min[0];
+            corners[i][1] = (i & 2) ? mi.bbox_max[1] : mi.bbox_min[1];
+            corners[i][2] = (i & 4) ? mi.bbox_max[2] : mi.bbox_min[2];
+        }
+        rect_t mi_rect;
+        float mi_min_t;
+        // closer instances processed before may hide this one completely
+        if (!GetRasterBounds(rc, corners, 8, r, mi_rect, mi_min_t) ||
+            IsRasterOccluded(r, mi_rect, mi_min_t, scratch)) {
+            continue;
+        }
+
+        // Covered samples are moved into object space once, the same way as TLAS traversal does it
+        const float *inv_xform = mi.inv_xform;
+        scratch.local_rays.resize(6 * size_t(mi_rect.w) * mi_rect.h);
+        for (int y = mi_rect.y; y < mi_rect.y + mi_rect.h; ++y) {
+            for (int x = mi_rect.x; x < mi_rect.x + mi_rect.w; ++x) {
+                const int i = px_rays[(y - r.y) * r.w + (x - r.x)];
+                if (i == -1) {
+                    continue;
+                }
+                const float *ro = &scratch.rays[6 * size_t(i)], *rd = &scratch.rays[6 * size_t(i) + 3];
+                float *local_ray = &scratch.local_rays[6 * ((y - mi_rect.y) * mi_rect.w + (x - mi_rect.x))];
+                for (int k = 0; k < 3; ++k) {
+                    local_ray[k] = ro[0] * inv_xform[k] + ro[1] * inv_xform[3 + k] + ro[2] * inv_xform[6 + k] +
+                                   inv_xform[9 + k];
+                    local_ray[3 + k] = rd[0] * inv_xform[k] + rd[1] * inv_xform[3 + k] + rd[2] * inv_xform[6 + k];
+                }
+            }
+        }
+
+        float xform[12];
+        InverseAffineMatrix(mi.inv_xform, xform);
+
+        const mesh_t &m = sc.meshes[mi.mesh_index];
+        // groups of eight triangles must not be shared between meshes
+        assert((m.tris_index % 8) == 0);
+        for (uint32_t j = m.tris_index / 8; j < (m.tris_index + m.tris_count + 7) / 8; ++j) {
+            rect_t tri_rect;
+            float tri_min_t;
+            if (!GetTriGroupRasterBounds(rc, xform, sc.tri_indices, sc.vtx_indices, sc.vertices, j, mi_rect,
+                                         tri_rect, tri_min_t) ||
+                IsRasterOccluded(r, tri_rect, tri_min_t, scratch)) {
+                continue;
+            }
+
+            bool hit_found = false;
+            for (int y = tri_rect.y; y < tri_rect.y + tri_rect.h; ++y) {
+                for (int x = tri_rect.x; x < tri_rect.x + tri_rect.w; ++x) {
+                    const int i = px_rays[(y - r.y) * r.w + (x - r.x)];
+                    if (i == -1) {
+                        continue;
+                    }
+
+                    const float *local_ray =
+                        &scratch.local_rays[6 * ((y - mi_rect.y) * mi_rect.w + (x - mi_rect.x))];
+
+                    raster_hit_t &hit = scratch.hits[i];
+                    if (intersect(&local_ray[0], &local_ray[3], sc.mtris[j], j * 8, hit)) {
+                        hit.obj_index = int(mi_index);
+                        hit_found = true;
+                    }
+                }
+            }
+
+            // tile bounds are tightened only where something has changed
+            if (hit_found) {
+                UpdateRasterTiles(r, tri_rect, scratch);
+            }
+        }
+    }
+}
+
+void Ray::PackVertex(const vertex_t &v, packed_vertex_t &out_v) {
+    memcpy(out_v.p, v.p, 3 * sizeof(float));
+    const auto encode_dir = [](const float d[3]) -> uint32_t {
+        if (d[0] == 0.0f && d[1] == 0.0f && d[2] == 0.0f) {
+            return 0;
+        }
+        // zero code is reserved for missing vector, directions around -Z that would map to it are moved by one step
+        return std::max(EncodeOctDir(d), 1u);
+    };
+    out_v.n = encode_dir(v.n);
+    out_v.b = encode_dir(v.b);
+    out_v.t[0] = f32_to_f16(v.t[0]);
+    out_v.t[1] = f32_to_f16(v.t[1]);
+}
+
+void Ray::UnpackVertex(const packed_vertex_t &v, vertex_t &out_v) {
+    memcpy(out_v.p, v.p, 3 * sizeof(float));
+    const auto decode_dir = [](const uint32_t oct, float out_d[3]) {
+        if (oct == 0) {
+            out_d[0] = out_d[1] = out_d[2] = 0.0f;
+            return;
+        }
+        out_d[0] = -1.0f + 2.0f * float((oct >> 16) & 0x0000ffff) / 65535.0f;
+        out_d[1] = -1.0f + 2.0f * float(oct & 0x0000ffff) / 65535.0f;
+        out_d[2] = 1.0f - fabsf(out_d[0]) - fabsf(out_d[1]);
+        if (out_d[2] < 0.0f) {
+            const float temp = out_d[0];
+            out_d[0] = (1.0f - fabsf(out_d[1])) * copysignf(1.0f, temp);
+            out_d[1] = (1.0f - fabsf(temp)) * copysignf(1.0f, out_d[1]);
+        }
+        const float len = sqrtf(out_d[0] * out_d[0] + out_d[1] * out_d[1] + out_d[2] * out_d[2]);
+        out_d[0] /= len;
+        out_d[1] /= len;
+        out_d[2] /= len;
+    };
+    decode_dir(v.n, out_v.n);
+    decode_dir(v.b, out_v.b);
+    out_v.t[0] = f16_to_f32(v.t[0]);
+    out_v.t[1] = f16_to_f32(v.t[1]);
+}
+
 // Used to convert 16x16 sphere sector coordinates to single value
 const uint8_t Ray::morton_table_16[] = {0, 1, 4, 5, 16, 17, 20, 21, 64, 65, 68, 69, 80, 81, 84, 85};
 
@@ -794,33 +1144,20 @@ uint32_t Ray::FlattenBVH_r(const bvh_node_t *nodes, const uint32_t node_index, c
         }
     }
 
-    // Sort children in morton order
-    Ref::fvec3 children_centers[8], whole_box_min = {FLT_MAX}, whole_box_max = {-FLT_MAX};
-    for (int i = 0; i < children_count; i++) {
-        children_centers[i] =
-            0.5f * (Ref::fvec3{nodes[children[i]].bbox_min} + Ref::fvec3{nodes[children[i]].bbox_max});
-        whole_box_min = min(whole_box_min, children_centers[i]);
-        whole_box_max = max(whole_box_max, children_centers[i]);
-    }
-
-    whole_box_max += Ref::fvec3{0.001f};
-
-    const Ref::fvec3 scale = 2.0f / (whole_box_max - whole_box_min);
+    // Sort children by decreasing surface area. Closest-hit traversal orders children by distance anyway, while
+    // any-hit traversal visits them in stored order, so that the most probable occluders are tested first
+    const auto surface_area = [nodes](const uint32_t i) {
+        const float e[3] = {nodes[i].bbox_max[0] - nodes[i].bbox_min[0], nodes[i].bbox_max[1] - nodes[i].bbox_min[1],
+                            nodes[i].bbox_max[2] - nodes[i].bbox_min[2]};
+        return e[0] * e[1] + e[1] * e[2] + e[2] * e[0];
+    };
+    std::stable_sort(children, children + children_count,
+                     [&](const uint32_t lhs, const uint32_t rhs) { return surface_area(lhs) > surface_area(rhs); });
 
     uint32_t sorted_children[8] = {0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff,
                                    0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff};
     for (int i = 0; i < children_count; i++) {
-        Ref::fvec3 code = (children_centers[i] - whole_box_min) * scale;
-
-        const auto x = uint32_t(code[0]), y = uint32_t(code[1]), z = uint32_t(code[2]);
-
-        uint32_t mort = (z << 2) | (y << 1) | (x << 0);
-
-        while (sorted_children[mort] != 0xffffffff) {
-            mort = (mort + 1) % 8;
-        }
-
-        sorted_children[mort] = children[i];
+        sorted_children[i] = children[i];
     }
 
     uint32_t new_children[8];
@@ -1288,6 +1625,23 @@ void Ray::TransformBoundingBox(const float bbox_min[3], const float bbox_max[3],
     }
 }
 
+void Ray::InverseAffineMatrix(const float mat[12], float out_mat[12]) {
+    const float *a = &mat[0], *b = &mat[3], *c = &mat[6], *t = &mat[9];
+    // rows of inverted 3x3 part are cross products of its columns
+    const float r0[3] = {b[1] * c[2] - b[2] * c[1], b[2] * c[0] - b[0] * c[2], b[0] * c[1] - b[1] * c[0]};
+    const float r1[3] = {c[1] * a[2] - c[2] * a[1], c[2] * a[0] - c[0] * a[2], c[0] * a[1] - c[1] * a[0]};
+    const float r2[3] = {a[1] * b[2] - a[2] * b[1], a[2] * b[0] - a[0] * b[2], a[0] * b[1] - a[1] * b[0]};
+    const float inv_det = 1.0f / (a[0] * r0[0] + a[1] * r0[1] + a[2] * r0[2]);
+    for (int i = 0; i < 3; ++i) {
+        out_mat[3 * i + 0] = inv_det * r0[i];
+        out_mat[3 * i + 1] = inv_det * r1[i];
+        out_mat[3 * i + 2] = inv_det * r2[i];
+    }
+    for (int i = 0; i < 3; ++i) {
+        out_mat[9 + i] = -(out_mat[i] * t[0] + out_mat[3 + i] * t[1] + out_mat[6 + i] * t[2]);
+    }
+}
+
 void Ray::InverseMatrix(const float mat[16], float out_mat[16]) {
     const float A2323 = mat[10] * mat[15] - mat[11] * mat[14];
     const float A1323 = mat[9] * mat[15] - mat[11] * mat[13];
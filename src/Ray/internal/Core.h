@@ -157,6 +157,14 @@ struct tri_mat_data_t {
     uint16_t front_mi, back_mi;
 };
 
+// Solid bit means that surface blocks light completely, transparent bit that it is fully see-through (its material
+// is not evaluated by shadow rays, but it still counts towards transparency depth, the same as on GPU). Both bits are
+// set per triangle, so textured mix materials are classified too
+force_inline bool is_solid_tri_side(const uint16_t mi) { return (mi & MATERIAL_SOLID_BIT) != 0; }
+force_inline bool is_clear_tri_side(const uint16_t mi) {
+    return (mi & (MATERIAL_SOLID_BIT | MATERIAL_TRANSPARENT_BIT)) == MATERIAL_TRANSPARENT_BIT;
+}
+
 struct material_t {
     uint32_t textures[MAX_MATERIAL_TEXTURES];
     float base_color[3];
@@ -349,6 +357,8 @@ void TransformBoundingBox(const float bbox_min[3], const float bbox_max[3], cons
                           float out_bbox_max[3]);
 
 void InverseMatrix(const float mat[16], float out_mat[16]);
+// Inverts 3x4 affine matrix (columns of 3x3 part followed by translation)
+void InverseAffineMatrix(const float mat[12], float out_mat[12]);
 
 extern const int __pmj02_sample_count;
 extern const int __pmj02_dims_count;
@@ -362,6 +372,32 @@ struct vertex_t {
 };
 static_assert(sizeof(vertex_t) == 44, "!");
 
+// Compact vertex (normal and binormal are octahedral-encoded, uvs are stored as half floats)
+struct packed_vertex_t {
+    float p[3];
+    uint32_t n, b; // zero means zero-length vector
+    uint16_t t[2];
+};
+static_assert(sizeof(packed_vertex_t) == 24, "!");
+
+void PackVertex(const vertex_t &v, packed_vertex_t &out_v);
+void UnpackVertex(const packed_vertex_t &v, vertex_t &out_v);
+
+// View of scene vertices, only one of pointers is set (depends on whether vertex compression is enabled)
+struct vertex_data_t {
+    const vertex_t *vertices = nullptr;
+    const packed_vertex_t *packed_vertices = nullptr;
+
+    force_inline vertex_t operator[](const uint32_t i) const {
+        if (vertices) {
+            return vertices[i];
+        }
+        vertex_t ret;
+        UnpackVertex(packed_vertices[i], ret);
+        return ret;
+    }
+};
+
 struct mesh_t {
     float bbox_min[3], bbox_max[3];
     uint32_t node_index, node_block;
@@ -371,7 +407,18 @@ struct mesh_t {
 };
 static_assert(sizeof(mesh_t) == 64, "!");
 
+// Instance record used by CPU backends, forward transform is not stored (recomputed from inverse when needed)
 struct mesh_instance_t {
+    float bbox_min[3];
+    uint32_t mesh_index;
+    float bbox_max[3];
+    uint32_t ray_visibility; // upper 24 bits identify lights_block (0xffffff if there are no lights)
+    float inv_xform[12];     // 3x4 affine matrix (columns of 3x3 part followed by translation)
+};
+static_assert(sizeof(mesh_instance_t) == 80, "!");
+
+// Instance record used by GPU backends (matches shader-side layout)
+struct gpu_mesh_instance_t {
     float bbox_min[3];
     uint32_t _unused;
     float bbox_max[3];
@@ -382,7 +429,7 @@ struct mesh_instance_t {
     uint32_t ray_visibility; // upper 24 bits identify lights_block
     float xform[16], inv_xform[16];
 };
-static_assert(sizeof(mesh_instance_t) == 176, "!");
+static_assert(sizeof(gpu_mesh_instance_t) == 176, "!");
 
 struct environment_t {
     float env_col[3];
@@ -423,6 +470,12 @@ void DirToCanonical(const float d[3], float y_rotation, float out_p[2]);
 
 uint32_t EncodeOctDir(const float d[3]);
 
+// Sorting key of ray: morton code of origin cell ('origin_bits' per axis of 255-cell grid over scene bounds) in
+// lower bits, octahedral direction ('dir_bits' per coordinate) in upper ones. Direction goes first so that rays towards
+// the same light from nearby points end up close to each other. Key must fit 32 bits (3 * origin_bits + 2 * dir_bits)
+uint32_t GetRaySortKey(const float o[3], const float d[3], const float root_min[3], const float cell_size[3],
+                       int origin_bits, int dir_bits);
+
 extern const uint8_t morton_table_16[];
 extern const int morton_table_256[];
 
@@ -440,6 +493,86 @@ struct ray_hash_t {
     uint32_t hash, index;
 };
 
+// Texel of geometry camera image covered by mesh triangle (barycentrics are stored the same way as in hit data)
+struct texel_sample_t {
+    uint32_t xy; // (x << 16) | y
+    uint32_t mi_index, prim_index;
+    float u, v;
+};
+static_assert(sizeof(texel_sample_t) == 20, "!");
+
+// Result of UV-space rasterization of mesh (or of whole lightmap atlas if mi_index is not set),
+// only covered texels are stored (row by row, sorted by x)
+struct texel_map_t {
+    uint32_t mi_index = 0xffffffff, mesh_index = 0xffffffff, uv_layer = 0;
+    int w = 0, h = 0;
+    std::vector<uint32_t> row_offsets; // h + 1 entries, texels of row y are in [row_offsets[y], row_offsets[y + 1])
+    std::vector<texel_sample_t> texels;
+};
+
+// Covered texels of row 'y' with x in [x_beg, x_end)
+Span<const texel_sample_t> GetTexelMapRow(const texel_map_t &map, int y, int x_beg, int x_end);
+
+// Pinhole projection used to find pixels, whose primary rays can hit given primitive
+struct raster_cam_t {
+    float origin[3], fwd[3], side[3], up[3];
+    // pixel coordinates are offset + scale * (dot(p, side), dot(p, up)) / dot(p, fwd)
+    float offset[2], scale[2];
+    float clip_start; // ray origins are moved forward by it, hit distances are shorter accordingly
+    int margin;       // covers subpixel jitter and reconstruction filter footprint
+};
+
+// Returns false if primary rays do not start from single point (depth of field, non-perspective projection)
+bool InitRasterCamera(const camera_t &cam, int w, int h, raster_cam_t &out_rc);
+// Conservative pixel bounds of points clipped against 'r' (whole rect if points cross camera plane),
+// returns false if bounds are empty. 'out_min_t' is lower bound of primary hit distance of any point inside of
+// convex hull of points
+bool GetRasterBounds(const raster_cam_t &rc, const float points[][3], int count, const rect_t &r, rect_t &out_rect,
+                     float &out_min_t);
+// Pixel bounds of eight triangles of mtri_accel_t group of instance with forward transform 'xform'
+bool GetTriGroupRasterBounds(const raster_cam_t &rc, const float xform[12], const uint32_t *tri_indices,
+                             const uint32_t *vtx_indices, const vertex_data_t &vertices, uint32_t group_index,
+                             const rect_t &r, rect_t &out_rect, float &out_min_t);
+
+// Closest hit found by rasterization (prim_index is not resolved through tri_indices yet)
+struct raster_hit_t {
+    int obj_index, prim_index;
+    float t, u, v;
+};
+
+const int RasterTileSize = 8;
+
+// Scratch memory of rasterized primary visibility
+struct raster_scratch_t {
+    std::vector<int> px_rays; // index of sample per pixel of region (-1 if pixel is not sampled)
+    std::vector<raster_hit_t> hits;
+    std::vector<float> rays;       // origins and directions of samples in world space (filled by backend)
+    std::vector<float> local_rays; // origins and directions of samples in object space of current instance
+    // farthest hit of samples of each RasterTileSize x RasterTileSize tile of region (-FLT_MAX if tile has none),
+    // can only be larger than actual value (it is refreshed after closer hits are found)
+    std::vector<float> tile_max_t;
+    std::vector<std::pair<float, uint32_t>> instances; // candidate instances with their hit distance bounds
+    std::vector<uint32_t> node_stack;
+};
+
+// Recalculates farthest hit of tiles that overlap 'dirty' rect of region 'r'
+void UpdateRasterTiles(const rect_t &r, const rect_t &dirty, raster_scratch_t &scratch);
+// Checks if anything with hit distance not less than 'min_t' is hidden behind existing hits in 'bounds'
+bool IsRasterOccluded(const rect_t &r, const rect_t &bounds, float min_t, const raster_scratch_t &scratch);
+// Collects camera-visible instances of TLAS which may contribute to region 'r', instances are sorted front-to-back
+void GatherRasterInstances(const raster_cam_t &rc, const rect_t &r, const wbvh_node_t *nodes, uint32_t root_index,
+                           const mesh_instance_t *mesh_instances, const uint32_t *mi_indices,
+                           raster_scratch_t &scratch);
+
+// Primary hit that does not depend on materials (solid surface or miss), kept between renders of the same view,
+// entry is valid only if its epoch matches current one
+struct cached_hit_t {
+    uint32_t epoch;
+    int obj_index, prim_index;
+    float t, u, v;
+};
+static_assert(sizeof(cached_hit_t) == 24, "!");
+
 enum class eActivation { ReLU };
 enum class ePostOp { None, Downscale, HDRTransfer, PositiveNormalize };
 enum class ePreOp { None, Upscale, HDRTransfer, PositiveNormalize };
@@ -502,13 +635,65 @@ struct cache_data_t {
 
 enum eSpatialCacheMode { None, Update, Query };
 
+const int MAX_SHADOW_HITS = 8;
+
+// Closest non-opaque intersections gathered during single any-hit traversal (sorted by distance).
+// Allows to resolve several transparent surfaces without restarting traversal after each of them.
+struct shadow_hits_t {
+    int count = 0, limit = MAX_SHADOW_HITS;
+    float t = 0.0f;      // culling distance (shrinks to the furthest hit when list is full)
+    float t_min = -1.0f; // hits at this distance or closer were processed before traversal restart
+    struct {
+        int obj_index, prim_index;
+        float t, u, v;
+    } hits[MAX_SHADOW_HITS];
+
+    force_inline bool full() const { return count == limit; }
+
+    // When list is full, other surfaces at the distance of the furthest hit could have been rejected. These hits are
+    // left for the next traversal (which starts strictly after the last processed hit), so no surface is lost.
+    // Returns distance to restart from or negative value if restart is not needed.
+    force_inline float TrimForRestart() {
+        if (!full()) {
+            return -1.0f;
+        }
+        int n = count;
+        while (n > 0 && hits[n - 1].t == t) {
+            --n;
+        }
+        // degenerate case: all hits are at the same distance, they are processed at once
+        count = (n > 0) ? n : count;
+        return hits[count - 1].t;
+    }
+
+    force_inline void Insert(const int obj_index, const int prim_index, const float _t, const float u, const float v) {
+        if (_t >= t || _t <= t_min) {
+            return;
+        }
+        for (int i = 0; i < count; ++i) {
+            // the same triangle can be referenced from several leaves
+            if (hits[i].obj_index == obj_index && hits[i].prim_index == prim_index) {
+                return;
+            }
+        }
+        int i = (count < limit) ? count++ : count - 1;
+        for (; i > 0 && hits[i - 1].t > _t; --i) {
+            hits[i] = hits[i - 1];
+        }
+        hits[i] = {obj_index, prim_index, _t, u, v};
+        if (count == limit) {
+            t = hits[count - 1].t;
+        }
+    }
+};
+
 struct scene_data_t {
     const environment_t &env;
     const mesh_instance_t *mesh_instances;
     const uint32_t *mi_indices;
     const mesh_t *meshes;
     const uint32_t *vtx_indices;
-    const vertex_t *vertices;
+    vertex_data_t vertices;
     const bvh_node_t *nodes;
     const wbvh_node_t *wnodes;
     const tri_accel_t *tris;
@@ -529,6 +714,17 @@ struct scene_data_t {
     Span<const packed_cache_voxel_t> spatial_cache_voxels;
 };
 
+// Backend-specific test of object space ray against eight triangles of group (first one is 'tri_start'), hit
+// distance, barycentrics and prim_index are updated only if closer intersection is found
+using RasterIntersectFunction = bool (*)(const float ro[3], const float rd[3], const mtri_accel_t &tris,
+                                         uint32_t tri_start, raster_hit_t &hit);
+// Rasterizes triangle groups of instances gathered from TLAS into samples of region 'r' (px_rays, hits and rays of
+// scratch must be initialized by caller). Instances are processed front-to-back, instances and groups that lie behind
+// already found hits of all covered tiles are skipped
+void RasterizeTriGroups(const raster_cam_t &rc, const rect_t &r, const scene_data_t &sc, uint32_t root_index,
+                        Span<const uint32_t> mi_indices, RasterIntersectFunction intersect,
+                        raster_scratch_t &scratch);
+
 force_inline float clamp(const float val, const float min, const float max) {
     return val < min ? min : (val > max ? max : val);
 }
@@ -600,28 +600,41 @@ force_inline uint32_t get_ray_hash(const ray_data_t &r, const float root_min[3],
     return (o << 25) | (p << 24) | (y << 2) | (z << 1) | (x << 0);
 }
 
-force_inline void _radix_sort_lsb(ray_chunk_t *begin, ray_chunk_t *end, ray_chunk_t *begin1, unsigned maxshift) {
-    ray_chunk_t *end1 = begin1 + (end - begin);
+force_inline void radix_sort(ray_chunk_t *begin, ray_chunk_t *end, ray_chunk_t *begin1, const int key_bits = 32) {
+    const size_t count = size_t(end - begin);
+    if (!count) {
+        return;
+    }
+    const int passes_count = (key_bits + 7) / 8;
+
+    // histograms of all digits are gathered at once
+    uint32_t histogram[4][0x100] = {};
+    for (const ray_chunk_t *p = begin; p != end; ++p) {
+        for (int k = 0; k < passes_count; ++k) {
+            ++histogram[k][(p->hash >> (8 * k)) & 0xFF];
+        }
+    }
 
-    for (unsigned shift = 0; shift <= maxshift; shift += 8) {
-        size_t count[0x100] = {};
-        for (ray_chunk_t *p = begin; p != end; p++) {
-            count[(p->hash >> shift) & 0xFF]++;
+    ray_chunk_t *src = begin, *dst = begin1;
+    for (int k = 0; k < passes_count; ++k) {
+        const unsigned shift = 8 * k;
+        if (histogram[k][(src->hash >> shift) & 0xFF] == count) {
+            // all keys share this digit
+            continue;
         }
-        ray_chunk_t *bucket[0x100], *q = begin1;
-        for (int i = 0; i < 0x100; q += count[i++]) {
+        ray_chunk_t *bucket[0x100], *q = dst;
+        for (int i = 0; i < 0x100; q += histogram[k][i++]) {
             bucket[i] = q;
         }
-        for (ray_chunk_t *p = begin; p != end; p++) {
+        for (const ray_chunk_t *p = src; p != src + count; ++p) {
             *bucket[(p->hash >> shift) & 0xFF]++ = *p;
         }
-        std::swap(begin, begin1);
-        std::swap(end, end1);
+        std::swap(src, dst);
     }
-}
 
-force_inline void radix_sort(ray_chunk_t *begin, ray_chunk_t *end, ray_chunk_t *begin1) {
-    _radix_sort_lsb(begin, end, begin1, 24);
+    if (src != begin) {
+        std::copy(src, src + count, begin);
+    }
 }
 
 void create_tbn_matrix(const fvec4 &N, fvec4 out_TBN[3]) {
@@ -1164,6 +1177,23 @@ force_inline float angle_between(const fvec4 &v1, const fvec4 &v2) {
     }
 }
 
+// Closest hit test in the form expected by RasterizeTriGroups
+bool IntersectRasterTri(const float ro[3], const float rd[3], const mtri_accel_t &tris, const uint32_t tri_start,
+                        raster_hit_t &hit) {
+    hit_data_t inter{Uninitialize};
+    inter.t = hit.t;
+    inter.v = -1.0f;
+    IntersectTri(ro, rd, tris, tri_start, inter);
+    if (inter.v < 0.0f) {
+        return false;
+    }
+    hit.prim_index = inter.prim_index;
+    hit.t = inter.t;
+    hit.u = inter.u;
+    hit.v = inter.v;
+    return true;
+}
+
 } // namespace Ref
 } // namespace Ray
 
@@ -1307,10 +1337,10 @@ Ray::Ref::fvec2 Ray::Ref::get_scrambled_2d_rand(const uint32_t dim, const uint32
                                 rand_seq[shuffled_dim * 2 * RAND_SAMPLES_COUNT + 2 * shuffled_i + 1])};
 }
 
-void Ray::Ref::GeneratePrimaryRays(const camera_t &cam, const rect_t &r, const int w, const int h,
-                                   const uint32_t rand_seq[], const uint32_t rand_seed, const float filter_table[],
-                                   const int iteration, const uint16_t required_samples[],
-                                   aligned_vector<ray_data_t> &out_rays, aligned_vector<hit_data_t> &out_inters) {
+int Ray::Ref::GeneratePrimaryRays(const camera_t &cam, const rect_t &r, const int w, const int h,
+                                  const uint32_t rand_seq[], const uint32_t rand_seed, const float filter_table[],
+                                  const int iteration, const uint16_t required_samples[],
+                                  aligned_vector<ray_data_t> &out_rays, aligned_vector<hit_data_t> &out_inters) {
     const fvec4 cam_origin = make_fvec3(cam.origin), fwd = make_fvec3(cam.fwd), side = make_fvec3(cam.side),
                 up = make_fvec3(cam.up);
     const float focus_distance = cam.focus_distance;
@@ -1430,60 +1460,24 @@ void Ray::Ref::GeneratePrimaryRays(const camera_t &cam, const rect_t &r, const i
 
     out_rays.resize(i);
     out_inters.resize(i);
-}
-
-void Ray::Ref::SampleMeshInTextureSpace(const int iteration, const int obj_index, const int uv_layer,
-                                        const mesh_t &mesh, const mesh_instance_t &mi, const uint32_t *vtx_indices,
-                                        const vertex_t *vertices, const rect_t &r, const int width, const int height,
-                                        const uint32_t rand_seq[], aligned_vector<ray_data_t> &out_rays,
-                                        aligned_vector<hit_data_t> &out_inters) {
-    out_rays.resize(size_t(r.w) * r.h);
-    out_inters.resize(out_rays.size());
-
-    for (int y = r.y; y < r.y + r.h; ++y) {
-        for (int x = r.x; x < r.x + r.w; ++x) {
-            const int i = (y - r.y) * r.w + (x - r.x);
 
-            ray_data_t &out_ray = out_rays[i];
-            hit_data_t &out_inter = out_inters[i];
-
-            out_ray.xy = (x << 16) | y;
-            out_ray.c[0] = out_ray.c[1] = out_ray.c[2] = 1.0f;
-            out_inter.v = -1.0f;
-        }
-    }
-
-    const ivec2 irect_min = {r.x, r.y}, irect_max = {r.x + r.w - 1, r.y + r.h - 1};
-    const fvec2 size = {float(width), float(height)};
-
-    for (uint32_t tri = mesh.tris_index; tri < mesh.tris_index + mesh.tris_count; tri++) {
-        const vertex_t &v0 = vertices[vtx_indices[tri * 3 + 0]];
-        const vertex_t &v1 = vertices[vtx_indices[tri * 3 + 1]];
-        const vertex_t &v2 = vertices[vtx_indices[tri * 3 + 2]];
+    return int(i);
+}
 
+void Ray::Ref::RasterizeMeshUVs(const mesh_t &mesh, const uint32_t mi_index, const int uv_layer,
+                                const uint32_t *vtx_indices, const vertex_data_t &vertices, const rect_t &r,
+                                const int width, texel_sample_t texels[]) {
+    const fvec2 offset = {float(r.x), float(r.y)}, size = {float(r.w), float(r.h)};
+    const auto uv_to_texel = [&](const vertex_t &vtx) {
         // TODO: use uv_layer
-        const auto t0 = fvec2{v0.t[0], 1.0f - v0.t[1]} * size;
-        const auto t1 = fvec2{v1.t[0], 1.0f - v1.t[1]} * size;
-        const auto t2 = fvec2{v2.t[0], 1.0f - v2.t[1]} * size;
-
-        fvec2 bbox_min = t0, bbox_max = t0;
-
-        bbox_min = min(bbox_min, t1);
-        bbox_min = min(bbox_min, t2);
-
-        bbox_max = max(bbox_max, t1);
-        bbox_max = max(bbox_max, t2);
-
-        ivec2 ibbox_min = ivec2{bbox_min},
-              ibbox_max = ivec2{int(roundf(bbox_max.get<0>())), int(roundf(bbox_max.get<1>()))};
-
-        if (ibbox_max.get<0>() < irect_min.get<0>() || ibbox_max.get<1>() < irect_min.get<1>() ||
-            ibbox_min.get<0>() > irect_max.get<0>() || ibbox_min.get<1>() > irect_max.get<1>()) {
-            continue;
-        }
+        return offset + fvec2{vtx.t[0], 1.0f - vtx.t[1]} * size;
+    };
 
-        ibbox_min = max(ibbox_min, irect_min);
-        ibbox_max = min(ibbox_max, irect_max);
+    // first triangle that covers texel wins
+    for (uint32_t tri = mesh.tris_index; tri < mesh.tris_index + mesh.tris_count; tri++) {
+        const fvec2 t0 = uv_to_texel(vertices[vtx_indices[tri * 3 + 0]]),
+                    t1 = uv_to_texel(vertices[vtx_indices[tri * 3 + 1]]),
+                    t2 = uv_to_texel(vertices[vtx_indices[tri * 3 + 2]]);
 
         const fvec2 d01 = t0 - t1, d12 = t1 - t2, d20 = t2 - t0;
 
@@ -1491,67 +1485,136 @@ void Ray::Ref::SampleMeshInTextureSpace(const int iteration, const int obj_index
         if (area < FLT_EPS) {
             continue;
         }
-
         const float inv_area = 1.0f / area;
 
-        for (int y = ibbox_min.get<1>(); y <= ibbox_max.get<1>(); ++y) {
-            for (int x = ibbox_min.get<0>(); x <= ibbox_max.get<0>(); ++x) {
-                const int i = (y - r.y) * r.w + (x - r.x);
-                ray_data_t &out_ray = out_rays[i];
-                hit_data_t &out_inter = out_inters[i];
+        const fvec2 bbox_min = min(min(t0, t1), t2), bbox_max = max(max(t0, t1), t2);
 
-                if (out_inter.v >= 0.0f) {
+        const int x_beg = std::max(int(bbox_min.get<0>()), r.x), y_beg = std::max(int(bbox_min.get<1>()), r.y),
+                  x_end = std::min(int(roundf(bbox_max.get<0>())), r.x + r.w - 1),
+                  y_end = std::min(int(roundf(bbox_max.get<1>())), r.y + r.h - 1);
+
+        for (int y = y_beg; y <= y_end; ++y) {
+            for (int x = x_beg; x <= x_end; ++x) {
+                texel_sample_t &texel = texels[size_t(y) * width + x];
+                if (texel.prim_index != 0xffffffff) {
                     continue;
                 }
 
-                const float _x = float(x); // + fract(rand_seq[RAND_DIM_FILTER_U] + construct_float(hash(out_ray.xy)));
-                const float _y =
-                    float(y); // + fract(rand_seq[RAND_DIM_FILTER_V] + construct_float(hash(hash(out_ray.xy))));
-
-                float u = d01.get<0>() * (_y - t0.get<1>()) - d01.get<1>() * (_x - t0.get<0>()),
-                      v = d12.get<0>() * (_y - t1.get<1>()) - d12.get<1>() * (_x - t1.get<0>()),
-                      w = d20.get<0>() * (_y - t2.get<1>()) - d20.get<1>() * (_x - t2.get<0>());
+                const float _x = float(x), _y = float(y);
 
+                const float u = d01.get<0>() * (_y - t0.get<1>()) - d01.get<1>() * (_x - t0.get<0>()),
+                            v = d12.get<0>() * (_y - t1.get<1>()) - d12.get<1>() * (_x - t1.get<0>()),
+                            w = d20.get<0>() * (_y - t2.get<1>()) - d20.get<1>() * (_x - t2.get<0>());
                 if (u >= -FLT_EPS && v >= -FLT_EPS && w >= -FLT_EPS) {
-                    const auto p0 = fvec4{v0.p}, p1 = fvec4{v1.p}, p2 = fvec4{v2.p};
-                    const auto n0 = fvec4{v0.n}, n1 = fvec4{v1.n}, n2 = fvec4{v2.n};
+                    texel.xy = (uint32_t(x) << 16) | uint32_t(y);
+                    texel.mi_index = mi_index;
+                    texel.prim_index = tri;
+                    texel.u = w * inv_area;
+                    texel.v = u * inv_area;
+                }
+            }
+        }
+    }
+}
 
-                    u *= inv_area;
-                    v *= inv_area;
-                    w *= inv_area;
+void Ray::Ref::CompactTexelMap(const texel_sample_t texels[], const int width, const int height,
+                               texel_map_t &out_map) {
+    out_map.w = width;
+    out_map.h = height;
+    out_map.row_offsets.resize(height + 1);
+    out_map.texels.clear();
+    for (int y = 0; y < height; ++y) {
+        out_map.row_offsets[y] = uint32_t(out_map.texels.size());
+        for (int x = 0; x < width; ++x) {
+            const texel_sample_t &texel = texels[size_t(y) * width + x];
+            if (texel.prim_index != 0xffffffff) {
+                out_map.texels.push_back(texel);
+            }
+        }
+    }
+    out_map.row_offsets[height] = uint32_t(out_map.texels.size());
+}
 
-                    const fvec4 p = TransformPoint(p0 * v + p1 * w + p2 * u, mi.xform),
-                                n = TransformNormal(n0 * v + n1 * w + n2 * u, mi.inv_xform);
+int Ray::Ref::SampleMeshInTextureSpace(const int iteration, const mesh_instance_t *mesh_instances,
+                                       const uint32_t *vtx_indices, const vertex_data_t &vertices,
+                                       const texel_map_t &texel_map, const rect_t &r, const uint32_t rand_seq[],
+                                       const uint16_t required_samples[], aligned_vector<ray_data_t> &out_rays,
+                                       aligned_vector<hit_data_t> &out_inters) {
+    const int y_end = std::min(r.y + r.h, texel_map.h);
 
-                    const fvec4 o = p + n, d = -n;
+    const auto is_active = [&](const texel_sample_t &t) {
+        return required_samples[(t.xy & 0xffff) * texel_map.w + (t.xy >> 16)] >= iteration;
+    };
 
-                    memcpy(&out_ray.o[0], value_ptr(o), 3 * sizeof(float));
-                    memcpy(&out_ray.d[0], value_ptr(d), 3 * sizeof(float));
+    // only covered texels that did not converge yet get rays
+    size_t count = 0;
+    for (int y = r.y; y < y_end; ++y) {
+        for (const texel_sample_t &t : GetTexelMapRow(texel_map, y, r.x, r.x + r.w)) {
+            count += is_active(t) ? 1 : 0;
+        }
+    }
 
-                    out_ray.cone_width = 0;
-                    out_ray.cone_spread = 0;
-                    out_ray.depth = pack_ray_type(RAY_TYPE_DIFFUSE);
-                    out_ray.depth |= pack_ray_depth(0, 0, 0, 0);
+    out_rays.resize(count);
+    out_inters.resize(count);
 
-                    out_inter.prim_index = int(tri);
-                    out_inter.obj_index = obj_index;
-                    out_inter.t = 1.0f;
-                    out_inter.u = w;
-                    out_inter.v = u;
-                }
+    // atlas texels belong to different instances, transform is updated when instance changes
+    uint32_t xform_mi = 0xffffffff;
+    float xform[12];
+
+    size_t i = 0;
+    for (int y = r.y; y < y_end; ++y) {
+        for (const texel_sample_t &t : GetTexelMapRow(texel_map, y, r.x, r.x + r.w)) {
+            if (!is_active(t)) {
+                continue;
             }
+
+            const mesh_instance_t &mi = mesh_instances[t.mi_index];
+            if (t.mi_index != xform_mi) {
+                InverseAffineMatrix(mi.inv_xform, xform);
+                xform_mi = t.mi_index;
+            }
+
+            const vertex_t v0 = vertices[vtx_indices[t.prim_index * 3 + 0]],
+                           v1 = vertices[vtx_indices[t.prim_index * 3 + 1]],
+                           v2 = vertices[vtx_indices[t.prim_index * 3 + 2]];
+
+            const float w = 1.0f - t.u - t.v;
+
+            const fvec4 p = TransformPoint(fvec4{v0.p} * w + fvec4{v1.p} * t.u + fvec4{v2.p} * t.v, xform),
+                        n = TransformNormal(fvec4{v0.n} * w + fvec4{v1.n} * t.u + fvec4{v2.n} * t.v, mi.inv_xform);
+
+            const fvec4 o = p + n, d = -n;
+
+            ray_data_t &out_ray = out_rays[i];
+            out_ray.xy = t.xy;
+            out_ray.c[0] = out_ray.c[1] = out_ray.c[2] = 1.0f;
+            memcpy(&out_ray.o[0], value_ptr(o), 3 * sizeof(float));
+            memcpy(&out_ray.d[0], value_ptr(d), 3 * sizeof(float));
+            out_ray.cone_width = 0;
+            out_ray.cone_spread = 0;
+            out_ray.depth = pack_ray_type(RAY_TYPE_DIFFUSE);
+            out_ray.depth |= pack_ray_depth(0, 0, 0, 0);
+
+            hit_data_t &out_inter = out_inters[i++];
+            out_inter.prim_index = int(t.prim_index);
+            out_inter.obj_index = int(t.mi_index);
+            out_inter.t = 1.0f;
+            out_inter.u = t.u;
+            out_inter.v = t.v;
         }
     }
+
+    return int(count);
 }
 
 int Ray::Ref::SortRays_CPU(Span<ray_data_t> rays, const float root_min[3], const float cell_size[3],
-                           uint32_t *hash_values, uint32_t *scan_values, ray_chunk_t *chunks,
-                           ray_chunk_t *chunks_temp) {
+                           const int origin_bits, const int dir_bits, uint32_t *hash_values, uint32_t *scan_values,
+                           ray_chunk_t *chunks, ray_chunk_t *chunks_temp) {
     // From "Fast Ray Sorting and Breadth-First Packet Traversal for GPU Ray Tracing" [2010]
 
     // compute ray hash values
     for (uint32_t i = 0; i < uint32_t(rays.size()); ++i) {
-        hash_values[i] = get_ray_hash(rays[i], root_min, cell_size);
+        hash_values[i] = GetRaySortKey(rays[i].o, rays[i].d, root_min, cell_size, origin_bits, dir_bits);
     }
 
     size_t chunks_count = 0;
@@ -1566,7 +1629,7 @@ int Ray::Ref::SortRays_CPU(Span<ray_data_t> rays, const float root_min[3], const
         }
     }
 
-    radix_sort(&chunks[0], &chunks[0] + chunks_count, &chunks_temp[0]);
+    radix_sort(&chunks[0], &chunks[0] + chunks_count, &chunks_temp[0], 3 * origin_bits + 2 * dir_bits);
 
     // decompress sorted spans
     size_t counter = 0;
@@ -1589,6 +1652,25 @@ int Ray::Ref::SortRays_CPU(Span<ray_data_t> rays, const float root_min[3], const
     return int(rays.size());
 }
 
+int Ray::Ref::SortShadowRays(Span<shadow_ray_t> rays, const float root_min[3], const float cell_size[3],
+                             std::vector<uint64_t> &temp_keys, aligned_vector<shadow_ray_t> &temp_rays) {
+    temp_keys.resize(rays.size());
+    for (int i = 0; i < int(rays.size()); ++i) {
+        temp_keys[i] = (uint64_t(GetRaySortKey(rays[i].o, rays[i].d, root_min, cell_size, 7, 5)) << 32) | uint32_t(i);
+    }
+    std::sort(begin(temp_keys), end(temp_keys));
+
+    temp_rays.resize(rays.size());
+    for (int i = 0; i < int(rays.size()); ++i) {
+        temp_rays[i] = rays[uint32_t(temp_keys[i] & 0xffffffff)];
+    }
+    for (int i = 0; i < int(rays.size()); ++i) {
+        rays[i] = temp_rays[i];
+    }
+
+    return int(rays.size());
+}
+
 int Ray::Ref::SortRays_GPU(Span<ray_data_t> rays, const float root_min[3], const float cell_size[3],
                            uint32_t *hash_values, int *head_flags, uint32_t *scan_values, ray_chunk_t *chunks,
                            ray_chunk_t *chunks_temp, uint32_t *skeleton) {
@@ -1719,52 +1801,26 @@ bool Ray::Ref::IntersectTris_ClosestHit(const float ro[3], const float rd[3], co
 
 bool Ray::Ref::IntersectTris_AnyHit(const float ro[3], const float rd[3], const tri_accel_t *tris,
                                     const tri_mat_data_t *materials, const uint32_t *indices, const int tri_start,
-                                    const int tri_end, const int obj_index, hit_data_t &out_inter) {
-    hit_data_t inter{Uninitialize};
-    inter.obj_index = obj_index;
-    inter.t = out_inter.t;
-    inter.v = -1.0f;
-
+                                    const int tri_end, const int obj_index, shadow_hits_t &out_hits) {
     for (int i = tri_start; i < tri_end; ++i) {
+        hit_data_t inter{Uninitialize};
+        inter.t = out_hits.t;
+        inter.v = -1.0f;
+
         IntersectTri(ro, rd, tris[i], i, inter);
-        if (inter.v >= 0.0f && ((inter.prim_index > 0 && (materials[indices[i]].front_mi & MATERIAL_SOLID_BIT)) ||
-                                (inter.prim_index < 0 && (materials[indices[i]].back_mi & MATERIAL_SOLID_BIT)))) {
-            break;
+        if (inter.v < 0.0f) {
+            continue;
         }
-    }
-
-    out_inter.obj_index = inter.v >= 0.0f ? inter.obj_index : out_inter.obj_index;
-    out_inter.prim_index = inter.v >= 0.0f ? inter.prim_index : out_inter.prim_index;
-    out_inter.t = inter.t; // already contains min value
-    out_inter.u = inter.v >= 0.0f ? inter.u : out_inter.u;
-    out_inter.v = inter.v >= 0.0f ? inter.v : out_inter.v;
-
-    return inter.v >= 0.0f;
-}
-
-bool Ray::Ref::IntersectTris_AnyHit(const float ro[3], const float rd[3], const mtri_accel_t *mtris,
-                                    const tri_mat_data_t *materials, const uint32_t *indices, const int tri_start,
-                                    const int tri_end, const int obj_index, hit_data_t &out_inter) {
-    hit_data_t inter{Uninitialize};
-    inter.obj_index = obj_index;
-    inter.t = out_inter.t;
-    inter.v = -1.0f;
 
-    for (int i = tri_start / 8; i < (tri_end + 7) / 8; ++i) {
-        IntersectTri(ro, rd, mtris[i], i * 8, inter);
-        if (inter.v >= 0.0f && ((inter.prim_index > 0 && (materials[indices[i]].front_mi & MATERIAL_SOLID_BIT)) ||
-                                (inter.prim_index < 0 && (materials[indices[i]].back_mi & MATERIAL_SOLID_BIT)))) {
-            break;
+        const tri_mat_data_t &mat = materials[indices[i]];
+        const uint16_t mi = (inter.prim_index < 0) ? mat.back_mi : mat.front_mi;
+        if (is_solid_tri_side(mi)) {
+            return true;
         }
+        out_hits.Insert(obj_index, inter.prim_index, inter.t, inter.u, inter.v);
     }
 
-    out_inter.obj_index = inter.v >= 0.0f ? inter.obj_index : out_inter.obj_index;
-    out_inter.prim_index = inter.v >= 0.0f ? inter.prim_index : out_inter.prim_index;
-    out_inter.t = inter.t; // already contains min value
-    out_inter.u = inter.v >= 0.0f ? inter.u : out_inter.u;
-    out_inter.v = inter.v >= 0.0f ? inter.v : out_inter.v;
-
-    return inter.v >= 0.0f;
+    return false;
 }
 
 bool Ray::Ref::Traverse_TLAS_WithStack_ClosestHit(const float ro[3], const float rd[3], const uint32_t ray_flags,
@@ -1937,9 +1993,9 @@ bool Ray::Ref::Traverse_TLAS_WithStack_ClosestHit(const float ro[3], const float
 bool Ray::Ref::Traverse_TLAS_WithStack_AnyHit(const float ro[3], const float rd[3], const int ray_type,
                                               const bvh_node_t *nodes, const uint32_t root_index,
                                               const mesh_instance_t *mesh_instances, const uint32_t *mi_indices,
-                                              const mesh_t *meshes, const mtri_accel_t *mtris,
+                                              const mesh_t *meshes, const tri_accel_t *tris,
                                               const tri_mat_data_t *materials, const uint32_t *tri_indices,
-                                              hit_data_t &inter) {
+                                              shadow_hits_t &hits) {
     const uint32_t ray_vismask = (1u << ray_type);
 
     float inv_d[3];
@@ -1953,7 +2009,7 @@ bool Ray::Ref::Traverse_TLAS_WithStack_AnyHit(const float ro[3], const float rd[
     while (stack_size) {
         const uint32_t cur = stack[--stack_size];
 
-        if (!bbox_test(ro, inv_d, inter.t, nodes[cur])) {
+        if (!bbox_test(ro, inv_d, hits.t, nodes[cur])) {
             continue;
         }
 
@@ -1970,7 +2026,7 @@ bool Ray::Ref::Traverse_TLAS_WithStack_AnyHit(const float ro[3], const float rd[
 
                 const mesh_t &m = meshes[mi.mesh_index];
 
-                if (!bbox_test(ro, inv_d, inter.t, mi.bbox_min, mi.bbox_max)) {
+                if (!bbox_test(ro, inv_d, hits.t, mi.bbox_min, mi.bbox_max)) {
                     continue;
                 }
 
@@ -1981,7 +2037,7 @@ bool Ray::Ref::Traverse_TLAS_WithStack_AnyHit(const float ro[3], const float rd[
                 safe_invert(_rd, _inv_d);
 
                 const bool solid_hit_found = Traverse_BLAS_WithStack_AnyHit(
-                    _ro, _rd, _inv_d, nodes, m.node_index, mtris, materials, tri_indices, int(mi_indices[i]), inter);
+                    _ro, _rd, _inv_d, nodes, m.node_index, tris, materials, tri_indices, int(mi_indices[i]), hits);
                 if (solid_hit_found) {
                     return true;
                 }
@@ -1990,10 +2046,12 @@ bool Ray::Ref::Traverse_TLAS_WithStack_AnyHit(const float ro[3], const float rd[
     }
 
     // resolve primitive index indirection
-    if (inter.prim_index < 0) {
-        inter.prim_index = -int(tri_indices[-inter.prim_index - 1]) - 1;
-    } else {
-        inter.prim_index = int(tri_indices[inter.prim_index]);
+    for (int i = 0; i < hits.count; ++i) {
+        if (hits.hits[i].prim_index < 0) {
+            hits.hits[i].prim_index = -int(tri_indices[-hits.hits[i].prim_index - 1]) - 1;
+        } else {
+            hits.hits[i].prim_index = int(tri_indices[hits.hits[i].prim_index]);
+        }
     }
 
     return false;
@@ -2004,13 +2062,9 @@ bool Ray::Ref::Traverse_TLAS_WithStack_AnyHit(const float ro[3], const float rd[
                                               const mesh_instance_t *mesh_instances, const uint32_t *mi_indices,
                                               const mesh_t *meshes, const tri_accel_t *tris,
                                               const tri_mat_data_t *materials, const uint32_t *tri_indices,
-                                              hit_data_t &inter) {
-    const int ray_dir_oct = ((rd[2] > 0.0f) << 2) | ((rd[1] > 0.0f) << 1) | (rd[0] > 0.0f);
+                                              shadow_hits_t &hits) {
     const uint32_t ray_vismask = (1u << ray_type);
 
-    int child_order[8];
-    UNROLLED_FOR(i, 8, { child_order[i] = i ^ ray_dir_oct; })
-
     float inv_d[3];
     safe_invert(rd, inv_d);
 
@@ -2020,68 +2074,33 @@ bool Ray::Ref::Traverse_TLAS_WithStack_AnyHit(const float ro[3], const float rd[
     while (!st.empty()) {
         stack_entry_t cur = st.pop();
 
-        if (cur.dist > inter.t) {
+        if (cur.dist > hits.t) {
             continue;
         }
 
     TRAVERSE:
         if (!is_leaf_node(nodes[cur.index])) {
             alignas(16) float dist[8];
-            long mask = bbox_test_oct(ro, inv_d, inter.t, nodes[cur.index], dist);
+            long mask = bbox_test_oct(ro, inv_d, hits.t, nodes[cur.index], dist);
             if (mask) {
-                long i = GetFirstBit(mask);
+                // Children are stored in order of decreasing surface area (see FlattenBVH_r), visiting them in this
+                // order finds an occluder faster on average than sorting by distance
+                const uint32_t *children = nodes[cur.index].child;
+                const long i = GetFirstBit(mask);
                 mask = ClearBit(mask, i);
-                if (mask == 0) { // only one box was hit
-                    cur.index = nodes[cur.index].child[i];
-                    goto TRAVERSE;
-                }
-
-                long i2 = GetFirstBit(mask);
-                mask = ClearBit(mask, i2);
-                if (mask == 0) { // two boxes were hit
-                    if (dist[i] < dist[i2]) {
-                        st.push(nodes[cur.index].child[i2], dist[i2]);
-                        cur.index = nodes[cur.index].child[i];
-                    } else {
-                        st.push(nodes[cur.index].child[i], dist[i]);
-                        cur.index = nodes[cur.index].child[i2];
+                if (mask != 0) {
+                    long rest[8];
+                    int rest_count = 0;
+                    do {
+                        rest[rest_count] = GetFirstBit(mask);
+                        mask = ClearBit(mask, rest[rest_count++]);
+                    } while (mask != 0);
+                    // push in reverse order, so that larger children are popped first
+                    while (rest_count--) {
+                        st.push(children[rest[rest_count]], dist[rest[rest_count]]);
                     }
-                    goto TRAVERSE;
                 }
-
-                st.push(nodes[cur.index].child[i], dist[i]);
-                st.push(nodes[cur.index].child[i2], dist[i2]);
-
-                i = GetFirstBit(mask);
-                mask = ClearBit(mask, i);
-                st.push(nodes[cur.index].child[i], dist[i]);
-                if (mask == 0) { // three boxes were hit
-                    st.sort_top3();
-                    cur.index = st.pop_index();
-                    goto TRAVERSE;
-                }
-
-                i = GetFirstBit(mask);
-                mask = ClearBit(mask, i);
-                st.push(nodes[cur.index].child[i], dist[i]);
-                if (mask == 0) { // four boxes were hit
-                    st.sort_top4();
-                    cur.index = st.pop_index();
-                    goto TRAVERSE;
-                }
-
-                const uint32_t size_before = st.stack_size;
-
-                // from five to eight boxes were hit
-                do {
-                    i = GetFirstBit(mask);
-                    mask = ClearBit(mask, i);
-                    st.push(nodes[cur.index].child[i], dist[i]);
-                } while (mask != 0);
-
-                int count = int(st.stack_size - size_before + 4);
-                st.sort_topN(count);
-                cur.index = st.pop_index();
+                cur.index = children[i];
                 goto TRAVERSE;
             }
         } else {
@@ -2094,7 +2113,7 @@ bool Ray::Ref::Traverse_TLAS_WithStack_AnyHit(const float ro[3], const float rd[
 
                 const mesh_t &m = meshes[mi.mesh_index];
 
-                if (!bbox_test(ro, inv_d, inter.t, mi.bbox_min, mi.bbox_max)) {
+                if (!bbox_test(ro, inv_d, hits.t, mi.bbox_min, mi.bbox_max)) {
                     continue;
                 }
 
@@ -2104,7 +2123,7 @@ bool Ray::Ref::Traverse_TLAS_WithStack_AnyHit(const float ro[3], const float rd[
                 float _inv_d[3];
                 safe_invert(_rd, _inv_d);
                 const bool solid_hit_found = Traverse_BLAS_WithStack_AnyHit(
-                    _ro, _rd, _inv_d, nodes, m.node_index, tris, materials, tri_indices, int(mi_indices[i]), inter);
+                    _ro, _rd, _inv_d, nodes, m.node_index, tris, materials, tri_indices, int(mi_indices[i]), hits);
                 if (solid_hit_found) {
                     return true;
                 }
@@ -2113,10 +2132,12 @@ bool Ray::Ref::Traverse_TLAS_WithStack_AnyHit(const float ro[3], const float rd[
     }
 
     // resolve primitive index indirection
-    if (inter.prim_index < 0) {
-        inter.prim_index = -int(tri_indices[-inter.prim_index - 1]) - 1;
-    } else {
-        inter.prim_index = int(tri_indices[inter.prim_index]);
+    for (int i = 0; i < hits.count; ++i) {
+        if (hits.hits[i].prim_index < 0) {
+            hits.hits[i].prim_index = -int(tri_indices[-hits.hits[i].prim_index - 1]) - 1;
+        } else {
+            hits.hits[i].prim_index = int(tri_indices[hits.hits[i].prim_index]);
+        }
     }
 
     return false;
@@ -2238,9 +2259,9 @@ bool Ray::Ref::Traverse_BLAS_WithStack_ClosestHit(const float ro[3], const float
 }
 
 bool Ray::Ref::Traverse_BLAS_WithStack_AnyHit(const float ro[3], const float rd[3], const float inv_d[3],
-                                              const bvh_node_t *nodes, uint32_t root_index, const mtri_accel_t *mtris,
+                                              const bvh_node_t *nodes, uint32_t root_index, const tri_accel_t *tris,
                                               const tri_mat_data_t *materials, const uint32_t *tri_indices,
-                                              int obj_index, hit_data_t &inter) {
+                                              int obj_index, shadow_hits_t &hits) {
     uint32_t stack[MAX_STACK_SIZE];
     uint32_t stack_size = 0;
 
@@ -2249,7 +2270,7 @@ bool Ray::Ref::Traverse_BLAS_WithStack_AnyHit(const float ro[3], const float rd[
     while (stack_size) {
         const uint32_t cur = stack[--stack_size];
 
-        if (!bbox_test(ro, inv_d, inter.t, nodes[cur])) {
+        if (!bbox_test(ro, inv_d, hits.t, nodes[cur])) {
             continue;
         }
 
@@ -2259,16 +2280,8 @@ bool Ray::Ref::Traverse_BLAS_WithStack_AnyHit(const float ro[3], const float rd[
         } else {
             const int tri_start = int(nodes[cur].prim_index & PRIM_INDEX_BITS),
                       tri_end = int(tri_start + nodes[cur].prim_count);
-            const bool hit_found =
-                IntersectTris_AnyHit(ro, rd, mtris, materials, tri_indices, tri_start, tri_end, obj_index, inter);
-            if (hit_found) {
-                const bool is_backfacing = inter.prim_index < 0;
-                const uint32_t prim_index = is_backfacing ? -inter.prim_index - 1 : inter.prim_index;
-
-                if ((!is_backfacing && (materials[tri_indices[prim_index]].front_mi & MATERIAL_SOLID_BIT)) ||
-                    (is_backfacing && (materials[tri_indices[prim_index]].back_mi & MATERIAL_SOLID_BIT))) {
-                    return true;
-                }
+            if (IntersectTris_AnyHit(ro, rd, tris, materials, tri_indices, tri_start, tri_end, obj_index, hits)) {
+                return true;
             }
         }
     }
@@ -2279,90 +2292,46 @@ bool Ray::Ref::Traverse_BLAS_WithStack_AnyHit(const float ro[3], const float rd[
 bool Ray::Ref::Traverse_BLAS_WithStack_AnyHit(const float ro[3], const float rd[3], const float inv_d[3],
                                               const wbvh_node_t *nodes, const uint32_t root_index,
                                               const tri_accel_t *tris, const tri_mat_data_t *materials,
-                                              const uint32_t *tri_indices, int obj_index, hit_data_t &inter) {
+                                              const uint32_t *tri_indices, int obj_index, shadow_hits_t &hits) {
     TraversalStack<MAX_STACK_SIZE> st;
     st.push(root_index, 0.0f);
 
     while (!st.empty()) {
         stack_entry_t cur = st.pop();
 
-        if (cur.dist > inter.t) {
+        if (cur.dist > hits.t) {
             continue;
         }
 
     TRAVERSE:
         if (!is_leaf_node(nodes[cur.index])) {
             alignas(16) float dist[8];
-            long mask = bbox_test_oct(ro, inv_d, inter.t, nodes[cur.index], dist);
+            long mask = bbox_test_oct(ro, inv_d, hits.t, nodes[cur.index], dist);
             if (mask) {
-                long i = GetFirstBit(mask);
+                // larger children go first, the same as in TLAS traversal
+                const uint32_t *children = nodes[cur.index].child;
+                const long i = GetFirstBit(mask);
                 mask = ClearBit(mask, i);
-                if (mask == 0) { // only one box was hit
-                    cur.index = nodes[cur.index].child[i];
-                    goto TRAVERSE;
-                }
-
-                const long i2 = GetFirstBit(mask);
-                mask = ClearBit(mask, i2);
-                if (mask == 0) { // two boxes were hit
-                    if (dist[i] < dist[i2]) {
-                        st.push(nodes[cur.index].child[i2], dist[i2]);
-                        cur.index = nodes[cur.index].child[i];
-                    } else {
-                        st.push(nodes[cur.index].child[i], dist[i]);
-                        cur.index = nodes[cur.index].child[i2];
+                if (mask != 0) {
+                    long rest[8];
+                    int rest_count = 0;
+                    do {
+                        rest[rest_count] = GetFirstBit(mask);
+                        mask = ClearBit(mask, rest[rest_count++]);
+                    } while (mask != 0);
+                    // push in reverse order, so that larger children are popped first
+                    while (rest_count--) {
+                        st.push(children[rest[rest_count]], dist[rest[rest_count]]);
                     }
-                    goto TRAVERSE;
                 }
-
-                st.push(nodes[cur.index].child[i], dist[i]);
-                st.push(nodes[cur.index].child[i2], dist[i2]);
-
-                i = GetFirstBit(mask);
-                mask = ClearBit(mask, i);
-                st.push(nodes[cur.index].child[i], dist[i]);
-                if (mask == 0) { // three boxes were hit
-                    st.sort_top3();
-                    cur.index = st.pop_index();
-                    goto TRAVERSE;
-                }
-
-                i = GetFirstBit(mask);
-                mask = ClearBit(mask, i);
-                st.push(nodes[cur.index].child[i], dist[i]);
-                if (mask == 0) { // four boxes were hit
-                    st.sort_top4();
-                    cur.index = st.pop_index();
-                    goto TRAVERSE;
-                }
-
-                uint32_t size_before = st.stack_size;
-
-                // from five to eight boxes were hit
-                do {
-                    i = GetFirstBit(mask);
-                    mask = ClearBit(mask, i);
-                    st.push(nodes[cur.index].child[i], dist[i]);
-                } while (mask != 0);
-
-                const int count = int(st.stack_size - size_before + 4);
-                st.sort_topN(count);
-                cur.index = st.pop_index();
+                cur.index = children[i];
                 goto TRAVERSE;
             }
         } else {
             const int tri_start = int(nodes[cur.index].child[0] & PRIM_INDEX_BITS),
                       tri_end = int(tri_start + nodes[cur.index].child[1]);
-            const bool hit_found =
-                IntersectTris_AnyHit(ro, rd, tris, materials, tri_indices, tri_start, tri_end, obj_index, inter);
-            if (hit_found) {
-                const bool is_backfacing = inter.prim_index < 0;
-                const uint32_t prim_index = is_backfacing ? -inter.prim_index - 1 : inter.prim_index;
-
-                if ((!is_backfacing && (materials[tri_indices[prim_index]].front_mi & MATERIAL_SOLID_BIT)) ||
-                    (is_backfacing && (materials[tri_indices[prim_index]].back_mi & MATERIAL_SOLID_BIT))) {
-                    return true;
-                }
+            if (IntersectTris_AnyHit(ro, rd, tris, materials, tri_indices, tri_start, tri_end, obj_index, hits)) {
+                return true;
             }
         }
     }
@@ -2372,22 +2341,34 @@ bool Ray::Ref::Traverse_BLAS_WithStack_AnyHit(const float ro[3], const float rd[
 
 void Ray::Ref::TransformRay(const float ro[3], const float rd[3], const float *xform, float out_ro[3],
                             float out_rd[3]) {
-    out_ro[0] = xform[0] * ro[0] + xform[4] * ro[1] + xform[8] * ro[2] + xform[12];
-    out_ro[1] = xform[1] * ro[0] + xform[5] * ro[1] + xform[9] * ro[2] + xform[13];
-    out_ro[2] = xform[2] * ro[0] + xform[6] * ro[1] + xform[10] * ro[2] + xform[14];
+    out_ro[0] = xform[0] * ro[0] + xform[3] * ro[1] + xform[6] * ro[2] + xform[9];
+    out_ro[1] = xform[1] * ro[0] + xform[4] * ro[1] + xform[7] * ro[2] + xform[10];
+    out_ro[2] = xform[2] * ro[0] + xform[5] * ro[1] + xform[8] * ro[2] + xform[11];
 
-    out_rd[0] = xform[0] * rd[0] + xform[4] * rd[1] + xform[8] * rd[2];
-    out_rd[1] = xform[1] * rd[0] + xform[5] * rd[1] + xform[9] * rd[2];
-    out_rd[2] = xform[2] * rd[0] + xform[6] * rd[1] + xform[10] * rd[2];
+    out_rd[0] = xform[0] * rd[0] + xform[3] * rd[1] + xform[6] * rd[2];
+    out_rd[1] = xform[1] * rd[0] + xform[4] * rd[1] + xform[7] * rd[2];
+    out_rd[2] = xform[2] * rd[0] + xform[5] * rd[1] + xform[8] * rd[2];
 }
 
 Ray::Ref::fvec4 Ray::Ref::TransformPoint(const fvec4 &p, const float *xform) {
+    return fvec4{xform[0] * p.get<0>() + xform[3] * p.get<1>() + xform[6] * p.get<2>() + xform[9],
+                 xform[1] * p.get<0>() + xform[4] * p.get<1>() + xform[7] * p.get<2>() + xform[10],
+                 xform[2] * p.get<0>() + xform[5] * p.get<1>() + xform[8] * p.get<2>() + xform[11], 0.0f};
+}
+
+Ray::Ref::fvec4 Ray::Ref::TransformDirection(const fvec4 &p, const float *xform) {
+    return fvec4{xform[0] * p.get<0>() + xform[3] * p.get<1>() + xform[6] * p.get<2>(),
+                 xform[1] * p.get<0>() + xform[4] * p.get<1>() + xform[7] * p.get<2>(),
+                 xform[2] * p.get<0>() + xform[5] * p.get<1>() + xform[8] * p.get<2>(), 0.0f};
+}
+
+Ray::Ref::fvec4 Ray::Ref::TransformPoint4x4(const fvec4 &p, const float *xform) {
     return fvec4{xform[0] * p.get<0>() + xform[4] * p.get<1>() + xform[8] * p.get<2>() + xform[12],
                  xform[1] * p.get<0>() + xform[5] * p.get<1>() + xform[9] * p.get<2>() + xform[13],
                  xform[2] * p.get<0>() + xform[6] * p.get<1>() + xform[10] * p.get<2>() + xform[14], 0.0f};
 }
 
-Ray::Ref::fvec4 Ray::Ref::TransformDirection(const fvec4 &p, const float *xform) {
+Ray::Ref::fvec4 Ray::Ref::TransformDirection4x4(const fvec4 &p, const float *xform) {
     return fvec4{xform[0] * p.get<0>() + xform[4] * p.get<1>() + xform[8] * p.get<2>(),
                  xform[1] * p.get<0>() + xform[5] * p.get<1>() + xform[9] * p.get<2>(),
                  xform[2] * p.get<0>() + xform[6] * p.get<1>() + xform[10] * p.get<2>(), 0.0f};
@@ -2395,8 +2376,8 @@ Ray::Ref::fvec4 Ray::Ref::TransformDirection(const fvec4 &p, const float *xform)
 
 Ray::Ref::fvec4 Ray::Ref::TransformNormal(const fvec4 &n, const float *inv_xform) {
     return fvec4{inv_xform[0] * n.get<0>() + inv_xform[1] * n.get<1>() + inv_xform[2] * n.get<2>(),
-                 inv_xform[4] * n.get<0>() + inv_xform[5] * n.get<1>() + inv_xform[6] * n.get<2>(),
-                 inv_xform[8] * n.get<0>() + inv_xform[9] * n.get<1>() + inv_xform[10] * n.get<2>(), 0.0f};
+                 inv_xform[3] * n.get<0>() + inv_xform[4] * n.get<1>() + inv_xform[5] * n.get<2>(),
+                 inv_xform[6] * n.get<0>() + inv_xform[7] * n.get<1>() + inv_xform[8] * n.get<2>(), 0.0f};
 }
 
 float Ray::Ref::get_texture_lod(const Cpu::TexStorageBase *const textures[], const uint32_t index, const fvec2 &duv_dx,
@@ -2745,7 +2726,7 @@ Ray::Ref::fvec4 Ray::Ref::IntersectScene(const shadow_ray_t &r, const int max_tr
                                          const uint32_t root_index, const uint32_t rand_seq[], const uint32_t rand_seed,
                                          const int iteration, const Cpu::TexStorageBase *const textures[]) {
     const fvec4 rd = make_fvec3(r.d);
-    fvec4 ro = make_fvec3(r.o);
+    const fvec4 ro = make_fvec3(r.o);
     fvec4 rc = make_fvec3(r.c);
     int depth = get_transp_depth(r.depth);
 
@@ -2754,92 +2735,122 @@ Ray::Ref::fvec4 Ray::Ref::IntersectScene(const shadow_ray_t &r, const int max_tr
 
     uint32_t rand_dim = RAND_DIM_BASE_COUNT + get_total_depth(r.depth) * RAND_DIM_BOUNCE_COUNT;
 
-    float dist = r.dist > 0.0f ? r.dist : MAX_DIST;
-    while (dist > HIT_BIAS) {
-        hit_data_t inter;
-        inter.t = dist;
+    const float dist = r.dist > 0.0f ? r.dist : MAX_DIST;
+    // ray origin is kept the same between restarts, so that distances to the same surfaces match exactly
+    float t_min = -1.0f;
+    while (dist > std::max(t_min, 0.0f) + HIT_BIAS) {
+        if (depth > max_transp_depth) {
+            rc = 0.0f;
+            break;
+        }
+
+        shadow_hits_t hits;
+        hits.t = dist;
+        hits.t_min = t_min;
+        // one extra hit is requested to detect that transparency depth is exceeded
+        hits.limit = std::min(max_transp_depth - depth + 1, MAX_SHADOW_HITS);
 
         bool solid_hit = false;
         if (sc.wnodes) {
             solid_hit = Traverse_TLAS_WithStack_AnyHit(value_ptr(ro), value_ptr(rd), RAY_TYPE_SHADOW, sc.wnodes,
                                                        root_index, sc.mesh_instances, sc.mi_indices, sc.meshes, sc.tris,
-                                                       sc.tri_materials, sc.tri_indices, inter);
+                                                       sc.tri_materials, sc.tri_indices, hits);
         } else {
             solid_hit = Traverse_TLAS_WithStack_AnyHit(value_ptr(ro), value_ptr(rd), RAY_TYPE_SHADOW, sc.nodes,
-                                                       root_index, sc.mesh_instances, sc.mi_indices, sc.meshes,
-                                                       sc.mtris, sc.tri_materials, sc.tri_indices, inter);
+                                                       root_index, sc.mesh_instances, sc.mi_indices, sc.meshes, sc.tris,
+                                                       sc.tri_materials, sc.tri_indices, hits);
         }
 
-        if (solid_hit || depth > max_transp_depth) {
+        if (solid_hit) {
             rc = 0.0f;
-        }
-
-        if (solid_hit || depth > max_transp_depth || inter.v < 0.0f) {
             break;
         }
 
-        const bool is_backfacing = (inter.prim_index < 0);
-        const uint32_t tri_index = is_backfacing ? -inter.prim_index - 1 : inter.prim_index;
+        const float restart_t = hits.TrimForRestart();
 
-        const uint32_t mat_index = is_backfacing ? (sc.tri_materials[tri_index].back_mi & MATERIAL_INDEX_BITS)
-                                                 : (sc.tri_materials[tri_index].front_mi & MATERIAL_INDEX_BITS);
+        // Process collected surfaces front-to-back (traversal is not restarted in between)
+        for (int i = 0; i < hits.count; ++i) {
+            const auto &inter = hits.hits[i];
 
-        const vertex_t &v1 = sc.vertices[sc.vtx_indices[tri_index * 3 + 0]];
-        const vertex_t &v2 = sc.vertices[sc.vtx_indices[tri_index * 3 + 1]];
-        const vertex_t &v3 = sc.vertices[sc.vtx_indices[tri_index * 3 + 2]];
+            const bool is_backfacing = (inter.prim_index < 0);
+            const uint32_t tri_index = is_backfacing ? -inter.prim_index - 1 : inter.prim_index;
 
-        const float w = 1.0f - inter.u - inter.v;
-        const fvec2 sh_uvs = fvec2(v1.t) * w + fvec2(v2.t) * inter.u + fvec2(v3.t) * inter.v;
+            const uint16_t mi =
+                is_backfacing ? sc.tri_materials[tri_index].back_mi : sc.tri_materials[tri_index].front_mi;
+            if (is_clear_tri_side(mi)) {
+                // throughput is known to be 1, only transparency depth is affected
+                rand_dim += RAND_DIM_BOUNCE_COUNT;
+                if (++depth > max_transp_depth) {
+                    rc = 0.0f;
+                    break;
+                }
+                continue;
+            }
+            const uint32_t mat_index = (mi & MATERIAL_INDEX_BITS);
 
-        const fvec2 tex_rand = get_scrambled_2d_rand(rand_dim + RAND_DIM_TEX, rand_hash, iteration - 1, rand_seq);
+            const vertex_t &v1 = sc.vertices[sc.vtx_indices[tri_index * 3 + 0]];
+            const vertex_t &v2 = sc.vertices[sc.vtx_indices[tri_index * 3 + 1]];
+            const vertex_t &v3 = sc.vertices[sc.vtx_indices[tri_index * 3 + 2]];
 
-        struct {
-            uint32_t index;
-            float weight;
-        } stack[16];
-        int stack_size = 0;
+            const float w = 1.0f - inter.u - inter.v;
+            const fvec2 sh_uvs = fvec2(v1.t) * w + fvec2(v2.t) * inter.u + fvec2(v3.t) * inter.v;
 
-        stack[stack_size++] = {mat_index, 1.0f};
+            const fvec2 tex_rand = get_scrambled_2d_rand(rand_dim + RAND_DIM_TEX, rand_hash, iteration - 1, rand_seq);
 
-        fvec4 throughput = 0.0f;
+            struct {
+                uint32_t index;
+                float weight;
+            } stack[16];
+            int stack_size = 0;
 
-        while (stack_size--) {
-            const material_t *mat = &sc.materials[stack[stack_size].index];
-            const float weight = stack[stack_size].weight;
+            stack[stack_size++] = {mat_index, 1.0f};
 
-            // resolve mix material
-            if (mat->type == eShadingNode::Mix) {
-                float mix_val = mat->strength;
-                const uint32_t base_texture = mat->textures[BASE_TEXTURE];
-                if (base_texture != 0xffffffff) {
-                    fvec4 tex_color = SampleBilinear(textures, base_texture, sh_uvs, 0, tex_rand);
-                    if (base_texture & TEX_YCOCG_BIT) {
-                        tex_color = YCoCg_to_RGB(tex_color);
-                    }
-                    if (base_texture & TEX_SRGB_BIT) {
-                        tex_color = srgb_to_linear(tex_color);
+            fvec4 throughput = 0.0f;
+
+            while (stack_size--) {
+                const material_t *mat = &sc.materials[stack[stack_size].index];
+                const float weight = stack[stack_size].weight;
+
+                // resolve mix material
+                if (mat->type == eShadingNode::Mix) {
+                    float mix_val = mat->strength;
+                    const uint32_t base_texture = mat->textures[BASE_TEXTURE];
+                    if (base_texture != 0xffffffff) {
+                        fvec4 tex_color = SampleBilinear(textures, base_texture, sh_uvs, 0, tex_rand);
+                        if (base_texture & TEX_YCOCG_BIT) {
+                            tex_color = YCoCg_to_RGB(tex_color);
+                        }
+                        if (base_texture & TEX_SRGB_BIT) {
+                            tex_color = srgb_to_linear(tex_color);
+                        }
+                        mix_val *= tex_color.get<0>();
                     }
-                    mix_val *= tex_color.get<0>();
+
+                    stack[stack_size++] = {mat->textures[MIX_MAT1], weight * (1.0f - mix_val)};
+                    stack[stack_size++] = {mat->textures[MIX_MAT2], weight * mix_val};
+                } else if (mat->type == eShadingNode::Transparent) {
+                    throughput += weight * make_fvec3(mat->base_color);
                 }
+            }
 
-                stack[stack_size++] = {mat->textures[MIX_MAT1], weight * (1.0f - mix_val)};
-                stack[stack_size++] = {mat->textures[MIX_MAT2], weight * mix_val};
-            } else if (mat->type == eShadingNode::Transparent) {
-                throughput += weight * make_fvec3(mat->base_color);
+            rc *= throughput;
+            if (lum(rc) < FLT_EPS) {
+                break;
+            }
+
+            rand_dim += RAND_DIM_BOUNCE_COUNT;
+            if (++depth > max_transp_depth) {
+                rc = 0.0f;
+                break;
             }
         }
 
-        rc *= throughput;
-        if (lum(rc) < FLT_EPS) {
+        if (restart_t < 0.0f || lum(rc) < FLT_EPS) {
             break;
         }
 
-        const float t = inter.t + HIT_BIAS;
-        ro += rd * t;
-        dist -= t;
-
-        ++depth;
-        rand_dim += RAND_DIM_BOUNCE_COUNT;
+        // there may be more surfaces behind the list, continue strictly after the last processed one
+        t_min = restart_t;
     }
 
     return rc;
@@ -3082,9 +3093,12 @@ void Ray::Ref::SampleLightSource(const fvec4 &P, const fvec4 &T, const fvec4 &B,
                        &v2 = sc.vertices[sc.vtx_indices[ltri_index * 3 + 1]],
                        &v3 = sc.vertices[sc.vtx_indices[ltri_index * 3 + 2]];
 
-        const fvec4 p1 = TransformPoint(fvec4(v1.p[0], v1.p[1], v1.p[2], 0.0f), lmi.xform),
-                    p2 = TransformPoint(fvec4(v2.p[0], v2.p[1], v2.p[2], 0.0f), lmi.xform),
-                    p3 = TransformPoint(fvec4(v3.p[0], v3.p[1], v3.p[2], 0.0f), lmi.xform);
+        float lxform[12];
+        InverseAffineMatrix(lmi.inv_xform, lxform);
+
+        const fvec4 p1 = TransformPoint(fvec4(v1.p[0], v1.p[1], v1.p[2], 0.0f), lxform),
+                    p2 = TransformPoint(fvec4(v2.p[0], v2.p[1], v2.p[2], 0.0f), lxform),
+                    p3 = TransformPoint(fvec4(v3.p[0], v3.p[1], v3.p[2], 0.0f), lxform);
         const fvec2 uv1 = fvec2(v1.t), uv2 = fvec2(v2.t), uv3 = fvec2(v3.t);
 
         const fvec4 e1 = p2 - p1, e2 = p3 - p1;
@@ -4422,31 +4436,142 @@ void Ray::Ref::TraceRays(Span<ray_data_t> rays, int min_transp_depth, int max_tr
     }
 }
 
+bool Ray::Ref::RasterizePrimaryHits(const camera_t &cam, const rect_t &r, const int w, const int h,
+                                    const int min_transp_depth, const int max_transp_depth, const scene_data_t &sc,
+                                    const uint32_t node_index, Span<const uint32_t> mi_indices,
+                                    const Cpu::TexStorageBase *const textures[], const uint32_t rand_seq[],
+                                    const uint32_t random_seed, const int iteration, raster_scratch_t &scratch,
+                                    Span<ray_data_t> rays, Span<hit_data_t> out_inter) {
+    raster_cam_t rc;
+    if (!sc.wnodes || !InitRasterCamera(cam, w, h, rc)) {
+        return false;
+    }
+
+    std::vector<int> &px_rays = scratch.px_rays;
+    px_rays.assign(size_t(r.w) * r.h, -1);
+    scratch.hits.resize(rays.size());
+    scratch.rays.resize(6 * rays.size());
+    for (int i = 0; i < int(rays.size()); ++i) {
+        const int x = int(rays[i].xy >> 16), y = int(rays[i].xy & 0x0000ffff);
+        px_rays[(y - r.y) * r.w + (x - r.x)] = i;
+        scratch.hits[i] = {-1, -1, out_inter[i].t, 0.0f, -1.0f};
+        memcpy(&scratch.rays[6 * i + 0], rays[i].o, 3 * sizeof(float));
+        memcpy(&scratch.rays[6 * i + 3], rays[i].d, 3 * sizeof(float));
+    }
+
+    RasterizeTriGroups(rc, r, sc, node_index, mi_indices, IntersectRasterTri, scratch);
+
+    for (int i = 0; i < int(rays.size()); ++i) {
+        const raster_hit_t &hit = scratch.hits[i];
+        if (hit.v < 0.0f) {
+            // initial values already mean 'no intersection'
+            continue;
+        }
+
+        const bool is_backfacing = (hit.prim_index < 0);
+        const uint32_t tri_index = sc.tri_indices[is_backfacing ? -hit.prim_index - 1 : hit.prim_index];
+
+        if (is_solid_tri_side(is_backfacing ? sc.tri_materials[tri_index].back_mi
+                                            : sc.tri_materials[tri_index].front_mi)) {
+            hit_data_t &inter = out_inter[i];
+            inter.obj_index = hit.obj_index;
+            inter.prim_index = is_backfacing ? -int(tri_index) - 1 : int(tri_index);
+            inter.t = hit.t;
+            inter.u = hit.u;
+            inter.v = hit.v;
+        } else {
+            // transparency (and everything behind it) is resolved by regular traversal
+            IntersectScene(Span<ray_data_t>{&rays[i], 1}, min_transp_depth, max_transp_depth, rand_seq, random_seed,
+                           iteration, sc, node_index, textures, Span<hit_data_t>{&out_inter[i], 1});
+        }
+    }
+
+    return true;
+}
+
+int Ray::Ref::FetchCachedPrimaryHits(Span<ray_data_t> rays, Span<hit_data_t> out_inter, const cached_hit_t cache[],
+                                     const int w, const uint32_t epoch) {
+    int traced_count = 0;
+    for (int i = 0; i < int(rays.size()); ++i) {
+        const uint32_t xy = rays[i].xy;
+        const cached_hit_t &entry = cache[(xy & 0x0000ffff) * w + (xy >> 16)];
+        if (entry.epoch == epoch) {
+            out_inter[i].obj_index = entry.obj_index;
+            out_inter[i].prim_index = entry.prim_index;
+            out_inter[i].t = entry.t;
+            out_inter[i].u = entry.u;
+            out_inter[i].v = entry.v;
+        } else {
+            std::swap(rays[traced_count], rays[i]);
+            std::swap(out_inter[traced_count], out_inter[i]);
+            ++traced_count;
+        }
+    }
+    return traced_count;
+}
+
+void Ray::Ref::StorePrimaryHits(Span<const ray_data_t> rays, Span<const hit_data_t> inters, const scene_data_t &sc,
+                                const uint32_t epoch, const int w, cached_hit_t cache[]) {
+    for (int i = 0; i < int(rays.size()); ++i) {
+        const ray_data_t &r = rays[i];
+        const hit_data_t &inter = inters[i];
+        if (get_transp_depth(r.depth) != 0) {
+            continue;
+        }
+        if (inter.v >= 0.0f) {
+            const bool is_backfacing = (inter.prim_index < 0);
+            const uint32_t tri_index = is_backfacing ? -inter.prim_index - 1 : inter.prim_index;
+            if (!is_solid_tri_side(is_backfacing ? sc.tri_materials[tri_index].back_mi
+                                                 : sc.tri_materials[tri_index].front_mi)) {
+                continue;
+            }
+        }
+        cache[(r.xy & 0x0000ffff) * w + (r.xy >> 16)] = {epoch, inter.obj_index, inter.prim_index, inter.t, inter.u,
+                                                         inter.v};
+    }
+}
+
 void Ray::Ref::TraceShadowRays(Span<const shadow_ray_t> rays, int max_transp_depth, float _clamp_val,
                                const scene_data_t &sc, uint32_t node_index, const uint32_t rand_seq[],
                                const uint32_t rand_seed, const int iteration,
                                const Cpu::TexStorageBase *const textures[], const int img_w, color_rgba_t *out_color) {
     const float limit = (_clamp_val != 0.0f) ? 3.0f * _clamp_val : FLT_MAX;
-    for (int i = 0; i < int(rays.size()); ++i) {
-        const shadow_ray_t &sh_r = rays[i];
 
-        const int x = (sh_r.xy >> 16) & 0x0000ffff;
-        const int y = sh_r.xy & 0x0000ffff;
+    // Blocking area lights are tested for whole batch first (light tree stays in cache), rays that are blocked
+    // completely do not need to traverse the scene
+    const int BatchSize = 64;
+    float light_visibility[BatchSize];
 
-        fvec4 rc = IntersectScene(sh_r, max_transp_depth, sc, node_index, rand_seq, rand_seed, iteration, textures);
-        if (sc.blocker_lights_count) {
-            rc *= IntersectAreaLights(sh_r, sc.lights, sc.light_cwnodes);
+    for (int batch_start = 0; batch_start < int(rays.size()); batch_start += BatchSize) {
+        const int batch_end = std::min(batch_start + BatchSize, int(rays.size()));
+        for (int i = batch_start; i < batch_end; ++i) {
+            light_visibility[i - batch_start] =
+                sc.blocker_lights_count ? IntersectAreaLights(rays[i], sc.lights, sc.light_cwnodes) : 1.0f;
         }
-        rc.set<3>(0.0f);
 
-        const float sum = hsum(rc);
-        if (sum > limit) {
-            rc *= (limit / sum);
-        }
+        for (int i = batch_start; i < batch_end; ++i) {
+            const shadow_ray_t &sh_r = rays[i];
+            const float k = light_visibility[i - batch_start];
+            if (k == 0.0f) {
+                continue;
+            }
 
-        auto old_val = fvec4{out_color[y * img_w + x].v, vector_aligned};
-        old_val += rc;
-        old_val.store_to(out_color[y * img_w + x].v, vector_aligned);
+            const int x = (sh_r.xy >> 16) & 0x0000ffff;
+            const int y = sh_r.xy & 0x0000ffff;
+
+            fvec4 rc = IntersectScene(sh_r, max_transp_depth, sc, node_index, rand_seq, rand_seed, iteration, textures);
+            rc *= k;
+            rc.set<3>(0.0f);
+
+            const float sum = hsum(rc);
+            if (sum > limit) {
+                rc *= (limit / sum);
+            }
+
+            auto old_val = fvec4{out_color[y * img_w + x].v, vector_aligned};
+            old_val += rc;
+            old_val.store_to(out_color[y * img_w + x].v, vector_aligned);
+        }
     }
 }
 
@@ -309,34 +309,42 @@ float SampleSphericalRectangle(const fvec4 &P, const fvec4 &light_pos, const fve
 float SampleSphericalTriangle(const fvec4 &P, const fvec4 &p1, const fvec4 &p2, const fvec4 &p3, const fvec2 Xi,
                               fvec4 *out_dir);
 
-// Generation of rays
-void GeneratePrimaryRays(const camera_t &cam, const rect_t &r, int w, int h, const uint32_t rand_seq[],
-                         uint32_t rand_seed, const float filter_table[], int iteration,
-                         const uint16_t required_samples[], aligned_vector<ray_data_t> &out_rays,
-                         aligned_vector<hit_data_t> &out_inters);
-void SampleMeshInTextureSpace(int iteration, int obj_index, int uv_layer, const mesh_t &mesh, const mesh_instance_t &mi,
-                              const uint32_t *vtx_indices, const vertex_t *vertices, const rect_t &r, int w, int h,
-                              const uint32_t rand_seq[], aligned_vector<ray_data_t> &out_rays,
-                              aligned_vector<hit_data_t> &out_inters);
+// Generation of rays (returns number of pixels that got a ray)
+int GeneratePrimaryRays(const camera_t &cam, const rect_t &r, int w, int h, const uint32_t rand_seq[],
+                        uint32_t rand_seed, const float filter_table[], int iteration,
+                        const uint16_t required_samples[], aligned_vector<ray_data_t> &out_rays,
+                        aligned_vector<hit_data_t> &out_inters);
+// Finds triangle (and barycentrics) that covers each texel of rectangle 'r' (UV range [0, 1] is mapped to it),
+// texels that are already covered are left untouched, done once per geometry camera setup
+void RasterizeMeshUVs(const mesh_t &mesh, uint32_t mi_index, int uv_layer, const uint32_t *vtx_indices,
+                      const vertex_data_t &vertices, const rect_t &r, int width, texel_sample_t texels[]);
+// Gathers covered texels of w x h image into texel map
+void CompactTexelMap(const texel_sample_t texels[], int width, int height, texel_map_t &out_map);
+// Returns number of sampled texels
+int SampleMeshInTextureSpace(int iteration, const mesh_instance_t *mesh_instances, const uint32_t *vtx_indices,
+                             const vertex_data_t &vertices, const texel_map_t &texel_map, const rect_t &r,
+                             const uint32_t rand_seq[], const uint16_t required_samples[],
+                             aligned_vector<ray_data_t> &out_rays, aligned_vector<hit_data_t> &out_inters);
 
 // Sorting of rays
-int SortRays_CPU(Span<ray_data_t> rays, const float root_min[3], const float cell_size[3], uint32_t *hash_values,
-                 uint32_t *scan_values, ray_chunk_t *chunks, ray_chunk_t *chunks_temp);
+int SortRays_CPU(Span<ray_data_t> rays, const float root_min[3], const float cell_size[3], int origin_bits, int dir_bits,
+                 uint32_t *hash_values, uint32_t *scan_values, ray_chunk_t *chunks, ray_chunk_t *chunks_temp);
 int SortRays_GPU(Span<ray_data_t> rays, const float root_min[3], const float cell_size[3], uint32_t *hash_values,
                  int *head_flags, uint32_t *scan_values, ray_chunk_t *chunks, ray_chunk_t *chunks_temp,
                  uint32_t *skeleton);
+// Reordering of shadow rays by direction and origin (for coherent memory access during traversal)
+int SortShadowRays(Span<shadow_ray_t> rays, const float root_min[3], const float cell_size[3],
+                   std::vector<uint64_t> &temp_keys, aligned_vector<shadow_ray_t> &temp_rays);
 
 // Intersect primitives
 bool IntersectTris_ClosestHit(const float ro[3], const float rd[3], const tri_accel_t *tris, int tri_start, int tri_end,
                               int obj_index, hit_data_t &out_inter);
 bool IntersectTris_ClosestHit(const float ro[3], const float rd[3], const mtri_accel_t *mtris, int tri_start,
                               int tri_end, int obj_index, hit_data_t &out_inter);
+// collects non-opaque hits, returns whether solid hit was found
 bool IntersectTris_AnyHit(const float ro[3], const float rd[3], const tri_accel_t *tris,
                           const tri_mat_data_t *materials, const uint32_t *indices, int tri_start, int tri_end,
-                          int obj_index, hit_data_t &out_inter);
-bool IntersectTris_AnyHit(const float ro[3], const float rd[3], const mtri_accel_t *mtris,
-                          const tri_mat_data_t *materials, const uint32_t *indices, int tri_start, int tri_end,
-                          int obj_index, hit_data_t &out_inter);
+                          int obj_index, shadow_hits_t &out_hits);
 
 // traditional bvh traversal with stack for outer nodes
 bool Traverse_TLAS_WithStack_ClosestHit(const float ro[3], const float rd[3], uint32_t ray_flags,
@@ -349,15 +357,15 @@ bool Traverse_TLAS_WithStack_ClosestHit(const float ro[3], const float rd[3], ui
                                         const mesh_instance_t *mesh_instances, const uint32_t *mi_indices,
                                         const mesh_t *meshes, const mtri_accel_t *mtris, const uint32_t *tri_indices,
                                         hit_data_t &inter);
-// returns whether hit was solid
+// returns whether hit was solid (closest non-opaque hits are collected otherwise)
 bool Traverse_TLAS_WithStack_AnyHit(const float ro[3], const float rd[3], int ray_type, const bvh_node_t *nodes,
                                     uint32_t root_index, const mesh_instance_t *mesh_instances,
-                                    const uint32_t *mi_indices, const mesh_t *meshes, const mtri_accel_t *mtris,
-                                    const tri_mat_data_t *materials, const uint32_t *tri_indices, hit_data_t &inter);
+                                    const uint32_t *mi_indices, const mesh_t *meshes, const tri_accel_t *tris,
+                                    const tri_mat_data_t *materials, const uint32_t *tri_indices, shadow_hits_t &hits);
 bool Traverse_TLAS_WithStack_AnyHit(const float ro[3], const float rd[3], int ray_type, const wbvh_node_t *nodes,
                                     uint32_t root_index, const mesh_instance_t *mesh_instances,
                                     const uint32_t *mi_indices, const mesh_t *meshes, const tri_accel_t *tris,
-                                    const tri_mat_data_t *materials, const uint32_t *tri_indices, hit_data_t &inter);
+                                    const tri_mat_data_t *materials, const uint32_t *tri_indices, shadow_hits_t &hits);
 // traditional bvh traversal with stack for inner nodes
 bool Traverse_BLAS_WithStack_ClosestHit(const float ro[3], const float rd[3], const float inv_d[3],
                                         const bvh_node_t *nodes, uint32_t root_index, const tri_accel_t *tris,
@@ -367,18 +375,21 @@ bool Traverse_BLAS_WithStack_ClosestHit(const float ro[3], const float rd[3], co
                                         int obj_index, hit_data_t &inter);
 // returns whether hit was solid
 bool Traverse_BLAS_WithStack_AnyHit(const float ro[3], const float rd[3], const float inv_d[3], const bvh_node_t *nodes,
-                                    uint32_t root_index, const mtri_accel_t *mtris, const tri_mat_data_t *materials,
-                                    const uint32_t *tri_indices, int obj_index, hit_data_t &inter);
+                                    uint32_t root_index, const tri_accel_t *tris, const tri_mat_data_t *materials,
+                                    const uint32_t *tri_indices, int obj_index, shadow_hits_t &hits);
 bool Traverse_BLAS_WithStack_AnyHit(const float ro[3], const float rd[3], const float inv_d[3],
                                     const wbvh_node_t *nodes, uint32_t root_index, const tri_accel_t *tris,
                                     const tri_mat_data_t *materials, const uint32_t *tri_indices, int obj_index,
-                                    hit_data_t &inter);
+                                    shadow_hits_t &hits);
 
-// Transform
+// Transform (matrices are 3x4 affine, see mesh_instance_t)
 void TransformRay(const float ro[3], const float rd[3], const float *xform, float out_ro[3], float out_rd[3]);
 fvec4 TransformPoint(const fvec4 &p, const float *xform);
 fvec4 TransformDirection(const fvec4 &p, const float *xform);
 fvec4 TransformNormal(const fvec4 &n, const float *inv_xform);
+// Same with column-major 4x4 matrix (as passed through public API)
+fvec4 TransformPoint4x4(const fvec4 &p, const float *xform);
+fvec4 TransformDirection4x4(const fvec4 &p, const float *xform);
 
 force_inline float lum(const fvec3 &color) {
     return 0.212671f * color.get<0>() + 0.715160f * color.get<1>() + 0.072169f * color.get<2>();
@@ -497,6 +508,24 @@ void TraceRays(Span<ray_data_t> rays, int min_transp_depth, int max_transp_depth
 void TraceShadowRays(Span<const shadow_ray_t> rays, int max_transp_depth, float clamp_val, const scene_data_t &sc,
                      uint32_t node_index, const uint32_t rand_seq[], uint32_t random_seed, int iteration,
                      const Cpu::TexStorageBase *const textures[], int img_w, color_rgba_t *out_color);
+// Replacement of TraceRays for primary rays of pinhole camera: triangle groups of camera-visible instances are
+// rasterized into pixels of region and only samples that fall inside of group bounds are intersected with it.
+// Instances are culled with TLAS and processed front-to-back, instances and groups that lie behind already found
+// hits of all covered tiles are skipped. Rays that hit non-solid surface are traced as usual, false is returned if
+// camera can not be rasterized
+bool RasterizePrimaryHits(const camera_t &cam, const rect_t &r, int w, int h, int min_transp_depth,
+                          int max_transp_depth, const scene_data_t &sc, uint32_t node_index,
+                          Span<const uint32_t> mi_indices, const Cpu::TexStorageBase *const textures[],
+                          const uint32_t rand_seq[], uint32_t random_seed, int iteration, raster_scratch_t &scratch,
+                          Span<ray_data_t> rays, Span<hit_data_t> out_inter);
+// Copies valid cached hits of primary rays (cache rows are 'w' entries long), rays that still have to be traced are
+// moved to the front (together with their hits), returns their count
+int FetchCachedPrimaryHits(Span<ray_data_t> rays, Span<hit_data_t> out_inter, const cached_hit_t cache[], int w,
+                           uint32_t epoch);
+// Stores traced primary hits that can be reused after material change (ray did not pass through transparent
+// surface and either missed or hit solid one)
+void StorePrimaryHits(Span<const ray_data_t> rays, Span<const hit_data_t> inters, const scene_data_t &sc,
+                      uint32_t epoch, int w, cached_hit_t cache[]);
 
 // Get environment color at direction
 fvec4 Evaluate_EnvColor(const ray_data_t &ray, const environment_t &env, const Cpu::TexStorageRGBA &tex_storage,
@@ -4,6 +4,7 @@
 //  Macros 'USE_XXX' define template instantiation of simd_vec classes.
 //  Template parameter S defines width of vectors used. Usualy it is equal to ray packet size.
 
+#include <algorithm>
 #include <array>
 #include <vector>
 
@@ -154,26 +155,39 @@ template <int S> force_inline ivec<S> is_indirect(const uvec<S> &depth) {
     return ivec<S>((depth & 0x001fffff) != 0u);
 }
 
-// Generating rays
+// Generating rays (returns number of active lanes)
 template <int DimX, int DimY>
-void GeneratePrimaryRays(const camera_t &cam, const rect_t &r, int w, int h, const uint32_t rand_seq[],
-                         uint32_t rand_seed, const float filter_table[], int iteration,
-                         const uint16_t required_samples[], aligned_vector<ray_data_t<DimX * DimY>> &out_rays,
-                         aligned_vector<hit_data_t<DimX * DimY>> &out_inters);
+int GeneratePrimaryRays(const camera_t &cam, const rect_t &r, int w, int h, const uint32_t rand_seq[],
+                        uint32_t rand_seed, const float filter_table[], int iteration,
+                        const uint16_t required_samples[], aligned_vector<ray_data_t<DimX * DimY>> &out_rays,
+                        aligned_vector<hit_data_t<DimX * DimY>> &out_inters);
 template <int DimX, int DimY>
-void SampleMeshInTextureSpace(int iteration, int obj_index, int uv_layer, const mesh_t &mesh, const mesh_instance_t &mi,
-                              const uint32_t *vtx_indices, const vertex_t *vertices, const rect_t &r, int w, int h,
-                              const uint32_t rand_seq[], aligned_vector<ray_data_t<DimX * DimY>> &out_rays,
-                              aligned_vector<hit_data_t<DimX * DimY>> &out_inters);
+int SampleMeshInTextureSpace(int iteration, const mesh_instance_t *mesh_instances, const uint32_t *vtx_indices,
+                             const vertex_data_t &vertices, const texel_map_t &texel_map, const rect_t &r,
+                             const uint32_t rand_seq[], const uint16_t required_samples[],
+                             aligned_vector<ray_data_t<DimX * DimY>> &out_rays,
+                             aligned_vector<hit_data_t<DimX * DimY>> &out_inters);
 
 // Sorting rays
 template <int S>
-int SortRays_CPU(Span<ray_data_t<S>> rays, const float root_min[3], const float cell_size[3], ivec<S> *hash_values,
-                 uint32_t *scan_values, ray_chunk_t *chunks, ray_chunk_t *chunks_temp);
+int SortRays_CPU(Span<ray_data_t<S>> rays, const float root_min[3], const float cell_size[3], int origin_bits,
+                 int dir_bits, ivec<S> *hash_values, uint32_t *scan_values, ray_chunk_t *chunks,
+                 ray_chunk_t *chunks_temp);
 template <int S>
 int SortRays_GPU(Span<ray_data_t<S>> rays, const float root_min[3], const float cell_size[3], ivec<S> *hash_values,
                  int *head_flags, uint32_t *scan_values, ray_chunk_t *chunks, ray_chunk_t *chunks_temp,
                  uint32_t *skeleton);
+// Repacking rays by material (ray packets with same material are shaded together)
+template <int S>
+int SortHitsByMaterial(Span<ray_data_t<S>> rays, Span<hit_data_t<S>> inters, const scene_data_t &sc,
+                       std::vector<uint64_t> &temp_keys, aligned_vector<ray_data_t<S>> &temp_rays,
+                       aligned_vector<hit_data_t<S>> &temp_inters);
+template <int S>
+int CountPacketMaterials(Span<const ray_data_t<S>> rays, Span<const hit_data_t<S>> inters, const scene_data_t &sc);
+// Repacking of shadow rays by direction and origin (also compacts partially filled packets)
+template <int S>
+int SortShadowRays(Span<shadow_ray_t<S>> rays, const float root_min[3], const float cell_size[3],
+                   std::vector<uint64_t> &temp_keys, aligned_vector<shadow_ray_t<S>> &temp_rays);
 
 // Intersect primitives
 template <int S>
@@ -199,10 +213,11 @@ template <int S>
 bool IntersectTris_AnyHit(const float o[3], const float d[3], int i, const tri_accel_t *tris,
                           const tri_mat_data_t *materials, const uint32_t *indices, int tri_start, int tri_end,
                           int obj_index, hit_data_t<S> &out_inter);
+// collects non-opaque hits, returns whether solid hit was found
 template <int S>
 bool IntersectTris_AnyHit(const float o[3], const float d[3], const mtri_accel_t *mtris,
                           const tri_mat_data_t *materials, const uint32_t *indices, int tri_start, int tri_end,
-                          int &inter_prim_index, float &inter_t, float &inter_u, float &inter_v);
+                          int obj_index, shadow_hits_t &out_hits);
 
 // Traverse acceleration structure
 template <int S>
@@ -223,12 +238,13 @@ ivec<S> Traverse_TLAS_WithStack_AnyHit(const fvec<S> ro[3], const fvec<S> rd[3],
                                        const mesh_instance_t *mesh_instances, const uint32_t *mi_indices,
                                        const mesh_t *meshes, const tri_accel_t *tris, const tri_mat_data_t *materials,
                                        const uint32_t *tri_indices, hit_data_t<S> &inter);
+// rays are traversed one by one, closest non-opaque hits of each ray are collected into out_hits
 template <int S>
 ivec<S> Traverse_TLAS_WithStack_AnyHit(const fvec<S> ro[3], const fvec<S> rd[3], int ray_type, const ivec<S> &ray_mask,
                                        const wbvh_node_t *nodes, uint32_t node_index,
                                        const mesh_instance_t *mesh_instances, const uint32_t *mi_indices,
                                        const mesh_t *meshes, const mtri_accel_t *mtris, const tri_mat_data_t *materials,
-                                       const uint32_t *tri_indices, hit_data_t<S> &inter);
+                                       const uint32_t *tri_indices, shadow_hits_t out_hits[S]);
 // traditional bvh traversal with stack for inner nodes
 template <int S>
 bool Traverse_BLAS_WithStack_ClosestHit(const fvec<S> ro[3], const fvec<S> rd[3], const ivec<S> &ray_mask,
@@ -244,11 +260,11 @@ ivec<S> Traverse_BLAS_WithStack_AnyHit(const fvec<S> ro[3], const fvec<S> rd[3],
                                        const bvh_node_t *nodes, uint32_t node_index, const tri_accel_t *tris,
                                        const tri_mat_data_t *materials, const uint32_t *tri_indices, int obj_index,
                                        hit_data_t<S> &inter);
+// returns whether solid hit was found
 template <int S>
-int Traverse_BLAS_WithStack_AnyHit(const float ro[3], const float rd[3], const wbvh_node_t *nodes, uint32_t node_index,
-                                   const mtri_accel_t *mtris, const tri_mat_data_t *materials,
-                                   const uint32_t *tri_indices, int &inter_prim_index, float &inter_t, float &inter_u,
-                                   float &inter_v);
+bool Traverse_BLAS_WithStack_AnyHit(const float ro[3], const float rd[3], const wbvh_node_t *nodes, uint32_t node_index,
+                                    const mtri_accel_t *mtris, const tri_mat_data_t *materials,
+                                    const uint32_t *tri_indices, int obj_index, shadow_hits_t &hits);
 
 // BRDFs
 template <int S>
@@ -309,15 +325,15 @@ template <int S>
 void Sample_EnvQTree(float y_rotation, const fvec4 *const *qtree_mips, int qtree_levels, const fvec<S> &rand,
                      const fvec<S> &rx, const fvec<S> &ry, fvec<S> out_V[4]);
 
-// Transform
+// Transform (matrices are 3x4 affine, see mesh_instance_t)
 template <int S>
 void TransformRay(const fvec<S> ro[3], const fvec<S> rd[3], const float *xform, fvec<S> out_ro[3], fvec<S> out_rd[3]);
 template <int S> void TransformPoint(const fvec<S> p[3], const float *xform, fvec<S> out_p[3]);
-template <int S> void TransformPoint(const fvec<S> xform[16], fvec<S> out_p[3]);
-template <int S> void TransformDirection(const fvec<S> xform[16], fvec<S> p[3]);
+template <int S> void TransformPoint(const fvec<S> xform[12], fvec<S> out_p[3]);
+template <int S> void TransformDirection(const fvec<S> xform[12], fvec<S> p[3]);
 template <int S> void TransformNormal(const fvec<S> n[3], const float *inv_xform, fvec<S> out_n[3]);
-template <int S> void TransformNormal(const fvec<S> n[3], const fvec<S> inv_xform[16], fvec<S> out_n[3]);
-template <int S> void TransformNormal(const fvec<S> inv_xform[16], fvec<S> inout_n[3]);
+template <int S> void TransformNormal(const fvec<S> n[3], const fvec<S> inv_xform[12], fvec<S> out_n[3]);
+template <int S> void TransformNormal(const fvec<S> inv_xform[12], fvec<S> inout_n[3]);
 
 void TransformRay(const float ro[3], const float rd[3], const float *xform, float out_ro[3], float out_rd[3]);
 
@@ -376,6 +392,23 @@ template <int S>
 void TraceShadowRays(Span<const shadow_ray_t<S>> rays, int max_transp_depth, float clamp_val, const scene_data_t &sc,
                      uint32_t root_index, const uint32_t rand_seq[], uint32_t random_seed, int iteration,
                      const Cpu::TexStorageBase *const textures[], int img_w, color_rgba_t *out_color);
+// Primary hits of pinhole camera are found with rasterization of triangle groups (see Ref::RasterizePrimaryHits)
+template <int S>
+bool RasterizePrimaryHits(const camera_t &cam, const rect_t &r, int w, int h, int min_transp_depth,
+                          int max_transp_depth, const scene_data_t &sc, uint32_t root_index,
+                          Span<const uint32_t> mi_indices, const Cpu::TexStorageBase *const textures[],
+                          const uint32_t rand_seq[], uint32_t random_seed, int iteration, raster_scratch_t &scratch,
+                          Span<ray_data_t<S>> rays, Span<hit_data_t<S>> out_inter);
+// Lanes with valid cached hit are masked out (their bits are written to 'cached_lanes'), packets with active lanes
+// left are moved to the front, returns their count
+template <int S>
+int FetchCachedPrimaryHits(Span<ray_data_t<S>> rays, Span<hit_data_t<S>> out_inter, const cached_hit_t cache[], int w,
+                           uint32_t epoch, std::vector<uint32_t> &cached_lanes);
+// Stores cacheable hits of first 'traced_count' packets and restores masks of all of them
+template <int S>
+void StorePrimaryHits(Span<ray_data_t<S>> rays, Span<const hit_data_t<S>> inters, int traced_count,
+                      const std::vector<uint32_t> &cached_lanes, const scene_data_t &sc, uint32_t epoch, int w,
+                      cached_hit_t cache[]);
 
 // Get environment collor at direction
 template <int S>
@@ -500,6 +533,16 @@ template <int S>
 void ShadeSky(const pass_settings_t &ps, float limit, Span<const hit_data_t<S>> inters, Span<const ray_data_t<S>> rays,
               Span<const uint32_t> ray_indices, const scene_data_t &sc, int iteration, int img_w,
               color_rgba_t *out_color);
+template <int S>
+void IntegrateScattering(const atmosphere_params_t &params, const fvec<S> ray_start[3], const fvec<S> ray_dir[3],
+                         float ray_length, const float light_dir[3], float light_angle, const float light_color[3],
+                         Span<const float> transmittance_lut, Span<const float> multiscatter_lut, uvec<S> rand_hash,
+                         ivec<S> mask, fvec<S> out_radiance[3]);
+template <int S>
+void IntegrateSkyRow(const atmosphere_params_t &params, Span<const float> transmittance_lut,
+                     Span<const float> multiscatter_lut, const float light_dir[3], float light_angle,
+                     const float light_col[3], int y, float cos_theta, float sin_theta, Span<const float> cos_phi,
+                     Span<const float> sin_phi, float inout_color[]);
 
 // Radiance caching
 template <int S>
@@ -533,24 +576,28 @@ class SIMDPolicyBase {
     using HitDataType = hit_data_t<RPSize>;
     using RayHashType = ivec<RPSize>;
 
-  protected:
-    static force_inline void GeneratePrimaryRays(const camera_t &cam, const rect_t &r, const int w, const int h,
-                                                 const uint32_t rand_seq[], const uint32_t rand_seed,
-                                                 const float filter_table[], const int iteration,
-                                                 const uint16_t required_samples[],
-                                                 aligned_vector<RayDataType> &out_rays,
-                                                 aligned_vector<HitDataType> &out_inters) {
-        NS::GeneratePrimaryRays<RPDimX, RPDimY>(cam, r, w, h, rand_seq, rand_seed, filter_table, iteration,
-                                                required_samples, out_rays, out_inters);
-    }
+    static const int RayPacketDimX = RPDimX, RayPacketDimY = RPDimY;
 
-    static force_inline void SampleMeshInTextureSpace(int iteration, int obj_index, int uv_layer, const mesh_t &mesh,
-                                                      const mesh_instance_t &mi, const uint32_t *vtx_indices,
-                                                      const vertex_t *vertices, const rect_t &r, int w, int h,
-                                                      const uint32_t rand_seq[], aligned_vector<RayDataType> &out_rays,
-                                                      aligned_vector<HitDataType> &out_inters) {
-        NS::SampleMeshInTextureSpace<RPDimX, RPDimY>(iteration, obj_index, uv_layer, mesh, mi, vtx_indices, vertices, r,
-                                                     w, h, rand_seq, out_rays, out_inters);
+  protected:
+    static force_inline int GeneratePrimaryRays(const camera_t &cam, const rect_t &r, const int w, const int h,
+                                                const uint32_t rand_seq[], const uint32_t rand_seed,
+                                                const float filter_table[], const int iteration,
+                                                const uint16_t required_samples[],
+                                                aligned_vector<RayDataType> &out_rays,
+                                                aligned_vector<HitDataType> &out_inters) {
+        return NS::GeneratePrimaryRays<RPDimX, RPDimY>(cam, r, w, h, rand_seq, rand_seed, filter_table, iteration,
+                                                       required_samples, out_rays, out_inters);
+    }
+
+    static force_inline int SampleMeshInTextureSpace(int iteration, const mesh_instance_t *mesh_instances,
+                                                     const uint32_t *vtx_indices, const vertex_data_t &vertices,
+                                                     const texel_map_t &texel_map, const rect_t &r,
+                                                     const uint32_t rand_seq[], const uint16_t required_samples[],
+                                                     aligned_vector<RayDataType> &out_rays,
+                                                     aligned_vector<HitDataType> &out_inters) {
+        return NS::SampleMeshInTextureSpace<RPDimX, RPDimY>(iteration, mesh_instances, vtx_indices, vertices,
+                                                            texel_map, r, rand_seq, required_samples, out_rays,
+                                                            out_inters);
     }
 
     static force_inline void TraceRays(Span<RayDataType> rays, int min_transp_depth, int max_transp_depth,
@@ -561,6 +608,31 @@ class SIMDPolicyBase {
                               rand_seq, rand_seed, iteration, out_inter);
     }
 
+    static force_inline bool RasterizePrimaryHits(const camera_t &cam, const rect_t &r, const int w, const int h,
+                                                  int min_transp_depth, int max_transp_depth, const scene_data_t &sc,
+                                                  uint32_t root_index, Span<const uint32_t> mi_indices,
+                                                  const Cpu::TexStorageBase *const textures[],
+                                                  const uint32_t rand_seq[], const uint32_t rand_seed,
+                                                  const int iteration, raster_scratch_t &scratch,
+                                                  Span<RayDataType> rays, Span<HitDataType> out_inter) {
+        return NS::RasterizePrimaryHits<RPSize>(cam, r, w, h, min_transp_depth, max_transp_depth, sc, root_index,
+                                                mi_indices, textures, rand_seq, rand_seed, iteration, scratch, rays,
+                                                out_inter);
+    }
+
+    static force_inline int FetchCachedPrimaryHits(Span<RayDataType> rays, Span<HitDataType> out_inter,
+                                                   const cached_hit_t cache[], const int w, const uint32_t epoch,
+                                                   std::vector<uint32_t> &cached_lanes) {
+        return NS::FetchCachedPrimaryHits<RPSize>(rays, out_inter, cache, w, epoch, cached_lanes);
+    }
+
+    static force_inline void StorePrimaryHits(Span<RayDataType> rays, Span<const HitDataType> inters,
+                                              const int traced_count, const std::vector<uint32_t> &cached_lanes,
+                                              const scene_data_t &sc, const uint32_t epoch, const int w,
+                                              cached_hit_t cache[]) {
+        NS::StorePrimaryHits<RPSize>(rays, inters, traced_count, cached_lanes, sc, epoch, w, cache);
+    }
+
     static force_inline void TraceShadowRays(Span<const ShadowRayType> rays, int max_transp_depth, float clamp_val,
                                              const scene_data_t &sc, uint32_t node_index, const uint32_t rand_seq[],
                                              const uint32_t rand_seed, const int iteration,
@@ -571,9 +643,28 @@ class SIMDPolicyBase {
     }
 
     static force_inline int SortRays_CPU(Span<RayDataType> rays, const float root_min[3], const float cell_size[3],
-                                         RayHashType *hash_values, uint32_t *scan_values, ray_chunk_t *chunks,
-                                         ray_chunk_t *chunks_temp) {
-        return NS::SortRays_CPU<RPSize>(rays, root_min, cell_size, hash_values, scan_values, chunks, chunks_temp);
+                                         const int origin_bits, const int dir_bits, RayHashType *hash_values,
+                                         uint32_t *scan_values, ray_chunk_t *chunks, ray_chunk_t *chunks_temp) {
+        return NS::SortRays_CPU<RPSize>(rays, root_min, cell_size, origin_bits, dir_bits, hash_values, scan_values,
+                                        chunks, chunks_temp);
+    }
+
+    static force_inline int SortHitsByMaterial(Span<RayDataType> rays, Span<HitDataType> inters,
+                                               const scene_data_t &sc, std::vector<uint64_t> &temp_keys,
+                                               aligned_vector<RayDataType> &temp_rays,
+                                               aligned_vector<HitDataType> &temp_inters) {
+        return NS::SortHitsByMaterial<RPSize>(rays, inters, sc, temp_keys, temp_rays, temp_inters);
+    }
+
+    static force_inline int CountPacketMaterials(Span<const RayDataType> rays, Span<const HitDataType> inters,
+                                                 const scene_data_t &sc) {
+        return NS::CountPacketMaterials<RPSize>(rays, inters, sc);
+    }
+
+    static force_inline int SortShadowRays(Span<ShadowRayType> rays, const float root_min[3], const float cell_size[3],
+                                           std::vector<uint64_t> &temp_keys,
+                                           aligned_vector<ShadowRayType> &temp_rays) {
+        return NS::SortShadowRays<RPSize>(rays, root_min, cell_size, temp_keys, temp_rays);
     }
 
     static force_inline void ShadePrimary(const pass_settings_t &ps, Span<const HitDataType> inters,
@@ -621,6 +712,16 @@ class SIMDPolicyBase {
         NS::ShadeSky(ps, limit, inters, rays, ray_indices, sc, iteration, img_w, out_color);
     }
 
+  public:
+    static void IntegrateSkyRow(const atmosphere_params_t &params, Span<const float> transmittance_lut,
+                                Span<const float> multiscatter_lut, const float light_dir[3], const float light_angle,
+                                const float light_col[3], const int y, const float cos_theta, const float sin_theta,
+                                Span<const float> cos_phi, Span<const float> sin_phi, float inout_color[]) {
+        NS::IntegrateSkyRow<RPSize>(params, transmittance_lut, multiscatter_lut, light_dir, light_angle, light_col, y,
+                                    cos_theta, sin_theta, cos_phi, sin_phi, inout_color);
+    }
+
+  protected:
     static force_inline void SpatialCacheUpdate(const cache_grid_params_t &params, Span<const HitDataType> inters,
                                                 Span<const RayDataType> rays, Span<cache_data_t> cache_data,
                                                 const color_rgba_t radiance[], const color_rgba_t depth_normals[],
@@ -1046,6 +1147,73 @@ bool IntersectTri<16>(const float ro[3], const float rd[3], const mtri_accel_t &
     return true;
 }
 
+// Intersection callback of RasterizeTriGroups, all eight triangles are tested at once as in BLAS traversal
+template <int S>
+bool IntersectRasterTri(const float ro[3], const float rd[3], const mtri_accel_t &tris, const uint32_t tri_start,
+                        raster_hit_t &hit) {
+    return IntersectTri<S>(ro, rd, tris, tri_start, hit.prim_index, hit.t, hit.u, hit.v);
+}
+
+// Unlike IntersectTri, reports all triangles that were hit closer than t_max (bit mask of lanes is returned)
+template <int S>
+force_inline long IntersectTri_AllHits(const float ro[3], const float rd[3], const mtri_accel_t &tri,
+                                       const uint32_t prim_index, const float t_max, int out_prim_index[8],
+                                       float out_t[8], float out_u[8], float out_v[8]) {
+    static_assert(S <= 8, "!");
+
+    long mask = 0;
+    for (int i = 0; i < 8; i += S) {
+        const fvec<S> det = rd[0] * fvec<S>{&tri.n_plane[0][i], vector_aligned} +
+                            rd[1] * fvec<S>{&tri.n_plane[1][i], vector_aligned} +
+                            rd[2] * fvec<S>{&tri.n_plane[2][i], vector_aligned};
+        const fvec<S> dett =
+            fvec<S>{&tri.n_plane[3][i], vector_aligned} - ro[0] * fvec<S>{&tri.n_plane[0][i], vector_aligned} -
+            ro[1] * fvec<S>{&tri.n_plane[1][i], vector_aligned} - ro[2] * fvec<S>{&tri.n_plane[2][i], vector_aligned};
+
+        // compare sign bits
+        ivec<S> is_active_lane = ~srai(simd_cast(dett ^ (det * t_max - dett)), 31);
+        if (is_active_lane.all_zeros()) {
+            continue;
+        }
+
+        const fvec<S> p[3] = {det * ro[0] + dett * rd[0], det * ro[1] + dett * rd[1], det * ro[2] + dett * rd[2]};
+
+        const fvec<S> detu =
+            p[0] * fvec<S>{&tri.u_plane[0][i], vector_aligned} + p[1] * fvec<S>{&tri.u_plane[1][i], vector_aligned} +
+            p[2] * fvec<S>{&tri.u_plane[2][i], vector_aligned} + det * fvec<S>{&tri.u_plane[3][i], vector_aligned};
+
+        // compare sign bits
+        is_active_lane &= ~srai(simd_cast(detu ^ (det - detu)), 31);
+        if (is_active_lane.all_zeros()) {
+            continue;
+        }
+
+        const fvec<S> detv =
+            p[0] * fvec<S>{&tri.v_plane[0][i], vector_aligned} + p[1] * fvec<S>{&tri.v_plane[1][i], vector_aligned} +
+            p[2] * fvec<S>{&tri.v_plane[2][i], vector_aligned} + det * fvec<S>{&tri.v_plane[3][i], vector_aligned};
+
+        // compare sign bits
+        is_active_lane &= ~srai(simd_cast(detv ^ (det - detu - detv)), 31);
+        if (is_active_lane.all_zeros()) {
+            continue;
+        }
+
+        const fvec<S> rdet = safe_inv(det);
+
+        ivec<S> prim = -(int(prim_index) + ivec<S>{&ascending_counter[i], vector_aligned}) - 1;
+        where(det < 0.0f, prim) = int(prim_index) + ivec<S>{&ascending_counter[i], vector_aligned};
+
+        prim.store_to(&out_prim_index[i]);
+        (dett * rdet).store_to(&out_t[i]);
+        (detu * rdet).store_to(&out_u[i]);
+        (detv * rdet).store_to(&out_v[i]);
+
+        mask |= (is_active_lane.movemask() << i);
+    }
+
+    return mask;
+}
+
 template <int S>
 force_inline ivec<S> bbox_test(const fvec<S> o[3], const fvec<S> inv_d[3], const fvec<S> &t, const float _bbox_min[3],
                                const float _bbox_max[3]) {
@@ -1891,19 +2059,84 @@ force_inline void reflect(const fvec<S> I[3], const fvec<S> N[3], const fvec<S>
 force_inline float pow5(const float v) { return (v * v) * (v * v) * v; }
 
 force_inline void TransformPoint(const float p[3], const float *xform, float out_p[3]) {
-    out_p[0] = xform[0] * p[0] + xform[4] * p[1] + xform[8] * p[2] + xform[12];
-    out_p[1] = xform[1] * p[0] + xform[5] * p[1] + xform[9] * p[2] + xform[13];
-    out_p[2] = xform[2] * p[0] + xform[6] * p[1] + xform[10] * p[2] + xform[14];
+    out_p[0] = xform[0] * p[0] + xform[3] * p[1] + xform[6] * p[2] + xform[9];
+    out_p[1] = xform[1] * p[0] + xform[4] * p[1] + xform[7] * p[2] + xform[10];
+    out_p[2] = xform[2] * p[0] + xform[5] * p[1] + xform[8] * p[2] + xform[11];
 }
 
 force_inline void TransformDirection(const float d[3], const float *xform, float out_d[3]) {
-    out_d[0] = xform[0] * d[0] + xform[4] * d[1] + xform[8] * d[2];
-    out_d[1] = xform[1] * d[0] + xform[5] * d[1] + xform[9] * d[2];
-    out_d[2] = xform[2] * d[0] + xform[6] * d[1] + xform[10] * d[2];
+    out_d[0] = xform[0] * d[0] + xform[3] * d[1] + xform[6] * d[2];
+    out_d[1] = xform[1] * d[0] + xform[4] * d[1] + xform[7] * d[2];
+    out_d[2] = xform[2] * d[0] + xform[5] * d[1] + xform[8] * d[2];
 }
 
 template <int S> force_inline fvec<S> pow5(const fvec<S> &v) { return (v * v) * (v * v) * v; }
 
+// Key used to group hits with the same shading path (material type goes first)
+template <int S>
+force_inline uint32_t get_shading_key(const ray_data_t<S> &r, const hit_data_t<S> &inter, const int lane,
+                                      const scene_data_t &sc) {
+    if (!r.mask[lane]) {
+        return 0xffffffff; // inactive lane
+    }
+    if (inter.v[lane] < 0.0f) {
+        return 0xfffffffe; // environment
+    }
+    if (inter.obj_index[lane] < 0) {
+        return 0xfffffffd; // area light
+    }
+    int tri_index = inter.prim_index[lane];
+    const bool is_backfacing = (tri_index < 0);
+    if (is_backfacing) {
+        tri_index = -tri_index - 1;
+    }
+    const uint16_t mi = is_backfacing ? sc.tri_materials[tri_index].back_mi : sc.tri_materials[tri_index].front_mi;
+    if (mi == 0xffff) {
+        return 0xfffffffc;
+    }
+    const uint32_t mat_index = (mi & MATERIAL_INDEX_BITS);
+    return (uint32_t(sc.materials[mat_index].type) << 16) | mat_index;
+}
+
+template <int S>
+force_inline void copy_lane(const ray_data_t<S> &src, const int src_lane, ray_data_t<S> &dst, const int dst_lane) {
+    dst.mask.set(dst_lane, src.mask[src_lane]);
+    UNROLLED_FOR(i, 3, {
+        dst.o[i].set(dst_lane, src.o[i][src_lane]);
+        dst.d[i].set(dst_lane, src.d[i][src_lane]);
+        dst.c[i].set(dst_lane, src.c[i][src_lane]);
+    })
+    dst.pdf.set(dst_lane, src.pdf[src_lane]);
+    UNROLLED_FOR(i, 4, { dst.ior[i].set(dst_lane, src.ior[i][src_lane]); })
+    dst.cone_width.set(dst_lane, src.cone_width[src_lane]);
+    dst.cone_spread.set(dst_lane, src.cone_spread[src_lane]);
+    dst.xy.set(dst_lane, src.xy[src_lane]);
+    dst.depth.set(dst_lane, src.depth[src_lane]);
+}
+
+template <int S>
+force_inline void copy_lane(const hit_data_t<S> &src, const int src_lane, hit_data_t<S> &dst, const int dst_lane) {
+    dst.obj_index.set(dst_lane, src.obj_index[src_lane]);
+    dst.prim_index.set(dst_lane, src.prim_index[src_lane]);
+    dst.t.set(dst_lane, src.t[src_lane]);
+    dst.u.set(dst_lane, src.u[src_lane]);
+    dst.v.set(dst_lane, src.v[src_lane]);
+}
+
+template <int S>
+force_inline void copy_lane(const shadow_ray_t<S> &src, const int src_lane, shadow_ray_t<S> &dst,
+                           const int dst_lane) {
+    dst.mask.set(dst_lane, src.mask[src_lane]);
+    UNROLLED_FOR(i, 3, {
+        dst.o[i].set(dst_lane, src.o[i][src_lane]);
+        dst.d[i].set(dst_lane, src.d[i][src_lane]);
+        dst.c[i].set(dst_lane, src.c[i][src_lane]);
+    })
+    dst.depth.set(dst_lane, src.depth[src_lane]);
+    dst.dist.set(dst_lane, src.dist[src_lane]);
+    dst.xy.set(dst_lane, src.xy[src_lane]);
+}
+
 template <int S> ivec<S> get_ray_hash(const ray_data_t<S> &r, const float root_min[3], const float cell_size[3]) {
     ivec<S> x = clamp(ivec<S>((r.o[0] - root_min[0]) / cell_size[0]), 0, 255),
             y = clamp(ivec<S>((r.o[1] - root_min[1]) / cell_size[1]), 0, 255),
@@ -1935,28 +2168,82 @@ template <int S> ivec<S> get_ray_hash(const ray_data_t<S> &r, const float root_m
     return (o << 25) | (p << 24) | (y << 2) | (z << 1) | (x << 0);
 }
 
-void _radix_sort_lsb(ray_chunk_t *begin, ray_chunk_t *end, ray_chunk_t *begin1, unsigned maxshift) {
-    ray_chunk_t *end1 = begin1 + (end - begin);
+// Spreads lower 8 bits of each lane so that there are two zero bits between each of them
+template <int S> force_inline ivec<S> morton_spread(ivec<S> v) {
+    v = (v | (v << 8)) & 0x0000F00F;
+    v = (v | (v << 4)) & 0x000C30C3;
+    v = (v | (v << 2)) & 0x00249249;
+    return v;
+}
+
+// Vectorized version of GetRaySortKey, inactive lanes get maximal key so they end up at the end
+template <int S>
+ivec<S> get_ray_sort_key(const fvec<S> o[3], const fvec<S> d[3], const ivec<S> &mask, const float root_min[3],
+                         const float cell_size[3], const int origin_bits, const int dir_bits) {
+    ivec<S> key = 0;
+    if (origin_bits) {
+        UNROLLED_FOR(i, 3, {
+            const ivec<S> cell = clamp(ivec<S>((o[i] - root_min[i]) / cell_size[i]), 0, 255) >> (8 - origin_bits);
+            // same axis order as in scalar version (y, z, x)
+            key |= morton_spread(cell) << ((2 * i) % 3);
+        })
+    }
+
+    const fvec<S> denom = abs(d[0]) + abs(d[1]) + abs(d[2]);
+    fvec<S> u = d[0] / denom, v = d[1] / denom;
+    const fvec<S> folded_u = (1.0f - abs(v)) * copysign(fvec<S>{1.0f}, u),
+                  folded_v = (1.0f - abs(u)) * copysign(fvec<S>{1.0f}, v);
+    const fvec<S> lower_hemisphere = d[2] < 0.0f;
+    where(lower_hemisphere, u) = folded_u;
+    where(lower_hemisphere, v) = folded_v;
+
+    const float scale = 0.5f * float(1u << dir_bits);
+    const int max_val = int(1u << dir_bits) - 1;
+    const ivec<S> ui = clamp(ivec<S>((u + 1.0f) * scale), 0, max_val),
+                  vi = clamp(ivec<S>((v + 1.0f) * scale), 0, max_val);
+    key |= ((ui << dir_bits) | vi) << (3 * origin_bits);
+
+    const int key_bits = 3 * origin_bits + 2 * dir_bits;
+    where(~mask, key) = key_bits < 32 ? int((1u << key_bits) - 1) : -1;
+
+    return key;
+}
+
+force_inline void radix_sort(ray_chunk_t *begin, ray_chunk_t *end, ray_chunk_t *begin1, const int key_bits = 32) {
+    const size_t count = size_t(end - begin);
+    if (!count) {
+        return;
+    }
+    const int passes_count = (key_bits + 7) / 8;
+
+    // single pass over data fills histograms of all digits
+    uint32_t histogram[4][0x100] = {};
+    for (const ray_chunk_t *p = begin; p != end; ++p) {
+        for (int k = 0; k < passes_count; ++k) {
+            ++histogram[k][(p->hash >> (8 * k)) & 0xFF];
+        }
+    }
 
-    for (unsigned shift = 0; shift <= maxshift; shift += 8) {
-        size_t count[0x100] = {};
-        for (ray_chunk_t *p = begin; p != end; p++) {
-            count[(p->hash >> shift) & 0xFF]++;
+    ray_chunk_t *src = begin, *dst = begin1;
+    for (int k = 0; k < passes_count; ++k) {
+        const unsigned shift = 8 * k;
+        if (histogram[k][(src->hash >> shift) & 0xFF] == count) {
+            // digit is the same for all keys (e.g. unused bits), scatter would keep the order
+            continue;
         }
-        ray_chunk_t *bucket[0x100], *q = begin1;
-        for (int i = 0; i < 0x100; q += count[i++]) {
+        ray_chunk_t *bucket[0x100], *q = dst;
+        for (int i = 0; i < 0x100; q += histogram[k][i++]) {
             bucket[i] = q;
         }
-        for (ray_chunk_t *p = begin; p != end; p++) {
+        for (const ray_chunk_t *p = src; p != src + count; ++p) {
             *bucket[(p->hash >> shift) & 0xFF]++ = *p;
         }
-        std::swap(begin, begin1);
-        std::swap(end, end1);
+        std::swap(src, dst);
     }
-}
 
-force_inline void radix_sort(ray_chunk_t *begin, ray_chunk_t *end, ray_chunk_t *begin1) {
-    _radix_sort_lsb(begin, end, begin1, 24);
+    if (src != begin) {
+        std::copy(src, src + count, begin);
+    }
 }
 
 template <int S> force_inline fvec<S> construct_float(const ivec<S> &_m) {
@@ -2114,50 +2401,44 @@ fvec<S> get_texture_lod(const ivec<S> &width, const ivec<S> &height, const fvec<
 
 template <int S> force_inline fvec<S> conv_unorm_16(const ivec<S> &v) { return fvec<S>(v) / 65535.0f; }
 
+template <int S> void InverseAffineMatrix(const fvec<S> mat[12], fvec<S> out_mat[12]) {
+    // rows of inverted 3x3 part are cross products of its columns
+    fvec<S> r[3][3];
+    cross(&mat[3], &mat[6], r[0]);
+    cross(&mat[6], &mat[0], r[1]);
+    cross(&mat[0], &mat[3], r[2]);
+    const fvec<S> inv_det = 1.0f / dot3(&mat[0], r[0]);
+    UNROLLED_FOR(i, 3, {
+        out_mat[3 * i + 0] = inv_det * r[0][i];
+        out_mat[3 * i + 1] = inv_det * r[1][i];
+        out_mat[3 * i + 2] = inv_det * r[2][i];
+    })
+    UNROLLED_FOR(i, 3, {
+        out_mat[9 + i] = -(out_mat[i] * mat[9] + out_mat[3 + i] * mat[10] + out_mat[6 + i] * mat[11]);
+    })
+}
+
 template <int S>
 void FetchTransformAndRecalcBasis(const mesh_instance_t *sc_mesh_instances, const ivec<S> &mi_index,
                                   const fvec<S> P_ls[3], fvec<S> inout_plane_N[3], fvec<S> inout_N[3],
                                   fvec<S> inout_B[3], fvec<S> inout_T[3], fvec<S> inout_tangent[3],
-                                  fvec<S> inout_ro_ls[3], fvec<S> out_transform[16]) {
-    const float *transforms = &sc_mesh_instances[0].xform[0];
+                                  fvec<S> inout_ro_ls[3], fvec<S> out_inv_transform[12]) {
     const float *inv_transforms = &sc_mesh_instances[0].inv_xform[0];
     const int MeshInstancesStride = sizeof(mesh_instance_t) / sizeof(float);
 
-    fvec<S> inv_transform[16];
-    UNROLLED_FOR(i, 16, {
-        out_transform[i] = gather(transforms + i, mi_index * MeshInstancesStride);
-        inv_transform[i] = gather(inv_transforms + i, mi_index * MeshInstancesStride);
-    })
+    UNROLLED_FOR(i, 12, { out_inv_transform[i] = gather(inv_transforms + i, mi_index * MeshInstancesStride); })
 
     fvec<S> temp[3];
     cross(inout_tangent, inout_N, temp);
     const fvec<S> mask = length2(temp) == 0.0f;
     UNROLLED_FOR(i, 3, { where(mask, inout_tangent[i]) = P_ls[i]; })
 
-    TransformNormal(inv_transform, inout_plane_N);
-    TransformNormal(inv_transform, inout_N);
-    TransformNormal(inv_transform, inout_B);
-    TransformNormal(inv_transform, inout_T);
-    TransformNormal(inv_transform, inout_tangent);
-    TransformPoint(inv_transform, inout_ro_ls);
-}
-
-template <int S>
-void FetchVertexAttribute3(const float *attribs, const ivec<S> vtx_indices[3], const fvec<S> &u, const fvec<S> &v,
-                           const fvec<S> &w, fvec<S> out_A[3]) {
-    static const int VtxStride = sizeof(vertex_t) / sizeof(float);
-
-    const fvec<S> A1[3] = {gather(attribs + 0, vtx_indices[0] * VtxStride),
-                           gather(attribs + 1, vtx_indices[0] * VtxStride),
-                           gather(attribs + 2, vtx_indices[0] * VtxStride)};
-    const fvec<S> A2[3] = {gather(attribs + 0, vtx_indices[1] * VtxStride),
-                           gather(attribs + 1, vtx_indices[1] * VtxStride),
-                           gather(attribs + 2, vtx_indices[1] * VtxStride)};
-    const fvec<S> A3[3] = {gather(attribs + 0, vtx_indices[2] * VtxStride),
-                           gather(attribs + 1, vtx_indices[2] * VtxStride),
-                           gather(attribs + 2, vtx_indices[2] * VtxStride)};
-
-    UNROLLED_FOR(i, 3, { out_A[i] = A1[i] * w + A2[i] * u + A3[i] * v; })
+    TransformNormal(out_inv_transform, inout_plane_N);
+    TransformNormal(out_inv_transform, inout_N);
+    TransformNormal(out_inv_transform, inout_B);
+    TransformNormal(out_inv_transform, inout_T);
+    TransformNormal(out_inv_transform, inout_tangent);
+    TransformPoint(out_inv_transform, inout_ro_ls);
 }
 
 template <int S> void EnsureValidReflection(const fvec<S> Ng[3], const fvec<S> I[3], fvec<S> inout_N[3]) {
@@ -2739,6 +3020,91 @@ template <int S> force_inline std::array<fvec<S>, 2> decode_cosines(const uvec<S
     return ret;
 }
 
+template <int S> force_inline fvec<S> decode_half(const ivec<S> &h) {
+    // move exponent and mantissa in place and rebias them with multiplication (handles zero and denormals)
+    const fvec<S> ret = simd_cast((h & 0x7fff) << 13) * 5.192296858534828e+33f; // 2^112
+    return simd_cast(simd_cast(ret) | ((h & 0x8000) << 16));
+}
+
+template <int S>
+void FetchVertexPositions(const vertex_data_t &vertices, const ivec<S> vtx_indices[3], fvec<S> out_p1[3],
+                          fvec<S> out_p2[3], fvec<S> out_p3[3]) {
+    const float *vtx_positions = vertices.vertices ? &vertices.vertices[0].p[0] : &vertices.packed_vertices[0].p[0];
+    const int VtxStride = vertices.vertices ? int(sizeof(vertex_t) / sizeof(float))
+                                            : int(sizeof(packed_vertex_t) / sizeof(float));
+
+    UNROLLED_FOR(i, 3, {
+        out_p1[i] = gather(vtx_positions + i, vtx_indices[0] * VtxStride);
+        out_p2[i] = gather(vtx_positions + i, vtx_indices[1] * VtxStride);
+        out_p3[i] = gather(vtx_positions + i, vtx_indices[2] * VtxStride);
+    })
+}
+
+template <int S>
+void FetchVertexUVs(const vertex_data_t &vertices, const ivec<S> vtx_indices[3], fvec<S> out_t1[2], fvec<S> out_t2[2],
+                    fvec<S> out_t3[2]) {
+    if (vertices.vertices) {
+        const float *vtx_uvs = &vertices.vertices[0].t[0];
+        const int VtxStride = sizeof(vertex_t) / sizeof(float);
+
+        UNROLLED_FOR(i, 2, {
+            out_t1[i] = gather(vtx_uvs + i, vtx_indices[0] * VtxStride);
+            out_t2[i] = gather(vtx_uvs + i, vtx_indices[1] * VtxStride);
+            out_t3[i] = gather(vtx_uvs + i, vtx_indices[2] * VtxStride);
+        })
+    } else {
+        // both half-float components are fetched at once
+        const int *vtx_uvs = reinterpret_cast<const int *>(&vertices.packed_vertices[0].t[0]);
+        const int VtxStride = sizeof(packed_vertex_t) / sizeof(int);
+
+        const ivec<S> t1 = gather(vtx_uvs, vtx_indices[0] * VtxStride),
+                      t2 = gather(vtx_uvs, vtx_indices[1] * VtxStride),
+                      t3 = gather(vtx_uvs, vtx_indices[2] * VtxStride);
+
+        out_t1[0] = decode_half(t1);
+        out_t1[1] = decode_half(t1 >> 16);
+        out_t2[0] = decode_half(t2);
+        out_t2[1] = decode_half(t2 >> 16);
+        out_t3[0] = decode_half(t3);
+        out_t3[1] = decode_half(t3 >> 16);
+    }
+}
+
+// Fetches and interpolates normal (Binormal == false) or binormal (Binormal == true)
+template <bool Binormal, int S>
+void FetchVertexDir(const vertex_data_t &vertices, const ivec<S> vtx_indices[3], const fvec<S> &u, const fvec<S> &v,
+                    const fvec<S> &w, fvec<S> out_dir[3]) {
+    if (vertices.vertices) {
+        const float *attribs = Binormal ? &vertices.vertices[0].b[0] : &vertices.vertices[0].n[0];
+        const int VtxStride = sizeof(vertex_t) / sizeof(float);
+
+        const fvec<S> A1[3] = {gather(attribs + 0, vtx_indices[0] * VtxStride),
+                               gather(attribs + 1, vtx_indices[0] * VtxStride),
+                               gather(attribs + 2, vtx_indices[0] * VtxStride)};
+        const fvec<S> A2[3] = {gather(attribs + 0, vtx_indices[1] * VtxStride),
+                               gather(attribs + 1, vtx_indices[1] * VtxStride),
+                               gather(attribs + 2, vtx_indices[1] * VtxStride)};
+        const fvec<S> A3[3] = {gather(attribs + 0, vtx_indices[2] * VtxStride),
+                               gather(attribs + 1, vtx_indices[2] * VtxStride),
+                               gather(attribs + 2, vtx_indices[2] * VtxStride)};
+
+        UNROLLED_FOR(i, 3, { out_dir[i] = A1[i] * w + A2[i] * u + A3[i] * v; })
+    } else {
+        const uint32_t *attribs = Binormal ? &vertices.packed_vertices[0].b : &vertices.packed_vertices[0].n;
+        const int VtxStride = sizeof(packed_vertex_t) / sizeof(uint32_t);
+
+        const fvec<S> weights[3] = {w, u, v};
+        UNROLLED_FOR(i, 3, { out_dir[i] = 0.0f; })
+        for (int j = 0; j < 3; ++j) {
+            const uvec<S> oct = gather(attribs, vtx_indices[j] * VtxStride);
+            const std::array<fvec<S>, 3> dir = decode_oct_dir(oct);
+            // zero encodes zero-length vector
+            const fvec<S> weight = select(oct == 0u, fvec<S>{0.0f}, weights[j]);
+            UNROLLED_FOR(i, 3, { out_dir[i] += dir[i] * weight; })
+        }
+    }
+}
+
 template <int S>
 void calc_lnode_importance(const light_cwbvh_node_t &n, const float bbox_min[3][8], const float bbox_max[3][8],
                            const float P[3], float importance[8]) {
@@ -2857,10 +3223,10 @@ template <int S> uvec<S> calc_grid_level(const fvec<S> p[3], const cache_grid_pa
 } // namespace Ray
 
 template <int DimX, int DimY>
-void Ray::NS::GeneratePrimaryRays(const camera_t &cam, const rect_t &r, int w, int h, const uint32_t rand_seq[],
-                                  const uint32_t rand_seed, const float filter_table[], const int iteration,
-                                  const uint16_t required_samples[], aligned_vector<ray_data_t<DimX * DimY>> &out_rays,
-                                  aligned_vector<hit_data_t<DimX * DimY>> &out_inters) {
+int Ray::NS::GeneratePrimaryRays(const camera_t &cam, const rect_t &r, int w, int h, const uint32_t rand_seq[],
+                                 const uint32_t rand_seed, const float filter_table[], const int iteration,
+                                 const uint16_t required_samples[], aligned_vector<ray_data_t<DimX * DimY>> &out_rays,
+                                 aligned_vector<hit_data_t<DimX * DimY>> &out_inters) {
     const int S = DimX * DimY;
     static_assert(S <= 16, "!");
 
@@ -2874,266 +3240,301 @@ void Ray::NS::GeneratePrimaryRays(const camera_t &cam, const rect_t &r, int w, i
 
     const int x_res = (r.w + DimX - 1) / DimX, y_res = (r.h + DimY - 1) / DimY;
 
-    size_t i = 0;
-    out_rays.resize(x_res * y_res);
-    out_inters.resize(x_res * y_res);
+    // Pixels that still require samples are gathered into dense packets (converged pixels would leave lanes idle)
+    aligned_vector<uint32_t> active_pixels;
+    int packets_count = x_res * y_res;
+    if (required_samples) {
+        active_pixels.reserve(x_res * y_res * S);
+        for (int y = r.y; y < r.y + r.h; y += DimY) {
+            for (int x = r.x; x < r.x + r.w; x += DimX) {
+                for (int j = 0; j < S; ++j) {
+                    const int xx = x + rays_layout_x[j], yy = y + rays_layout_y[j];
+                    if (xx < w && yy < h && required_samples[yy * w + xx] >= iteration) {
+                        active_pixels.push_back(uint32_t((xx << 16) | yy));
+                    }
+                }
+            }
+        }
+        packets_count = (int(active_pixels.size()) + S - 1) / S;
+    }
+
+    out_rays.resize(packets_count);
+    out_inters.resize(packets_count);
 
-    for (int y = r.y; y < r.y + r.h; y += DimY) {
-        for (int x = r.x; x < r.x + r.w; x += DimX) {
-            ray_data_t<S> &out_r = out_rays[i];
+    for (int packet = 0; packet < packets_count; ++packet) {
+        ray_data_t<S> &out_r = out_rays[packet];
 
-            const ivec<S> ixx = x + off_x, iyy = y + off_y;
-            const ivec<S> ixx_clamped = min(ixx, w - 1), iyy_clamped = min(iyy, h - 1);
+        ivec<S> ixx, iyy;
+        if (required_samples) {
+            const int count = std::min(int(active_pixels.size()) - packet * S, S);
 
-            ivec<S> req_samples = INT_MAX;
-            if (required_samples) {
-                UNROLLED_FOR_S(i, S, {
-                    req_samples.template set<i>(
-                        required_samples[iyy_clamped.template get<i>() * w + ixx_clamped.template get<i>()]);
-                })
+            alignas(64) int lane_x[S], lane_y[S], lane_mask[S];
+            for (int j = 0; j < S; ++j) {
+                // inactive lanes duplicate the last pixel to keep calculations well-defined
+                const uint32_t px = active_pixels[packet * S + std::min(j, count - 1)];
+                lane_x[j] = int(px >> 16);
+                lane_y[j] = int(px & 0xffff);
+                lane_mask[j] = (j < count) ? -1 : 0;
             }
 
-            out_r.mask = (ixx < w) & (iyy < h) & (req_samples >= iteration);
+            ixx = ivec<S>{lane_x, vector_aligned};
+            iyy = ivec<S>{lane_y, vector_aligned};
+            out_r.mask = ivec<S>{lane_mask, vector_aligned};
+        } else {
+            const int x = r.x + (packet % x_res) * DimX, y = r.y + (packet / x_res) * DimY;
+            ixx = x + off_x;
+            iyy = y + off_y;
+            out_r.mask = (ixx < w) & (iyy < h);
+        }
 
-            auto fxx = fvec<S>(ixx), fyy = fvec<S>(iyy);
+        auto fxx = fvec<S>(ixx), fyy = fvec<S>(iyy);
 
-            const uvec<S> px_hash = hash(uvec<S>((ixx << 16) | iyy));
-            const uvec<S> rand_hash = hash_combine(px_hash, rand_seed);
+        const uvec<S> px_hash = hash(uvec<S>((ixx << 16) | iyy));
+        const uvec<S> rand_hash = hash_combine(px_hash, rand_seed);
 
-            std::array<fvec<S>, 2> filter_rand =
-                get_scrambled_2d_rand(uvec<S>(uint32_t(RAND_DIM_FILTER)), rand_hash, iteration - 1, rand_seq);
-            if (cam.filter != ePixelFilter::Box) {
-                filter_rand[0] *= float(FILTER_TABLE_SIZE - 1);
-                filter_rand[1] *= float(FILTER_TABLE_SIZE - 1);
+        std::array<fvec<S>, 2> filter_rand =
+            get_scrambled_2d_rand(uvec<S>(uint32_t(RAND_DIM_FILTER)), rand_hash, iteration - 1, rand_seq);
+        if (cam.filter != ePixelFilter::Box) {
+            filter_rand[0] *= float(FILTER_TABLE_SIZE - 1);
+            filter_rand[1] *= float(FILTER_TABLE_SIZE - 1);
 
-                const ivec<S> index_x = min(ivec<S>(filter_rand[0]), FILTER_TABLE_SIZE - 1),
-                              index_y = min(ivec<S>(filter_rand[1]), FILTER_TABLE_SIZE - 1);
+            const ivec<S> index_x = min(ivec<S>(filter_rand[0]), FILTER_TABLE_SIZE - 1),
+                          index_y = min(ivec<S>(filter_rand[1]), FILTER_TABLE_SIZE - 1);
 
-                const ivec<S> nindex_x = min(index_x + 1, FILTER_TABLE_SIZE - 1),
-                              nindex_y = min(index_y + 1, FILTER_TABLE_SIZE - 1);
+            const ivec<S> nindex_x = min(index_x + 1, FILTER_TABLE_SIZE - 1),
+                          nindex_y = min(index_y + 1, FILTER_TABLE_SIZE - 1);
 
-                const fvec<S> tx = filter_rand[0] - fvec<S>(index_x), ty = filter_rand[1] - fvec<S>(index_y);
+            const fvec<S> tx = filter_rand[0] - fvec<S>(index_x), ty = filter_rand[1] - fvec<S>(index_y);
 
-                const fvec<S> data0_x = gather(filter_table, index_x), data1_x = gather(filter_table, nindex_x);
-                const fvec<S> data0_y = gather(filter_table, index_y), data1_y = gather(filter_table, nindex_y);
+            const fvec<S> data0_x = gather(filter_table, index_x), data1_x = gather(filter_table, nindex_x);
+            const fvec<S> data0_y = gather(filter_table, index_y), data1_y = gather(filter_table, nindex_y);
 
-                filter_rand[0] = (1.0f - tx) * data0_x + tx * data1_x;
-                filter_rand[1] = (1.0f - ty) * data0_y + ty * data1_y;
-            }
+            filter_rand[0] = (1.0f - tx) * data0_x + tx * data1_x;
+            filter_rand[1] = (1.0f - ty) * data0_y + ty * data1_y;
+        }
 
-            fxx += filter_rand[0];
-            fyy += filter_rand[1];
+        fxx += filter_rand[0];
+        fyy += filter_rand[1];
 
-            fvec<S> offset[2] = {0.0f, 0.0f};
-            if (cam.fstop > 0.0f) {
-                const std::array<fvec<S>, 2> lens_rand =
-                    get_scrambled_2d_rand(uvec<S>(uint32_t(RAND_DIM_LENS)), rand_hash, iteration - 1, rand_seq);
+        fvec<S> offset[2] = {0.0f, 0.0f};
+        if (cam.fstop > 0.0f) {
+            const std::array<fvec<S>, 2> lens_rand =
+                get_scrambled_2d_rand(uvec<S>(uint32_t(RAND_DIM_LENS)), rand_hash, iteration - 1, rand_seq);
 
-                offset[0] = 2.0f * lens_rand[0] - 1.0f;
-                offset[1] = 2.0f * lens_rand[1] - 1.0f;
+            offset[0] = 2.0f * lens_rand[0] - 1.0f;
+            offset[1] = 2.0f * lens_rand[1] - 1.0f;
 
-                fvec<S> r = offset[1], theta = 0.5f * PI - 0.25f * PI * safe_div(offset[0], offset[1]);
-                where(abs(offset[0]) > abs(offset[1]), r) = offset[0];
-                where(abs(offset[0]) > abs(offset[1]), theta) = 0.25f * PI * safe_div(offset[1], offset[0]);
+            fvec<S> r = offset[1], theta = 0.5f * PI - 0.25f * PI * safe_div(offset[0], offset[1]);
+            where(abs(offset[0]) > abs(offset[1]), r) = offset[0];
+            where(abs(offset[0]) > abs(offset[1]), theta) = 0.25f * PI * safe_div(offset[1], offset[0]);
 
-                if (cam.lens_blades) {
-                    r *= ngon_rad(theta, float(cam.lens_blades));
-                }
+            if (cam.lens_blades) {
+                r *= ngon_rad(theta, float(cam.lens_blades));
+            }
 
-                theta += cam.lens_rotation;
+            theta += cam.lens_rotation;
 
-                where(offset[0] != 0.0f & offset[1] != 0.0f, offset[0]) = 0.5f * r * cos(theta) / cam.lens_ratio;
-                where(offset[0] != 0.0f & offset[1] != 0.0f, offset[1]) = 0.5f * r * sin(theta);
+            where(offset[0] != 0.0f & offset[1] != 0.0f, offset[0]) = 0.5f * r * cos(theta) / cam.lens_ratio;
+            where(offset[0] != 0.0f & offset[1] != 0.0f, offset[1]) = 0.5f * r * sin(theta);
 
-                const float coc = 0.5f * (cam.focal_length / cam.fstop);
-                offset[0] *= coc * cam.sensor_height;
-                offset[1] *= coc * cam.sensor_height;
-            }
+            const float coc = 0.5f * (cam.focal_length / cam.fstop);
+            offset[0] *= coc * cam.sensor_height;
+            offset[1] *= coc * cam.sensor_height;
+        }
 
-            const fvec<S> _origin[3] = {{cam.origin[0] + cam.side[0] * offset[0] + cam.up[0] * offset[1]},
-                                        {cam.origin[1] + cam.side[1] * offset[0] + cam.up[1] * offset[1]},
-                                        {cam.origin[2] + cam.side[2] * offset[0] + cam.up[2] * offset[1]}};
+        const fvec<S> _origin[3] = {{cam.origin[0] + cam.side[0] * offset[0] + cam.up[0] * offset[1]},
+                                    {cam.origin[1] + cam.side[1] * offset[0] + cam.up[1] * offset[1]},
+                                    {cam.origin[2] + cam.side[2] * offset[0] + cam.up[2] * offset[1]}};
 
-            fvec<S> _d[3], _dx[3], _dy[3];
-            get_pix_dirs(float(w), float(h), cam, k, fov_k, fxx, fyy, _origin, _d);
-            get_pix_dirs(float(w), float(h), cam, k, fov_k, fxx + 1.0f, fyy, _origin, _dx);
-            get_pix_dirs(float(w), float(h), cam, k, fov_k, fxx, fyy + 1.0f, _origin, _dy);
+        fvec<S> _d[3], _dx[3], _dy[3];
+        get_pix_dirs(float(w), float(h), cam, k, fov_k, fxx, fyy, _origin, _d);
+        get_pix_dirs(float(w), float(h), cam, k, fov_k, fxx + 1.0f, fyy, _origin, _dx);
+        get_pix_dirs(float(w), float(h), cam, k, fov_k, fxx, fyy + 1.0f, _origin, _dy);
 
-            const fvec<S> clip_start = cam.clip_start / dot3(_d, cam.fwd);
+        const fvec<S> clip_start = cam.clip_start / dot3(_d, cam.fwd);
 
-            for (int j = 0; j < 3; j++) {
-                out_r.d[j] = _d[j];
-                out_r.o[j] = _origin[j] + _d[j] * clip_start;
-                out_r.c[j] = {1.0f};
-            }
+        for (int j = 0; j < 3; j++) {
+            out_r.d[j] = _d[j];
+            out_r.o[j] = _origin[j] + _d[j] * clip_start;
+            out_r.c[j] = {1.0f};
+        }
 
-            // air ior is implicit
-            out_r.ior[0] = out_r.ior[1] = out_r.ior[2] = out_r.ior[3] = -1.0f;
+        // air ior is implicit
+        out_r.ior[0] = out_r.ior[1] = out_r.ior[2] = out_r.ior[3] = -1.0f;
 
-            out_r.cone_width = 0.0f;
-            out_r.cone_spread = spread_angle;
+        out_r.cone_width = 0.0f;
+        out_r.cone_spread = spread_angle;
 
-            out_r.pdf = {1e6f};
-            out_r.xy = uvec<S>((ixx << 16) | iyy);
-            out_r.depth = pack_ray_type(RAY_TYPE_CAMERA);
-            out_r.depth |= pack_depth(ivec<S>{0}, ivec<S>{0}, ivec<S>{0}, ivec<S>{0});
+        out_r.pdf = {1e6f};
+        out_r.xy = uvec<S>((ixx << 16) | iyy);
+        out_r.depth = pack_ray_type(RAY_TYPE_CAMERA);
+        out_r.depth |= pack_depth(ivec<S>{0}, ivec<S>{0}, ivec<S>{0}, ivec<S>{0});
 
-            hit_data_t<S> &out_i = out_inters[i++];
-            out_i = {};
-            out_i.t = (cam.clip_end / dot3(_d, cam.fwd)) - clip_start;
-        }
+        hit_data_t<S> &out_i = out_inters[packet];
+        out_i = {};
+        out_i.t = (cam.clip_end / dot3(_d, cam.fwd)) - clip_start;
     }
 
-    out_rays.resize(i);
-    out_inters.resize(i);
+    return required_samples ? int(active_pixels.size()) : r.w * r.h;
 }
 
 template <int DimX, int DimY>
-void Ray::NS::SampleMeshInTextureSpace(int iteration, int obj_index, int uv_layer, const mesh_t &mesh,
-                                       const mesh_instance_t &mi, const uint32_t *vtx_indices, const vertex_t *vertices,
-                                       const rect_t &r, int width, int height, const uint32_t rand_seq[],
-                                       aligned_vector<ray_data_t<DimX * DimY>> &out_rays,
-                                       aligned_vector<hit_data_t<DimX * DimY>> &out_inters) {
+int Ray::NS::SampleMeshInTextureSpace(int iteration, const mesh_instance_t *mesh_instances,
+                                      const uint32_t *vtx_indices, const vertex_data_t &vertices,
+                                      const texel_map_t &texel_map, const rect_t &r, const uint32_t rand_seq[],
+                                      const uint16_t required_samples[],
+                                      aligned_vector<ray_data_t<DimX * DimY>> &out_rays,
+                                      aligned_vector<hit_data_t<DimX * DimY>> &out_inters) {
     const int S = DimX * DimY;
     static_assert(S <= 16, "!");
 
-    out_rays.resize(r.w * r.h / S + ((r.w * r.h) % S != 0));
-    out_inters.resize(out_rays.size());
-
-    const auto off_x = ivec<S>{rays_layout_x}, off_y = ivec<S>{rays_layout_y};
-
-    size_t count = 0;
-    for (int y = r.y; y < r.y + r.h - (r.h & (DimY - 1)); y += DimY) {
-        for (int x = r.x; x < r.x + r.w - (r.w & (DimX - 1)); x += DimX) {
-            const ivec<S> ixx = x + off_x, iyy = ivec<S>(y) + off_y;
-
-            ray_data_t<S> &out_ray = out_rays[count];
-            hit_data_t<S> &out_inter = out_inters[count];
-            count++;
-
-            out_ray.xy = uvec<S>((ixx << 16) | iyy);
-            out_ray.c[0] = out_ray.c[1] = out_ray.c[2] = 1.0f;
-            out_ray.cone_width = 0.0f;
-            out_ray.cone_spread = 0.0f;
-            out_inter.v = -1.0f;
+    const int y_end = std::min(r.y + r.h, texel_map.h);
+
+    const auto is_active = [&](const texel_sample_t &t) {
+        return required_samples[(t.xy & 0xffff) * texel_map.w + (t.xy >> 16)] >= iteration;
+    };
+
+    // covered texels are packed densely, packet layout does not follow image tiles,
+    // packet is cut short when mesh instance changes (happens only at instance borders of lightmap atlas)
+    int packets_count = 0, texels_count = 0;
+    {
+        int lane = 0;
+        uint32_t packet_mi = 0xffffffff;
+        for (int y = r.y; y < y_end; ++y) {
+            for (const texel_sample_t &t : GetTexelMapRow(texel_map, y, r.x, r.x + r.w)) {
+                if (!is_active(t)) {
+                    continue;
+                }
+                ++texels_count;
+                if (lane == 0 || t.mi_index != packet_mi) {
+                    ++packets_count;
+                    packet_mi = t.mi_index;
+                    lane = 0;
+                }
+                lane = (lane + 1) % S;
+            }
         }
     }
 
-    const ivec4 irect_min = {r.x, r.y, 0, 0}, irect_max = {r.x + r.w - 1, r.y + r.h - 1, 0, 0};
-    const fvec4 size = {float(width), float(height), 0.0f, 0.0f};
-
-    for (uint32_t tri = mesh.tris_index; tri < mesh.tris_index + mesh.tris_count; tri++) {
-        const vertex_t &v0 = vertices[vtx_indices[tri * 3 + 0]];
-        const vertex_t &v1 = vertices[vtx_indices[tri * 3 + 1]];
-        const vertex_t &v2 = vertices[vtx_indices[tri * 3 + 2]];
-
-        // TODO: use uv_layer
-        const auto t0 = fvec4{v0.t[0], 1.0f - v0.t[1], 0.0f, 0.0f} * size;
-        const auto t1 = fvec4{v1.t[0], 1.0f - v1.t[1], 0.0f, 0.0f} * size;
-        const auto t2 = fvec4{v2.t[0], 1.0f - v2.t[1], 0.0f, 0.0f} * size;
-
-        fvec4 bbox_min = t0, bbox_max = t0;
-
-        bbox_min = min(bbox_min, t1);
-        bbox_min = min(bbox_min, t2);
-
-        bbox_max = max(bbox_max, t1);
-        bbox_max = max(bbox_max, t2);
-
-        ivec4 ibbox_min = ivec4(bbox_min), ibbox_max = ivec4{int(roundf(bbox_max[0])), int(roundf(bbox_max[1])), 0, 0};
-
-        if (ibbox_max[0] < irect_min[0] || ibbox_max[1] < irect_min[1] || ibbox_min[0] > irect_max[0] ||
-            ibbox_min[1] > irect_max[1]) {
-            continue;
-        }
-
-        ibbox_min = max(ibbox_min, irect_min);
-        ibbox_max = min(ibbox_max, irect_max);
-
-        ibbox_min.set<0>(ibbox_min[0] - (ibbox_min[0] % DimX));
-        ibbox_min.set<1>(ibbox_min[1] - (ibbox_min[1] % DimY));
-        ibbox_max.set<0>(ibbox_max[0] + (((ibbox_max[0] + 1) % DimX) ? (DimX - (ibbox_max[0] + 1) % DimX) : 0));
-        ibbox_max.set<1>(ibbox_max[1] + (((ibbox_max[1] + 1) % DimY) ? (DimY - (ibbox_max[1] + 1) % DimY) : 0));
-
-        const fvec4 d01 = t0 - t1, d12 = t1 - t2, d20 = t2 - t0;
-
-        float area = d01[0] * d20[1] - d20[0] * d01[1];
-        if (area < FLT_EPS) {
-            continue;
-        }
-
-        const float inv_area = 1.0f / area;
-
-        for (int y = ibbox_min[1]; y <= ibbox_max[1]; y += DimY) {
-            for (int x = ibbox_min[0]; x <= ibbox_max[0]; x += DimX) {
-                const ivec<S> ixx = x + off_x, iyy = ivec<S>(y) + off_y;
+    out_rays.resize(packets_count);
+    out_inters.resize(packets_count);
 
-                const int ndx = ((y - r.y) / DimY) * (r.w / DimX) + (x - r.x) / DimX;
-                ray_data_t<S> &out_ray = out_rays[ndx];
-                hit_data_t<S> &out_inter = out_inters[ndx];
+    float xform[12];
+    uint32_t packet_mi = 0xffffffff;
 
-                // NOTE: temporarily broken
-                fvec<S> rxx = 0.0f;
-                fvec<S> ryy = 0.0f;
+    int lane = 0, packet = 0;
+    fvec<S> p0[3], p1[3], p2[3], n0[3], n1[3], n2[3];
+    uvec<S> xy;
+    ivec<S> prim_index, mask;
+    fvec<S> u, v;
 
-                // UNROLLED_FOR_S(i, S, {
-                //     float _unused;
-                //     rxx.template set<i>(modff(rand_seq[RAND_DIM_FILTER_U] + rxx.template get<i>(), &_unused));
-                //     ryy.template set<i>(modff(rand_seq[RAND_DIM_FILTER_V] + ryy.template get<i>(), &_unused));
-                // })
+    const auto flush_packet = [&]() {
+        const mesh_instance_t &mi = mesh_instances[packet_mi];
 
-                const fvec<S> fxx = fvec<S>{ixx} + rxx, fyy = fvec<S>{iyy} + ryy;
+        const fvec<S> fmask = simd_cast(mask);
+        const fvec<S> w = 1.0f - u - v;
 
-                fvec<S> u = d01[0] * (fyy - t0[1]) - d01[1] * (fxx - t0[0]),
-                        v = d12[0] * (fyy - t1[1]) - d12[1] * (fxx - t1[0]),
-                        w = d20[0] * (fyy - t2[1]) - d20[1] * (fxx - t2[0]);
+        fvec<S> _p[3], _n[3];
+        UNROLLED_FOR(i, 3, {
+            _p[i] = p0[i] * w + p1[i] * u + p2[i] * v;
+            _n[i] = n0[i] * w + n1[i] * u + n2[i] * v;
+        })
 
-                const fvec<S> fmask = (u >= -FLT_EPS) & (v >= -FLT_EPS) & (w >= -FLT_EPS);
-                const ivec<S> imask = simd_cast(fmask);
+        fvec<S> p[3], n[3];
+        TransformPoint(_p, xform, p);
+        TransformNormal(_n, mi.inv_xform, n);
 
-                if (imask.not_all_zeros()) {
-                    u *= inv_area;
-                    v *= inv_area;
-                    w *= inv_area;
+        ray_data_t<S> &out_ray = out_rays[packet];
+        hit_data_t<S> &out_inter = out_inters[packet];
+        ++packet;
 
-                    const fvec<S> _p[3] = {v0.p[0] * v + v1.p[0] * w + v2.p[0] * u,
-                                           v0.p[1] * v + v1.p[1] * w + v2.p[1] * u,
-                                           v0.p[2] * v + v1.p[2] * w + v2.p[2] * u},
-                                  _n[3] = {v0.n[0] * v + v1.n[0] * w + v2.n[0] * u,
-                                           v0.n[1] * v + v1.n[1] * w + v2.n[1] * u,
-                                           v0.n[2] * v + v1.n[2] * w + v2.n[2] * u};
+        out_ray.mask = mask;
+        UNROLLED_FOR(i, 3, {
+            out_ray.o[i] = p[i] + n[i];
+            out_ray.d[i] = -n[i];
+            out_ray.c[i] = 1.0f;
+        })
+        out_ray.cone_width = 0.0f;
+        out_ray.cone_spread = 0.0f;
+        out_ray.xy = xy;
+        out_ray.depth = pack_ray_type(RAY_TYPE_DIFFUSE);
+        out_ray.depth |= pack_depth(ivec<S>{0}, ivec<S>{0}, ivec<S>{0}, ivec<S>{0});
+
+        out_inter = {};
+        out_inter.prim_index = prim_index;
+        out_inter.obj_index = int(packet_mi);
+        out_inter.t = 1.0f;
+        out_inter.u = u;
+        out_inter.v = -1.0f;
+        where(fmask, out_inter.v) = v;
+    };
+
+    for (int y = r.y; y < y_end; ++y) {
+        for (const texel_sample_t &t : GetTexelMapRow(texel_map, y, r.x, r.x + r.w)) {
+            if (!is_active(t)) {
+                continue;
+            }
 
-                    fvec<S> p[3], n[3];
+            if (lane != 0 && t.mi_index != packet_mi) {
+                flush_packet();
+                lane = 0;
+            }
 
-                    TransformPoint(_p, mi.xform, p);
-                    TransformNormal(_n, mi.inv_xform, n);
+            if (lane == 0) {
+                if (t.mi_index != packet_mi) {
+                    Ray::InverseAffineMatrix(mesh_instances[t.mi_index].inv_xform, xform);
+                    packet_mi = t.mi_index;
+                }
 
-                    UNROLLED_FOR(i, 3, { where(fmask, out_ray.o[i]) = p[i] + n[i]; })
-                    UNROLLED_FOR(i, 3, { where(fmask, out_ray.d[i]) = -n[i]; })
-                    // where(fmask, out_ray.ior) = 1.0f;
-                    where(fmask, out_ray.depth) = pack_ray_type(RAY_TYPE_DIFFUSE);
-                    where(fmask, out_ray.depth) |= pack_depth(ivec<S>{0}, ivec<S>{0}, ivec<S>{0}, ivec<S>{0});
+                mask = 0;
+                prim_index = 0;
+                xy = 0;
+                u = v = 0.0f;
+                UNROLLED_FOR(i, 3, { p0[i] = p1[i] = p2[i] = n0[i] = n1[i] = n2[i] = 0.0f; })
+            }
 
-                    where(imask, out_inter.prim_index) = tri;
-                    where(imask, out_inter.obj_index) = obj_index;
-                    where(fmask, out_inter.t) = 1.0f;
-                    where(fmask, out_inter.u) = w;
-                    where(fmask, out_inter.v) = u;
-                }
+            // triangles differ between lanes, vertices are gathered one by one
+            const vertex_t v0 = vertices[vtx_indices[t.prim_index * 3 + 0]],
+                           v1 = vertices[vtx_indices[t.prim_index * 3 + 1]],
+                           v2 = vertices[vtx_indices[t.prim_index * 3 + 2]];
+            UNROLLED_FOR(i, 3, {
+                p0[i].set(lane, v0.p[i]);
+                p1[i].set(lane, v1.p[i]);
+                p2[i].set(lane, v2.p[i]);
+                n0[i].set(lane, v0.n[i]);
+                n1[i].set(lane, v1.n[i]);
+                n2[i].set(lane, v2.n[i]);
+            })
+            xy.set(lane, t.xy);
+            prim_index.set(lane, int(t.prim_index));
+            u.set(lane, t.u);
+            v.set(lane, t.v);
+            mask.set(lane, -1);
+
+            if (++lane == S) {
+                flush_packet();
+                lane = 0;
             }
         }
     }
+    if (lane) {
+        flush_packet();
+    }
+
+    return texels_count;
 }
 
 template <int S>
 int Ray::NS::SortRays_CPU(Span<ray_data_t<S>> rays, const float root_min[3], const float cell_size[3],
-                          ivec<S> *hash_values, uint32_t *scan_values, ray_chunk_t *chunks, ray_chunk_t *chunks_temp) {
+                          const int origin_bits, const int dir_bits, ivec<S> *hash_values, uint32_t *scan_values,
+                          ray_chunk_t *chunks, ray_chunk_t *chunks_temp) {
     // From "Fast Ray Sorting and Breadth-First Packet Traversal for GPU Ray Tracing" [2010]
     int rays_count = int(rays.size());
 
     // compute ray hash values
     for (int i = 0; i < rays_count; i++) {
-        hash_values[i] = get_ray_hash(rays[i], root_min, cell_size);
+        hash_values[i] =
+            get_ray_sort_key(rays[i].o, rays[i].d, rays[i].mask, root_min, cell_size, origin_bits, dir_bits);
     }
 
     size_t chunks_count = 0;
@@ -3149,7 +3550,7 @@ int Ray::NS::SortRays_CPU(Span<ray_data_t<S>> rays, const float root_min[3], con
         }
     }
 
-    radix_sort(&chunks[0], &chunks[0] + chunks_count, &chunks_temp[0]);
+    radix_sort(&chunks[0], &chunks[0] + chunks_count, &chunks_temp[0], 3 * origin_bits + 2 * dir_bits);
 
     // decompress sorted spans
     size_t counter = 0;
@@ -3329,6 +3730,100 @@ int Ray::NS::SortRays_GPU(Span<ray_data_t<S>> rays, const float root_min[3], con
     return rays_count;
 }
 
+template <int S>
+int Ray::NS::SortHitsByMaterial(Span<ray_data_t<S>> rays, Span<hit_data_t<S>> inters, const scene_data_t &sc,
+                                std::vector<uint64_t> &temp_keys, aligned_vector<ray_data_t<S>> &temp_rays,
+                                aligned_vector<hit_data_t<S>> &temp_inters) {
+    temp_keys.clear();
+    for (int i = 0; i < int(rays.size()); ++i) {
+        for (int j = 0; j < S; ++j) {
+            const uint32_t key = get_shading_key(rays[i], inters[i], j, sc);
+            if (key != 0xffffffff) {
+                temp_keys.push_back((uint64_t(key) << 32) | uint32_t(i * S + j));
+            }
+        }
+    }
+
+    // NOTE: packing is dense, so packet may still contain more than one material at key boundaries
+    std::sort(begin(temp_keys), end(temp_keys));
+
+    const int rays_count = int(temp_keys.size() + S - 1) / S;
+    temp_rays.resize(rays_count);
+    temp_inters.resize(rays_count);
+
+    for (int i = 0; i < rays_count; ++i) {
+        ray_data_t<S> &out_r = temp_rays[i];
+        hit_data_t<S> &out_i = temp_inters[i];
+        out_r.mask = {0};
+        out_i = {};
+
+        for (int j = 0; j < S && i * S + j < int(temp_keys.size()); ++j) {
+            const uint32_t src_index = uint32_t(temp_keys[i * S + j] & 0xffffffff);
+            copy_lane(rays[src_index / S], src_index % S, out_r, j);
+            copy_lane(inters[src_index / S], src_index % S, out_i, j);
+        }
+    }
+
+    for (int i = 0; i < rays_count; ++i) {
+        rays[i] = temp_rays[i];
+        inters[i] = temp_inters[i];
+    }
+
+    return rays_count;
+}
+
+template <int S>
+int Ray::NS::CountPacketMaterials(Span<const ray_data_t<S>> rays, Span<const hit_data_t<S>> inters,
+                                  const scene_data_t &sc) {
+    int total = 0;
+    for (int i = 0; i < int(rays.size()); ++i) {
+        uint32_t keys[S];
+        int keys_count = 0;
+        for (int j = 0; j < S; ++j) {
+            const uint32_t key = get_shading_key(rays[i], inters[i], j, sc);
+            if (key != 0xffffffff && std::find(keys, keys + keys_count, key) == keys + keys_count) {
+                keys[keys_count++] = key;
+            }
+        }
+        total += keys_count;
+    }
+    return total;
+}
+
+template <int S>
+int Ray::NS::SortShadowRays(Span<shadow_ray_t<S>> rays, const float root_min[3], const float cell_size[3],
+                            std::vector<uint64_t> &temp_keys, aligned_vector<shadow_ray_t<S>> &temp_rays) {
+    temp_keys.clear();
+    for (int i = 0; i < int(rays.size()); ++i) {
+        const ivec<S> keys = get_ray_sort_key(rays[i].o, rays[i].d, rays[i].mask, root_min, cell_size, 7, 5);
+        for (int j = 0; j < S; ++j) {
+            if (rays[i].mask[j]) {
+                temp_keys.push_back((uint64_t(uint32_t(keys[j])) << 32) | uint32_t(i * S + j));
+            }
+        }
+    }
+    std::sort(begin(temp_keys), end(temp_keys));
+
+    const int rays_count = int(temp_keys.size() + S - 1) / S;
+    temp_rays.resize(rays_count);
+
+    for (int i = 0; i < rays_count; ++i) {
+        shadow_ray_t<S> &out_r = temp_rays[i];
+        out_r.mask = {0};
+
+        for (int j = 0; j < S && i * S + j < int(temp_keys.size()); ++j) {
+            const uint32_t src_index = uint32_t(temp_keys[i * S + j] & 0xffffffff);
+            copy_lane(rays[src_index / S], src_index % S, out_r, j);
+        }
+    }
+
+    for (int i = 0; i < rays_count; ++i) {
+        rays[i] = temp_rays[i];
+    }
+
+    return rays_count;
+}
+
 template <int S>
 bool Ray::NS::IntersectTris_ClosestHit(const fvec<S> ro[3], const fvec<S> rd[3], const ivec<S> &ray_mask,
                                        const tri_accel_t *tris, uint32_t num_tris, int obj_index,
@@ -3487,19 +3982,32 @@ bool Ray::NS::IntersectTris_AnyHit(const float o[3], const float d[3], int i, co
 template <int S>
 bool Ray::NS::IntersectTris_AnyHit(const float o[3], const float d[3], const mtri_accel_t *mtris,
                                    const tri_mat_data_t *materials, const uint32_t *indices, const int tri_start,
-                                   const int tri_end, int &inter_prim_index, float &inter_t, float &inter_u,
-                                   float &inter_v) {
-    bool res = false;
+                                   const int tri_end, const int obj_index, shadow_hits_t &out_hits) {
+    alignas(32) int hit_prim_index[8];
+    alignas(32) float hit_t[8], hit_u[8], hit_v[8];
 
     for (int j = tri_start / 8; j < (tri_end + 7) / 8; j++) {
-        res |= IntersectTri<S>(o, d, mtris[j], j * 8, inter_prim_index, inter_t, inter_u, inter_v);
-        // if (res && ((inter.prim_index > 0 && (materials[indices[i]].front_mi & MATERIAL_SOLID_BIT)) ||
-        //             (inter.prim_index < 0 && (materials[indices[i]].back_mi & MATERIAL_SOLID_BIT)))) {
-        //     break;
-        // }
+        long mask = IntersectTri_AllHits<(S > 8 ? 8 : S)>(o, d, mtris[j], j * 8, out_hits.t, hit_prim_index, hit_t,
+                                                           hit_u, hit_v);
+        while (mask) {
+            const long i = GetFirstBit(mask);
+            mask = ClearBit(mask, i);
+
+            const int tri_index = j * 8 + int(i);
+            if (tri_index < tri_start || tri_index >= tri_end) {
+                continue;
+            }
+
+            const tri_mat_data_t &mat = materials[indices[tri_index]];
+            const uint16_t mi = (hit_prim_index[i] < 0) ? mat.back_mi : mat.front_mi;
+            if (is_solid_tri_side(mi)) {
+                return true;
+            }
+            out_hits.Insert(obj_index, hit_prim_index[i], hit_t[i], hit_u[i], hit_v[i]);
+        }
     }
 
-    return res;
+    return false;
 }
 
 template <int S>
@@ -3509,6 +4017,8 @@ bool Ray::NS::Traverse_TLAS_WithStack_ClosestHit(const fvec<S> ro[3], const fvec
                                                  const mesh_t *meshes, const tri_accel_t *tris,
                                                  const uint32_t *tri_indices, hit_data_t<S> &inter) {
     bool res = false;
+    // rays may come with hit that is already resolved (e.g. after passing through transparent surface)
+    const fvec<S> prev_t = inter.t;
 
     fvec<S> inv_d[3], inv_d_o[3];
     comp_aux_inv_values(ro, rd, inv_d, inv_d_o);
@@ -3565,12 +4075,15 @@ bool Ray::NS::Traverse_TLAS_WithStack_ClosestHit(const fvec<S> ro[3], const fvec
         st.index++;
     }
 
-    // resolve primitive index indirection
-    const ivec<S> is_backfacing = (inter.prim_index < 0);
-    where(is_backfacing, inter.prim_index) = -inter.prim_index - 1;
+    // resolve primitive index indirection (only for new hits)
+    const ivec<S> new_hit = ray_mask & simd_cast(inter.t < prev_t);
+    ivec<S> prim_index = (new_hit & inter.prim_index);
+
+    const ivec<S> is_backfacing = (prim_index < 0);
+    where(is_backfacing, prim_index) = -prim_index - 1;
 
-    inter.prim_index = gather(reinterpret_cast<const int *>(tri_indices), inter.prim_index);
-    where(is_backfacing, inter.prim_index) = -inter.prim_index - 1;
+    where(new_hit, inter.prim_index) = gather(reinterpret_cast<const int *>(tri_indices), prim_index);
+    where(new_hit & is_backfacing, inter.prim_index) = -inter.prim_index - 1;
 
     return res;
 }
@@ -3582,6 +4095,7 @@ bool Ray::NS::Traverse_TLAS_WithStack_ClosestHit(const fvec<S> ro[3], const fvec
                                                  const mesh_t *meshes, const mtri_accel_t *mtris,
                                                  const uint32_t *tri_indices, hit_data_t<S> &inter) {
     bool res = false;
+    const fvec<S> prev_t = inter.t;
 
     fvec<S> inv_d[3], inv_d_o[3];
     comp_aux_inv_values(ro, rd, inv_d, inv_d_o);
@@ -3719,14 +4233,15 @@ bool Ray::NS::Traverse_TLAS_WithStack_ClosestHit(const fvec<S> ro[3], const fvec
     inter.u = fvec<S>{inter_u, vector_aligned};
     inter.v = fvec<S>{inter_v, vector_aligned};
 
-    // resolve primitive index indirection
-    ivec<S> prim_index = (ray_mask & inter.prim_index);
+    // resolve primitive index indirection (hits that were not updated are resolved already)
+    const ivec<S> new_hit = ray_mask & simd_cast(inter.t < prev_t);
+    ivec<S> prim_index = (new_hit & inter.prim_index);
 
     const ivec<S> is_backfacing = (prim_index < 0);
     where(is_backfacing, prim_index) = -prim_index - 1;
 
-    where(ray_mask, inter.prim_index) = gather(reinterpret_cast<const int *>(tri_indices), prim_index);
-    where(ray_mask & is_backfacing, inter.prim_index) = -inter.prim_index - 1;
+    where(new_hit, inter.prim_index) = gather(reinterpret_cast<const int *>(tri_indices), prim_index);
+    where(new_hit & is_backfacing, inter.prim_index) = -inter.prim_index - 1;
 
     return res;
 }
@@ -3818,7 +4333,7 @@ Ray::NS::ivec<S> Ray::NS::Traverse_TLAS_WithStack_AnyHit(const fvec<S> ro[3], co
                                                          uint32_t node_index, const mesh_instance_t *mesh_instances,
                                                          const uint32_t *mi_indices, const mesh_t *meshes,
                                                          const mtri_accel_t *mtris, const tri_mat_data_t *materials,
-                                                         const uint32_t *tri_indices, hit_data_t<S> &inter) {
+                                                         const uint32_t *tri_indices, shadow_hits_t out_hits[S]) {
     const int ray_vismask = (1u << ray_type);
 
     ivec<S> solid_hit_mask = {0};
@@ -3826,19 +4341,16 @@ Ray::NS::ivec<S> Ray::NS::Traverse_TLAS_WithStack_AnyHit(const fvec<S> ro[3], co
     fvec<S> inv_d[3], inv_d_o[3];
     comp_aux_inv_values(ro, rd, inv_d, inv_d_o);
 
-    alignas(S * 4) int ray_masks[S], inter_prim_index[S];
-    alignas(S * 4) float inter_t[S], inter_u[S], inter_v[S];
+    alignas(S * 4) int ray_masks[S];
     ray_mask.store_to(ray_masks, vector_aligned);
-    inter.prim_index.store_to(inter_prim_index, vector_aligned);
-    inter.t.store_to(inter_t, vector_aligned);
-    inter.u.store_to(inter_u, vector_aligned);
-    inter.v.store_to(inter_v, vector_aligned);
 
     for (int ri = 0; ri < S; ri++) {
         if (!ray_masks[ri]) {
             continue;
         }
 
+        shadow_hits_t &hits = out_hits[ri];
+
         // recombine in AoS layout
         const float r_o[3] = {ro[0][ri], ro[1][ri], ro[2][ri]}, r_d[3] = {rd[0][ri], rd[1][ri], rd[2][ri]};
         const float _inv_d[3] = {inv_d[0][ri], inv_d[1][ri], inv_d[2][ri]},
@@ -3850,69 +4362,33 @@ Ray::NS::ivec<S> Ray::NS::Traverse_TLAS_WithStack_AnyHit(const fvec<S> ro[3], co
         while (!st.empty()) {
             stack_entry_t cur = st.pop();
 
-            if (cur.dist > inter_t[ri]) {
+            if (cur.dist > hits.t) {
                 continue;
             }
 
         TRAVERSE:
             if (!is_leaf_node(nodes[cur.index])) {
                 alignas(32) float res_dist[8];
-                long mask = bbox_test_oct<S>(_inv_d, _inv_d_o, inter_t[ri], nodes[cur.index].bbox_min,
+                long mask = bbox_test_oct<S>(_inv_d, _inv_d_o, hits.t, nodes[cur.index].bbox_min,
                                              nodes[cur.index].bbox_max, res_dist);
                 if (mask) {
-                    long i = GetFirstBit(mask);
+                    // children are visited in stored order (decreasing surface area) instead of sorting by distance
+                    const uint32_t *children = nodes[cur.index].child;
+                    const long i = GetFirstBit(mask);
                     mask = ClearBit(mask, i);
-                    if (mask == 0) { // only one box was hit
-                        cur.index = nodes[cur.index].child[i];
-                        goto TRAVERSE;
-                    }
-
-                    const long i2 = GetFirstBit(mask);
-                    mask = ClearBit(mask, i2);
-                    if (mask == 0) { // two boxes were hit
-                        if (res_dist[i] < res_dist[i2]) {
-                            st.push(nodes[cur.index].child[i2], res_dist[i2]);
-                            cur.index = nodes[cur.index].child[i];
-                        } else {
-                            st.push(nodes[cur.index].child[i], res_dist[i]);
-                            cur.index = nodes[cur.index].child[i2];
+                    if (mask != 0) {
+                        long rest[8];
+                        int rest_count = 0;
+                        do {
+                            rest[rest_count] = GetFirstBit(mask);
+                            mask = ClearBit(mask, rest[rest_count++]);
+                        } while (mask != 0);
+                        // push in reverse order, so that larger children are popped first
+                        while (rest_count--) {
+                            st.push(children[rest[rest_count]], res_dist[rest[rest_count]]);
                         }
-                        goto TRAVERSE;
-                    }
-
-                    st.push(nodes[cur.index].child[i], res_dist[i]);
-                    st.push(nodes[cur.index].child[i2], res_dist[i2]);
-
-                    i = GetFirstBit(mask);
-                    mask = ClearBit(mask, i);
-                    st.push(nodes[cur.index].child[i], res_dist[i]);
-                    if (mask == 0) { // three boxes were hit
-                        st.sort_top3();
-                        cur.index = st.pop_index();
-                        goto TRAVERSE;
-                    }
-
-                    i = GetFirstBit(mask);
-                    mask = ClearBit(mask, i);
-                    st.push(nodes[cur.index].child[i], res_dist[i]);
-                    if (mask == 0) { // four boxes were hit
-                        st.sort_top4();
-                        cur.index = st.pop_index();
-                        goto TRAVERSE;
                     }
-
-                    const uint32_t size_before = st.stack_size;
-
-                    // from five to eight boxes were hit
-                    do {
-                        i = GetFirstBit(mask);
-                        mask = ClearBit(mask, i);
-                        st.push(nodes[cur.index].child[i], res_dist[i]);
-                    } while (mask != 0);
-
-                    const int count = int(st.stack_size - size_before + 4);
-                    st.sort_topN(count);
-                    cur.index = st.pop_index();
+                    cur.index = children[i];
                     goto TRAVERSE;
                 }
             } else {
@@ -3925,20 +4401,15 @@ Ray::NS::ivec<S> Ray::NS::Traverse_TLAS_WithStack_AnyHit(const fvec<S> ro[3], co
 
                     const mesh_t &m = meshes[mi.mesh_index];
 
-                    if (!bbox_test(_inv_d, _inv_d_o, inter_t[ri], mi.bbox_min, mi.bbox_max)) {
+                    if (!bbox_test(_inv_d, _inv_d_o, hits.t, mi.bbox_min, mi.bbox_max)) {
                         continue;
                     }
 
                     float tr_ro[3], tr_rd[3];
                     TransformRay(r_o, r_d, mi.inv_xform, tr_ro, tr_rd);
 
-                    const int hit_type = Traverse_BLAS_WithStack_AnyHit<S>(tr_ro, tr_rd, nodes, m.node_index, mtris,
-                                                                           materials, tri_indices, inter_prim_index[ri],
-                                                                           inter_t[ri], inter_u[ri], inter_v[ri]);
-                    if (hit_type) {
-                        inter.obj_index.set(ri, int(mi_indices[j]));
-                    }
-                    if (hit_type == 2) {
+                    if (Traverse_BLAS_WithStack_AnyHit<S>(tr_ro, tr_rd, nodes, m.node_index, mtris, materials,
+                                                          tri_indices, int(mi_indices[j]), hits)) {
                         solid_hit_mask.set(ri, -1);
                         break;
                     }
@@ -3951,17 +4422,17 @@ Ray::NS::ivec<S> Ray::NS::Traverse_TLAS_WithStack_AnyHit(const fvec<S> ro[3], co
         }
     }
 
-    inter.prim_index = ivec<S>{inter_prim_index, vector_aligned};
-    inter.t = fvec<S>{inter_t, vector_aligned};
-    inter.u = fvec<S>{inter_u, vector_aligned};
-    inter.v = fvec<S>{inter_v, vector_aligned};
-
     // resolve primitive index indirection
-    const ivec<S> is_backfacing = (inter.prim_index < 0);
-    where(is_backfacing, inter.prim_index) = -inter.prim_index - 1;
-
-    inter.prim_index = gather(reinterpret_cast<const int *>(tri_indices), inter.prim_index);
-    where(is_backfacing, inter.prim_index) = -inter.prim_index - 1;
+    for (int ri = 0; ri < S; ri++) {
+        for (int i = 0; i < out_hits[ri].count; ++i) {
+            int &prim_index = out_hits[ri].hits[i].prim_index;
+            if (prim_index < 0) {
+                prim_index = -int(tri_indices[-prim_index - 1]) - 1;
+            } else {
+                prim_index = int(tri_indices[prim_index]);
+            }
+        }
+    }
 
     return solid_hit_mask;
 }
@@ -4172,12 +4643,10 @@ Ray::NS::ivec<S> Ray::NS::Traverse_BLAS_WithStack_AnyHit(const fvec<S> ro[3], co
 }
 
 template <int S>
-int Ray::NS::Traverse_BLAS_WithStack_AnyHit(const float ro[3], const float rd[3], const wbvh_node_t *nodes,
-                                            uint32_t node_index, const mtri_accel_t *mtris,
-                                            const tri_mat_data_t *materials, const uint32_t *tri_indices,
-                                            int &inter_prim_index, float &inter_t, float &inter_u, float &inter_v) {
-    bool res = false;
-
+bool Ray::NS::Traverse_BLAS_WithStack_AnyHit(const float ro[3], const float rd[3], const wbvh_node_t *nodes,
+                                             uint32_t node_index, const mtri_accel_t *mtris,
+                                             const tri_mat_data_t *materials, const uint32_t *tri_indices,
+                                             const int obj_index, shadow_hits_t &hits) {
     float _inv_d[3], _inv_d_o[3];
     comp_aux_inv_values(ro, rd, _inv_d, _inv_d_o);
 
@@ -4187,90 +4656,45 @@ int Ray::NS::Traverse_BLAS_WithStack_AnyHit(const float ro[3], const float rd[3]
     while (!st.empty()) {
         stack_entry_t cur = st.pop();
 
-        if (cur.dist > inter_t) {
+        if (cur.dist > hits.t) {
             continue;
         }
 
     TRAVERSE:
         if (!is_leaf_node(nodes[cur.index])) {
             alignas(32) float res_dist[8];
-            long mask = bbox_test_oct<S>(_inv_d, _inv_d_o, inter_t, nodes[cur.index].bbox_min,
+            long mask = bbox_test_oct<S>(_inv_d, _inv_d_o, hits.t, nodes[cur.index].bbox_min,
                                          nodes[cur.index].bbox_max, res_dist);
             if (mask) {
-                long i = GetFirstBit(mask);
+                // larger children go first, the same as in TLAS traversal
+                const uint32_t *children = nodes[cur.index].child;
+                const long i = GetFirstBit(mask);
                 mask = ClearBit(mask, i);
-                if (mask == 0) { // only one box was hit
-                    cur.index = nodes[cur.index].child[i];
-                    goto TRAVERSE;
-                }
-
-                const long i2 = GetFirstBit(mask);
-                mask = ClearBit(mask, i2);
-                if (mask == 0) { // two boxes were hit
-                    if (res_dist[i] < res_dist[i2]) {
-                        st.push(nodes[cur.index].child[i2], res_dist[i2]);
-                        cur.index = nodes[cur.index].child[i];
-                    } else {
-                        st.push(nodes[cur.index].child[i], res_dist[i]);
-                        cur.index = nodes[cur.index].child[i2];
+                if (mask != 0) {
+                    long rest[8];
+                    int rest_count = 0;
+                    do {
+                        rest[rest_count] = GetFirstBit(mask);
+                        mask = ClearBit(mask, rest[rest_count++]);
+                    } while (mask != 0);
+                    // push in reverse order, so that larger children are popped first
+                    while (rest_count--) {
+                        st.push(children[rest[rest_count]], res_dist[rest[rest_count]]);
                     }
-                    goto TRAVERSE;
-                }
-
-                st.push(nodes[cur.index].child[i], res_dist[i]);
-                st.push(nodes[cur.index].child[i2], res_dist[i2]);
-
-                i = GetFirstBit(mask);
-                mask = ClearBit(mask, i);
-                st.push(nodes[cur.index].child[i], res_dist[i]);
-                if (mask == 0) { // three boxes were hit
-                    st.sort_top3();
-                    cur.index = st.pop_index();
-                    goto TRAVERSE;
-                }
-
-                i = GetFirstBit(mask);
-                mask = ClearBit(mask, i);
-                st.push(nodes[cur.index].child[i], res_dist[i]);
-                if (mask == 0) { // four boxes were hit
-                    st.sort_top4();
-                    cur.index = st.pop_index();
-                    goto TRAVERSE;
                 }
-
-                const uint32_t size_before = st.stack_size;
-
-                // from five to eight boxes were hit
-                do {
-                    i = GetFirstBit(mask);
-                    mask = ClearBit(mask, i);
-                    st.push(nodes[cur.index].child[i], res_dist[i]);
-                } while (mask != 0);
-
-                const int count = int(st.stack_size - size_before + 4);
-                st.sort_topN(count);
-                cur.index = st.pop_index();
+                cur.index = children[i];
                 goto TRAVERSE;
             }
         } else {
             const int tri_start = int(nodes[cur.index].child[0] & PRIM_INDEX_BITS),
                       tri_end = int(tri_start + nodes[cur.index].child[1]);
-            const bool hit_found = IntersectTris_AnyHit<S>(ro, rd, mtris, materials, tri_indices, tri_start, tri_end,
-                                                           inter_prim_index, inter_t, inter_u, inter_v);
-            if (hit_found) {
-                const bool is_backfacing = inter_prim_index < 0;
-                const uint32_t prim_index = is_backfacing ? -inter_prim_index - 1 : inter_prim_index;
-
-                if ((!is_backfacing && (materials[tri_indices[prim_index]].front_mi & MATERIAL_SOLID_BIT)) ||
-                    (is_backfacing && (materials[tri_indices[prim_index]].back_mi & MATERIAL_SOLID_BIT))) {
-                    return 2;
-                }
+            if (IntersectTris_AnyHit<S>(ro, rd, mtris, materials, tri_indices, tri_start, tri_end, obj_index, hits)) {
+                return true;
             }
-            res |= hit_found;
         }
     }
 
-    return res ? 1 : 0;
+    return false;
 }
 
 template <int S>
@@ -4733,45 +5157,45 @@ void Ray::NS::Sample_EnvQTree(float y_rotation, const fvec4 *const *qtree_mips,
 template <int S>
 void Ray::NS::TransformRay(const fvec<S> ro[3], const fvec<S> rd[3], const float *xform, fvec<S> out_ro[3],
                            fvec<S> out_rd[3]) {
-    out_ro[0] = ro[0] * xform[0] + ro[1] * xform[4] + ro[2] * xform[8] + xform[12];
-    out_ro[1] = ro[0] * xform[1] + ro[1] * xform[5] + ro[2] * xform[9] + xform[13];
-    out_ro[2] = ro[0] * xform[2] + ro[1] * xform[6] + ro[2] * xform[10] + xform[14];
+    out_ro[0] = ro[0] * xform[0] + ro[1] * xform[3] + ro[2] * xform[6] + xform[9];
+    out_ro[1] = ro[0] * xform[1] + ro[1] * xform[4] + ro[2] * xform[7] + xform[10];
+    out_ro[2] = ro[0] * xform[2] + ro[1] * xform[5] + ro[2] * xform[8] + xform[11];
 
-    out_rd[0] = rd[0] * xform[0] + rd[1] * xform[4] + rd[2] * xform[8];
-    out_rd[1] = rd[0] * xform[1] + rd[1] * xform[5] + rd[2] * xform[9];
-    out_rd[2] = rd[0] * xform[2] + rd[1] * xform[6] + rd[2] * xform[10];
+    out_rd[0] = rd[0] * xform[0] + rd[1] * xform[3] + rd[2] * xform[6];
+    out_rd[1] = rd[0] * xform[1] + rd[1] * xform[4] + rd[2] * xform[7];
+    out_rd[2] = rd[0] * xform[2] + rd[1] * xform[5] + rd[2] * xform[8];
 }
 
 void Ray::NS::TransformRay(const float ro[3], const float rd[3], const float *xform, float out_ro[3], float out_rd[3]) {
-    out_ro[0] = ro[0] * xform[0] + ro[1] * xform[4] + ro[2] * xform[8] + xform[12];
-    out_ro[1] = ro[0] * xform[1] + ro[1] * xform[5] + ro[2] * xform[9] + xform[13];
-    out_ro[2] = ro[0] * xform[2] + ro[1] * xform[6] + ro[2] * xform[10] + xform[14];
+    out_ro[0] = ro[0] * xform[0] + ro[1] * xform[3] + ro[2] * xform[6] + xform[9];
+    out_ro[1] = ro[0] * xform[1] + ro[1] * xform[4] + ro[2] * xform[7] + xform[10];
+    out_ro[2] = ro[0] * xform[2] + ro[1] * xform[5] + ro[2] * xform[8] + xform[11];
 
-    out_rd[0] = rd[0] * xform[0] + rd[1] * xform[4] + rd[2] * xform[8];
-    out_rd[1] = rd[0] * xform[1] + rd[1] * xform[5] + rd[2] * xform[9];
-    out_rd[2] = rd[0] * xform[2] + rd[1] * xform[6] + rd[2] * xform[10];
+    out_rd[0] = rd[0] * xform[0] + rd[1] * xform[3] + rd[2] * xform[6];
+    out_rd[1] = rd[0] * xform[1] + rd[1] * xform[4] + rd[2] * xform[7];
+    out_rd[2] = rd[0] * xform[2] + rd[1] * xform[5] + rd[2] * xform[8];
 }
 
 template <int S> void Ray::NS::TransformPoint(const fvec<S> p[3], const float *xform, fvec<S> out_p[3]) {
-    out_p[0] = xform[0] * p[0] + xform[4] * p[1] + xform[8] * p[2] + xform[12];
-    out_p[1] = xform[1] * p[0] + xform[5] * p[1] + xform[9] * p[2] + xform[13];
-    out_p[2] = xform[2] * p[0] + xform[6] * p[1] + xform[10] * p[2] + xform[14];
+    out_p[0] = xform[0] * p[0] + xform[3] * p[1] + xform[6] * p[2] + xform[9];
+    out_p[1] = xform[1] * p[0] + xform[4] * p[1] + xform[7] * p[2] + xform[10];
+    out_p[2] = xform[2] * p[0] + xform[5] * p[1] + xform[8] * p[2] + xform[11];
 }
 
-template <int S> void Ray::NS::TransformPoint(const fvec<S> xform[16], fvec<S> p[3]) {
-    const fvec<S> temp0 = xform[0] * p[0] + xform[4] * p[1] + xform[8] * p[2] + xform[12];
-    const fvec<S> temp1 = xform[1] * p[0] + xform[5] * p[1] + xform[9] * p[2] + xform[13];
-    const fvec<S> temp2 = xform[2] * p[0] + xform[6] * p[1] + xform[10] * p[2] + xform[14];
+template <int S> void Ray::NS::TransformPoint(const fvec<S> xform[12], fvec<S> p[3]) {
+    const fvec<S> temp0 = xform[0] * p[0] + xform[3] * p[1] + xform[6] * p[2] + xform[9];
+    const fvec<S> temp1 = xform[1] * p[0] + xform[4] * p[1] + xform[7] * p[2] + xform[10];
+    const fvec<S> temp2 = xform[2] * p[0] + xform[5] * p[1] + xform[8] * p[2] + xform[11];
 
     p[0] = temp0;
     p[1] = temp1;
     p[2] = temp2;
 }
 
-template <int S> void Ray::NS::TransformDirection(const fvec<S> xform[16], fvec<S> p[3]) {
-    const fvec<S> temp0 = xform[0] * p[0] + xform[4] * p[1] + xform[8] * p[2];
-    const fvec<S> temp1 = xform[1] * p[0] + xform[5] * p[1] + xform[9] * p[2];
-    const fvec<S> temp2 = xform[2] * p[0] + xform[6] * p[1] + xform[10] * p[2];
+template <int S> void Ray::NS::TransformDirection(const fvec<S> xform[12], fvec<S> p[3]) {
+    const fvec<S> temp0 = xform[0] * p[0] + xform[3] * p[1] + xform[6] * p[2];
+    const fvec<S> temp1 = xform[1] * p[0] + xform[4] * p[1] + xform[7] * p[2];
+    const fvec<S> temp2 = xform[2] * p[0] + xform[5] * p[1] + xform[8] * p[2];
 
     p[0] = temp0;
     p[1] = temp1;
@@ -4780,20 +5204,20 @@ template <int S> void Ray::NS::TransformDirection(const fvec<S> xform[16], fvec<
 
 template <int S> void Ray::NS::TransformNormal(const fvec<S> n[3], const float *inv_xform, fvec<S> out_n[3]) {
     out_n[0] = n[0] * inv_xform[0] + n[1] * inv_xform[1] + n[2] * inv_xform[2];
-    out_n[1] = n[0] * inv_xform[4] + n[1] * inv_xform[5] + n[2] * inv_xform[6];
-    out_n[2] = n[0] * inv_xform[8] + n[1] * inv_xform[9] + n[2] * inv_xform[10];
+    out_n[1] = n[0] * inv_xform[3] + n[1] * inv_xform[4] + n[2] * inv_xform[5];
+    out_n[2] = n[0] * inv_xform[6] + n[1] * inv_xform[7] + n[2] * inv_xform[8];
 }
 
-template <int S> void Ray::NS::TransformNormal(const fvec<S> n[3], const fvec<S> inv_xform[16], fvec<S> out_n[3]) {
+template <int S> void Ray::NS::TransformNormal(const fvec<S> n[3], const fvec<S> inv_xform[12], fvec<S> out_n[3]) {
     out_n[0] = n[0] * inv_xform[0] + n[1] * inv_xform[1] + n[2] * inv_xform[2];
-    out_n[1] = n[0] * inv_xform[4] + n[1] * inv_xform[5] + n[2] * inv_xform[6];
-    out_n[2] = n[0] * inv_xform[8] + n[1] * inv_xform[9] + n[2] * inv_xform[10];
+    out_n[1] = n[0] * inv_xform[3] + n[1] * inv_xform[4] + n[2] * inv_xform[5];
+    out_n[2] = n[0] * inv_xform[6] + n[1] * inv_xform[7] + n[2] * inv_xform[8];
 }
 
-template <int S> void Ray::NS::TransformNormal(const fvec<S> inv_xform[16], fvec<S> inout_n[3]) {
+template <int S> void Ray::NS::TransformNormal(const fvec<S> inv_xform[12], fvec<S> inout_n[3]) {
     fvec<S> temp0 = inout_n[0] * inv_xform[0] + inout_n[1] * inv_xform[1] + inout_n[2] * inv_xform[2];
-    fvec<S> temp1 = inout_n[0] * inv_xform[4] + inout_n[1] * inv_xform[5] + inout_n[2] * inv_xform[6];
-    fvec<S> temp2 = inout_n[0] * inv_xform[8] + inout_n[1] * inv_xform[9] + inout_n[2] * inv_xform[10];
+    fvec<S> temp1 = inout_n[0] * inv_xform[3] + inout_n[1] * inv_xform[4] + inout_n[2] * inv_xform[5];
+    fvec<S> temp2 = inout_n[0] * inv_xform[6] + inout_n[1] * inv_xform[7] + inout_n[2] * inv_xform[8];
 
     inout_n[0] = temp0;
     inout_n[1] = temp1;
@@ -5107,16 +5531,9 @@ void Ray::NS::IntersectScene(ray_data_t<S> &r, const int min_transp_depth, const
         fvec<S> uvs[2];
 
         { // Fetch vertex uvs
-            const float *vtx_uvs = &sc.vertices[0].t[0];
-            const int VtxUVsStride = sizeof(vertex_t) / sizeof(float);
-
-            UNROLLED_FOR(i, 2, {
-                const fvec<S> temp1 = gather(vtx_uvs + i, vtx_indices[0] * VtxUVsStride);
-                const fvec<S> temp2 = gather(vtx_uvs + i, vtx_indices[1] * VtxUVsStride);
-                const fvec<S> temp3 = gather(vtx_uvs + i, vtx_indices[2] * VtxUVsStride);
-
-                uvs[i] = temp1 * w + temp2 * inter.u + temp3 * inter.v;
-            })
+            fvec<S> temp1[2], temp2[2], temp3[2];
+            FetchVertexUVs(sc.vertices, vtx_indices, temp1, temp2, temp3);
+            UNROLLED_FOR(i, 2, { uvs[i] = temp1[i] * w + temp2[i] * inter.u + temp3[i] * inter.v; })
         }
 
         std::array<fvec<S>, 2> mix_term_rand =
@@ -5262,34 +5679,215 @@ void Ray::NS::TraceRays(Span<ray_data_t<S>> rays, int min_transp_depth, int max_
     }
 }
 
+template <int S>
+bool Ray::NS::RasterizePrimaryHits(const camera_t &cam, const rect_t &r, const int w, const int h,
+                                   const int min_transp_depth, const int max_transp_depth, const scene_data_t &sc,
+                                   const uint32_t root_index, Span<const uint32_t> mi_indices,
+                                   const Cpu::TexStorageBase *const textures[], const uint32_t rand_seq[],
+                                   const uint32_t random_seed, const int iteration, raster_scratch_t &scratch,
+                                   Span<ray_data_t<S>> rays, Span<hit_data_t<S>> out_inter) {
+    raster_cam_t rc;
+    if (!sc.wnodes || !InitRasterCamera(cam, w, h, rc)) {
+        return false;
+    }
+
+    // Samples are addressed individually (packet index * S + lane), packets are only used to trace leftovers
+    std::vector<int> &px_rays = scratch.px_rays;
+    px_rays.assign(size_t(r.w) * r.h, -1);
+    scratch.hits.resize(rays.size() * S);
+    scratch.rays.resize(6 * rays.size() * S);
+    for (int i = 0; i < int(rays.size()); ++i) {
+        for (int lane = 0; lane < S; ++lane) {
+            raster_hit_t &hit = scratch.hits[i * S + lane];
+            hit = {-1, -1, out_inter[i].t[lane], 0.0f, -1.0f};
+            if (!rays[i].mask[lane]) {
+                continue;
+            }
+            const int x = int(rays[i].xy[lane] >> 16), y = int(rays[i].xy[lane] & 0x0000ffff);
+            px_rays[(y - r.y) * r.w + (x - r.x)] = i * S + lane;
+
+            float *ray = &scratch.rays[6 * (size_t(i) * S + lane)];
+            for (int k = 0; k < 3; ++k) {
+                ray[k] = rays[i].o[k][lane];
+                ray[3 + k] = rays[i].d[k][lane];
+            }
+        }
+    }
+
+    RasterizeTriGroups(rc, r, sc, root_index, mi_indices, IntersectRasterTri<S>, scratch);
+
+    for (int i = 0; i < int(rays.size()); ++i) {
+        ray_data_t<S> &r = rays[i];
+        hit_data_t<S> &inter = out_inter[i];
+
+        ivec<S> trace_mask = 0;
+        for (int lane = 0; lane < S; ++lane) {
+            const raster_hit_t &hit = scratch.hits[i * S + lane];
+            if (hit.v < 0.0f) {
+                continue;
+            }
+
+            const bool is_backfacing = (hit.prim_index < 0);
+            const uint32_t tri_index = sc.tri_indices[is_backfacing ? -hit.prim_index - 1 : hit.prim_index];
+
+            if (is_solid_tri_side(is_backfacing ? sc.tri_materials[tri_index].back_mi
+                                                : sc.tri_materials[tri_index].front_mi)) {
+                inter.obj_index.set(lane, hit.obj_index);
+                inter.prim_index.set(lane, is_backfacing ? -int(tri_index) - 1 : int(tri_index));
+                inter.t.set(lane, hit.t);
+                inter.u.set(lane, hit.u);
+                inter.v.set(lane, hit.v);
+            } else {
+                trace_mask.set(lane, -1);
+            }
+        }
+
+        if (trace_mask.not_all_zeros()) {
+            // lanes that hit non-solid surface are traced as usual, the rest of packet is masked out temporarily
+            const ivec<S> mask = r.mask;
+            r.mask = trace_mask;
+            IntersectScene(r, min_transp_depth, max_transp_depth, rand_seq, random_seed, iteration, sc, root_index,
+                           textures, inter);
+            r.mask = mask;
+        }
+    }
+
+    return true;
+}
+
+template <int S>
+int Ray::NS::FetchCachedPrimaryHits(Span<ray_data_t<S>> rays, Span<hit_data_t<S>> out_inter,
+                                    const cached_hit_t cache[], const int w, const uint32_t epoch,
+                                    std::vector<uint32_t> &cached_lanes) {
+    static_assert(S <= 32, "!");
+    cached_lanes.resize(rays.size());
+
+    int traced_count = 0;
+    for (int i = 0; i < int(rays.size()); ++i) {
+        ray_data_t<S> &r = rays[i];
+        hit_data_t<S> &inter = out_inter[i];
+
+        uint32_t cached = 0;
+        for (int lane = 0; lane < S; ++lane) {
+            if (!r.mask[lane]) {
+                continue;
+            }
+            const uint32_t xy = r.xy[lane];
+            const cached_hit_t &entry = cache[(xy & 0x0000ffff) * w + (xy >> 16)];
+            if (entry.epoch != epoch) {
+                continue;
+            }
+            inter.obj_index.set(lane, entry.obj_index);
+            inter.prim_index.set(lane, entry.prim_index);
+            inter.t.set(lane, entry.t);
+            inter.u.set(lane, entry.u);
+            inter.v.set(lane, entry.v);
+            r.mask.set(lane, 0);
+            cached |= (1u << lane);
+        }
+        cached_lanes[i] = cached;
+
+        if (r.mask.not_all_zeros()) {
+            std::swap(rays[traced_count], rays[i]);
+            std::swap(out_inter[traced_count], out_inter[i]);
+            std::swap(cached_lanes[traced_count], cached_lanes[i]);
+            ++traced_count;
+        }
+    }
+    return traced_count;
+}
+
+template <int S>
+void Ray::NS::StorePrimaryHits(Span<ray_data_t<S>> rays, Span<const hit_data_t<S>> inters, const int traced_count,
+                               const std::vector<uint32_t> &cached_lanes, const scene_data_t &sc,
+                               const uint32_t epoch, const int w, cached_hit_t cache[]) {
+    for (int i = 0; i < int(rays.size()); ++i) {
+        ray_data_t<S> &r = rays[i];
+        const hit_data_t<S> &inter = inters[i];
+
+        if (i < traced_count) {
+            const ivec<S> transp_depth = get_transp_depth(r.depth);
+            for (int lane = 0; lane < S; ++lane) {
+                if (!r.mask[lane] || transp_depth[lane] != 0) {
+                    continue;
+                }
+                if (inter.v[lane] >= 0.0f) {
+                    const int prim_index = inter.prim_index[lane];
+                    const bool is_backfacing = (prim_index < 0);
+                    const uint32_t tri_index = is_backfacing ? -prim_index - 1 : prim_index;
+                    if (!is_solid_tri_side(is_backfacing ? sc.tri_materials[tri_index].back_mi
+                                                         : sc.tri_materials[tri_index].front_mi)) {
+                        continue;
+                    }
+                }
+                const uint32_t xy = r.xy[lane];
+                cache[(xy & 0x0000ffff) * w + (xy >> 16)] = {
+                    epoch, inter.obj_index[lane], inter.prim_index[lane], inter.t[lane], inter.u[lane], inter.v[lane]};
+            }
+        }
+
+        for (int lane = 0; lane < S; ++lane) {
+            if (cached_lanes[i] & (1u << lane)) {
+                r.mask.set(lane, -1);
+            }
+        }
+    }
+}
+
 template <int S>
 void Ray::NS::TraceShadowRays(Span<const shadow_ray_t<S>> rays, int max_transp_depth, float _clamp_val,
                               const scene_data_t &sc, const uint32_t root_index, const uint32_t rand_seq[],
                               const uint32_t rand_seed, const int iteration,
                               const Cpu::TexStorageBase *const textures[], int img_w, color_rgba_t *out_color) {
     const float limit = (_clamp_val != 0.0f) ? 3.0f * _clamp_val : FLT_MAX;
-    for (int i = 0; i < rays.size(); ++i) {
-        const shadow_ray_t<S> &sh_r = rays[i];
 
-        fvec<S> rc[3];
-        IntersectScene(sh_r, max_transp_depth, sc, root_index, rand_seq, rand_seed, iteration, textures, rc);
+    // Light blockers are tested for the batch of packets first, lanes that are blocked completely are masked out
+    // before scene traversal
+    const int BatchSize = 16;
+    fvec<S> light_visibility[BatchSize];
+
+    for (int batch_start = 0; batch_start < int(rays.size()); batch_start += BatchSize) {
+        const int batch_end = std::min(batch_start + BatchSize, int(rays.size()));
         if (sc.blocker_lights_count) {
-            const fvec<S> k = IntersectAreaLights(sh_r, sc.lights, sc.light_cwnodes);
-            UNROLLED_FOR(j, 3, { rc[j] *= k; })
+            for (int i = batch_start; i < batch_end; ++i) {
+                light_visibility[i - batch_start] = IntersectAreaLights(rays[i], sc.lights, sc.light_cwnodes);
+            }
         }
-        const fvec<S> sum = rc[0] + rc[1] + rc[2];
-        UNROLLED_FOR(j, 3, { where(sum > limit, rc[j]) = safe_div_pos(rc[j] * limit, sum); })
 
-        const uvec<S> x = sh_r.xy >> 16, y = sh_r.xy & 0x0000FFFF;
+        for (int i = batch_start; i < batch_end; ++i) {
+            const shadow_ray_t<S> *sh_r = &rays[i];
 
-        // TODO: match layouts!
-        UNROLLED_FOR_S(i, S, {
-            if (sh_r.mask.template get<i>()) {
-                auto old_val = fvec4(out_color[y.template get<i>() * img_w + x.template get<i>()].v, vector_aligned);
-                old_val += fvec4(rc[0].template get<i>(), rc[1].template get<i>(), rc[2].template get<i>(), 0.0f);
-                old_val.store_to(out_color[y.template get<i>() * img_w + x.template get<i>()].v, vector_aligned);
+            shadow_ray_t<S> unblocked_r;
+            if (sc.blocker_lights_count) {
+                const ivec<S> unblocked_mask = sh_r->mask & simd_cast(light_visibility[i - batch_start] > 0.0f);
+                if (unblocked_mask.all_zeros()) {
+                    continue;
+                }
+                unblocked_r = *sh_r;
+                unblocked_r.mask = unblocked_mask;
+                sh_r = &unblocked_r;
             }
-        })
+
+            fvec<S> rc[3];
+            IntersectScene(*sh_r, max_transp_depth, sc, root_index, rand_seq, rand_seed, iteration, textures, rc);
+            if (sc.blocker_lights_count) {
+                UNROLLED_FOR(j, 3, { rc[j] *= light_visibility[i - batch_start]; })
+            }
+            const fvec<S> sum = rc[0] + rc[1] + rc[2];
+            UNROLLED_FOR(j, 3, { where(sum > limit, rc[j]) = safe_div_pos(rc[j] * limit, sum); })
+
+            const uvec<S> x = sh_r->xy >> 16, y = sh_r->xy & 0x0000FFFF;
+
+            // TODO: match layouts!
+            UNROLLED_FOR_S(i, S, {
+                if (sh_r->mask.template get<i>()) {
+                    auto old_val =
+                        fvec4(out_color[y.template get<i>() * img_w + x.template get<i>()].v, vector_aligned);
+                    old_val += fvec4(rc[0].template get<i>(), rc[1].template get<i>(), rc[2].template get<i>(), 0.0f);
+                    old_val.store_to(out_color[y.template get<i>() * img_w + x.template get<i>()].v, vector_aligned);
+                }
+            })
+        }
     }
 }
 
@@ -5307,138 +5905,206 @@ void Ray::NS::IntersectScene(const shadow_ray_t<S> &r, const int max_transp_dept
 
     auto rand_dim = uvec<S>(RAND_DIM_BASE_COUNT + get_total_depth(r.depth) * RAND_DIM_BOUNCE_COUNT);
 
+    // with wide BVH the origin is kept between restarts and hits up to t_min are skipped instead
+    fvec<S> t_min = -1.0f;
+
     ivec<S> keep_going = simd_cast(dist > HIT_EPS) & r.mask;
     while (keep_going.not_all_zeros()) {
-        hit_data_t<S> inter;
-        inter.t = dist;
+        const ivec<S> depth_exceeded = keep_going & (depth > max_transp_depth);
+        UNROLLED_FOR(i, 3, { where(depth_exceeded, rc[i]) = 0.0f; })
+        keep_going &= ~depth_exceeded;
+        if (keep_going.all_zeros()) {
+            break;
+        }
+
+        shadow_hits_t hits[S];
 
         ivec<S> solid_hit;
         if (sc.wnodes) {
+            for (int i = 0; i < S; ++i) {
+                hits[i].t = dist[i];
+                hits[i].t_min = t_min[i];
+                // one extra hit is requested to detect that transparency depth is exceeded
+                hits[i].limit = std::min(max_transp_depth - depth[i] + 1, MAX_SHADOW_HITS);
+            }
             solid_hit = Traverse_TLAS_WithStack_AnyHit(ro, r.d, RAY_TYPE_SHADOW, keep_going, sc.wnodes, node_index,
                                                        sc.mesh_instances, sc.mi_indices, sc.meshes, sc.mtris,
-                                                       sc.tri_materials, sc.tri_indices, inter);
+                                                       sc.tri_materials, sc.tri_indices, hits);
         } else {
+            hit_data_t<S> inter;
+            inter.t = dist;
             solid_hit = Traverse_TLAS_WithStack_AnyHit(ro, r.d, RAY_TYPE_SHADOW, keep_going, sc.nodes, node_index,
                                                        sc.mesh_instances, sc.mi_indices, sc.meshes, sc.tris,
                                                        sc.tri_materials, sc.tri_indices, inter);
+            // packet traversal reports only the closest hit
+            for (int i = 0; i < S; ++i) {
+                hits[i].limit = 1;
+                if (inter.v[i] >= 0.0f) {
+                    hits[i].hits[0] = {inter.obj_index[i], inter.prim_index[i], inter.t[i], inter.u[i], inter.v[i]};
+                    hits[i].count = 1;
+                }
+            }
         }
 
-        const ivec<S> terminate_mask = solid_hit | (depth > max_transp_depth);
-        UNROLLED_FOR(i, 3, { where(terminate_mask, rc[i]) = 0.0f; })
+        UNROLLED_FOR(i, 3, { where(solid_hit, rc[i]) = 0.0f; })
+        keep_going &= ~solid_hit;
 
-        keep_going &= simd_cast(inter.v >= 0.0f) & ~terminate_mask;
-        if (keep_going.all_zeros()) {
-            break;
+        float restart_t[S];
+        int max_hits_count = 0;
+        for (int i = 0; i < S; ++i) {
+            restart_t[i] = -1.0f;
+            if (keep_going[i]) {
+                if (sc.wnodes) {
+                    restart_t[i] = hits[i].TrimForRestart();
+                } else if (hits[i].full()) {
+                    restart_t[i] = hits[i].hits[0].t;
+                }
+                max_hits_count = std::max(max_hits_count, hits[i].count);
+            }
         }
 
-        const fvec<S> w = 1.0f - inter.u - inter.v;
+        // Process collected surfaces front-to-back, one layer at a time (traversal is not restarted in between)
+        ivec<S> layer_mask = keep_going;
+        for (int k = 0; k < max_hits_count && layer_mask.not_all_zeros(); ++k) {
+            hit_data_t<S> inter;
+            for (int i = 0; i < S; ++i) {
+                if (layer_mask[i] && k < hits[i].count) {
+                    inter.obj_index.set(i, hits[i].hits[k].obj_index);
+                    inter.prim_index.set(i, hits[i].hits[k].prim_index);
+                    inter.t.set(i, hits[i].hits[k].t);
+                    inter.u.set(i, hits[i].hits[k].u);
+                    inter.v.set(i, hits[i].hits[k].v);
+                }
+            }
+            layer_mask &= simd_cast(inter.v >= 0.0f);
 
-        ivec<S> tri_index = inter.prim_index;
-        const ivec<S> is_backfacing = (tri_index < 0);
-        where(is_backfacing, tri_index) = -tri_index - 1;
+            const fvec<S> w = 1.0f - inter.u - inter.v;
 
-        const ivec<S> vtx_indices[3] = {gather(reinterpret_cast<const int *>(sc.vtx_indices + 0), tri_index * 3),
-                                        gather(reinterpret_cast<const int *>(sc.vtx_indices + 1), tri_index * 3),
-                                        gather(reinterpret_cast<const int *>(sc.vtx_indices + 2), tri_index * 3)};
+            ivec<S> tri_index = inter.prim_index;
+            const ivec<S> is_backfacing = (tri_index < 0);
+            where(is_backfacing, tri_index) = -tri_index - 1;
 
-        fvec<S> sh_uvs[2];
+            ivec<S> mat_index = gather(reinterpret_cast<const int *>(sc.tri_materials), tri_index);
+            where(is_backfacing, mat_index) = mat_index >> 16;
+            mat_index &= 0xffff;
 
-        { // Fetch vertex uvs
-            const float *vtx_uvs = &sc.vertices[0].t[0];
-            const int VtxUVsStride = sizeof(vertex_t) / sizeof(float);
+            { // resolve classified surfaces without sampling textures
+                const ivec<S> is_solid = layer_mask & ((mat_index & MATERIAL_SOLID_BIT) != 0);
+                UNROLLED_FOR(i, 3, { where(is_solid, rc[i]) = 0.0f; })
 
-            UNROLLED_FOR(i, 2, {
-                const fvec<S> temp1 = gather(vtx_uvs + i, vtx_indices[0] * VtxUVsStride);
-                const fvec<S> temp2 = gather(vtx_uvs + i, vtx_indices[1] * VtxUVsStride);
-                const fvec<S> temp3 = gather(vtx_uvs + i, vtx_indices[2] * VtxUVsStride);
+                const ivec<S> is_clear =
+                    layer_mask & ((mat_index & (MATERIAL_SOLID_BIT | MATERIAL_TRANSPARENT_BIT)) ==
+                                  MATERIAL_TRANSPARENT_BIT);
+                where(is_solid | is_clear | ~layer_mask, mat_index) = 0xffff;
+            }
+            where(mat_index != 0xffff, mat_index) = mat_index & MATERIAL_INDEX_BITS;
 
-                sh_uvs[i] = temp1 * w + temp2 * inter.u + temp3 * inter.v;
-            })
-        }
+            const ivec<S> vtx_indices[3] = {gather(reinterpret_cast<const int *>(sc.vtx_indices + 0), tri_index * 3),
+                                            gather(reinterpret_cast<const int *>(sc.vtx_indices + 1), tri_index * 3),
+                                            gather(reinterpret_cast<const int *>(sc.vtx_indices + 2), tri_index * 3)};
 
-        const std::array<fvec<S>, 2> tex_rand =
-            get_scrambled_2d_rand(rand_dim + RAND_DIM_TEX, rand_hash, iteration - 1, rand_seq);
+            fvec<S> sh_uvs[2];
 
-        ivec<S> mat_index = gather(reinterpret_cast<const int *>(sc.tri_materials), tri_index) &
-                            ivec<S>((MATERIAL_INDEX_BITS << 16) | MATERIAL_INDEX_BITS);
+            { // Fetch vertex uvs
+                fvec<S> temp1[2], temp2[2], temp3[2];
+                FetchVertexUVs(sc.vertices, vtx_indices, temp1, temp2, temp3);
+                UNROLLED_FOR(i, 2, { sh_uvs[i] = temp1[i] * w + temp2[i] * inter.u + temp3[i] * inter.v; })
+            }
 
-        where(~is_backfacing, mat_index) = mat_index & 0xffff; // use front material index
-        where(is_backfacing, mat_index) = mat_index >> 16;     // use back material index
-        where(inter.v < 0.0f, mat_index) = 0xffff;
+            const std::array<fvec<S>, 2> tex_rand =
+                get_scrambled_2d_rand(rand_dim + RAND_DIM_TEX, rand_hash, iteration - 1, rand_seq);
 
-        { // resolve material
-            ivec<S> ray_queue[S];
-            int index = 0, num = 1;
+            { // resolve material
+                ivec<S> ray_queue[S];
+                int index = 0, num = 1;
 
-            ray_queue[0] = simd_cast(inter.v >= 0.0f);
+                ray_queue[0] = layer_mask;
 
-            while (index != num) {
-                const int mask = ray_queue[index].movemask();
-                const uint32_t first_mi = mat_index[GetFirstBit(mask)];
+                while (index != num) {
+                    const int mask = ray_queue[index].movemask();
+                    const uint32_t first_mi = mat_index[GetFirstBit(mask)];
 
-                ivec<S> same_mi = (mat_index == first_mi);
-                ivec<S> diff_mi = and_not(same_mi, ray_queue[index]);
+                    ivec<S> same_mi = (mat_index == first_mi);
+                    ivec<S> diff_mi = and_not(same_mi, ray_queue[index]);
 
-                if (diff_mi.not_all_zeros()) {
-                    ray_queue[num] = diff_mi;
-                    num++;
-                }
+                    if (diff_mi.not_all_zeros()) {
+                        ray_queue[num] = diff_mi;
+                        num++;
+                    }
 
-                if (first_mi != 0xffff) {
-                    struct {
-                        uint32_t index;
-                        fvec<S> weight;
-                    } stack[16];
-                    int stack_size = 0;
-
-                    stack[stack_size++] = {first_mi, 1.0f};
-
-                    fvec<S> throughput[3] = {};
-
-                    while (stack_size--) {
-                        const material_t *mat = &sc.materials[stack[stack_size].index];
-                        const fvec<S> weight = stack[stack_size].weight;
-
-                        // resolve mix material
-                        if (mat->type == eShadingNode::Mix) {
-                            fvec<S> mix_val = mat->strength;
-                            const uint32_t first_t = mat->textures[BASE_TEXTURE];
-                            if (first_t != 0xffffffff) {
-                                fvec<S> mix[4] = {};
-                                SampleBilinear(textures, first_t, sh_uvs, {0}, tex_rand.data(), same_mi, mix);
-                                if (first_t & TEX_YCOCG_BIT) {
-                                    YCoCg_to_RGB(mix, mix);
-                                }
-                                if (first_t & TEX_SRGB_BIT) {
-                                    srgb_to_linear(mix, mix);
+                    if (first_mi != 0xffff) {
+                        struct {
+                            uint32_t index;
+                            fvec<S> weight;
+                        } stack[16];
+                        int stack_size = 0;
+
+                        stack[stack_size++] = {first_mi, 1.0f};
+
+                        fvec<S> throughput[3] = {};
+
+                        while (stack_size--) {
+                            const material_t *mat = &sc.materials[stack[stack_size].index];
+                            const fvec<S> weight = stack[stack_size].weight;
+
+                            // resolve mix material
+                            if (mat->type == eShadingNode::Mix) {
+                                fvec<S> mix_val = mat->strength;
+                                const uint32_t first_t = mat->textures[BASE_TEXTURE];
+                                if (first_t != 0xffffffff) {
+                                    fvec<S> mix[4] = {};
+                                    SampleBilinear(textures, first_t, sh_uvs, {0}, tex_rand.data(), same_mi, mix);
+                                    if (first_t & TEX_YCOCG_BIT) {
+                                        YCoCg_to_RGB(mix, mix);
+                                    }
+                                    if (first_t & TEX_SRGB_BIT) {
+                                        srgb_to_linear(mix, mix);
+                                    }
+                                    mix_val *= mix[0];
                                 }
-                                mix_val *= mix[0];
-                            }
 
-                            stack[stack_size++] = {mat->textures[MIX_MAT1], weight * (1.0f - mix_val)};
-                            stack[stack_size++] = {mat->textures[MIX_MAT2], weight * mix_val};
-                        } else if (mat->type == eShadingNode::Transparent) {
-                            UNROLLED_FOR(i, 3, { throughput[i] += weight * mat->base_color[i]; })
+                                stack[stack_size++] = {mat->textures[MIX_MAT1], weight * (1.0f - mix_val)};
+                                stack[stack_size++] = {mat->textures[MIX_MAT2], weight * mix_val};
+                            } else if (mat->type == eShadingNode::Transparent) {
+                                UNROLLED_FOR(i, 3, { throughput[i] += weight * mat->base_color[i]; })
+                            }
                         }
+
+                        UNROLLED_FOR(i, 3, { where(same_mi & layer_mask, rc[i]) *= throughput[i]; })
                     }
 
-                    UNROLLED_FOR(i, 3, { where(same_mi & keep_going, rc[i]) *= throughput[i]; })
+                    index++;
                 }
+            }
 
-                index++;
+            where(layer_mask, depth) += 1;
+            where(layer_mask, rand_dim) += RAND_DIM_BOUNCE_COUNT;
+
+            const ivec<S> layer_depth_exceeded = layer_mask & (depth > max_transp_depth);
+            UNROLLED_FOR(i, 3, { where(layer_depth_exceeded, rc[i]) = 0.0f; })
+
+            layer_mask &= simd_cast(lum(rc) >= FLT_EPS) & ~layer_depth_exceeded;
+        }
+
+        // continue only rays that may have more surfaces behind the collected ones
+        fvec<S> t = 0.0f;
+        for (int i = 0; i < S; ++i) {
+            if (keep_going[i] && layer_mask[i] && restart_t[i] >= 0.0f) {
+                if (sc.wnodes) {
+                    t_min.set(i, restart_t[i]);
+                } else {
+                    // packet traversal has no lower distance bound, ray origin is moved past the hit instead
+                    t.set(i, restart_t[i] + HIT_BIAS);
+                }
+            } else {
+                keep_going.set(i, 0);
             }
         }
 
-        fvec<S> t = inter.t + HIT_BIAS;
         UNROLLED_FOR(i, 3, { ro[i] += r.d[i] * t; })
         dist -= t;
 
-        where(keep_going, depth) += 1;
-
-        // update mask
-        keep_going &= simd_cast(dist > HIT_EPS) & simd_cast(lum(rc) >= FLT_EPS);
-
-        rand_dim += RAND_DIM_BOUNCE_COUNT;
+        keep_going &= simd_cast(dist > max(t_min, fvec<S>{0.0f}) + HIT_EPS);
     }
 }
 
@@ -5783,10 +6449,13 @@ void Ray::NS::SampleLightSource(const fvec<S> P[3], const fvec<S> T[3], const fv
                            &v2 = sc.vertices[sc.vtx_indices[ltri_index * 3 + 1]],
                            &v3 = sc.vertices[sc.vtx_indices[ltri_index * 3 + 2]];
 
+            float lxform[12];
+            Ray::InverseAffineMatrix(lmi.inv_xform, lxform);
+
             float p1[3], p2[3], p3[3];
-            TransformPoint(v1.p, lmi.xform, p1);
-            TransformPoint(v2.p, lmi.xform, p2);
-            TransformPoint(v3.p, lmi.xform, p3);
+            TransformPoint(v1.p, lxform, p1);
+            TransformPoint(v2.p, lxform, p2);
+            TransformPoint(v3.p, lxform, p3);
 
             const fvec<S> vp1[3] = {p1[0], p1[1], p1[2]}, vp2[3] = {p2[0], p2[1], p2[2]},
                           vp3[3] = {p3[0], p3[1], p3[2]};
@@ -7268,35 +7937,15 @@ void Ray::NS::ShadeSurface(const pass_settings_t &ps, const float limits[2], con
     const fvec<S> w = 1.0f - inter.u - inter.v;
 
     fvec<S> p1[3], p2[3], p3[3], P_ls[3];
-    { // Fetch vertex positions
-        const float *vtx_positions = &sc.vertices[0].p[0];
-        const int VtxPositionsStride = sizeof(vertex_t) / sizeof(float);
-
-        UNROLLED_FOR(i, 3, {
-            p1[i] = gather(vtx_positions + i, vtx_indices[0] * VtxPositionsStride);
-            p2[i] = gather(vtx_positions + i, vtx_indices[1] * VtxPositionsStride);
-            p3[i] = gather(vtx_positions + i, vtx_indices[2] * VtxPositionsStride);
+    FetchVertexPositions(sc.vertices, vtx_indices, p1, p2, p3);
+    UNROLLED_FOR(i, 3, { P_ls[i] = p1[i] * w + p2[i] * inter.u + p3[i] * inter.v; })
 
-            P_ls[i] = p1[i] * w + p2[i] * inter.u + p3[i] * inter.v;
-        })
-    }
-
-    FetchVertexAttribute3(&sc.vertices[0].n[0], vtx_indices, inter.u, inter.v, w, surf.N);
+    FetchVertexDir<false>(sc.vertices, vtx_indices, inter.u, inter.v, w, surf.N);
     safe_normalize(surf.N);
 
     fvec<S> u1[2], u2[2], u3[2];
-    { // Fetch vertex uvs
-        const float *vtx_uvs = &sc.vertices[0].t[0];
-        const int VtxUVStride = sizeof(vertex_t) / sizeof(float);
-
-        UNROLLED_FOR(i, 2, {
-            u1[i] = gather(vtx_uvs + i, vtx_indices[0] * VtxUVStride);
-            u2[i] = gather(vtx_uvs + i, vtx_indices[1] * VtxUVStride);
-            u3[i] = gather(vtx_uvs + i, vtx_indices[2] * VtxUVStride);
-
-            surf.uvs[i] = u1[i] * w + u2[i] * inter.u + u3[i] * inter.v;
-        })
-    }
+    FetchVertexUVs(sc.vertices, vtx_indices, u1, u2, u3);
+    UNROLLED_FOR(i, 2, { surf.uvs[i] = u1[i] * w + u2[i] * inter.u + u3[i] * inter.v; })
 
     { // calc planar normal
         fvec<S> e21[3], e31[3];
@@ -7308,7 +7957,7 @@ void Ray::NS::ShadeSurface(const pass_settings_t &ps, const float limits[2], con
     }
     const fvec<S> pa = normalize(surf.plane_N);
 
-    FetchVertexAttribute3(&sc.vertices[0].b[0], vtx_indices, inter.u, inter.v, w, surf.B);
+    FetchVertexDir<true>(sc.vertices, vtx_indices, inter.u, inter.v, w, surf.B);
     cross(surf.B, surf.N, surf.T);
 
     { // return black for non-existing backfacing material
@@ -7336,9 +7985,9 @@ void Ray::NS::ShadeSurface(const pass_settings_t &ps, const float limits[2], con
 
     fvec<S> tangent[3] = {-P_ls[2], {0.0f}, P_ls[0]};
 
-    fvec<S> transform[16], ro_ls[3] = {ray.o[0], ray.o[1], ray.o[2]};
+    fvec<S> inv_transform[12], ro_ls[3] = {ray.o[0], ray.o[1], ray.o[2]};
     FetchTransformAndRecalcBasis(sc.mesh_instances, obj_index, P_ls, surf.plane_N, surf.N, surf.B, surf.T, tangent,
-                                 ro_ls, transform);
+                                 ro_ls, inv_transform);
 
     // normalize vectors (scaling might have been applied)
     safe_normalize(surf.plane_N);
@@ -7823,6 +8472,9 @@ void Ray::NS::ShadeSurface(const pass_settings_t &ps, const float limits[2], con
                     const fvec<S> v1[3] = {p2[0] - p1[0], p2[1] - p1[1], p2[2] - p1[2]},
                                   v2[3] = {p3[0] - p1[0], p3[1] - p1[1], p3[2] - p1[2]};
 
+                    fvec<S> transform[12];
+                    InverseAffineMatrix(inv_transform, transform);
+
                     fvec<S> light_forward[3];
                     cross(v1, v2, light_forward);
                     TransformDirection(transform, light_forward);
@@ -8099,6 +8751,891 @@ void Ray::NS::ShadeSecondary(const pass_settings_t &ps, const float clamp_direct
     }
 }
 
+namespace Ray {
+extern const int MOON_TEX_W;
+extern const int MOON_TEX_H;
+extern const uint8_t __moon_tex[];
+extern const int WEATHER_TEX_RES;
+extern const uint8_t __weather_tex[];
+extern const int NOISE_3D_RES;
+extern const uint8_t __3d_noise_tex[];
+extern const int CIRRUS_TEX_RES;
+extern const uint8_t __cirrus_tex[];
+extern const int CURL_TEX_RES;
+extern const uint8_t __curl_tex[];
+
+namespace NS {
+//
+// Atmosphere (follows AtmosphereRef.cpp, each lane integrates its own view direction)
+//
+
+template <int S> force_inline fvec<S> fast_exp(const fvec<S> &x) {
+    ivec<S> i = ivec<S>(12102203.0f * x) + 127 * (1 << 23);
+    const ivec<S> m = srai(i, 7) & 0xFFFF; // copy mantissa
+    i += srai((srai((srai((srai(3537 * m, 16) + 13668) * m, 18) + 15817) * m, 14) - 80470) * m, 11);
+    return simd_cast(i);
+}
+
+template <int S> force_inline fvec<S> smoothstep(const fvec<S> &edge0, const fvec<S> &edge1, const fvec<S> &x) {
+    const fvec<S> t = saturate((x - edge0) / (edge1 - edge0));
+    return t * t * (3.0f - 2.0f * t);
+}
+
+template <int S> force_inline fvec<S> srgb_to_linear(const fvec<S> &col) {
+    return select(col > 0.04045f, pow((col + 0.055f) / 1.055f, 2.4f), col / 12.92f);
+}
+
+template <int S> force_inline ivec<S> clamp_coord(const ivec<S> &coord, const int size) {
+    return min(max(coord, ivec<S>{0}), ivec<S>{size - 1});
+}
+
+template <int S>
+force_inline void SphereIntersection(const fvec<S> ray_start[3], const fvec<S> ray_dir[3], const float sphere_center[3],
+                                     const float sphere_radius, fvec<S> out_t[2]) {
+    const fvec<S> rs[3] = {ray_start[0] - sphere_center[0], ray_start[1] - sphere_center[1],
+                           ray_start[2] - sphere_center[2]};
+    const fvec<S> a = dot3(ray_dir, ray_dir);
+    const fvec<S> b = 2.0f * dot3(rs, ray_dir);
+    const fvec<S> c = dot3(rs, rs) - (sphere_radius * sphere_radius);
+    const fvec<S> d = b * b - 4.0f * a * c;
+    const fvec<S> sqrt_d = sqrt(max(d, 0.0f));
+    out_t[0] = (-b - sqrt_d) / (2.0f * a);
+    out_t[1] = (-b + sqrt_d) / (2.0f * a);
+    where(d < 0.0f, out_t[0]) = -1.0f;
+    where(d < 0.0f, out_t[1]) = -1.0f;
+}
+
+template <int S>
+force_inline void PlanetIntersection(const atmosphere_params_t &params, const fvec<S> ray_start[3],
+                                     const fvec<S> ray_dir[3], fvec<S> out_t[2]) {
+    const float planet_center[3] = {0.0f, -params.planet_radius, 0.0f};
+    SphereIntersection(ray_start, ray_dir, planet_center, params.planet_radius, out_t);
+}
+
+template <int S>
+force_inline void AtmosphereIntersection(const atmosphere_params_t &params, const fvec<S> ray_start[3],
+                                         const fvec<S> ray_dir[3], fvec<S> out_t[2]) {
+    const float planet_center[3] = {0.0f, -params.planet_radius, 0.0f};
+    SphereIntersection(ray_start, ray_dir, planet_center, params.planet_radius + params.atmosphere_height, out_t);
+}
+
+template <int S>
+force_inline void CloudsIntersection(const atmosphere_params_t &params, const fvec<S> ray_start[3],
+                                     const fvec<S> ray_dir[3], fvec<S> out_t[4]) {
+    const float planet_center[3] = {0.0f, -params.planet_radius, 0.0f};
+    SphereIntersection(ray_start, ray_dir, planet_center, params.planet_radius + params.clouds_height_beg, &out_t[0]);
+    SphereIntersection(ray_start, ray_dir, planet_center, params.planet_radius + params.clouds_height_end, &out_t[2]);
+}
+
+template <int S>
+force_inline void MoonIntersection(const atmosphere_params_t &params, const fvec<S> ray_start[3],
+                                   const fvec<S> ray_dir[3], fvec<S> out_t[2]) {
+    const float moon_center[3] = {params.moon_dir[0] * params.moon_distance, params.moon_dir[1] * params.moon_distance,
+                                  params.moon_dir[2] * params.moon_distance};
+    SphereIntersection(ray_start, ray_dir, moon_center, params.moon_radius, out_t);
+}
+
+// Phase functions
+template <int S> force_inline fvec<S> PhaseRayleigh(const fvec<S> &costh) {
+    return 3.0f * (1.0f + costh * costh) / (16.0f * PI);
+}
+
+template <int S> force_inline fvec<S> PhaseMie(const fvec<S> &costh) {
+    const float g = 0.85f;
+    const float k = 1.55f * g - 0.55f * g * g * g;
+    const fvec<S> kcosth = k * costh;
+    return (1.0f - k * k) / ((4.0f * PI) * (1.0f - kcosth) * (1.0f - kcosth));
+}
+
+template <int S> force_inline fvec<S> HenyeyGreenstein(const fvec<S> &mu, const float g) {
+    const fvec<S> denom = 1.0f + g * g - 2.0f * g * mu;
+    return (1.0f - g * g) / (denom * sqrt(denom) * 4.0f * PI);
+}
+
+template <int S> force_inline fvec<S> CloudPhaseFunction(const fvec<S> &mu) {
+    return mix(HenyeyGreenstein(mu, -0.2f), HenyeyGreenstein(mu, 0.8f), 0.7f);
+}
+
+template <int S> force_inline void PhaseWrenninge(const fvec<S> &mu, fvec<S> out_phase[3]) {
+    const float WrenningePhaseScale = 0.9f;
+    // Wrenninge multiscatter approximation
+    out_phase[0] = CloudPhaseFunction(mu);
+    out_phase[1] = CloudPhaseFunction(mu * WrenningePhaseScale);
+    out_phase[2] = CloudPhaseFunction(mu * WrenningePhaseScale * WrenningePhaseScale);
+}
+
+template <int S> force_inline fvec<S> GetLightEnergy(const fvec<S> &dl, const fvec<S> phase_probability[3]) {
+    // Wrenninge multi scatter approximation
+    return 2.0f * phase_probability[0] * exp(-dl * 0.8f) + 0.8f * phase_probability[1] * exp(-dl * 0.1f) +
+           0.4f * phase_probability[2] * exp(-dl * 0.002f);
+}
+
+template <int S>
+force_inline fvec<S> AtmosphereHeight(const atmosphere_params_t &params, const fvec<S> position_ws[3],
+                                      fvec<S> out_up_vector[3]) {
+    out_up_vector[0] = position_ws[0];
+    out_up_vector[1] = position_ws[1] + params.planet_radius;
+    out_up_vector[2] = position_ws[2];
+    const fvec<S> height = length(out_up_vector);
+    for (int i = 0; i < 3; ++i) {
+        out_up_vector[i] /= height;
+    }
+    return height - params.planet_radius;
+}
+
+template <int S> struct atmosphere_medium_t {
+    fvec<S> scattering[3], extinction[3];
+    fvec<S> scattering_mie[3], scattering_ray[3];
+};
+
+template <int S>
+force_inline void SampleAtmosphereMedium(const atmosphere_params_t &params, const fvec<S> &h,
+                                         atmosphere_medium_t<S> &out_medium) {
+    const fvec<S> density_rayleigh = params.atmosphere_density * fast_exp(-max(h / params.rayleigh_height, 0.0f));
+    const fvec<S> density_mie = params.atmosphere_density * fast_exp(-max(h / params.mie_height, 0.0f));
+    const fvec<S> density_ozone =
+        params.atmosphere_density *
+        max(1.0f - abs(h - params.ozone_height_center) / params.ozone_half_width, fvec<S>{0.0f});
+
+    for (int i = 0; i < 3; ++i) {
+        out_medium.scattering_mie[i] = density_mie * params.mie_scattering[i];
+        out_medium.scattering_ray[i] = density_rayleigh * params.rayleigh_scattering[i];
+        out_medium.scattering[i] = out_medium.scattering_mie[i] + out_medium.scattering_ray[i];
+        out_medium.extinction[i] = density_mie * params.mie_extinction[i] + out_medium.scattering_ray[i] +
+                                   density_ozone * params.ozone_absorbtion[i];
+    }
+}
+
+template <int S>
+force_inline void LutTransmittanceParamsToUv(const atmosphere_params_t &params, const fvec<S> &view_height,
+                                             const fvec<S> &view_zenith_cos_angle, fvec<S> out_uv[2]) {
+    const float top_radius = params.planet_radius + params.atmosphere_height;
+
+    const float H = sqrtf(fmaxf(0.0f, top_radius * top_radius - params.planet_radius * params.planet_radius));
+    const fvec<S> rho = sqrt(max(view_height * view_height - params.planet_radius * params.planet_radius, 0.0f));
+
+    const fvec<S> discriminant =
+        view_height * view_height * (view_zenith_cos_angle * view_zenith_cos_angle - 1.0f) + top_radius * top_radius;
+    // Distance to atmosphere boundary
+    const fvec<S> d = max(-view_height * view_zenith_cos_angle + sqrt(discriminant), 0.0f);
+
+    const fvec<S> d_min = top_radius - view_height;
+    const fvec<S> d_max = rho + H;
+    out_uv[0] = (d - d_min) / (d_max - d_min);
+    out_uv[1] = rho / H;
+}
+
+// Bilinear fetch from float RGBA LUT
+template <int S>
+force_inline void SampleLUT(Span<const float> lut, const int w, const ivec<S> &x0, const ivec<S> &y0,
+                            const ivec<S> &x1, const ivec<S> &y1, const fvec<S> &kx, const fvec<S> &ky,
+                            fvec<S> out_val[3]) {
+    const ivec<S> i00 = 4 * (y0 * w + x0), i01 = 4 * (y0 * w + x1), i10 = 4 * (y1 * w + x0), i11 = 4 * (y1 * w + x1);
+    for (int i = 0; i < 3; ++i) {
+        const fvec<S> v00 = gather(lut.data() + i, i00), v01 = gather(lut.data() + i, i01),
+                      v10 = gather(lut.data() + i, i10), v11 = gather(lut.data() + i, i11);
+        const fvec<S> v0 = v01 * kx + v00 * (1.0f - kx), v1 = v11 * kx + v10 * (1.0f - kx);
+        out_val[i] = v1 * ky + v0 * (1.0f - ky);
+    }
+}
+
+template <int S>
+force_inline void SampleTransmittanceLUT(Span<const float> lut, const fvec<S> uv[2], fvec<S> out_transmittance[3]) {
+    const fvec<S> u = uv[0] * float(SKY_TRANSMITTANCE_LUT_W), v = uv[1] * float(SKY_TRANSMITTANCE_LUT_H);
+    const ivec<S> x0 = clamp_coord(ivec<S>(u), SKY_TRANSMITTANCE_LUT_W),
+                  y0 = clamp_coord(ivec<S>(v), SKY_TRANSMITTANCE_LUT_H);
+    const ivec<S> x1 = min(x0 + 1, ivec<S>{SKY_TRANSMITTANCE_LUT_W - 1}),
+                  y1 = min(y0 + 1, ivec<S>{SKY_TRANSMITTANCE_LUT_H - 1});
+    SampleLUT(lut, SKY_TRANSMITTANCE_LUT_W, x0, y0, x1, y1, fract(u), fract(v), out_transmittance);
+}
+
+template <int S>
+force_inline void SampleMultiscatterLUT(Span<const float> lut, const fvec<S> uv[2], fvec<S> out_multiscatter[3]) {
+    const fvec<S> u = fract(uv[0] - 0.5f / SKY_MULTISCATTER_LUT_RES) * float(SKY_MULTISCATTER_LUT_RES),
+                  v = fract(uv[1] - 0.5f / SKY_MULTISCATTER_LUT_RES) * float(SKY_MULTISCATTER_LUT_RES);
+    const ivec<S> x0 = clamp_coord(ivec<S>(u), SKY_MULTISCATTER_LUT_RES),
+                  y0 = clamp_coord(ivec<S>(v), SKY_MULTISCATTER_LUT_RES);
+    const ivec<S> x1 = min(x0 + 1, ivec<S>{SKY_MULTISCATTER_LUT_RES - 1}),
+                  y1 = min(y0 + 1, ivec<S>{SKY_MULTISCATTER_LUT_RES - 1});
+    SampleLUT(lut, SKY_MULTISCATTER_LUT_RES, x0, y0, x1, y1, fract(u), fract(v), out_multiscatter);
+}
+
+// Transmittance towards the light (and optionally multiscattered luminance) at given height
+template <int S>
+void SampleLightLUTs(const atmosphere_params_t &params, Span<const float> transmittance_lut,
+                     Span<const float> multiscatter_lut, const fvec<S> &local_height, const fvec<S> up_vector[3],
+                     const float light_dir[3], fvec<S> out_transmittance[3], fvec<S> out_multiscattered_lum[3]) {
+    const fvec<S> view_zenith_cos_angle = dot3(light_dir, up_vector);
+
+    fvec<S> uv[2];
+    LutTransmittanceParamsToUv(params, local_height + params.planet_radius, view_zenith_cos_angle, uv);
+    SampleTransmittanceLUT(transmittance_lut, uv, out_transmittance);
+
+    if (!out_multiscattered_lum) {
+        return;
+    }
+    if (multiscatter_lut.empty()) {
+        for (int i = 0; i < 3; ++i) {
+            out_multiscattered_lum[i] = 0.0f;
+        }
+        return;
+    }
+
+    const float res = float(SKY_MULTISCATTER_LUT_RES);
+    uv[0] = saturate(view_zenith_cos_angle * 0.5f + 0.5f);
+    uv[1] = saturate(local_height / params.atmosphere_height);
+    for (int i = 0; i < 2; ++i) {
+        uv[i] = (uv[i] + 0.5f / res) * (res / (res + 1.0f)); // from_unit_to_sub_uvs
+    }
+    SampleMultiscatterLUT(multiscatter_lut, uv, out_multiscattered_lum);
+}
+
+// There is no byte gather, so texels of 8-bit textures are fetched lane by lane
+template <int S, int N>
+force_inline void SampleBilinear_U8(const uint8_t tex[], const int w, const ivec<S> &x0, const ivec<S> &y0,
+                                    const ivec<S> &x1, const ivec<S> &y1, const fvec<S> &kx, const fvec<S> &ky,
+                                    fvec<S> out_val[N]) {
+    fvec<S> t00[N], t01[N], t10[N], t11[N];
+    for (int i = 0; i < S; ++i) {
+        const uint8_t *p00 = &tex[N * (y0[i] * w + x0[i])], *p01 = &tex[N * (y0[i] * w + x1[i])],
+                      *p10 = &tex[N * (y1[i] * w + x0[i])], *p11 = &tex[N * (y1[i] * w + x1[i])];
+        for (int j = 0; j < N; ++j) {
+            t00[j].set(i, float(p00[j]));
+            t01[j].set(i, float(p01[j]));
+            t10[j].set(i, float(p10[j]));
+            t11[j].set(i, float(p11[j]));
+        }
+    }
+    for (int j = 0; j < N; ++j) {
+        const fvec<S> t0 = t01[j] * kx + t00[j] * (1.0f - kx), t1 = t11[j] * kx + t10[j] * (1.0f - kx);
+        out_val[j] = (t1 * ky + t0 * (1.0f - ky)) * (1.0f / 255.0f);
+    }
+}
+
+// Textures with texel centers at integer coordinates and wrapping
+template <int S, int N>
+force_inline void SampleWrapped_U8(const uint8_t tex[], const int res, const fvec<S> uv[2], fvec<S> out_val[N]) {
+    const fvec<S> u = fract(uv[0] - 0.5f / res) * float(res), v = fract(uv[1] - 0.5f / res) * float(res);
+    const ivec<S> x0 = clamp_coord(ivec<S>(u), res), y0 = clamp_coord(ivec<S>(v), res);
+    const ivec<S> x1 = (x0 + 1) & (res - 1), y1 = (y0 + 1) & (res - 1);
+    SampleBilinear_U8<S, N>(tex, res, x0, y0, x1, y1, fract(u), fract(v), out_val);
+}
+
+// Textures without half-texel offset (moon and cirrus)
+template <int S, int N>
+force_inline void SampleSRGB_U8(const uint8_t tex[], const int w, const int h, const fvec<S> uv[2],
+                                fvec<S> out_val[N]) {
+    const fvec<S> u = uv[0] * float(w), v = uv[1] * float(h);
+    const ivec<S> x0 = clamp_coord(ivec<S>(u), w), y0 = clamp_coord(ivec<S>(v), h);
+    const ivec<S> x1 = (x0 + 1) & (w - 1), y1 = (y0 + 1) & (h - 1);
+    SampleBilinear_U8<S, N>(tex, w, x0, y0, x1, y1, fract(u), fract(v), out_val);
+    for (int j = 0; j < N; ++j) {
+        out_val[j] = srgb_to_linear(out_val[j]);
+    }
+}
+
+template <int S> fvec<S> Sample3dNoiseTex(const fvec<S> uvw[3]) {
+    const int res = NOISE_3D_RES;
+
+    ivec<S> i0[3], i1[3];
+    fvec<S> k[3];
+    for (int j = 0; j < 3; ++j) {
+        const fvec<S> coord = fract(uvw[j] - 0.5f / res) * float(res);
+        i0[j] = clamp_coord(ivec<S>(coord), res);
+        i1[j] = (i0[j] + 1) & (res - 1);
+        k[j] = fract(coord);
+    }
+
+    fvec<S> n[8];
+    for (int i = 0; i < S; ++i) {
+        for (int j = 0; j < 8; ++j) {
+            const int x = (j & 1) ? i1[0][i] : i0[0][i], y = (j & 2) ? i1[1][i] : i0[1][i],
+                      z = (j & 4) ? i1[2][i] : i0[2][i];
+            n[j].set(i, float(__3d_noise_tex[z * res * res + y * res + x]));
+        }
+    }
+
+    const fvec<S> n00x = (1.0f - k[0]) * n[0] + k[0] * n[1], n01x = (1.0f - k[0]) * n[2] + k[0] * n[3],
+                  n10x = (1.0f - k[0]) * n[4] + k[0] * n[5], n11x = (1.0f - k[0]) * n[6] + k[0] * n[7];
+
+    const fvec<S> n0xx = (1.0f - k[1]) * n00x + k[1] * n01x, n1xx = (1.0f - k[1]) * n10x + k[1] * n11x;
+
+    return ((1.0f - k[2]) * n0xx + k[2] * n1xx) / 255.0f;
+}
+
+template <int S> fvec<S> GetDensityHeightGradientForPoint(const fvec<S> &height, const fvec<S> &cloud_type) {
+    const float stratus_grad[] = {0.02f, 0.05f, 0.09f, 0.11f};
+    const float stratocumulus_grad[] = {0.02f, 0.2f, 0.48f, 0.625f};
+    const float cumulus_grad[] = {0.01f, 0.0625f, 0.78f, 1.0f};
+    const fvec<S> stratus = 1.0f - saturate(cloud_type * 2.0f);
+    const fvec<S> stratocumulus = 1.0f - abs(cloud_type - 0.5f) * 2.0f;
+    const fvec<S> cumulus = saturate(cloud_type - 0.5f) * 2.0f;
+    fvec<S> cloud_gradient[4];
+    for (int i = 0; i < 4; ++i) {
+        cloud_gradient[i] =
+            stratus_grad[i] * stratus + stratocumulus_grad[i] * stratocumulus + cumulus_grad[i] * cumulus;
+    }
+    return smoothstep(cloud_gradient[0], cloud_gradient[1], height) -
+           smoothstep(cloud_gradient[2], cloud_gradient[3], height);
+}
+
+template <int S> force_inline fvec<S> remap(const fvec<S> &value, const fvec<S> &original_min) {
+    return saturate((value - original_min) / (1.000001f - original_min));
+}
+
+template <int S>
+fvec<S> GetCloudsDensity(const atmosphere_params_t &params, const fvec<S> position[3], fvec<S> &out_local_height,
+                         fvec<S> &out_height_fraction, fvec<S> out_up_vector[3]) {
+    out_local_height = AtmosphereHeight(params, position, out_up_vector);
+    out_height_fraction =
+        (out_local_height - params.clouds_height_beg) / (params.clouds_height_end - params.clouds_height_beg);
+
+    const fvec<S> weather_uv[2] = {(position[0] + params.clouds_offset_x) * 0.00007f,
+                                   (position[2] + params.clouds_offset_z) * 0.00007f};
+    fvec<S> weather_sample[3];
+    SampleWrapped_U8<S, 3>(__weather_tex, WEATHER_TEX_RES, weather_uv, weather_sample);
+
+    fvec<S> cloud_coverage = mix(weather_sample[2], weather_sample[1], params.clouds_variety);
+    cloud_coverage = remap(cloud_coverage, saturate(1.0f - params.clouds_density + 0.5f * out_height_fraction));
+
+    const fvec<S> &cloud_type = weather_sample[0];
+    cloud_coverage *= GetDensityHeightGradientForPoint(out_height_fraction, cloud_type);
+
+    const fvec<S> is_cloud = (out_height_fraction <= 1.0f) & (cloud_coverage >= 0.01f);
+    if (simd_cast(is_cloud).all_zeros()) {
+        return 0.0f;
+    }
+
+    const float scale = 1.0f / (1.5f * (params.clouds_height_end - params.clouds_height_beg));
+    fvec<S> local_position[3] = {position[0] * scale, position[1] * scale, position[2] * scale};
+
+    // TODO: Apply animated cloud offset here
+    const fvec<S> curl_uv0[2] = {8.0f * local_position[0], 8.0f * local_position[2]};
+    fvec<S> curl_read0[3];
+    SampleWrapped_U8<S, 3>(__curl_tex, CURL_TEX_RES, curl_uv0, curl_read0);
+    for (int i = 0; i < 3; ++i) {
+        local_position[i] += srgb_to_linear(curl_read0[i]) * out_height_fraction * 0.25f;
+    }
+
+    const fvec<S> curl_uv1[2] = {16.0f * local_position[1], 16.0f * local_position[0]};
+    fvec<S> curl_read1[3];
+    SampleWrapped_U8<S, 3>(__curl_tex, CURL_TEX_RES, curl_uv1, curl_read1);
+    for (int i = 0; i < 3; ++i) {
+        local_position[i] += srgb_to_linear(curl_read1[(i + 1) % 3]) * (1.0f - out_height_fraction) * 0.05f;
+    }
+
+    const fvec<S> noise_read = Sample3dNoiseTex(local_position);
+    const fvec<S> density = 3.0f * mix(max(1.0f - cloud_type * 2.0f, 0.0f), fvec<S>{1.0f}, out_height_fraction) *
+                            remap(cloud_coverage, 0.6f * noise_read);
+    return select(is_cloud, density, fvec<S>{0.0f});
+}
+
+template <int S>
+fvec<S> TraceCloudShadow(const atmosphere_params_t &params, const uvec<S> &rand_hash, const fvec<S> ray_start[3],
+                         const float ray_dir[3]) {
+    const fvec<S> _ray_dir[3] = {ray_dir[0], ray_dir[1], ray_dir[2]};
+
+    fvec<S> clouds_intersection[4];
+    CloudsIntersection(params, ray_start, _ray_dir, clouds_intersection);
+    const fvec<S> hit_clouds = clouds_intersection[3] > 0.0f;
+    if (simd_cast(hit_clouds).all_zeros()) {
+        return 1.0f;
+    }
+
+    const int SampleCount = 24;
+    const float StepSize = 16.0f;
+
+    const fvec<S> offset = construct_float(ivec<S>(rand_hash)) * StepSize;
+    fvec<S> pos[3];
+    for (int i = 0; i < 3; ++i) {
+        pos[i] = ray_start[i] + offset * ray_dir[i];
+    }
+
+    fvec<S> ret = 0.0f;
+    for (int i = 0; i < SampleCount; ++i) {
+        fvec<S> local_height, height_fraction, up_vector[3];
+        ret += GetCloudsDensity(params, pos, local_height, height_fraction, up_vector);
+        for (int j = 0; j < 3; ++j) {
+            pos[j] += ray_dir[j] * StepSize;
+        }
+    }
+
+    return select(hit_clouds, ret * StepSize, fvec<S>{1.0f});
+}
+
+template <int S>
+void IntegrateScatteringMain(const atmosphere_params_t &params, const fvec<S> ray_start[3], const fvec<S> ray_dir[3],
+                             fvec<S> ray_length, const float light_dir[3], const float moon_dir[3],
+                             const float light_color[3], Span<const float> transmittance_lut,
+                             Span<const float> multiscatter_lut, const fvec<S> &rand_offset, const int sample_count,
+                             const ivec<S> &mask, fvec<S> inout_radiance[3], fvec<S> inout_transmittance[3]) {
+    fvec<S> atm_intersection[2], planet_intersection[2];
+    AtmosphereIntersection(params, ray_start, ray_dir, atm_intersection);
+    ray_length = min(ray_length, atm_intersection[1]);
+    PlanetIntersection(params, ray_start, ray_dir, planet_intersection);
+    where(planet_intersection[0] > 0.0f, ray_length) = min(ray_length, planet_intersection[0]);
+
+    const fvec<S> costh = dot3(ray_dir, light_dir);
+    const fvec<S> phase_r = PhaseRayleigh(costh), phase_m = PhaseMie(costh);
+
+    const fvec<S> moon_costh = dot3(ray_dir, moon_dir);
+    const fvec<S> moon_phase_r = PhaseRayleigh(moon_costh), moon_phase_m = PhaseMie(moon_costh);
+
+    const fvec<S> _light_dir[3] = {light_dir[0], light_dir[1], light_dir[2]};
+
+    fvec<S> radiance[3] = {0.0f, 0.0f, 0.0f};
+    fvec<S> transmittance[3] = {inout_transmittance[0], inout_transmittance[1], inout_transmittance[2]};
+
+    const fvec<S> step_size = ray_length / float(sample_count);
+    fvec<S> ray_time = 0.1f * rand_offset * step_size;
+    for (int i = 0; i < sample_count; ++i) {
+        fvec<S> local_position[3], up_vector[3];
+        for (int j = 0; j < 3; ++j) {
+            local_position[j] = ray_start[j] + ray_dir[j] * ray_time;
+        }
+        const fvec<S> local_height = AtmosphereHeight(params, local_position, up_vector);
+        atmosphere_medium_t<S> medium;
+        SampleAtmosphereMedium(params, local_height, medium);
+
+        fvec<S> in_scattering[3] = {0.0f, 0.0f, 0.0f};
+        if (light_dir[1] > -0.025f) {
+            // main light contribution
+            fvec<S> light_transmittance[3], multiscattered_lum[3];
+            SampleLightLUTs(params, transmittance_lut, multiscatter_lut, local_height, up_vector, light_dir,
+                            light_transmittance, multiscattered_lum);
+
+            fvec<S> light_planet_intersection[2];
+            PlanetIntersection(params, local_position, _light_dir, light_planet_intersection);
+            const fvec<S> planet_shadow = select(light_planet_intersection[0] > 0.0f, fvec<S>{0.0f}, fvec<S>{1.0f});
+
+            for (int j = 0; j < 3; ++j) {
+                const fvec<S> phase_times_scattering =
+                    medium.scattering_ray[j] * phase_r + medium.scattering_mie[j] * phase_m;
+                in_scattering[j] = (planet_shadow * light_transmittance[j] * phase_times_scattering +
+                                    multiscattered_lum[j] * medium.scattering[j]) *
+                                   light_color[j];
+            }
+        } else if (params.moon_radius > 0.0f) {
+            // moon reflection contribution  (totally fake)
+            fvec<S> light_transmittance[3], multiscattered_lum[3];
+            SampleLightLUTs(params, transmittance_lut, multiscatter_lut, local_height, up_vector, moon_dir,
+                            light_transmittance, multiscattered_lum);
+
+            for (int j = 0; j < 3; ++j) {
+                const fvec<S> phase_times_scattering =
+                    medium.scattering_ray[j] * moon_phase_r + medium.scattering_mie[j] * moon_phase_m;
+                in_scattering[j] = SKY_MOON_SUN_RELATION *
+                                   (light_transmittance[j] * phase_times_scattering +
+                                    multiscattered_lum[j] * medium.scattering[j]) *
+                                   light_color[j];
+            }
+        }
+
+        for (int j = 0; j < 3; ++j) {
+            const fvec<S> local_transmittance = fast_exp(-medium.extinction[j] * step_size);
+            const fvec<S> S_int = (in_scattering[j] - in_scattering[j] * local_transmittance) / medium.extinction[j];
+            radiance[j] += transmittance[j] * S_int;
+            transmittance[j] *= local_transmittance;
+        }
+
+        ray_time += step_size;
+    }
+
+    //
+    // Ground 'floor'
+    //
+    const ivec<S> ground_mask = mask & simd_cast(planet_intersection[0] > 0.0f);
+    if (ground_mask.not_all_zeros()) {
+        fvec<S> local_position[3], up_vector[3];
+        for (int j = 0; j < 3; ++j) {
+            local_position[j] = ray_start[j] + ray_dir[j] * planet_intersection[0];
+        }
+        const fvec<S> local_height = AtmosphereHeight(params, local_position, up_vector);
+
+        fvec<S> light_transmittance[3];
+        SampleLightLUTs(params, transmittance_lut, multiscatter_lut, local_height, up_vector, light_dir,
+                        light_transmittance, (fvec<S> *)nullptr);
+
+        const fvec<S> cos_theta = saturate(dot3(up_vector, light_dir));
+        for (int j = 0; j < 3; ++j) {
+            where(ground_mask, radiance[j]) +=
+                params.ground_albedo[j] * cos_theta * transmittance[j] * light_transmittance[j] * light_color[j];
+        }
+    }
+
+    for (int j = 0; j < 3; ++j) {
+        where(mask, inout_radiance[j]) += radiance[j];
+        where(mask, inout_transmittance[j]) = transmittance[j];
+    }
+}
+} // namespace NS
+} // namespace Ray
+
+template <int S>
+void Ray::NS::IntegrateScattering(const atmosphere_params_t &params, const fvec<S> _ray_start[3],
+                                  const fvec<S> ray_dir[3], const float _ray_length, const float light_dir[3],
+                                  const float light_angle, const float light_color[3],
+                                  Span<const float> transmittance_lut, Span<const float> multiscatter_lut,
+                                  uvec<S> rand_hash, ivec<S> mask, fvec<S> out_radiance[3]) {
+    for (int i = 0; i < 3; ++i) {
+        out_radiance[i] = 0.0f;
+    }
+
+    fvec<S> ray_start[3] = {_ray_start[0], _ray_start[1], _ray_start[2]};
+
+    fvec<S> atm_intersection[2];
+    AtmosphereIntersection(params, ray_start, ray_dir, atm_intersection);
+    fvec<S> ray_length = min(fvec<S>{_ray_length}, atm_intersection[1]);
+    { // Advance ray to the atmosphere entry point
+        const fvec<S> outside = atm_intersection[0] > 0.0f;
+        for (int i = 0; i < 3; ++i) {
+            where(outside, ray_start[i]) += ray_dir[i] * atm_intersection[0];
+        }
+        where(outside, ray_length) -= atm_intersection[0];
+    }
+
+    fvec<S> planet_intersection[2];
+    PlanetIntersection(params, ray_start, ray_dir, planet_intersection);
+    where(planet_intersection[0] > 0.0f, ray_length) = min(ray_length, planet_intersection[0]);
+    const ivec<S> sky_mask = simd_cast(planet_intersection[0] < 0.0f);
+
+    mask &= simd_cast(ray_length > 0.0f);
+    if (mask.all_zeros()) {
+        return;
+    }
+
+    fvec<S> moon_intersection[2];
+    MoonIntersection(params, ray_start, ray_dir, moon_intersection);
+
+    // Moon direction does not depend on view direction
+    float moon_dir[3];
+    for (int i = 0; i < 3; ++i) {
+        moon_dir[i] = params.moon_dir[i] * params.moon_distance + 0.5f * light_dir[i] * params.moon_radius;
+    }
+    normalize(moon_dir);
+
+    const fvec<S> costh = dot3(ray_dir, light_dir);
+    fvec<S> phase_w[3];
+    PhaseWrenninge(costh, phase_w);
+
+    const fvec<S> moon_costh = dot3(ray_dir, moon_dir);
+    fvec<S> moon_phase_w[3];
+    PhaseWrenninge(moon_costh, moon_phase_w);
+
+    const float light_brightness = light_color[0] + light_color[1] + light_color[2];
+
+    // 4th component matches alpha channel of the scalar version (it takes part in early termination)
+    fvec<S> total_transmittance[4] = {1.0f, 1.0f, 1.0f, 1.0f};
+
+    fvec<S> clouds_intersection[4];
+    CloudsIntersection(params, ray_start, ray_dir, clouds_intersection);
+    const ivec<S> clouds_mask = simd_cast(clouds_intersection[1] > 0.0f);
+
+    //
+    // Atmosphere before clouds
+    //
+    const ivec<S> pre_atmosphere_mask = mask & clouds_mask;
+    if (pre_atmosphere_mask.not_all_zeros() && light_brightness > 0.0f) {
+        const fvec<S> pre_atmosphere_ray_length = min(ray_length, clouds_intersection[1]);
+
+        const fvec<S> rand_offset = construct_float(ivec<S>(rand_hash));
+        where(pre_atmosphere_mask, rand_hash) = hash(rand_hash);
+
+        IntegrateScatteringMain(params, ray_start, ray_dir, pre_atmosphere_ray_length, light_dir, moon_dir,
+                                light_color, transmittance_lut, multiscatter_lut, rand_offset,
+                                SKY_PRE_ATMOSPHERE_SAMPLE_COUNT, pre_atmosphere_mask, out_radiance,
+                                total_transmittance);
+    }
+
+    //
+    // Main clouds
+    //
+    ivec<S> main_clouds_mask = mask & sky_mask & clouds_mask & simd_cast(ray_dir[1] > SKY_CLOUDS_HORIZON_CUTOFF);
+    const fvec<S> clouds_ray_length = min(ray_length, clouds_intersection[3]) - clouds_intersection[1];
+    main_clouds_mask &= simd_cast(clouds_ray_length > 0.0f);
+    if (main_clouds_mask.not_all_zeros() && params.clouds_density > 0.0f && light_brightness > 0.0f) {
+        const fvec<S> step_size = clouds_ray_length / float(SKY_CLOUDS_SAMPLE_COUNT);
+
+        const fvec<S> offset = clouds_intersection[1] + construct_float(ivec<S>(rand_hash)) * step_size;
+        where(main_clouds_mask, rand_hash) = hash(rand_hash);
+
+        fvec<S> local_position[3];
+        for (int i = 0; i < 3; ++i) {
+            local_position[i] = ray_start[i] + ray_dir[i] * offset;
+        }
+
+        // NOTE: We assume transmittance is constant along the clouds range (~500m)
+        fvec<S> light_transmittance[3], moon_transmittance[3], multiscattered_lum[3], moon_multiscattered_lum[3];
+        {
+            fvec<S> up_vector[3];
+            const fvec<S> local_height = AtmosphereHeight(params, local_position, up_vector);
+            SampleLightLUTs(params, transmittance_lut, multiscatter_lut, local_height, up_vector, light_dir,
+                            light_transmittance, multiscattered_lum);
+            SampleLightLUTs(params, transmittance_lut, multiscatter_lut, local_height, up_vector, moon_dir,
+                            moon_transmittance, moon_multiscattered_lum);
+        }
+
+        const fvec<S> transmittance_before[4] = {total_transmittance[0], total_transmittance[1],
+                                                 total_transmittance[2], total_transmittance[3]};
+
+        fvec<S> clouds[3] = {0.0f, 0.0f, 0.0f};
+
+        ivec<S> march_mask = main_clouds_mask;
+        for (int i = 0; i < SKY_CLOUDS_SAMPLE_COUNT && march_mask.not_all_zeros(); ++i) {
+            fvec<S> local_height, height_fraction, up_vector[3];
+            const fvec<S> local_density =
+                GetCloudsDensity(params, local_position, local_height, height_fraction, up_vector);
+
+            const ivec<S> density_mask = march_mask & simd_cast(local_density > 0.0f);
+            if (density_mask.not_all_zeros()) {
+                const fvec<S> local_transmittance = exp(-local_density * step_size);
+                const fvec<S> ambient_visibility = (0.75f + 1.5f * max(height_fraction - 0.1f, 0.0f));
+
+                if (light_dir[1] > -0.025f) {
+                    // main light contribution
+                    const fvec<S> _light_dir[3] = {light_dir[0], light_dir[1], light_dir[2]};
+                    fvec<S> light_planet_intersection[2];
+                    PlanetIntersection(params, local_position, _light_dir, light_planet_intersection);
+                    const fvec<S> planet_shadow =
+                        select(light_planet_intersection[0] > 0.0f, fvec<S>{0.0f}, fvec<S>{1.0f});
+                    const fvec<S> cloud_shadow = TraceCloudShadow(params, rand_hash, local_position, light_dir);
+                    const fvec<S> light_energy = GetLightEnergy(cloud_shadow, phase_w);
+
+                    for (int j = 0; j < 3; ++j) {
+                        where(density_mask, clouds[j]) +=
+                            total_transmittance[j] *
+                            (planet_shadow * light_energy + ambient_visibility * multiscattered_lum[j]) *
+                            (1.0f - local_transmittance) * light_transmittance[j];
+                    }
+                } else if (params.moon_radius > 0.0f) {
+                    // moon reflection contribution (totally fake)
+                    const fvec<S> cloud_shadow = TraceCloudShadow(params, rand_hash, local_position, moon_dir);
+                    const fvec<S> light_energy = GetLightEnergy(cloud_shadow, moon_phase_w);
+
+                    for (int j = 0; j < 3; ++j) {
+                        where(density_mask, clouds[j]) +=
+                            SKY_MOON_SUN_RELATION * total_transmittance[j] *
+                            (light_energy + ambient_visibility * moon_multiscattered_lum[j]) *
+                            (1.0f - local_transmittance) * moon_transmittance[j];
+                    }
+                }
+
+                for (int j = 0; j < 4; ++j) {
+                    where(density_mask, total_transmittance[j]) *= local_transmittance;
+                }
+                const fvec<S> transmittance_sum =
+                    total_transmittance[0] + total_transmittance[1] + total_transmittance[2] + total_transmittance[3];
+                march_mask = and_not(density_mask & simd_cast(transmittance_sum < 0.01f), march_mask);
+            }
+            for (int j = 0; j < 3; ++j) {
+                local_position[j] += ray_dir[j] * step_size;
+            }
+        }
+
+        // NOTE: totally arbitrary cloud blending
+        const fvec<S> cloud_blend = 1.0f - pow5(saturate((ray_dir[1] - (SKY_CLOUDS_HORIZON_CUTOFF + 0.25f)) / -0.25f));
+
+        for (int j = 0; j < 3; ++j) {
+            where(main_clouds_mask, out_radiance[j]) += cloud_blend * clouds[j] * light_color[j];
+        }
+        for (int j = 0; j < 4; ++j) {
+            where(main_clouds_mask, total_transmittance[j]) =
+                mix(transmittance_before[j], total_transmittance[j], cloud_blend);
+        }
+    }
+
+    //
+    // Cirrus clouds
+    //
+    const ivec<S> cirrus_mask = mask & sky_mask & clouds_mask;
+    if (cirrus_mask.not_all_zeros() && params.cirrus_clouds_amount > 0.0f && light_brightness > 0.0f) {
+        fvec<S> cirrus_coords[2] = {3e-4f * params.clouds_offset_z + 0.8f * ray_dir[2] / (abs(ray_dir[1]) + 0.02f),
+                                    3e-4f * params.clouds_offset_x + 0.8f * ray_dir[0] / (abs(ray_dir[1]) + 0.02f)};
+        cirrus_coords[1] += 1.75f;
+
+        const float amount = params.cirrus_clouds_amount;
+
+        fvec<S> noise_uvw[3] = {0.0f, fract(cirrus_coords[0] * 0.03f), fract(cirrus_coords[1] * 0.03f)};
+        fvec<S> noise_read = 1.0f - Sample3dNoiseTex(noise_uvw);
+        noise_read = saturate(noise_read - 1.0f + amount * 0.6f) / (amount + 1e-9f);
+
+        fvec<S> cirrus_uv[2] = {fract(cirrus_coords[0] * 0.5f), fract(cirrus_coords[1] * 0.5f)};
+        fvec<S> cirrus_sample[2];
+        SampleSRGB_U8<S, 2>(__cirrus_tex, CIRRUS_TEX_RES, CIRRUS_TEX_RES, cirrus_uv, cirrus_sample);
+
+        fvec<S> dC = 1.2f * smoothstep(fvec<S>{0.0f}, fvec<S>{1.0f}, noise_read) * cirrus_sample[0];
+
+        //
+        cirrus_coords[0] += 0.25f;
+        noise_uvw[0] = 0.7f;
+        noise_uvw[1] = fract(cirrus_coords[0] * 0.02f);
+        noise_uvw[2] = fract(cirrus_coords[1] * 0.02f);
+        noise_read = 1.0f - Sample3dNoiseTex(noise_uvw);
+        noise_read = saturate(noise_read - 1.0f + amount * 0.7f) / (amount + 1e-9f);
+
+        cirrus_uv[0] = fract(cirrus_coords[0] * 0.25f);
+        cirrus_uv[1] = fract(cirrus_coords[1] * 0.25f);
+        SampleSRGB_U8<S, 2>(__cirrus_tex, CIRRUS_TEX_RES, CIRRUS_TEX_RES, cirrus_uv, cirrus_sample);
+
+        dC += 0.6f * smoothstep(fvec<S>{0.0f}, fvec<S>{1.0f}, noise_read) * cirrus_sample[1];
+
+        fvec<S> local_position[3];
+        for (int i = 0; i < 3; ++i) {
+            local_position[i] = ray_start[i] + ray_dir[i] * params.cirrus_clouds_height;
+        }
+
+        fvec<S> up_vector[3];
+        const fvec<S> local_height = AtmosphereHeight(params, local_position, up_vector);
+
+        if (light_dir[1] > -0.025f) {
+            fvec<S> light_transmittance[3];
+            SampleLightLUTs(params, transmittance_lut, multiscatter_lut, local_height, up_vector, light_dir,
+                            light_transmittance, (fvec<S> *)nullptr);
+            const fvec<S> light_energy = GetLightEnergy(fvec<S>{0.002f}, phase_w);
+            for (int j = 0; j < 3; ++j) {
+                where(cirrus_mask, out_radiance[j]) +=
+                    total_transmittance[j] * light_energy * light_transmittance[j] * dC * light_color[j];
+            }
+        } else if (params.moon_radius > 0.0f) {
+            fvec<S> moon_transmittance[3];
+            SampleLightLUTs(params, transmittance_lut, multiscatter_lut, local_height, up_vector, moon_dir,
+                            moon_transmittance, (fvec<S> *)nullptr);
+            const fvec<S> light_energy = GetLightEnergy(fvec<S>{0.002f}, moon_phase_w);
+            for (int j = 0; j < 3; ++j) {
+                where(cirrus_mask, out_radiance[j]) += SKY_MOON_SUN_RELATION * total_transmittance[j] *
+                                                       light_energy * moon_transmittance[j] * dC * light_color[j];
+            }
+        }
+
+        const fvec<S> cirrus_transmittance = exp(-dC * 0.002f * 1000.0f);
+        for (int j = 0; j < 4; ++j) {
+            where(cirrus_mask, total_transmittance[j]) *= cirrus_transmittance;
+        }
+    }
+
+    const fvec<S> transmittance_sum =
+        total_transmittance[0] + total_transmittance[1] + total_transmittance[2] + total_transmittance[3];
+    mask &= simd_cast(transmittance_sum >= 0.001f);
+    if (mask.all_zeros()) {
+        return;
+    }
+
+    //
+    // Main atmosphere
+    //
+    const ivec<S> main_atmosphere_mask = mask & sky_mask;
+    if (main_atmosphere_mask.not_all_zeros() && light_brightness > 0.0f) {
+        fvec<S> main_ray_start[3];
+        for (int i = 0; i < 3; ++i) {
+            main_ray_start[i] = ray_start[i] + ray_dir[i] * clouds_intersection[3];
+        }
+        const fvec<S> main_ray_length = ray_length - clouds_intersection[1];
+
+        const fvec<S> rand_offset = construct_float(ivec<S>(rand_hash));
+
+        IntegrateScatteringMain(params, main_ray_start, ray_dir, main_ray_length, light_dir, moon_dir, light_color,
+                                transmittance_lut, multiscatter_lut, rand_offset, SKY_MAIN_ATMOSPHERE_SAMPLE_COUNT,
+                                main_atmosphere_mask, out_radiance, total_transmittance);
+    }
+
+    //
+    // Sun disk (bake directional light into the texture)
+    //
+    if (light_angle > 0.0f && main_atmosphere_mask.not_all_zeros() && light_brightness > 0.0f) {
+        const float cos_theta = cosf(light_angle);
+        // 'de-multiply' by disk area (to get original brightness)
+        const float radius = tanf(light_angle);
+        const fvec<S> sun_disk = smoothstep(fvec<S>{cos_theta - SKY_SUN_BLEND_VAL},
+                                            fvec<S>{cos_theta + SKY_SUN_BLEND_VAL}, costh) /
+                                 (PI * radius * radius);
+        for (int j = 0; j < 3; ++j) {
+            where(main_atmosphere_mask, out_radiance[j]) += total_transmittance[j] * sun_disk * light_color[j];
+        }
+    }
+
+    //
+    // Stars
+    //
+    const ivec<S> stars_mask = main_atmosphere_mask & simd_cast(moon_intersection[0] < 0.0f);
+    if (params.stars_brightness > 0.0f && stars_mask.not_all_zeros()) {
+        // Hashing is very sensitive to rounding, it is kept scalar to get exactly the same stars as other backends
+        fvec<S> stars = 0.0f;
+        for (int i = 0; i < S; ++i) {
+            if (stars_mask[i]) {
+                const Ref::fvec4 p = Ref::fvec4{ray_dir[0][i], ray_dir[1][i], ray_dir[2][i], 0.0f} * 400.0f;
+                stars.set(i, Ref::stars_noise(p));
+            }
+        }
+        stars = pow(saturate(stars), fvec<S>{SKY_STARS_THRESHOLD}) * params.stars_brightness;
+        for (int j = 0; j < 3; ++j) {
+            where(stars_mask, out_radiance[j]) += total_transmittance[j] * stars;
+        }
+    }
+
+    //
+    // Moon
+    //
+    const ivec<S> moon_mask = main_atmosphere_mask & simd_cast(moon_intersection[0] > 0.0f);
+    if (params.moon_radius > 0.0f && moon_mask.not_all_zeros() && light_brightness > 0.0f) {
+        fvec<S> moon_normal[3];
+        for (int i = 0; i < 3; ++i) {
+            moon_normal[i] =
+                ray_start[i] + moon_intersection[0] * ray_dir[i] - params.moon_dir[i] * params.moon_distance;
+        }
+        normalize(moon_normal);
+
+        const fvec<S> theta = acos(clamp(moon_normal[1], -1.0f, 1.0f)) / PI;
+
+        fvec<S> phi;
+        for (int i = 0; i < S; ++i) {
+            phi.set(i, atan2f(moon_normal[2][i], moon_normal[0][i]));
+        }
+        where(phi < 0.0f, phi) += 2 * PI;
+        where(phi > 2 * PI, phi) -= 2 * PI;
+
+        const fvec<S> moon_uv[2] = {fract(0.5f * phi / PI), theta};
+        fvec<S> albedo[3];
+        SampleSRGB_U8<S, 3>(__moon_tex, MOON_TEX_W, MOON_TEX_H, moon_uv, albedo);
+
+        const fvec<S> cos_theta = max(dot3(moon_normal, light_dir), 0.0f);
+        for (int j = 0; j < 3; ++j) {
+            where(moon_mask, out_radiance[j]) += total_transmittance[j] * cos_theta * albedo[j];
+        }
+    }
+}
+
+template <int S>
+void Ray::NS::IntegrateSkyRow(const atmosphere_params_t &params, Span<const float> transmittance_lut,
+                              Span<const float> multiscatter_lut, const float light_dir[3], const float light_angle,
+                              const float light_col[3], const int y, const float cos_theta, const float sin_theta,
+                              Span<const float> cos_phi, Span<const float> sin_phi, float inout_color[]) {
+    const fvec<S> ray_start[3] = {0.0f, params.viewpoint_height, 0.0f};
+
+    const int w = int(cos_phi.size());
+    for (int x = 0; x < w; x += S) {
+        const ivec<S> xx = x + ivec<S>{&ascending_counter[0], vector_aligned};
+        const ivec<S> mask = xx < w;
+
+        fvec<S> ray_dir[3] = {0.0f, cos_theta, 0.0f};
+        for (int i = 0; i < S && x + i < w; ++i) {
+            ray_dir[0].set(i, sin_theta * cos_phi[x + i]);
+            ray_dir[2].set(i, sin_theta * sin_phi[x + i]);
+        }
+
+        const uvec<S> px_hash = hash(uvec<S>((xx << 16) | y));
+
+        fvec<S> color[3];
+        IntegrateScattering(params, ray_start, ray_dir, MAX_DIST, light_dir, light_angle, light_col,
+                            transmittance_lut, multiscatter_lut, px_hash, mask, color);
+
+        for (int i = 0; i < S && x + i < w; ++i) {
+            for (int j = 0; j < 3; ++j) {
+                inout_color[3 * (x + i) + j] += color[j][i];
+            }
+        }
+    }
+}
+
 template <int S>
 void Ray::NS::ShadeSky(const pass_settings_t &ps, float limit, Span<const hit_data_t<S>> inters,
                        Span<const ray_data_t<S>> rays, Span<const uint32_t> ray_indices, const scene_data_t &sc,
@@ -8158,50 +9695,49 @@ void Ray::NS::ShadeSky(const pass_settings_t &ps, float limit, Span<const hit_da
         }
 #endif
 
-        for (int j = 0; j < S; ++j) {
-            if (!mask[j]) {
-                continue;
-            }
-
-            const Ref::fvec4 _I = Ref::fvec4{I[0][j], I[1][j], I[2][j], 0.0f};
+        const fvec<S> ray_start[3] = {0.0f, sc.env.atmosphere.viewpoint_height, 0.0f};
 
-            Ref::fvec4 color = 0.0f;
-            if (!sc.dir_lights.empty()) {
-                for (const uint32_t li_index : sc.dir_lights) {
-                    const light_t &l = sc.lights[li_index];
+        fvec<S> color[3] = {0.0f, 0.0f, 0.0f};
+        if (!sc.dir_lights.empty()) {
+            for (const uint32_t li_index : sc.dir_lights) {
+                const light_t &l = sc.lights[li_index];
 
-                    const Ref::fvec4 light_dir = {l.dir.dir[0], l.dir.dir[1], l.dir.dir[2], 0.0f};
-                    Ref::fvec4 light_col = {l.col[0], l.col[1], l.col[2], 0.0f};
-                    if (l.dir.angle != 0.0f) {
-                        const float radius = tanf(l.dir.angle);
-                        light_col *= (PI * radius * radius);
+                float light_col[3] = {l.col[0], l.col[1], l.col[2]};
+                if (l.dir.angle != 0.0f) {
+                    const float radius = tanf(l.dir.angle);
+                    for (int k = 0; k < 3; ++k) {
+                        light_col[k] *= (PI * radius * radius);
                     }
-
-                    color += Ref::IntegrateScattering(sc.env.atmosphere,
-                                                      Ref::fvec4{0.0f, sc.env.atmosphere.viewpoint_height, 0.0f, 0.0f},
-                                                      _I, MAX_DIST, light_dir, l.dir.angle, light_col,
-                                                      sc.sky_transmittance_lut, sc.sky_multiscatter_lut, rand_hash[j]);
                 }
-            } else if (sc.env.atmosphere.stars_brightness > 0.0f) {
-                // Use fake lightsource (to light up the moon)
-                const Ref::fvec4 light_dir = {0.0f, -1.0f, 0.0f, 0.0f},
-                                 light_col = {144809.866891f, 129443.618266f, 127098.894121f, 0.0f};
-
-                color += Ref::IntegrateScattering(
-                    sc.env.atmosphere, Ref::fvec4{0.0f, sc.env.atmosphere.viewpoint_height, 0.0f, 0.0f}, _I, MAX_DIST,
-                    light_dir, 0.0f, light_col, sc.sky_transmittance_lut, sc.sky_multiscatter_lut, rand_hash[j]);
+
+                fvec<S> light_color[3];
+                IntegrateScattering(sc.env.atmosphere, ray_start, I, MAX_DIST, l.dir.dir, l.dir.angle, light_col,
+                                    sc.sky_transmittance_lut, sc.sky_multiscatter_lut, rand_hash, mask, light_color);
+                UNROLLED_FOR(k, 3, { color[k] += light_color[k]; })
             }
+        } else if (sc.env.atmosphere.stars_brightness > 0.0f) {
+            // Use fake lightsource (to light up the moon)
+            const float light_dir[3] = {0.0f, -1.0f, 0.0f},
+                        light_col[3] = {144809.866891f, 129443.618266f, 127098.894121f};
+
+            IntegrateScattering(sc.env.atmosphere, ray_start, I, MAX_DIST, light_dir, 0.0f, light_col,
+                                sc.sky_transmittance_lut, sc.sky_multiscatter_lut, rand_hash, mask, color);
+        }
 
-            color *= mis_weight[j];
-            color *= Ref::fvec4{r.c[0][j], r.c[1][j], r.c[2][j], 0.0f};
-            const float sum = hsum(color);
-            if (sum > limit) {
-                color *= (limit / sum);
+        UNROLLED_FOR(k, 3, { color[k] *= mis_weight * r.c[k]; })
+        const fvec<S> sum = color[0] + color[1] + color[2];
+        for (int k = 0; k < 3; ++k) {
+            where(sum > limit, color[k]) *= limit / sum;
+        }
+
+        for (int j = 0; j < S; ++j) {
+            if (!mask[j]) {
+                continue;
             }
 
-            out_color[y[j] * img_w + x[j]].v[0] += color[0];
-            out_color[y[j] * img_w + x[j]].v[1] += color[1];
-            out_color[y[j] * img_w + x[j]].v[2] += color[2];
+            out_color[y[j] * img_w + x[j]].v[0] += color[0][j];
+            out_color[y[j] * img_w + x[j]].v[1] += color[1][j];
+            out_color[y[j] * img_w + x[j]].v[2] += color[2][j];
             out_color[y[j] * img_w + x[j]].v[3] = 1.0f;
         }
     }
@@ -2,6 +2,7 @@
 
 #include <cassert>
 
+#include "BinaryIO.h"
 #include "Core.h"
 
 namespace Ray {
@@ -289,6 +290,43 @@ bool Ray::FreelistAlloc::IntegrityCheck() const {
     return (errors == 0);
 }
 
+void Ray::FreelistAlloc::Serialize(BinaryWriter &out) const {
+    out.Write(index_);
+    out.WriteArray(Span<const block_t>(all_blocks_));
+    out.WriteArray(Span<const uint32_t>(unused_blocks_));
+    out.WriteArray(Span<const pool_t>(pools_));
+    out.WriteArray(Span<const uint16_t>(unused_pools_));
+}
+
+bool Ray::FreelistAlloc::Deserialize(BinaryReader &in) {
+    in.Read(index_);
+    in.ReadArray(all_blocks_);
+    in.ReadArray(unused_blocks_);
+    in.ReadArray(pools_);
+    in.ReadArray(unused_pools_);
+    if (in.failed()) {
+        return false;
+    }
+
+    // links are followed without checks later, so they must at least point inside of block array
+    const auto is_valid_link = [this](const uint32_t i) { return i == 0xffffffff || i < all_blocks_.size(); };
+    bool valid = !pools_.empty();
+    for (const pool_t &p : pools_) {
+        valid &= is_valid_link(p.head) && is_valid_link(p.tail);
+    }
+    for (const block_t &b : all_blocks_) {
+        valid &= is_valid_link(b.prev_phys) && is_valid_link(b.next_phys) && is_valid_link(b.prev_free) &&
+                 is_valid_link(b.next_free);
+    }
+    for (const uint32_t i : unused_blocks_) {
+        valid &= (i < all_blocks_.size());
+    }
+    if (!valid) {
+        in.SetFailed();
+    }
+    return valid;
+}
+
 void Ray::FreelistAlloc::insert_free_block(const uint32_t block_index, const std::pair<int, int> index) {
     const uint32_t current_index = index_.free_heads[index.first][index.second];
     all_blocks_[block_index].next_free = current_index;
@@ -8,6 +8,9 @@
 // Based on : https://github.com/mattconte/tlsf
 
 namespace Ray {
+class BinaryReader;
+class BinaryWriter;
+
 template <typename OffsetType, bool InPlace> struct tlsf_index_t {
     static const int ALIGN_SIZE_LOG2 = InPlace ? (sizeof(OffsetType) == 8 ? 3 : 2) : 0;
     static const int ALIGN_SIZE = (1 << ALIGN_SIZE_LOG2);
@@ -151,9 +154,15 @@ class FreelistAlloc {
     Range GetFirstOccupiedBlock(uint16_t pool) const;
     Range GetNextOccupiedBlock(uint32_t block) const;
     Range GetBlockRange(const uint32_t block) const { return {block, all_blocks_[block].offset, all_blocks_[block].size}; }
+    bool IsOccupied(const uint32_t block) const {
+        return block != 0 && block < all_blocks_.size() && !all_blocks_[block].is_free && all_blocks_[block].size != 0;
+    }
 
     bool IntegrityCheck() const;
 
+    void Serialize(BinaryWriter &out) const;
+    bool Deserialize(BinaryReader &in);
+
     static uint32_t rounded_size(const uint32_t size) { return tlsf_index_t<uint32_t, false>::rounded_size(size); }
 };
 } // namespace Ray
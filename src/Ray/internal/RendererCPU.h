@@ -15,6 +15,7 @@
 #include "RadCacheRef.h"
 #include "SceneCPU.h"
 #include "ShadeRef.h"
+#include "TextureUtils.h"
 #include "TonemapRef.h"
 #include "UNetFilter.h"
 
@@ -33,26 +34,29 @@ class SIMDPolicy {
     using HitDataType = Ref::hit_data_t;
     using RayHashType = uint32_t;
 
+    static const int RayPacketDimX = 1, RayPacketDimY = 1;
+
   protected:
     static force_inline eRendererType type() { return eRendererType::Reference; }
 
-    static force_inline void GeneratePrimaryRays(const camera_t &cam, const rect_t &r, int w, int h,
-                                                 const uint32_t rand_seq[], const uint32_t rand_seed,
-                                                 const float filter_table[], const int iteration,
-                                                 const uint16_t required_samples[],
-                                                 aligned_vector<Ref::ray_data_t> &out_rays,
-                                                 aligned_vector<Ref::hit_data_t> &out_inters) {
-        Ref::GeneratePrimaryRays(cam, r, w, h, rand_seq, rand_seed, filter_table, iteration, required_samples, out_rays,
-                                 out_inters);
+    static force_inline int GeneratePrimaryRays(const camera_t &cam, const rect_t &r, int w, int h,
+                                                const uint32_t rand_seq[], const uint32_t rand_seed,
+                                                const float filter_table[], const int iteration,
+                                                const uint16_t required_samples[],
+                                                aligned_vector<Ref::ray_data_t> &out_rays,
+                                                aligned_vector<Ref::hit_data_t> &out_inters) {
+        return Ref::GeneratePrimaryRays(cam, r, w, h, rand_seq, rand_seed, filter_table, iteration, required_samples,
+                                        out_rays, out_inters);
     }
 
-    static force_inline void SampleMeshInTextureSpace(int iteration, int obj_index, int uv_layer, const mesh_t &mesh,
-                                                      const mesh_instance_t &mi, const uint32_t *vtx_indices,
-                                                      const vertex_t *vertices, const rect_t &r, int w, int h,
-                                                      const uint32_t rand_seq[], aligned_vector<ray_data_t> &out_rays,
-                                                      aligned_vector<hit_data_t> &out_inters) {
-        Ref::SampleMeshInTextureSpace(iteration, obj_index, uv_layer, mesh, mi, vtx_indices, vertices, r, w, h,
-                                      rand_seq, out_rays, out_inters);
+    static force_inline int SampleMeshInTextureSpace(int iteration, const mesh_instance_t *mesh_instances,
+                                                     const uint32_t *vtx_indices, const vertex_data_t &vertices,
+                                                     const texel_map_t &texel_map, const rect_t &r,
+                                                     const uint32_t rand_seq[], const uint16_t required_samples[],
+                                                     aligned_vector<ray_data_t> &out_rays,
+                                                     aligned_vector<hit_data_t> &out_inters) {
+        return Ref::SampleMeshInTextureSpace(iteration, mesh_instances, vtx_indices, vertices, texel_map, r, rand_seq,
+                                             required_samples, out_rays, out_inters);
     }
 
     static force_inline void IntersectScene(Span<ray_data_t> rays, int min_transp_depth, int max_transp_depth,
@@ -71,6 +75,33 @@ class SIMDPolicy {
                        random_seed, iteration, out_inter);
     }
 
+    static force_inline bool RasterizePrimaryHits(const camera_t &cam, const rect_t &r, const int w, const int h,
+                                                  int min_transp_depth, int max_transp_depth, const scene_data_t &sc,
+                                                  uint32_t node_index, Span<const uint32_t> mi_indices,
+                                                  const Cpu::TexStorageBase *const textures[],
+                                                  const uint32_t rand_seq[], const uint32_t random_seed,
+                                                  const int iteration, raster_scratch_t &scratch,
+                                                  Span<ray_data_t> rays, Span<hit_data_t> out_inter) {
+        return Ref::RasterizePrimaryHits(cam, r, w, h, min_transp_depth, max_transp_depth, sc, node_index,
+                                         mi_indices, textures, rand_seq, random_seed, iteration, scratch, rays,
+                                         out_inter);
+    }
+
+    // Rays are reordered instead of masked, there are no lanes to remember
+    static force_inline int FetchCachedPrimaryHits(Span<ray_data_t> rays, Span<hit_data_t> out_inter,
+                                                   const cached_hit_t cache[], const int w, const uint32_t epoch,
+                                                   std::vector<uint32_t> &cached_lanes) {
+        return Ref::FetchCachedPrimaryHits(rays, out_inter, cache, w, epoch);
+    }
+
+    static force_inline void StorePrimaryHits(Span<ray_data_t> rays, Span<const hit_data_t> inters,
+                                              const int traced_count, const std::vector<uint32_t> &cached_lanes,
+                                              const scene_data_t &sc, const uint32_t epoch, const int w,
+                                              cached_hit_t cache[]) {
+        Ref::StorePrimaryHits(Span<const ray_data_t>{rays.data(), traced_count},
+                              Span<const hit_data_t>{inters.data(), traced_count}, sc, epoch, w, cache);
+    }
+
     static force_inline void TraceShadowRays(Span<const shadow_ray_t> rays, int max_transp_depth, float clamp_val,
                                              const scene_data_t &sc, uint32_t node_index, const uint32_t rand_seq[],
                                              const uint32_t random_seed, const int iteration,
@@ -81,9 +112,27 @@ class SIMDPolicy {
     }
 
     static force_inline int SortRays_CPU(Span<ray_data_t> rays, const float root_min[3], const float cell_size[3],
-                                         uint32_t *hash_values, uint32_t *scan_values, ray_chunk_t *chunks,
-                                         ray_chunk_t *chunks_temp) {
-        return Ref::SortRays_CPU(rays, root_min, cell_size, hash_values, scan_values, chunks, chunks_temp);
+                                         const int origin_bits, const int dir_bits, uint32_t *hash_values,
+                                         uint32_t *scan_values, ray_chunk_t *chunks, ray_chunk_t *chunks_temp) {
+        return Ref::SortRays_CPU(rays, root_min, cell_size, origin_bits, dir_bits, hash_values, scan_values, chunks,
+                                 chunks_temp);
+    }
+
+    // Rays are shaded one by one, there is nothing to gain from reordering
+    static force_inline int SortHitsByMaterial(Span<ray_data_t> rays, Span<hit_data_t> inters, const scene_data_t &sc,
+                                               std::vector<uint64_t> &temp_keys, aligned_vector<ray_data_t> &temp_rays,
+                                               aligned_vector<hit_data_t> &temp_inters) {
+        return int(rays.size());
+    }
+
+    static force_inline int CountPacketMaterials(Span<const ray_data_t> rays, Span<const hit_data_t> inters,
+                                                 const scene_data_t &sc) {
+        return int(rays.size());
+    }
+
+    static force_inline int SortShadowRays(Span<shadow_ray_t> rays, const float root_min[3], const float cell_size[3],
+                                           std::vector<uint64_t> &temp_keys, aligned_vector<shadow_ray_t> &temp_rays) {
+        return Ref::SortShadowRays(rays, root_min, cell_size, temp_keys, temp_rays);
     }
 
     static force_inline void ShadePrimary(const pass_settings_t &ps, Span<const hit_data_t> inters,
@@ -129,6 +178,17 @@ class SIMDPolicy {
         Ref::ShadeSkySecondary(ps, clamp_direct, inters, rays, ray_indices, sc, iteration, img_w, out_color);
     }
 
+  public:
+    static void IntegrateSkyRow(const atmosphere_params_t &params, Span<const float> transmittance_lut,
+                                Span<const float> multiscatter_lut, const float light_dir[3], const float light_angle,
+                                const float light_col[3], const int y, const float cos_theta, const float sin_theta,
+                                Span<const float> cos_phi, Span<const float> sin_phi, float inout_color[]) {
+        Ref::IntegrateSkyRow(params, transmittance_lut, multiscatter_lut, light_dir, light_angle, light_col, y,
+                             cos_theta, sin_theta, cos_phi, sin_phi, inout_color);
+    }
+
+  protected:
+
     static force_inline void SpatialCacheUpdate(const cache_grid_params_t &params, Span<const hit_data_t> inters,
                                                 Span<const ray_data_t> rays, Span<cache_data_t> cache_data,
                                                 const color_rgba_t radiance[], const color_rgba_t depth_normals[],
@@ -190,12 +250,33 @@ namespace Cpu {
 template <typename SIMDPolicy> class Renderer : public RendererBase, private SIMDPolicy {
     ILog *log_;
 
-    bool use_tex_compression_, use_spatial_cache_;
-    aligned_vector<color_rgba_t, 16> full_buf_, half_buf_, base_color_buf_, depth_normals_buf_, temp_buf_, final_buf_,
+    bool use_tex_compression_, use_vtx_compression_, use_spatial_cache_, use_material_sort_, use_compact_framebuffer_;
+    bool use_ray_sort_, use_raster_primary_, use_packet_stats_;
+    int ray_sort_origin_bits_, ray_sort_dir_bits_;
+    int hit_cache_samples_;
+    int preview_levels_;
+    float preview_budget_ms_;
+    int reprojection_max_samples_;
+    aligned_vector<color_rgba_t, 16> full_buf_, half_buf_, base_color_buf_, depth_normals_buf_, temp_buf_,
         raw_filtered_buf_;
+    // in compact mode tonemapped image is resolved on read (only if something was rendered since the last one)
+    mutable aligned_vector<color_rgba_t, 16> final_buf_;
+    mutable bool final_buf_dirty_ = true;
+    // half-precision variant of half_buf_ used in compact mode (it only serves for variance estimation)
+    std::vector<color_t<uint16_t, 4>> half_buf_f16_;
     std::vector<uint16_t> required_samples_;
-
-    std::mutex mtx_;
+    // pixels sampled by reduced resolution preview (the same layout as required_samples_, filled per region)
+    std::vector<uint16_t> preview_required_;
+    // Previous accumulation kept by Clear, it is reprojected by the first sample of the next one. Per-pixel sample
+    // counts are: accumulated before Clear, taken over from history and accumulated so far (including taken over).
+    // Half buffer is kept too, so that variance of taken over pixels is estimated from history instead of zero
+    aligned_vector<color_rgba_t, 16> history_buf_, history_half_buf_, history_depth_normals_;
+    std::vector<uint16_t> history_samples_, carried_samples_, accum_samples_;
+    camera_t history_cam_ = {}, accum_cam_ = {};
+    uint32_t history_generation_ = 0, accum_generation_ = 0;
+    bool has_history_ = false, has_accum_ = false;
+
+    mutable std::mutex mtx_;
 
     stats_t stats_ = {0};
     int w_ = 0, h_ = 0;
@@ -210,6 +291,11 @@ template <typename SIMDPolicy> class Renderer : public RendererBase, private SIM
 
     std::vector<cache_data_t> temp_cache_data_;
 
+    // primary hits of first samples (w_ * h_ entries per sample), they are valid while view and geometry stay the same
+    std::vector<cached_hit_t> hit_cache_;
+    uint32_t hit_cache_epoch_ = 0, hit_cache_generation_ = 0;
+    camera_t hit_cache_cam_ = {};
+
     aligned_vector<float, 64> unet_weights_;
     unet_weight_offsets_t unet_offsets_;
     bool unet_alias_memory_ = true;
@@ -234,6 +320,53 @@ template <typename SIMDPolicy> class Renderer : public RendererBase, private SIM
     SmallVector<int, 2> unet_alias_dependencies_[UNetFilterPasses];
     void UpdateUNetFilterMemory();
 
+    Ref::fvec4 GetHalfBufValue(const int i) const {
+        if (use_compact_framebuffer_) {
+            const color_t<uint16_t, 4> &c = half_buf_f16_[i];
+            return Ref::fvec4{f16_to_f32(c.v[0]), f16_to_f32(c.v[1]), f16_to_f32(c.v[2]), f16_to_f32(c.v[3])};
+        }
+        return Ref::fvec4{half_buf_[i].v, Ref::vector_aligned};
+    }
+    void SetHalfBufValue(const int i, const Ref::fvec4 &val) {
+        if (use_compact_framebuffer_) {
+            const Ref::fvec4 clamped = min(val, 65504.0f);
+            color_t<uint16_t, 4> &c = half_buf_f16_[i];
+            UNROLLED_FOR(j, 4, { c.v[j] = f32_to_f16(clamped.get<j>()); })
+        } else {
+            val.store_to(half_buf_[i].v, Ref::vector_aligned);
+        }
+    }
+
+    void AllocateDenoiseBuffers_nolock(bool aux);
+    void ResolveFinalBuf() const;
+    void InvalidateFinalBuf() {
+        if (use_compact_framebuffer_) {
+            std::lock_guard<std::mutex> _(mtx_);
+            final_buf_dirty_ = true;
+        }
+    }
+
+    camera_t GetRegionCamera(const camera_t &cam, const RegionContext &region) const;
+    void UpsamplePreview(const rect_t &rect, int step);
+    void ReprojectHistory(const camera_t &cam, const rect_t &rect);
+
+    double framebuffer_bytes_per_pixel() const {
+        // in compact mode final buffer is allocated on the first read, but it is counted in advance
+        const size_t final_buf_size =
+            use_compact_framebuffer_ ? std::max(final_buf_.capacity(), size_t(w_) * h_) : final_buf_.capacity();
+        const size_t total = sizeof(color_rgba_t) * (full_buf_.capacity() + half_buf_.capacity() +
+                                                     base_color_buf_.capacity() + depth_normals_buf_.capacity() +
+                                                     temp_buf_.capacity() + final_buf_size +
+                                                     raw_filtered_buf_.capacity() + history_buf_.capacity() +
+                                                     history_half_buf_.capacity() +
+                                                     history_depth_normals_.capacity()) +
+                             sizeof(color_t<uint16_t, 4>) * half_buf_f16_.capacity() +
+                             sizeof(uint16_t) * (required_samples_.capacity() + preview_required_.capacity() +
+                                                 history_samples_.capacity() + carried_samples_.capacity() +
+                                                 accum_samples_.capacity());
+        return double(total) / std::max(w_ * h_, 1);
+    }
+
   public:
     Renderer(const settings_t &s, ILog *log);
 
@@ -247,12 +380,21 @@ template <typename SIMDPolicy> class Renderer : public RendererBase, private SIM
 
     std::pair<int, int> size() const override { return std::make_pair(w_, h_); }
 
-    color_data_rgba_t get_pixels_ref() const override { return {final_buf_.data(), w_}; }
-    color_data_rgba_t get_raw_pixels_ref() const override { return {raw_filtered_buf_.data(), w_}; }
+    color_data_rgba_t get_pixels_ref() const override {
+        if (use_compact_framebuffer_) {
+            ResolveFinalBuf();
+        }
+        return {final_buf_.data(), w_};
+    }
+    color_data_rgba_t get_raw_pixels_ref() const override {
+        // in compact mode accumulated image is returned as is until denoising will be requested
+        return {raw_filtered_buf_.empty() ? full_buf_.data() : raw_filtered_buf_.data(), w_};
+    }
     color_data_rgba_t get_aux_pixels_ref(const eAUXBuffer buf) const override {
-        if (buf == eAUXBuffer::BaseColor) {
+        // compact framebuffer allocates these only when denoising is requested
+        if (buf == eAUXBuffer::BaseColor && !base_color_buf_.empty()) {
             return {base_color_buf_.data(), w_};
-        } else if (buf == eAUXBuffer::DepthNormals) {
+        } else if (buf == eAUXBuffer::DepthNormals && !depth_normals_buf_.empty()) {
             return color_data_rgba_t{depth_normals_buf_.data(), w_};
         }
         return {};
@@ -264,36 +406,100 @@ template <typename SIMDPolicy> class Renderer : public RendererBase, private SIM
         if (w_ != w || h_ != h) {
             full_buf_.assign(w * h, {});
             full_buf_.shrink_to_fit();
-            half_buf_.assign(w * h, {});
-            half_buf_.shrink_to_fit();
-            base_color_buf_.assign(w * h, {});
-            base_color_buf_.shrink_to_fit();
-            depth_normals_buf_.assign(w * h, {});
-            depth_normals_buf_.shrink_to_fit();
             required_samples_.assign(w * h, 0xffff);
             required_samples_.shrink_to_fit();
+            if (preview_levels_) {
+                preview_required_.assign(w * h, 0);
+                preview_required_.shrink_to_fit();
+            }
             temp_buf_.assign(w * h, {});
             temp_buf_.shrink_to_fit();
-            final_buf_.assign(w * h, {});
-            final_buf_.shrink_to_fit();
-            raw_filtered_buf_.assign(w * h, {});
-            raw_filtered_buf_.shrink_to_fit();
+            if (use_compact_framebuffer_) {
+                half_buf_f16_.assign(w * h, {});
+                half_buf_f16_.shrink_to_fit();
+                // the rest is allocated on demand
+                half_buf_ = {};
+                base_color_buf_ = {};
+                depth_normals_buf_ = {};
+                final_buf_ = {};
+                final_buf_dirty_ = true;
+                raw_filtered_buf_ = {};
+            } else {
+                half_buf_.assign(w * h, {});
+                half_buf_.shrink_to_fit();
+                base_color_buf_.assign(w * h, {});
+                base_color_buf_.shrink_to_fit();
+                depth_normals_buf_.assign(w * h, {});
+                depth_normals_buf_.shrink_to_fit();
+                final_buf_.assign(w * h, {});
+                final_buf_.shrink_to_fit();
+                raw_filtered_buf_.assign(w * h, {});
+                raw_filtered_buf_.shrink_to_fit();
+            }
 
             if (use_spatial_cache_) {
                 temp_cache_data_.assign((w / RAD_CACHE_DOWNSAMPLING_FACTOR) * (h / RAD_CACHE_DOWNSAMPLING_FACTOR), {});
                 temp_cache_data_.shrink_to_fit();
             }
 
+            // all entries start with zero epoch, so they are invalid
+            hit_cache_.assign(size_t(w) * h * hit_cache_samples_, {});
+            hit_cache_.shrink_to_fit();
+
+            if (reprojection_max_samples_) {
+                history_buf_.assign(w * h, {});
+                history_buf_.shrink_to_fit();
+                history_half_buf_.assign(w * h, {});
+                history_half_buf_.shrink_to_fit();
+                history_depth_normals_.assign(w * h, {});
+                history_depth_normals_.shrink_to_fit();
+                history_samples_.assign(w * h, 0);
+                history_samples_.shrink_to_fit();
+                carried_samples_.assign(w * h, 0);
+                carried_samples_.shrink_to_fit();
+                accum_samples_.assign(w * h, 0);
+                accum_samples_.shrink_to_fit();
+            }
+            has_history_ = has_accum_ = false;
+
             w_ = w;
             h_ = h;
 
+            if (use_compact_framebuffer_ && (!unet_weights_.empty() || use_spatial_cache_)) {
+                // spatial cache update uses raw_filtered_buf_ as a temporary storage
+                AllocateDenoiseBuffers_nolock(!unet_weights_.empty() /* aux */);
+            }
+
             UpdateUNetFilterMemory();
+
+            log_->Info("Framebuffer  uses %.1f bytes per pixel", framebuffer_bytes_per_pixel());
         }
     }
 
     void Clear(const color_rgba_t &c) override {
+        if (has_accum_) {
+            // Accumulated image becomes history (repeated clear keeps the previous one), depth and normals are
+            // overwritten by the first sample anyway
+            std::swap(full_buf_, history_buf_);
+            std::swap(half_buf_, history_half_buf_);
+            std::swap(depth_normals_buf_, history_depth_normals_);
+            std::swap(accum_samples_, history_samples_);
+            std::fill(begin(accum_samples_), end(accum_samples_), 0);
+            std::fill(begin(carried_samples_), end(carried_samples_), 0);
+            history_cam_ = accum_cam_;
+            history_generation_ = accum_generation_;
+            has_history_ = true;
+            has_accum_ = false;
+        }
         full_buf_.assign(w_ * h_, c);
-        half_buf_.assign(w_ * h_, c);
+        if (use_compact_framebuffer_) {
+            const color_t<uint16_t, 4> c16 = {
+                {f32_to_f16(c.v[0]), f32_to_f16(c.v[1]), f32_to_f16(c.v[2]), f32_to_f16(c.v[3])}};
+            half_buf_f16_.assign(w_ * h_, c16);
+            final_buf_dirty_ = true;
+        } else {
+            half_buf_.assign(w_ * h_, c);
+        }
         required_samples_.assign(w_ * h_, 0xffff);
     }
 
@@ -339,6 +545,16 @@ template <typename SIMDPolicy> struct PassData {
 
     std::vector<ray_chunk_t> chunks, chunks_temp;
     std::vector<uint32_t> skeleton;
+
+    std::vector<uint64_t> material_keys;
+    aligned_vector<typename SIMDPolicy::RayDataType> material_sorted_rays;
+    aligned_vector<typename SIMDPolicy::HitDataType> material_sorted_inters;
+
+    std::vector<uint64_t> shadow_keys;
+    aligned_vector<typename SIMDPolicy::ShadowRayType> sorted_shadow_rays;
+
+    raster_scratch_t raster_scratch;
+    std::vector<uint32_t> cached_lanes;
 };
 
 template <typename SIMDPolicy> PassData<SIMDPolicy> &get_per_thread_pass_data() {
@@ -350,17 +566,53 @@ template <typename SIMDPolicy> PassData<SIMDPolicy> &get_per_thread_pass_data()
 
 template <typename SIMDPolicy>
 Ray::Cpu::Renderer<SIMDPolicy>::Renderer(const settings_t &s, ILog *log)
-    : log_(log), use_tex_compression_(s.use_tex_compression), use_spatial_cache_(s.use_spatial_cache) {
+    : log_(log), use_tex_compression_(s.use_tex_compression), use_vtx_compression_(s.use_vtx_compression),
+      use_spatial_cache_(s.use_spatial_cache), use_material_sort_(s.use_material_sort),
+      use_compact_framebuffer_(s.use_compact_framebuffer), use_ray_sort_(s.use_ray_sort),
+      use_raster_primary_(s.use_raster_primary), use_packet_stats_(s.use_packet_stats || s.use_material_sort),
+      hit_cache_samples_(std::max(s.primary_hit_cache_samples, 0)),
+      preview_levels_(std::min(std::max(s.preview_levels, 0), 4)), preview_budget_ms_(s.preview_budget_ms),
+      reprojection_max_samples_(s.use_compact_framebuffer ? 0
+                                                          : std::min(std::max(s.reprojection_max_samples, 0), 4096)) {
+    // key is 32-bit (3 bits per origin cell level, 2 bits per direction level)
+    ray_sort_origin_bits_ = std::min(std::max(s.ray_sort_origin_bits, 0), 8);
+    ray_sort_dir_bits_ = std::min(std::max(s.ray_sort_dir_bits, 0), std::min((32 - 3 * ray_sort_origin_bits_) / 2, 8));
+
     log->Info("===========================================");
     log->Info("Compression  is %s", use_tex_compression_ ? "enabled" : "disabled");
+    log->Info("VtxCompress  is %s", use_vtx_compression_ ? "enabled" : "disabled");
     log->Info("SpatialCache is %s", use_spatial_cache_ ? "enabled" : "disabled");
+    log->Info("MaterialSort is %s", use_material_sort_ ? "enabled" : "disabled");
+    log->Info("CompactFB    is %s", use_compact_framebuffer_ ? "enabled" : "disabled");
+    if (use_ray_sort_) {
+        log->Info("RaySort      is enabled (origin %i bits, dir %i bits)", ray_sort_origin_bits_, ray_sort_dir_bits_);
+    } else {
+        log->Info("RaySort      is disabled");
+    }
+    log->Info("RastPrimary  is %s", use_raster_primary_ ? "enabled" : "disabled");
+    if (hit_cache_samples_) {
+        log->Info("HitCache     is enabled (%i samples)", hit_cache_samples_);
+    } else {
+        log->Info("HitCache     is disabled");
+    }
+    if (preview_levels_) {
+        log->Info("Preview      is enabled (%i levels, %.1fms budget)", preview_levels_, preview_budget_ms_);
+    } else {
+        log->Info("Preview      is disabled");
+    }
+    if (reprojection_max_samples_) {
+        log->Info("Reprojection is enabled (%i samples)", reprojection_max_samples_);
+    } else {
+        log->Info("Reprojection is disabled");
+    }
     log->Info("===========================================");
 
     Resize(s.w, s.h);
 }
 
 template <typename SIMDPolicy> Ray::SceneBase *Ray::Cpu::Renderer<SIMDPolicy>::CreateScene() {
-    return new Cpu::Scene(log_, true /* use_wide_bvh */, use_tex_compression_, use_spatial_cache_);
+    return new Cpu::Scene(log_, true /* use_wide_bvh */, use_tex_compression_, use_vtx_compression_,
+                          use_spatial_cache_, &SIMDPolicy::IntegrateSkyRow);
 }
 
 template <typename SIMDPolicy>
@@ -371,9 +623,21 @@ void Ray::Cpu::Renderer<SIMDPolicy>::RenderScene(const SceneBase &scene, RegionC
 
     std::shared_lock<std::shared_timed_mutex> scene_lock(s.mtx_);
 
-    const camera_t &cam = s.cams_[s.current_cam()._index];
+    if (region.image_size[0] != 0 && s.cams_[s.current_cam()._index].type != eCamType::Persp) {
+        // region frustum is derived for perspective projection only (geo camera has no image plane at all)
+        log_->Error("Ray: Image window can only be rendered with perspective camera!");
+        return;
+    }
 
-    ++region.iteration;
+    const camera_t &cam = GetRegionCamera(s.cams_[s.current_cam()._index], region);
+
+    // reduced resolution frames have their own sample counter, accumulation starts at full resolution
+    const int preview_level =
+        (preview_levels_ && region.iteration == 0 && cam.type != eCamType::Geo)
+            ? (region.preview_level < 0 ? preview_levels_ : std::min(region.preview_level, preview_levels_))
+            : 0;
+    int &iteration = preview_level ? region.preview_iteration : region.iteration;
+    ++iteration;
 
     cache_grid_params_t cache_grid_params;
     memcpy(cache_grid_params.cam_pos_curr, cam.origin, 3 * sizeof(float));
@@ -384,7 +648,7 @@ void Ray::Cpu::Renderer<SIMDPolicy>::RenderScene(const SceneBase &scene, RegionC
                                   s.mi_indices_.empty() ? nullptr : &s.mi_indices_[0],
                                   s.meshes_.empty() ? nullptr : &s.meshes_[0],
                                   s.vtx_indices_.empty() ? nullptr : &s.vtx_indices_[0],
-                                  s.vertices_.empty() ? nullptr : &s.vertices_[0],
+                                  s.vertex_data(),
                                   s.nodes_.empty() ? nullptr : &s.nodes_[0],
                                   s.wnodes_.empty() ? nullptr : &s.wnodes_[0],
                                   s.tris_.empty() ? nullptr : &s.tris_[0],
@@ -413,6 +677,7 @@ void Ray::Cpu::Renderer<SIMDPolicy>::RenderScene(const SceneBase &scene, RegionC
 
     const rect_t &rect = region.rect();
 
+    uint32_t hit_cache_epoch = 0;
     { // Check filter table
         // TODO: Skip locking here
         std::lock_guard<std::mutex> _(mtx_);
@@ -421,6 +686,32 @@ void Ray::Cpu::Renderer<SIMDPolicy>::RenderScene(const SceneBase &scene, RegionC
             filter_table_filter_ = cam.filter;
             filter_table_width_ = cam.filter_width;
         }
+
+        // tiles share framebuffer coordinates, so they can not use hit cache
+        if (iteration <= hit_cache_samples_ && region.image_size[0] == 0 && cam.type != eCamType::Geo &&
+            tlas_root != 0xffffffff && s.geometry_generation_ != 0) {
+            // tonemapping and path settings do not affect primary hits
+            camera_t view_cam = cam;
+            view_cam.view_transform = eViewTransform::Standard;
+            view_cam.exposure = view_cam.gamma = 0.0f;
+            view_cam.pass_settings = {};
+            if (s.geometry_generation_ != hit_cache_generation_ ||
+                memcmp(&view_cam, &hit_cache_cam_, sizeof(camera_t)) != 0) {
+                if (++hit_cache_epoch_ == 0) {
+                    ++hit_cache_epoch_;
+                }
+                hit_cache_generation_ = s.geometry_generation_;
+                hit_cache_cam_ = view_cam;
+            }
+            hit_cache_epoch = hit_cache_epoch_;
+        }
+
+        // tiles have their own cameras, they are never reprojected
+        if (reprojection_max_samples_ && !preview_level && region.image_size[0] == 0) {
+            accum_cam_ = cam;
+            accum_generation_ = s.finalize_generation_;
+            has_accum_ = true;
+        }
     }
 
     PassData<SIMDPolicy> &p = get_per_thread_pass_data<SIMDPolicy>();
@@ -434,30 +725,89 @@ void Ray::Cpu::Renderer<SIMDPolicy>::RenderScene(const SceneBase &scene, RegionC
     time_point<high_resolution_clock> time_after_ray_gen;
 
     const uint32_t *rand_seq = __pmj02_samples;
-    const uint32_t rand_seed = Ref::hash((region.iteration - 1) / RAND_SAMPLES_COUNT);
+    uint32_t rand_seed = Ref::hash((iteration - 1) / RAND_SAMPLES_COUNT);
+    if (region.image_size[0] != 0) {
+        // decorrelate tiles, which share framebuffer coordinates
+        rand_seed = Ref::hash_combine(Ref::hash_combine(rand_seed, uint32_t(region.image_offset[0])),
+                                      uint32_t(region.image_offset[1]));
+    }
+
+    unsigned long long primary_rays_count = 0, primary_lanes_uncompacted = 0, primary_lanes_compacted = 0;
 
     if (cam.type != eCamType::Geo) {
-        SIMDPolicy::GeneratePrimaryRays(cam, rect, w_, h_, rand_seq, rand_seed, filter_table_.data(), region.iteration,
-                                        required_samples_.data(), p.primary_rays, p.intersections);
+        const uint16_t *required_samples = required_samples_.data();
+        if (preview_level) {
+            // single pixel of each block is sampled, blocks are aligned to framebuffer and clipped by region
+            const int step = (1 << preview_level);
+            for (int y = rect.y; y < rect.y + rect.h; ++y) {
+                const bool sampled_row = (y == std::max(y & ~(step - 1), rect.y));
+                for (int x = rect.x; x < rect.x + rect.w; ++x) {
+                    const bool sampled = sampled_row && (x == std::max(x & ~(step - 1), rect.x));
+                    preview_required_[y * w_ + x] = sampled ? 0xffff : 0;
+                }
+            }
+            required_samples = preview_required_.data();
+        }
+
+        primary_rays_count =
+            SIMDPolicy::GeneratePrimaryRays(cam, rect, w_, h_, rand_seq, rand_seed, filter_table_.data(), iteration,
+                                            required_samples, p.primary_rays, p.intersections);
 
         time_after_ray_gen = high_resolution_clock::now();
 
-        if (tlas_root != 0xffffffff) {
-            SIMDPolicy::TraceRays(p.primary_rays, cam.pass_settings.min_transp_depth,
-                                  cam.pass_settings.max_transp_depth, sc_data, tlas_root, false, s.tex_storages_,
-                                  rand_seq, rand_seed, region.iteration, p.intersections);
+        // Lanes that would be occupied without compaction of active pixels
+        const int RayPacketSize = SIMDPolicy::RayPacketDimX * SIMDPolicy::RayPacketDimY;
+        primary_lanes_uncompacted = (unsigned long long)((rect.w + SIMDPolicy::RayPacketDimX - 1) /
+                                                         SIMDPolicy::RayPacketDimX) *
+                                    ((rect.h + SIMDPolicy::RayPacketDimY - 1) / SIMDPolicy::RayPacketDimY) *
+                                    RayPacketSize;
+        primary_lanes_compacted = (unsigned long long)(p.primary_rays.size()) * RayPacketSize;
+
+        // rays are deterministic per sample, so hits of cached pixels are taken as is and only the rest is traced
+        int traced_count = int(p.primary_rays.size());
+        cached_hit_t *hit_cache = nullptr;
+        if (hit_cache_epoch) {
+            hit_cache = &hit_cache_[size_t(iteration - 1) * w_ * h_];
+            traced_count = SIMDPolicy::FetchCachedPrimaryHits(p.primary_rays, p.intersections, hit_cache, w_,
+                                                              hit_cache_epoch, p.cached_lanes);
+        }
+        const Span<typename SIMDPolicy::RayDataType> traced_rays = {p.primary_rays.data(), traced_count};
+        const Span<typename SIMDPolicy::HitDataType> traced_inters = {p.intersections.data(), traced_count};
+
+        // rasterization is skipped for cameras that it can not handle
+        if (tlas_root != 0xffffffff && traced_count &&
+            (!use_raster_primary_ ||
+             !SIMDPolicy::RasterizePrimaryHits(cam, rect, w_, h_, cam.pass_settings.min_transp_depth,
+                                               cam.pass_settings.max_transp_depth, sc_data, tlas_root, s.mi_indices_,
+                                               s.tex_storages_, rand_seq, rand_seed, iteration, p.raster_scratch,
+                                               traced_rays, traced_inters))) {
+            SIMDPolicy::TraceRays(traced_rays, cam.pass_settings.min_transp_depth, cam.pass_settings.max_transp_depth,
+                                  sc_data, tlas_root, false, s.tex_storages_, rand_seq, rand_seed, iteration,
+                                  traced_inters);
+        }
+
+        if (hit_cache) {
+            SIMDPolicy::StorePrimaryHits(p.primary_rays, p.intersections, traced_count, p.cached_lanes, sc_data,
+                                         hit_cache_epoch, w_, hit_cache);
         }
     } else {
-        const mesh_instance_t &mi = sc_data.mesh_instances[cam.mi_index];
-        SIMDPolicy::SampleMeshInTextureSpace(region.iteration, int(cam.mi_index), int(cam.uv_index),
-                                             sc_data.meshes[mi.mesh_index], mi, sc_data.vtx_indices, sc_data.vertices,
-                                             rect, w_, h_, rand_seq, p.primary_rays, p.intersections);
+        // instance is not set when whole lightmap atlas is rendered
+        const std::shared_ptr<const texel_map_t> texel_map = s.GetTexelMap(cam.mi_index, cam.uv_index, w_, h_);
+        primary_rays_count = SIMDPolicy::SampleMeshInTextureSpace(iteration, sc_data.mesh_instances,
+                                                                  sc_data.vtx_indices, sc_data.vertices, *texel_map,
+                                                                  rect, rand_seq, required_samples_.data(),
+                                                                  p.primary_rays, p.intersections);
+
+        // texels that are not covered by mesh get no rays
+        for (int y = rect.y; y < rect.y + rect.h; ++y) {
+            std::fill(&temp_buf_[y * w_ + rect.x], &temp_buf_[y * w_ + rect.x] + rect.w, color_rgba_t{});
+        }
 
         time_after_ray_gen = high_resolution_clock::now();
     }
 
     // factor used to compute incremental average
-    const float mix_factor = 1.0f / float(region.iteration);
+    const float mix_factor = 1.0f / float(iteration);
 
     const auto time_after_prim_trace = high_resolution_clock::now();
 
@@ -468,23 +818,33 @@ void Ray::Cpu::Renderer<SIMDPolicy>::RenderScene(const SceneBase &scene, RegionC
     int secondary_rays_count = 0, shadow_rays_count = 0, def_sky_count = 0;
 
     const eSpatialCacheMode cache_mode = use_spatial_cache_ ? eSpatialCacheMode::Query : eSpatialCacheMode::None;
-    SIMDPolicy::ShadePrimary(cam.pass_settings, p.intersections, p.primary_rays, rand_seq, rand_seed, region.iteration,
+    SIMDPolicy::ShadePrimary(cam.pass_settings, p.intersections, p.primary_rays, rand_seq, rand_seed, iteration,
                              cache_mode, sc_data, s.tex_storages_, &p.secondary_rays[0], &secondary_rays_count,
                              &p.shadow_rays[0], &shadow_rays_count, &p.deferred_sky_indexes[0], &def_sky_count, w_,
                              mix_factor, temp_buf_.data(), base_color_buf_.data(), depth_normals_buf_.data());
     SIMDPolicy::ShadeSkyPrimary(cam.pass_settings, p.intersections, p.primary_rays,
-                                {&p.deferred_sky_indexes[0], def_sky_count}, sc_data, region.iteration, w_,
-                                temp_buf_.data());
+                                {&p.deferred_sky_indexes[0], def_sky_count}, sc_data, iteration, w_, temp_buf_.data());
 
     const auto time_after_prim_shade = high_resolution_clock::now();
 
+    if (use_ray_sort_) {
+        shadow_rays_count = SIMDPolicy::SortShadowRays(
+            Span<typename SIMDPolicy::ShadowRayType>{p.shadow_rays.data(), shadow_rays_count}, root_min, cell_size,
+            p.shadow_keys, p.sorted_shadow_rays);
+    }
+
+    const auto time_after_prim_shadow_sort = high_resolution_clock::now();
+
     SIMDPolicy::TraceShadowRays(Span<typename SIMDPolicy::ShadowRayType>{p.shadow_rays.data(), shadow_rays_count},
                                 cam.pass_settings.max_transp_depth, cam.pass_settings.clamp_direct, sc_data, tlas_root,
-                                rand_seq, rand_seed, region.iteration, s.tex_storages_, w_, temp_buf_.data());
+                                rand_seq, rand_seed, iteration, s.tex_storages_, w_, temp_buf_.data());
 
     const auto time_after_prim_shadow = high_resolution_clock::now();
     duration<double, std::micro> secondary_sort_time{}, secondary_trace_time{}, secondary_shade_time{},
         secondary_shadow_time{};
+    duration<double, std::micro> shadow_sort_time{time_after_prim_shadow_sort - time_after_prim_shade};
+    unsigned long long secondary_packets_count[4] = {}, secondary_packet_materials[4] = {};
+    duration<double, std::micro> secondary_bounce_sort_time[4] = {}, secondary_bounce_trace_time[4] = {};
 
     p.hash_values.resize(p.primary_rays.size());
     p.scan_values.resize(round_up(rect.w, 4) * round_up(rect.h, 4));
@@ -494,9 +854,12 @@ void Ray::Cpu::Renderer<SIMDPolicy>::RenderScene(const SceneBase &scene, RegionC
     for (int bounce = 1; bounce <= cam.pass_settings.max_total_depth && secondary_rays_count; ++bounce) {
         const auto time_secondary_sort_start = high_resolution_clock::now();
 
-        secondary_rays_count = SIMDPolicy::SortRays_CPU(
-            Span<typename SIMDPolicy::RayDataType>{&p.secondary_rays[0], secondary_rays_count}, root_min, cell_size,
-            &p.hash_values[0], &p.scan_values[0], &p.chunks[0], &p.chunks_temp[0]);
+        if (use_ray_sort_) {
+            secondary_rays_count = SIMDPolicy::SortRays_CPU(
+                Span<typename SIMDPolicy::RayDataType>{&p.secondary_rays[0], secondary_rays_count}, root_min,
+                cell_size, ray_sort_origin_bits_, ray_sort_dir_bits_, &p.hash_values[0], &p.scan_values[0],
+                &p.chunks[0], &p.chunks_temp[0]);
+        }
 
 #if 0 // debug hash values
         static std::vector<fvec3> color_table;
@@ -527,7 +890,30 @@ void Ray::Cpu::Renderer<SIMDPolicy>::RenderScene(const SceneBase &scene, RegionC
 
         SIMDPolicy::TraceRays(Span<typename SIMDPolicy::RayDataType>{p.secondary_rays.data(), secondary_rays_count},
                               cam.pass_settings.min_transp_depth, cam.pass_settings.max_transp_depth, sc_data,
-                              tlas_root, true, s.tex_storages_, rand_seq, rand_seed, region.iteration, p.intersections);
+                              tlas_root, true, s.tex_storages_, rand_seq, rand_seed, iteration, p.intersections);
+
+        const auto time_secondary_material_sort_start = high_resolution_clock::now();
+
+        if (use_material_sort_) {
+            secondary_rays_count = SIMDPolicy::SortHitsByMaterial(
+                Span<typename SIMDPolicy::RayDataType>{p.secondary_rays.data(), secondary_rays_count},
+                Span<typename SIMDPolicy::HitDataType>{p.intersections.data(), secondary_rays_count}, sc_data,
+                p.material_keys, p.material_sorted_rays, p.material_sorted_inters);
+        }
+
+        const auto time_secondary_material_sort_end = high_resolution_clock::now();
+
+        const int stats_bounce = std::min(bounce, int(countof(stats_.secondary_packets_count))) - 1;
+        secondary_bounce_sort_time[stats_bounce] +=
+            duration<double, std::micro>{time_secondary_trace_start - time_secondary_sort_start};
+        secondary_bounce_trace_time[stats_bounce] +=
+            duration<double, std::micro>{time_secondary_material_sort_start - time_secondary_trace_start};
+        secondary_packets_count[stats_bounce] += secondary_rays_count;
+        if (use_packet_stats_) {
+            secondary_packet_materials[stats_bounce] += SIMDPolicy::CountPacketMaterials(
+                Span<const typename SIMDPolicy::RayDataType>{p.secondary_rays.data(), secondary_rays_count},
+                Span<const typename SIMDPolicy::HitDataType>{p.intersections.data(), secondary_rays_count}, sc_data);
+        }
 
         const auto time_secondary_shade_start = high_resolution_clock::now();
 
@@ -540,24 +926,37 @@ void Ray::Cpu::Renderer<SIMDPolicy>::RenderScene(const SceneBase &scene, RegionC
         SIMDPolicy::ShadeSecondary(cam.pass_settings, clamp_direct,
                                    Span<typename SIMDPolicy::HitDataType>{p.intersections.data(), rays_count},
                                    Span<typename SIMDPolicy::RayDataType>{p.primary_rays.data(), rays_count}, rand_seq,
-                                   rand_seed, region.iteration, cache_mode, sc_data, s.tex_storages_,
-                                   &p.secondary_rays[0], &secondary_rays_count, &p.shadow_rays[0], &shadow_rays_count,
+                                   rand_seed, iteration, cache_mode, sc_data, s.tex_storages_, &p.secondary_rays[0],
+                                   &secondary_rays_count, &p.shadow_rays[0], &shadow_rays_count,
                                    &p.deferred_sky_indexes[0], &def_sky_count, w_, temp_buf_.data(), nullptr, nullptr);
         SIMDPolicy::ShadeSkySecondary(cam.pass_settings, clamp_direct, p.intersections, p.primary_rays,
-                                      {&p.deferred_sky_indexes[0], def_sky_count}, sc_data, region.iteration, w_,
+                                      {&p.deferred_sky_indexes[0], def_sky_count}, sc_data, iteration, w_,
                                       temp_buf_.data());
 
+        const auto time_secondary_shadow_sort_start = high_resolution_clock::now();
+
+        if (use_ray_sort_) {
+            shadow_rays_count = SIMDPolicy::SortShadowRays(
+                Span<typename SIMDPolicy::ShadowRayType>{p.shadow_rays.data(), shadow_rays_count}, root_min,
+                cell_size, p.shadow_keys, p.sorted_shadow_rays);
+        }
+
         const auto time_secondary_shadow_start = high_resolution_clock::now();
 
         SIMDPolicy::TraceShadowRays(Span<typename SIMDPolicy::ShadowRayType>{p.shadow_rays.data(), shadow_rays_count},
                                     cam.pass_settings.max_transp_depth, cam.pass_settings.clamp_indirect, sc_data,
-                                    tlas_root, rand_seq, rand_seed, region.iteration, s.tex_storages_, w_,
-                                    temp_buf_.data());
+                                    tlas_root, rand_seq, rand_seed, iteration, s.tex_storages_, w_, temp_buf_.data());
 
         const auto time_secondary_shadow_end = high_resolution_clock::now();
+        shadow_sort_time +=
+            duration<double, std::micro>{time_secondary_shadow_start - time_secondary_shadow_sort_start};
         secondary_sort_time += duration<double, std::micro>{time_secondary_trace_start - time_secondary_sort_start};
-        secondary_trace_time += duration<double, std::micro>{time_secondary_shade_start - time_secondary_trace_start};
-        secondary_shade_time += duration<double, std::micro>{time_secondary_shadow_start - time_secondary_shade_start};
+        secondary_sort_time +=
+            duration<double, std::micro>{time_secondary_material_sort_end - time_secondary_material_sort_start};
+        secondary_trace_time +=
+            duration<double, std::micro>{time_secondary_material_sort_start - time_secondary_trace_start};
+        secondary_shade_time +=
+            duration<double, std::micro>{time_secondary_shadow_sort_start - time_secondary_shade_start};
         secondary_shadow_time += duration<double, std::micro>{time_secondary_shadow_end - time_secondary_shadow_start};
     }
 
@@ -570,11 +969,11 @@ void Ray::Cpu::Renderer<SIMDPolicy>::RenderScene(const SceneBase &scene, RegionC
     Ref::fvec4 exposure = std::pow(2.0f, cam.exposure);
     exposure.set<3>(1.0f);
 
-    const float variance_threshold =
-        region.iteration > cam.pass_settings.min_samples
-            ? 0.5f * cam.pass_settings.variance_threshold * cam.pass_settings.variance_threshold
-            : 0.0f;
+    const float full_variance_threshold =
+        0.5f * cam.pass_settings.variance_threshold * cam.pass_settings.variance_threshold;
+    const float variance_threshold = iteration > cam.pass_settings.min_samples ? full_variance_threshold : 0.0f;
 
+    bool store_raw_filtered;
     {
         std::lock_guard<std::mutex> _(mtx_);
 
@@ -585,34 +984,115 @@ void Ray::Cpu::Renderer<SIMDPolicy>::RenderScene(const SceneBase &scene, RegionC
         stats_.time_primary_shade_us +=
             (unsigned long long)duration<double, std::micro>{time_after_prim_shade - time_after_prim_trace}.count();
         stats_.time_primary_shadow_us +=
-            (unsigned long long)duration<double, std::micro>{time_after_prim_shadow - time_after_prim_shade}.count();
+            (unsigned long long)duration<double, std::micro>{time_after_prim_shadow - time_after_prim_shadow_sort}
+                .count();
         stats_.time_secondary_sort_us += (unsigned long long)secondary_sort_time.count();
+        stats_.time_shadow_sort_us += (unsigned long long)shadow_sort_time.count();
         stats_.time_secondary_trace_us += (unsigned long long)secondary_trace_time.count();
         stats_.time_secondary_shade_us += (unsigned long long)secondary_shade_time.count();
         stats_.time_secondary_shadow_us += (unsigned long long)secondary_shadow_time.count();
+        stats_.primary_rays_count += primary_rays_count;
+        stats_.primary_lanes_uncompacted += primary_lanes_uncompacted;
+        stats_.primary_lanes_compacted += primary_lanes_compacted;
+        for (int i = 0; i < int(countof(stats_.secondary_packets_count)); ++i) {
+            stats_.secondary_packets_count[i] += secondary_packets_count[i];
+            stats_.secondary_packet_materials[i] += secondary_packet_materials[i];
+            stats_.secondary_bounce_sort_us[i] += (unsigned long long)secondary_bounce_sort_time[i].count();
+            stats_.secondary_bounce_trace_us[i] += (unsigned long long)secondary_bounce_trace_time[i].count();
+        }
 
         tonemap_params_ = tonemap_params;
         variance_threshold_ = variance_threshold;
+        // in compact mode it is allocated only after denoising was requested
+        store_raw_filtered = !raw_filtered_buf_.empty();
     }
 
-    const bool is_class_a = popcount(uint32_t(region.iteration - 1) & 0xaaaaaaaa) & 1;
-    const float half_mix_factor = 1.0f / float((region.iteration + 1) / 2);
+    // in compact mode tonemapping is done on read
+    const bool store_final = !use_compact_framebuffer_;
+
+    if (preview_level) {
+        // sampled pixels accumulate until level changes, the rest of framebuffer is overwritten with upsampled result
+        for (int y = rect.y; y < rect.y + rect.h; ++y) {
+            for (int x = rect.x; x < rect.x + rect.w; ++x) {
+                if (!preview_required_[y * w_ + x]) {
+                    continue;
+                }
+                const auto new_val = Ref::fvec4{temp_buf_[y * w_ + x].v, Ref::vector_aligned} * exposure;
+                Ref::fvec4 cur_val_full = {full_buf_[y * w_ + x].v, Ref::vector_aligned};
+                cur_val_full += (new_val - cur_val_full) * mix_factor;
+                cur_val_full.store_to(full_buf_[y * w_ + x].v, Ref::vector_aligned);
+            }
+        }
+
+        UpsamplePreview(rect, 1 << preview_level);
+
+        for (int y = rect.y; y < rect.y + rect.h; ++y) {
+            for (int x = rect.x; x < rect.x + rect.w; ++x) {
+                const auto full_val = Ref::fvec4{full_buf_[y * w_ + x].v, Ref::vector_aligned};
+                if (store_raw_filtered) {
+                    full_val.store_to(raw_filtered_buf_[y * w_ + x].v, Ref::vector_aligned);
+                }
+                if (store_final) {
+                    const Ref::fvec4 tonemapped_res = Tonemap(tonemap_params, full_val);
+                    tonemapped_res.store_to(final_buf_[y * w_ + x].v, Ref::vector_aligned);
+                }
+            }
+        }
+        region.active_pixels = rect.w * rect.h;
+
+        // Finer level has four times more samples, it is started when its frame is expected to fit into budget or
+        // when current level has already spent the same time (more samples here would not make it converge faster)
+        const double frame_ms = duration<double, std::milli>{high_resolution_clock::now() - time_start}.count();
+        if (preview_budget_ms_ <= 0.0f || 4.0 * frame_ms <= preview_budget_ms_ || iteration >= 4) {
+            region.preview_level = preview_level - 1;
+            region.preview_iteration = 0;
+        } else {
+            region.preview_level = preview_level;
+        }
+        InvalidateFinalBuf();
+        return;
+    }
+
+    if (reprojection_max_samples_ && iteration == 1) {
+        // history is only valid if nothing but camera has changed since it was accumulated
+        if (has_history_ && history_generation_ == s.finalize_generation_ && history_generation_ != 0 &&
+            region.image_size[0] == 0 && cam.type == eCamType::Persp && history_cam_.type == eCamType::Persp &&
+            cam.fstop == 0.0f && history_cam_.fstop == 0.0f) {
+            ReprojectHistory(cam, rect);
+        } else {
+            for (int y = rect.y; y < rect.y + rect.h; ++y) {
+                std::fill_n(&carried_samples_[y * w_ + rect.x], rect.w, uint16_t(0));
+            }
+        }
+    }
+
+    int active_pixels = 0;
+
+    const bool is_class_a = popcount(uint32_t(iteration - 1) & 0xaaaaaaaa) & 1;
+    const float half_mix_factor = 1.0f / float((iteration + 1) / 2);
     for (int y = rect.y; y < rect.y + rect.h; ++y) {
         for (int x = rect.x; x < rect.x + rect.w; ++x) {
-            if (required_samples_[y * w_ + x] < region.iteration) {
+            if (required_samples_[y * w_ + x] < iteration) {
                 continue;
             }
 
+            // samples taken over from previous view continue to count
+            const int carried = reprojection_max_samples_ ? carried_samples_[y * w_ + x] : 0;
+            if (reprojection_max_samples_) {
+                accum_samples_[y * w_ + x] = uint16_t(std::min(iteration + carried, 0xffff));
+            }
+
             const auto new_val = Ref::fvec4{temp_buf_[y * w_ + x].v, Ref::vector_aligned} * exposure;
             // accumulate full buffer
             Ref::fvec4 cur_val_full = {full_buf_[y * w_ + x].v, Ref::vector_aligned};
-            cur_val_full += (new_val - cur_val_full) * mix_factor;
+            cur_val_full += (new_val - cur_val_full) * (carried ? 1.0f / float(iteration + carried) : mix_factor);
             cur_val_full.store_to(full_buf_[y * w_ + x].v, Ref::vector_aligned);
             if (is_class_a) {
                 // accumulate half buffer
-                Ref::fvec4 cur_val_half = {half_buf_[y * w_ + x].v, Ref::vector_aligned};
-                cur_val_half += (new_val - cur_val_half) * half_mix_factor;
-                cur_val_half.store_to(half_buf_[y * w_ + x].v, Ref::vector_aligned);
+                Ref::fvec4 cur_val_half = GetHalfBufValue(y * w_ + x);
+                cur_val_half += (new_val - cur_val_half) *
+                                (carried ? 1.0f / float((iteration + 1) / 2 + carried / 2) : half_mix_factor);
+                SetHalfBufValue(y * w_ + x, cur_val_half);
             }
         }
     }
@@ -620,13 +1100,17 @@ void Ray::Cpu::Renderer<SIMDPolicy>::RenderScene(const SceneBase &scene, RegionC
     for (int y = rect.y; y < rect.y + rect.h; ++y) {
         for (int x = rect.x; x < rect.x + rect.w; ++x) {
             auto full_val = Ref::fvec4{full_buf_[y * w_ + x].v, Ref::vector_aligned};
-            auto half_val = Ref::fvec4{half_buf_[y * w_ + x].v, Ref::vector_aligned};
+            auto half_val = GetHalfBufValue(y * w_ + x);
 
-            // Store as denosed result until DenoiseImage method will be called
-            full_val.store_to(raw_filtered_buf_[y * w_ + x].v, Ref::vector_aligned);
+            if (store_raw_filtered) {
+                // Store as denosed result until DenoiseImage method will be called
+                full_val.store_to(raw_filtered_buf_[y * w_ + x].v, Ref::vector_aligned);
+            }
 
-            const Ref::fvec4 tonemapped_res = Tonemap(tonemap_params, full_val);
-            tonemapped_res.store_to(final_buf_[y * w_ + x].v, Ref::vector_aligned);
+            if (store_final) {
+                const Ref::fvec4 tonemapped_res = Tonemap(tonemap_params, full_val);
+                tonemapped_res.store_to(final_buf_[y * w_ + x].v, Ref::vector_aligned);
+            }
 
             const Ref::fvec4 p1 = reversible_tonemap(max(2.0f * full_val - half_val, 0.0f));
             const Ref::fvec4 p2 = reversible_tonemap(half_val);
@@ -635,16 +1119,161 @@ void Ray::Cpu::Renderer<SIMDPolicy>::RenderScene(const SceneBase &scene, RegionC
             variance.store_to(temp_buf_[y * w_ + x].v, Ref::vector_aligned);
 
 #if DEBUG_ADAPTIVE_SAMPLING
-            if (cam.pass_settings.variance_threshold != 0.0f && required_samples_[y * w_ + x] >= region.iteration &&
-                (region.iteration % 5) == 0) {
+            if (cam.pass_settings.variance_threshold != 0.0f && required_samples_[y * w_ + x] >= iteration &&
+                (iteration % 5) == 0 && store_final) {
                 final_buf_[y * w_ + x].v[0] = 1.0f;
                 full_buf_[y * w_ + x].v[0] = 1.0f;
             }
 #endif
 
-            if (simd_cast(variance >= variance_threshold).not_all_zeros()) {
-                required_samples_[y * w_ + x] = region.iteration + 1;
+            // reprojected pixels may converge before the region has taken minimal number of samples
+            float px_variance_threshold = variance_threshold;
+            if (reprojection_max_samples_ && iteration + carried_samples_[y * w_ + x] > cam.pass_settings.min_samples) {
+                px_variance_threshold = full_variance_threshold;
+            }
+
+            if (simd_cast(variance >= px_variance_threshold).not_all_zeros()) {
+                required_samples_[y * w_ + x] = iteration + 1;
+                ++active_pixels;
+            }
+        }
+    }
+
+    region.active_pixels = active_pixels;
+    InvalidateFinalBuf();
+}
+
+template <typename SIMDPolicy>
+void Ray::Cpu::Renderer<SIMDPolicy>::UpsamplePreview(const rect_t &rect, const int step) {
+    // sampled pixel of block that contains given coordinate (blocks are clipped by region)
+    const auto block_origin = [step](const int v, const int beg) { return std::max(v & ~(step - 1), beg); };
+
+    const bool guided = !depth_normals_buf_.empty();
+    for (int y = rect.y; y < rect.y + rect.h; ++y) {
+        const int y0 = block_origin(y, rect.y);
+        int y1 = (y & ~(step - 1)) + step;
+        if (y1 >= rect.y + rect.h) {
+            y1 = y0;
+        }
+        const float fy = (y1 != y0) ? float(y - y0) / float(y1 - y0) : 0.0f;
+
+        for (int x = rect.x; x < rect.x + rect.w; ++x) {
+            const int x0 = block_origin(x, rect.x);
+            if (x == x0 && y == y0) {
+                continue;
+            }
+            int x1 = (x & ~(step - 1)) + step;
+            if (x1 >= rect.x + rect.w) {
+                x1 = x0;
+            }
+            const float fx = (x1 != x0) ? float(x - x0) / float(x1 - x0) : 0.0f;
+
+            const int samples[4] = {y0 * w_ + x0, y0 * w_ + x1, y1 * w_ + x0, y1 * w_ + x1};
+            const float weights[4] = {(1.0f - fx) * (1.0f - fy), fx * (1.0f - fy), (1.0f - fx) * fy, fx * fy};
+
+            // Pixel itself was not sampled, so its own block sample serves as a guide, neighbours that lie on
+            // different surface get lower weight (this keeps silhouettes sharp)
+            const color_rgba_t &ref = guided ? depth_normals_buf_[samples[0]] : color_rgba_t{};
+
+            Ref::fvec4 sum = 0.0f;
+            float weight_sum = 0.0f;
+            for (int i = 0; i < 4; ++i) {
+                float w = weights[i];
+                if (guided && i != 0) {
+                    const color_rgba_t &dn = depth_normals_buf_[samples[i]];
+                    if (ref.v[3] == 0.0f || dn.v[3] == 0.0f) {
+                        // background is only mixed with background
+                        w *= (ref.v[3] == dn.v[3]) ? 1.0f : 0.0f;
+                    } else {
+                        const float n_dot = dn.v[0] * ref.v[0] + dn.v[1] * ref.v[1] + dn.v[2] * ref.v[2];
+                        const float depth_diff = fabsf(dn.v[3] - ref.v[3]) / ref.v[3];
+                        w *= powf(std::max(n_dot, 0.0f), 8.0f) / (1.0f + 32.0f * depth_diff);
+                    }
+                }
+                sum += Ref::fvec4{full_buf_[samples[i]].v, Ref::vector_aligned} * w;
+                weight_sum += w;
             }
+            // weight of own block sample is never zero
+            sum /= weight_sum;
+            sum.store_to(full_buf_[y * w_ + x].v, Ref::vector_aligned);
+        }
+    }
+}
+
+template <typename SIMDPolicy>
+void Ray::Cpu::Renderer<SIMDPolicy>::ReprojectHistory(const camera_t &cam, const rect_t &rect) {
+    const camera_t &prev = history_cam_;
+
+    const float k = float(w_) / float(h_);
+    const float cur_tan = tanf(0.5f * cam.fov * PI / 180.0f), prev_tan = tanf(0.5f * prev.fov * PI / 180.0f);
+
+    const Ref::fvec4 cur_origin = Ref::make_fvec3(cam.origin), cur_fwd = Ref::make_fvec3(cam.fwd),
+                     cur_side = Ref::make_fvec3(cam.side), cur_up = Ref::make_fvec3(cam.up);
+    const Ref::fvec4 prev_origin = Ref::make_fvec3(prev.origin), prev_fwd = Ref::make_fvec3(prev.fwd),
+                     prev_side = Ref::make_fvec3(prev.side), prev_up = Ref::make_fvec3(prev.up);
+
+    // accumulated values include exposure
+    Ref::fvec4 exposure_scale = std::pow(2.0f, cam.exposure - prev.exposure);
+    exposure_scale.set<3>(1.0f);
+
+    for (int y = rect.y; y < rect.y + rect.h; ++y) {
+        for (int x = rect.x; x < rect.x + rect.w; ++x) {
+            const int i = y * w_ + x;
+            carried_samples_[i] = 0;
+
+            // Depth of the first sample is measured along jittered ray, pixel center is close enough
+            const float cur_x = (float(x) + 0.5f) / float(w_) + cam.shift[0] / k,
+                        cur_y = cam.shift[1] - (float(y) + 0.5f) / float(h_);
+            const Ref::fvec4 dir = normalize(k * cur_tan * (2.0f * cur_x - 1.0f) * cur_side +
+                                             cur_tan * (2.0f * cur_y + 1.0f) * cur_up + cur_fwd);
+
+            const color_rgba_t &dn = depth_normals_buf_[i];
+            const bool background = (dn.v[3] == 0.0f);
+
+            // background is reprojected as direction (it is infinitely far)
+            const Ref::fvec4 v =
+                background ? dir : cur_origin + dir * (cam.clip_start / dot(dir, cur_fwd) + dn.v[3]) - prev_origin;
+
+            const float z = dot(v, prev_fwd);
+            if (z <= 0.0f) {
+                continue;
+            }
+            const float prev_x =
+                float(w_) * (0.5f * (dot(v, prev_side) / (z * k * prev_tan) + 1.0f) - prev.shift[0] / k);
+            const float prev_y = float(h_) * (prev.shift[1] - 0.5f * (dot(v, prev_up) / (z * prev_tan) - 1.0f));
+            if (prev_x < 0.0f || prev_y < 0.0f || prev_x >= float(w_) || prev_y >= float(h_)) {
+                continue;
+            }
+
+            const int j = int(prev_y) * w_ + int(prev_x);
+            const int samples = std::min(int(history_samples_[j]), reprojection_max_samples_);
+            if (!samples) {
+                continue;
+            }
+
+            // Surface that was visible in previous view must be the same (rejects disocclusions)
+            const color_rgba_t &prev_dn = history_depth_normals_[j];
+            if (background != (prev_dn.v[3] == 0.0f)) {
+                continue;
+            }
+            if (!background) {
+                const float dist = v.length();
+                const float expected_t = dist - prev.clip_start * dist / z;
+                if (fabsf(prev_dn.v[3] - expected_t) > 0.05f * expected_t) {
+                    continue;
+                }
+                // normals are averaged, so they are not exactly unit length
+                const Ref::fvec4 n = Ref::make_fvec3(dn.v), prev_n = Ref::make_fvec3(prev_dn.v);
+                if (dot(n, prev_n) < 0.9f * n.length() * prev_n.length()) {
+                    continue;
+                }
+            }
+
+            const Ref::fvec4 val = Ref::fvec4{history_buf_[j].v, Ref::vector_aligned} * exposure_scale,
+                             half_val = Ref::fvec4{history_half_buf_[j].v, Ref::vector_aligned} * exposure_scale;
+            val.store_to(full_buf_[i].v, Ref::vector_aligned);
+            SetHalfBufValue(i, half_val);
+            carried_samples_[i] = uint16_t(samples);
         }
     }
 }
@@ -664,8 +1293,9 @@ template <typename SIMDPolicy> void Ray::Cpu::Renderer<SIMDPolicy>::DenoiseImage
     p.temp_final_buf.resize(rect_ext.w * rect_ext.h);
     p.variance_buf.resize(rect_ext.w * rect_ext.h);
     p.filtered_variance_buf.resize(rect_ext.w * rect_ext.h);
-    p.feature_buf1.resize(rect_ext.w * rect_ext.h);
-    p.feature_buf2.resize(rect_ext.w * rect_ext.h);
+    // auxiliary buffers can be missing in compact mode
+    p.feature_buf1.resize(base_color_buf_.empty() ? 0 : rect_ext.w * rect_ext.h);
+    p.feature_buf2.resize(depth_normals_buf_.empty() ? 0 : rect_ext.w * rect_ext.h);
 
 #define FETCH_FINAL_BUF(_x, _y)                                                                                        \
     Ref::fvec4(full_buf_[std::min(std::max(_y, 0), h_ - 1) * w_ + std::min(std::max(_x, 0), w_ - 1)].v,                \
@@ -719,8 +1349,10 @@ template <typename SIMDPolicy> void Ray::Cpu::Renderer<SIMDPolicy>::DenoiseImage
             res = max(res, center_val);
             res.store_to(p.filtered_variance_buf[y * rect_ext.w + x].v, Ref::vector_aligned);
 
-            p.feature_buf1[y * rect_ext.w + x] = FETCH_BASE_COLOR(rect_ext.x + x, rect_ext.y + y);
-            p.feature_buf2[y * rect_ext.w + x] = FETCH_DEPTH_NORMALS(rect_ext.x + x, rect_ext.y + y);
+            if (!p.feature_buf1.empty()) {
+                p.feature_buf1[y * rect_ext.w + x] = FETCH_BASE_COLOR(rect_ext.x + x, rect_ext.y + y);
+                p.feature_buf2[y * rect_ext.w + x] = FETCH_DEPTH_NORMALS(rect_ext.x + x, rect_ext.y + y);
+            }
         }
     }
 
@@ -734,6 +1366,9 @@ template <typename SIMDPolicy> void Ray::Cpu::Renderer<SIMDPolicy>::DenoiseImage
         std::lock_guard<std::mutex> _(mtx_);
         tonemap_params = tonemap_params_;
         variance_threshold = variance_threshold_;
+        if (raw_filtered_buf_.empty()) {
+            AllocateDenoiseBuffers_nolock(false /* aux */);
+        }
     }
 
     for (int y = 0; y < rect.h; ++y) {
@@ -764,8 +1399,10 @@ template <typename SIMDPolicy> void Ray::Cpu::Renderer<SIMDPolicy>::DenoiseImage
             auto col = Ref::fvec4(raw_filtered_buf_[y * w_ + x].v, Ref::vector_aligned);
             col = Ref::reversible_tonemap_invert(col);
             col.store_to(raw_filtered_buf_[y * w_ + x].v, Ref::vector_aligned);
-            col = Tonemap(tonemap_params, col);
-            col.store_to(final_buf_[y * w_ + x].v, Ref::vector_aligned);
+            if (!use_compact_framebuffer_) {
+                col = Tonemap(tonemap_params, col);
+                col.store_to(final_buf_[y * w_ + x].v, Ref::vector_aligned);
+            }
         }
     }
 
@@ -774,6 +1411,7 @@ template <typename SIMDPolicy> void Ray::Cpu::Renderer<SIMDPolicy>::DenoiseImage
     {
         std::lock_guard<std::mutex> _(mtx_);
         stats_.time_denoise_us += (unsigned long long)duration<double, std::micro>{denoise_end - denoise_start}.count();
+        final_buf_dirty_ = true;
     }
 }
 
@@ -969,6 +1607,11 @@ void Ray::Cpu::Renderer<SIMDPolicy>::DenoiseImage(const int pass, const RegionCo
             unet_tensors_.dec_conv1b + (w_rounded + 3) * 32, r, w_, h_, w_rounded + 2,
             &weights[offsets->dec_conv0_weight], &weights[offsets->dec_conv0_bias], &raw_filtered_buf_[0].v[0], 0);
 
+        if (use_compact_framebuffer_) {
+            // tonemapping is done on read
+            break;
+        }
+
         Ref::tonemap_params_t tonemap_params;
 
         {
@@ -993,6 +1636,7 @@ void Ray::Cpu::Renderer<SIMDPolicy>::DenoiseImage(const int pass, const RegionCo
     {
         std::lock_guard<std::mutex> _(mtx_);
         stats_.time_denoise_us += (unsigned long long)duration<double, std::micro>{denoise_end - denoise_start}.count();
+        final_buf_dirty_ = true;
     }
 }
 
@@ -1023,7 +1667,7 @@ void Ray::Cpu::Renderer<SIMDPolicy>::UpdateSpatialCache(const SceneBase &scene,
                                   s.mi_indices_.empty() ? nullptr : &s.mi_indices_[0],
                                   s.meshes_.empty() ? nullptr : &s.meshes_[0],
                                   s.vtx_indices_.empty() ? nullptr : &s.vtx_indices_[0],
-                                  s.vertices_.empty() ? nullptr : &s.vertices_[0],
+                                  s.vertex_data(),
                                   s.nodes_.empty() ? nullptr : &s.nodes_[0],
                                   s.wnodes_.empty() ? nullptr : &s.wnodes_[0],
                                   s.tris_.empty() ? nullptr : &s.tris_[0],
@@ -1091,6 +1735,11 @@ void Ray::Cpu::Renderer<SIMDPolicy>::UpdateSpatialCache(const SceneBase &scene,
                              &p.secondary_rays[0], &secondary_rays_count, &p.shadow_rays[0], &shadow_rays_count,
                              nullptr, nullptr, w_, 1.0f, temp_buf_.data(), nullptr, raw_filtered_buf_.data());
 
+    if (use_ray_sort_) {
+        shadow_rays_count = SIMDPolicy::SortShadowRays(
+            Span<typename SIMDPolicy::ShadowRayType>{p.shadow_rays.data(), shadow_rays_count}, root_min, cell_size,
+            p.shadow_keys, p.sorted_shadow_rays);
+    }
     SIMDPolicy::TraceShadowRays(Span<typename SIMDPolicy::ShadowRayType>{p.shadow_rays.data(), shadow_rays_count},
                                 cam.pass_settings.max_transp_depth, cam.pass_settings.clamp_direct, sc_data, tlas_root,
                                 rand_seq, rand_seed, region.cache_iteration, s.tex_storages_, w_, temp_buf_.data());
@@ -1106,9 +1755,12 @@ void Ray::Cpu::Renderer<SIMDPolicy>::UpdateSpatialCache(const SceneBase &scene,
     p.chunks_temp.resize(round_up(rect.w, 4) * round_up(rect.h, 4));
 
     for (int bounce = 1; bounce <= cam.pass_settings.max_total_depth && secondary_rays_count; ++bounce) {
-        secondary_rays_count = SIMDPolicy::SortRays_CPU(
-            Span<typename SIMDPolicy::RayDataType>{&p.secondary_rays[0], secondary_rays_count}, root_min, cell_size,
-            &p.hash_values[0], &p.scan_values[0], &p.chunks[0], &p.chunks_temp[0]);
+        if (use_ray_sort_) {
+            secondary_rays_count = SIMDPolicy::SortRays_CPU(
+                Span<typename SIMDPolicy::RayDataType>{&p.secondary_rays[0], secondary_rays_count}, root_min,
+                cell_size, ray_sort_origin_bits_, ray_sort_dir_bits_, &p.hash_values[0], &p.scan_values[0],
+                &p.chunks[0], &p.chunks_temp[0]);
+        }
 
         for (int i = 0; i < secondary_rays_count; i++) {
             p.intersections[i] = {};
@@ -1132,6 +1784,11 @@ void Ray::Cpu::Renderer<SIMDPolicy>::UpdateSpatialCache(const SceneBase &scene,
                                    &p.secondary_rays[0], &secondary_rays_count, &p.shadow_rays[0], &shadow_rays_count,
                                    nullptr, nullptr, w_, temp_buf_.data(), nullptr, raw_filtered_buf_.data());
 
+        if (use_ray_sort_) {
+            shadow_rays_count = SIMDPolicy::SortShadowRays(
+                Span<typename SIMDPolicy::ShadowRayType>{p.shadow_rays.data(), shadow_rays_count}, root_min,
+                cell_size, p.shadow_keys, p.sorted_shadow_rays);
+        }
         SIMDPolicy::TraceShadowRays(Span<typename SIMDPolicy::ShadowRayType>{p.shadow_rays.data(), shadow_rays_count},
                                     cam.pass_settings.max_transp_depth, cam.pass_settings.clamp_indirect, sc_data,
                                     tlas_root, rand_seq, rand_seed, region.cache_iteration, s.tex_storages_, w_,
@@ -1149,6 +1806,8 @@ void Ray::Cpu::Renderer<SIMDPolicy>::UpdateSpatialCache(const SceneBase &scene,
     {
         std::lock_guard<std::mutex> _(mtx_);
         stats_.time_cache_update_us += (unsigned long long)duration<double, std::micro>{time_end - time_start}.count();
+        // raw_filtered_buf_ was used as temporary storage
+        final_buf_dirty_ = true;
     }
 }
 
@@ -1255,6 +1914,9 @@ void Ray::Cpu::Renderer<SIMDPolicy>::InitUNetFilter(const bool alias_memory, une
     SetupUNetWeights(true, 1, &unet_offsets_, unet_weights_.data());
 
     unet_alias_memory_ = alias_memory;
+    if (use_compact_framebuffer_) {
+        AllocateDenoiseBuffers_nolock(true /* aux */);
+    }
     UpdateUNetFilterMemory();
 
     out_props.pass_count = UNetFilterPasses;
@@ -1266,6 +1928,57 @@ void Ray::Cpu::Renderer<SIMDPolicy>::InitUNetFilter(const bool alias_memory, une
     }
 }
 
+template <typename SIMDPolicy> void Ray::Cpu::Renderer<SIMDPolicy>::AllocateDenoiseBuffers_nolock(const bool aux) {
+    assert(use_compact_framebuffer_);
+    if (raw_filtered_buf_.empty()) {
+        raw_filtered_buf_.assign(full_buf_.begin(), full_buf_.end());
+    }
+    if (aux && base_color_buf_.empty()) {
+        // will be filled starting from the next iteration
+        base_color_buf_.assign(w_ * h_, {});
+        depth_normals_buf_.assign(w_ * h_, {});
+    }
+    log_->Info("Framebuffer  uses %.1f bytes per pixel", framebuffer_bytes_per_pixel());
+}
+
+template <typename SIMDPolicy> void Ray::Cpu::Renderer<SIMDPolicy>::ResolveFinalBuf() const {
+    // concurrent readers must not resolve into the same buffer, repeated reads of the same image are free
+    std::lock_guard<std::mutex> _(mtx_);
+    if (!final_buf_dirty_ && final_buf_.size() == size_t(w_) * h_) {
+        return;
+    }
+
+    const color_rgba_t *src = raw_filtered_buf_.empty() ? full_buf_.data() : raw_filtered_buf_.data();
+
+    final_buf_.resize(size_t(w_) * h_);
+    for (int i = 0; i < w_ * h_; ++i) {
+        const Ref::fvec4 col = Tonemap(tonemap_params_, Ref::fvec4{src[i].v, Ref::vector_aligned});
+        col.store_to(final_buf_[i].v, Ref::vector_aligned);
+    }
+    final_buf_dirty_ = false;
+}
+
+template <typename SIMDPolicy>
+Ray::camera_t Ray::Cpu::Renderer<SIMDPolicy>::GetRegionCamera(const camera_t &cam, const RegionContext &region) const {
+    camera_t ret = cam;
+    if (region.image_size[0] == 0) {
+        return ret;
+    }
+    assert(cam.type == eCamType::Persp);
+
+    // Adjust frustum so that framebuffer covers its window of the output image
+    const float img_w = float(region.image_size[0]), img_h = float(region.image_size[1]);
+    const float off_x = float(region.image_offset[0] - region.rect().x),
+                off_y = float(region.image_offset[1] - region.rect().y);
+
+    const float temp = tanf(0.5f * cam.fov * PI / 180.0f) * float(h_) / img_h;
+    ret.fov = 2.0f * atanf(temp) * 180.0f / PI;
+    ret.shift[0] = (2.0f * off_x + 2.0f * cam.shift[0] * img_h - img_w + float(w_)) / (2.0f * float(h_));
+    ret.shift[1] = 0.5f * ((img_h - 2.0f * off_y + 2.0f * cam.shift[1] * img_h) / float(h_) - 1.0f);
+
+    return ret;
+}
+
 template <typename SIMDPolicy> void Ray::Cpu::Renderer<SIMDPolicy>::UpdateUNetFilterMemory() {
     unet_tensors_heap_ = {};
     if (unet_weights_.empty()) {
@@ -12,8 +12,14 @@
 namespace Ray {
 namespace Sse2 {
 template int SortRays_CPU<RPSize>(Span<ray_data_t<RPSize>> rays, const float root_min[3], const float cell_size[3],
-                                  ivec<RPSize> *hash_values, uint32_t *scan_values, ray_chunk_t *chunks,
-                                  ray_chunk_t *chunks_temp);
+                                  int origin_bits, int dir_bits, ivec<RPSize> *hash_values, uint32_t *scan_values,
+                                  ray_chunk_t *chunks, ray_chunk_t *chunks_temp);
+template int SortHitsByMaterial<RPSize>(Span<ray_data_t<RPSize>> rays, Span<hit_data_t<RPSize>> inters,
+                                        const scene_data_t &sc, std::vector<uint64_t> &temp_keys,
+                                        aligned_vector<ray_data_t<RPSize>> &temp_rays,
+                                        aligned_vector<hit_data_t<RPSize>> &temp_inters);
+template int CountPacketMaterials<RPSize>(Span<const ray_data_t<RPSize>> rays, Span<const hit_data_t<RPSize>> inters,
+                                          const scene_data_t &sc);
 template int SortRays_GPU<RPSize>(Span<ray_data_t<RPSize>> rays, const float root_min[3], const float cell_size[3],
                                   ivec<RPSize> *hash_values, int *head_flags, uint32_t *scan_values,
                                   ray_chunk_t *chunks, ray_chunk_t *chunks_temp, uint32_t *skeleton);
@@ -39,7 +45,7 @@ template ivec<RPSize> Traverse_TLAS_WithStack_AnyHit<RPSize>(const fvec<RPSize>
                                                              const mesh_instance_t *mesh_instances,
                                                              const uint32_t *mi_indices, const mesh_t *meshes,
                                                              const mtri_accel_t *mtris, const tri_mat_data_t *materials,
-                                                             const uint32_t *tri_indices, hit_data_t<RPSize> &inter);
+                                                             const uint32_t *tri_indices, shadow_hits_t out_hits[RPSize]);
 template bool Traverse_BLAS_WithStack_ClosestHit<RPSize>(const fvec<RPSize> ro[3], const fvec<RPSize> rd[3],
                                                          const ivec<RPSize> &ray_mask, const bvh_node_t *nodes,
                                                          uint32_t node_index, const tri_accel_t *tris,
@@ -55,11 +61,10 @@ template ivec<RPSize> Traverse_BLAS_WithStack_AnyHit<RPSize>(const fvec<RPSize>
                                                              const tri_mat_data_t *materials,
                                                              const uint32_t *tri_indices, int obj_index,
                                                              hit_data_t<RPSize> &inter);
-template int Traverse_BLAS_WithStack_AnyHit<RPSize>(const float ro[3], const float rd[3], const wbvh_node_t *nodes,
-                                                    uint32_t node_index, const mtri_accel_t *mtris,
-                                                    const tri_mat_data_t *materials, const uint32_t *tri_indices,
-                                                    int &inter_prim_index, float &inter_t, float &inter_u,
-                                                    float &inter_v);
+template bool Traverse_BLAS_WithStack_AnyHit<RPSize>(const float ro[3], const float rd[3], const wbvh_node_t *nodes,
+                                                     uint32_t node_index, const mtri_accel_t *mtris,
+                                                     const tri_mat_data_t *materials, const uint32_t *tri_indices,
+                                                     int obj_index, shadow_hits_t &hits);
 
 template void SampleNearest<RPSize>(const Cpu::TexStorageBase *const textures[], uint32_t index,
                                     const fvec<RPSize> uvs[2], const fvec<RPSize> &lod, const ivec<RPSize> &mask,
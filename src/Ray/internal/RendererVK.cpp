@@ -35,7 +35,7 @@ static_assert(sizeof(Types::light_wbvh_node_t) == sizeof(Ray::light_wbvh_node_t)
 static_assert(sizeof(Types::light_cwbvh_node_t) == sizeof(Ray::light_cwbvh_node_t), "!");
 static_assert(sizeof(Types::vertex_t) == sizeof(Ray::vertex_t), "!");
 static_assert(sizeof(Types::mesh_t) == sizeof(Ray::mesh_t), "!");
-static_assert(sizeof(Types::mesh_instance_t) == sizeof(Ray::mesh_instance_t), "!");
+static_assert(sizeof(Types::mesh_instance_t) == sizeof(Ray::gpu_mesh_instance_t), "!");
 static_assert(sizeof(Types::light_t) == sizeof(Ray::light_t), "!");
 static_assert(sizeof(Types::material_t) == sizeof(Ray::material_t), "!");
 static_assert(sizeof(Types::atlas_texture_t) == sizeof(Ray::atlas_texture_t), "!");
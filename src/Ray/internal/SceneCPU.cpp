@@ -3,6 +3,8 @@
 #include <cassert>
 #include <cstring>
 
+#include <algorithm>
+#include <atomic>
 #include <functional>
 
 #include "../Log.h"
@@ -13,6 +15,18 @@
 
 namespace Ray {
 namespace Cpu {
+const int MaxCachedTexelMaps = 4;
+
+// zero is reserved for geometry that was changed after last TLAS rebuild
+std::atomic<uint32_t> g_last_geometry_generation{0};
+uint32_t NextGeometryGeneration() {
+    uint32_t ret;
+    do {
+        ret = ++g_last_geometry_generation;
+    } while (ret == 0);
+    return ret;
+}
+
 template <typename T> T clamp(T val, T min, T max) { return (val < min ? min : (val > max ? max : val)); }
 
 Ref::fvec4 cross(const Ref::fvec4 &v1, const Ref::fvec4 &v2) {
@@ -20,12 +34,32 @@ Ref::fvec4 cross(const Ref::fvec4 &v1, const Ref::fvec4 &v2) {
                       v1.get<2>() * v2.get<0>() - v1.get<0>() * v2.get<2>(),
                       v1.get<0>() * v2.get<1>() - v1.get<1>() * v2.get<0>(), 0.0f};
 }
+
+// Same as Ray::TransformBoundingBox, but processes all three axes at once
+void TransformBoundingBox(const float bbox_min[3], const float bbox_max[3], const float *xform, float out_bbox_min[3],
+                          float out_bbox_max[3]) {
+    Ref::fvec4 res_min = {xform[12], xform[13], xform[14], 0.0f}, res_max = res_min;
+    for (int i = 0; i < 3; i++) {
+        const Ref::fvec4 col = {xform[i * 4 + 0], xform[i * 4 + 1], xform[i * 4 + 2], 0.0f};
+        const Ref::fvec4 a = col * bbox_min[i], b = col * bbox_max[i];
+        res_min += min(a, b);
+        res_max += max(a, b);
+    }
+    for (int j = 0; j < 3; j++) {
+        out_bbox_min[j] = res_min[j];
+        out_bbox_max[j] = res_max[j];
+    }
+}
 } // namespace Cpu
 } // namespace Ray
 
-Ray::Cpu::Scene::Scene(ILog *log, const bool use_wide_bvh, const bool use_tex_compression, const bool use_spatial_cache)
-    : use_wide_bvh_(use_wide_bvh), use_tex_compression_(use_tex_compression) {
+Ray::Cpu::Scene::Scene(ILog *log, const bool use_wide_bvh, const bool use_tex_compression,
+                       const bool use_vtx_compression, const bool use_spatial_cache,
+                       IntegrateSkyRowFunction integrate_sky_row)
+    : use_wide_bvh_(use_wide_bvh), use_tex_compression_(use_tex_compression),
+      use_vtx_compression_(use_vtx_compression) {
     SceneBase::log_ = log;
+    integrate_sky_row_ = integrate_sky_row;
     SetEnvironment({});
     if (use_spatial_cache) {
         spatial_cache_entries_.resize(HASH_GRID_CACHE_ENTRIES_COUNT, 0);
@@ -520,8 +554,16 @@ Ray::MeshHandle Ray::Cpu::Scene::AddMesh(const mesh_desc_t &_m) {
         ComputeTangentBasis(0, 0, new_vertices, new_vtx_indices, new_vtx_indices);
     }
 
-    const std::pair<uint32_t, uint32_t> vtx_index = vertices_.Allocate(uint32_t(new_vertices.size()));
-    memcpy(&vertices_[vtx_index.first], new_vertices.data(), new_vertices.size() * sizeof(vertex_t));
+    std::pair<uint32_t, uint32_t> vtx_index;
+    if (use_vtx_compression_) {
+        vtx_index = packed_vertices_.Allocate(uint32_t(new_vertices.size()));
+        for (uint32_t i = 0; i < uint32_t(new_vertices.size()); ++i) {
+            PackVertex(new_vertices[i], packed_vertices_[vtx_index.first + i]);
+        }
+    } else {
+        vtx_index = vertices_.Allocate(uint32_t(new_vertices.size()));
+        memcpy(&vertices_[vtx_index.first], new_vertices.data(), new_vertices.size() * sizeof(vertex_t));
+    }
 
     const std::pair<uint32_t, uint32_t> vtx_indices_index = vtx_indices_.Allocate(uint32_t(new_vtx_indices.size()));
     assert(trimat_index.second == vtx_indices_index.second);
@@ -537,23 +579,316 @@ Ray::MeshHandle Ray::Cpu::Scene::AddMesh(const mesh_desc_t &_m) {
     m.vert_data_block = vtx_index.second;
 
     const std::pair<uint32_t, uint32_t> ret = meshes_.emplace(m);
+    UpdateMeshEmissiveTris_nolock(ret.first);
+    UpdateMeshTriOpacity_nolock(ret.first);
+
     return MeshHandle{ret.first, ret.second};
 }
 
+void Ray::Cpu::Scene::UpdateMeshEmissiveTris_nolock(const uint32_t mesh_index) {
+    if (mesh_index >= mesh_emissive_tris_.size()) {
+        mesh_emissive_tris_.resize(mesh_index + 1);
+    }
+    mesh_emissive_tris_[mesh_index].materials_generation = materials_generation_;
+    FindEmissiveTris_nolock(mesh_index, mesh_emissive_tris_[mesh_index].ranges);
+}
+
+void Ray::Cpu::Scene::StoreEmissiveTris_nolock(const uint32_t mesh_index,
+                                               const std::vector<emissive_tris_t> &ranges) {
+    if (mesh_index < mesh_emissive_tris_.size() &&
+        mesh_emissive_tris_[mesh_index].materials_generation != materials_generation_) {
+        mesh_emissive_tris_[mesh_index].materials_generation = materials_generation_;
+        mesh_emissive_tris_[mesh_index].ranges = ranges;
+    }
+}
+
+void Ray::Cpu::Scene::GetEmissiveTris_nolock(const uint32_t mesh_index,
+                                             std::vector<emissive_tris_t> &out_ranges) const {
+    if (mesh_index >= mesh_emissive_tris_.size()) {
+        out_ranges.clear();
+    } else if (mesh_emissive_tris_[mesh_index].materials_generation != materials_generation_) {
+        // material was removed since mesh was added, its slot might be taken by different material now
+        FindEmissiveTris_nolock(mesh_index, out_ranges);
+    } else {
+        out_ranges = mesh_emissive_tris_[mesh_index].ranges;
+    }
+}
+
+void Ray::Cpu::Scene::FindEmissiveTris_nolock(const uint32_t mesh_index,
+                                              std::vector<emissive_tris_t> &ranges) const {
+    ranges.clear();
+
+    auto find_emissive = [this](const uint16_t mat_index) -> uint16_t {
+        if (mat_index == 0xffff) {
+            return 0xffff;
+        }
+        SmallVector<uint16_t, 64> mat_indices;
+        mat_indices.push_back(mat_index & MATERIAL_INDEX_BITS);
+        for (int i = 0; i < int(mat_indices.size()); ++i) {
+            const material_t &mat = materials_[mat_indices[i]];
+            if (mat.type == eShadingNode::Emissive && (mat.flags & MAT_FLAG_IMP_SAMPLE)) {
+                return mat_indices[i];
+            } else if (mat.type == eShadingNode::Mix) {
+                mat_indices.push_back(mat.textures[MIX_MAT1]);
+                mat_indices.push_back(mat.textures[MIX_MAT2]);
+            }
+        }
+        return 0xffff;
+    };
+
+    const mesh_t &m = meshes_[mesh_index];
+
+    // Triangles are grouped by material, so material graph is traversed only when it changes
+    tri_mat_data_t last_tri_mat = {0xffff, 0xffff};
+    uint16_t front_emissive = 0xffff, back_emissive = 0xffff;
+
+    for (uint32_t tri = (m.vert_index / 3); tri < (m.vert_index + m.vert_count) / 3; ++tri) {
+        const tri_mat_data_t &tri_mat = tri_materials_[tri];
+        if (tri_mat.front_mi != last_tri_mat.front_mi || tri_mat.back_mi != last_tri_mat.back_mi) {
+            front_emissive = find_emissive(tri_mat.front_mi);
+            back_emissive = find_emissive(tri_mat.back_mi);
+            last_tri_mat = tri_mat;
+        }
+        if (front_emissive == 0xffff) {
+            continue;
+        }
+
+        const uint16_t doublesided = (back_emissive != 0xffff) ? 1 : 0;
+        if (!ranges.empty() && ranges.back().tri_index + ranges.back().tri_count == tri &&
+            ranges.back().front_mi == front_emissive && ranges.back().doublesided == doublesided) {
+            ++ranges.back().tri_count;
+        } else {
+            ranges.push_back({tri, 1, front_emissive, doublesided});
+        }
+    }
+}
+
+void Ray::Cpu::Scene::UpdateMeshTriOpacity_nolock(const uint32_t mesh_index, const bool reclassify) {
+    using namespace Ref;
+
+    if (mesh_index >= mesh_opacity_generation_.size()) {
+        mesh_opacity_generation_.resize(mesh_index + 1);
+    }
+    mesh_opacity_generation_[mesh_index] = materials_generation_;
+
+    // Transmittance of shadow ray through a triangle is bounded by interval arithmetic over material graph. Mix
+    // factors are bounded by texels covered by triangle's uv footprint (shadow rays always sample the finest level)
+    struct range_t {
+        float lo, hi;
+    };
+    const int MaxFootprintTexels = 64 * 64;
+
+    auto texture_range = [this](const uint32_t texture, const float uv_min[2], const float uv_max[2]) -> range_t {
+        if (texture & TEX_YCOCG_BIT) {
+            return {0.0f, 1.0f};
+        }
+
+        const TexStorageBase &storage = *tex_storages_[texture >> 28];
+        const int tex = int(texture & 0x00ffffff);
+
+        int res[2];
+        storage.GetIRes(tex, 0, res);
+
+        int beg[2], end[2];
+        for (int j = 0; j < 2; ++j) {
+            if (uv_max[j] - uv_min[j] >= 1.0f) {
+                beg[j] = 0;
+                end[j] = res[j] - 1;
+            } else {
+                // neighbouring texel can be reached by bilinear (or stochastic) filtering
+                beg[j] = int(std::floor(uv_min[j] * float(res[j]) - 0.5f));
+                end[j] = int(std::floor(uv_max[j] * float(res[j]) - 0.5f)) + 1;
+            }
+        }
+        if ((end[0] - beg[0] + 1) * (end[1] - beg[1] + 1) > MaxFootprintTexels) {
+            return {0.0f, 1.0f};
+        }
+
+        range_t ret = {FLT_MAX, -FLT_MAX};
+        for (int y = beg[1]; y <= end[1]; ++y) {
+            for (int x = beg[0]; x <= end[0]; ++x) {
+                const color_rgba_t texel =
+                    storage.Fetch(tex, ((x % res[0]) + res[0]) % res[0], ((y % res[1]) + res[1]) % res[1], 0);
+                fvec4 col = {texel.v[0], texel.v[1], texel.v[2], texel.v[3]};
+                if (texture & TEX_SRGB_BIT) {
+                    col = srgb_to_linear(col);
+                }
+                ret.lo = fminf(ret.lo, col.get<0>());
+                ret.hi = fmaxf(ret.hi, col.get<0>());
+                if (ret.lo < ret.hi) {
+                    // partially covered, exact bounds do not matter
+                    return {0.0f, 1.0f};
+                }
+            }
+        }
+        return ret;
+    };
+
+    std::function<range_t(uint32_t, const float[2], const float[2])> throughput_range;
+    throughput_range = [&](const uint32_t mat_index, const float uv_min[2], const float uv_max[2]) -> range_t {
+        const material_t &mat = materials_[mat_index];
+        if (mat.type == eShadingNode::Mix) {
+            const range_t t1 = throughput_range(mat.textures[MIX_MAT1], uv_min, uv_max),
+                          t2 = throughput_range(mat.textures[MIX_MAT2], uv_min, uv_max);
+            if (t1.hi <= 0.0f && t2.hi <= 0.0f) {
+                // mix factor does not matter, no need to look at texture
+                return {0.0f, 0.0f};
+            }
+            range_t mix = {mat.strength, mat.strength};
+            if (mat.textures[BASE_TEXTURE] != 0xffffffff) {
+                const range_t tex = texture_range(mat.textures[BASE_TEXTURE], uv_min, uv_max);
+                mix = {fminf(mat.strength * tex.lo, mat.strength * tex.hi),
+                       fmaxf(mat.strength * tex.lo, mat.strength * tex.hi)};
+            }
+            // result is linear in mix factor, so extremes are reached at interval ends
+            return {fminf((1.0f - mix.lo) * t1.lo + mix.lo * t2.lo, (1.0f - mix.hi) * t1.lo + mix.hi * t2.lo),
+                    fmaxf((1.0f - mix.lo) * t1.hi + mix.lo * t2.hi, (1.0f - mix.hi) * t1.hi + mix.hi * t2.hi)};
+        } else if (mat.type == eShadingNode::Transparent) {
+            return {fminf(mat.base_color[0], fminf(mat.base_color[1], mat.base_color[2])),
+                    fmaxf(mat.base_color[0], fmaxf(mat.base_color[1], mat.base_color[2]))};
+        }
+        return {0.0f, 0.0f};
+    };
+
+    auto classify = [&](uint16_t &mi, const float uv_min[2], const float uv_max[2]) {
+        if (reclassify && mi != 0xffff) {
+            // referenced material could have been replaced, solid bit is derived again (it is implied by zero
+            // throughput of material graph, the same as in AddMesh)
+            mi &= ~(MATERIAL_SOLID_BIT | MATERIAL_TRANSPARENT_BIT);
+        }
+        if (mi == 0xffff || (mi & MATERIAL_SOLID_BIT)) {
+            return;
+        }
+        mi &= ~MATERIAL_TRANSPARENT_BIT;
+        const range_t throughput = throughput_range(mi & MATERIAL_INDEX_BITS, uv_min, uv_max);
+        if (throughput.hi <= 0.0f) {
+            mi |= MATERIAL_SOLID_BIT;
+        } else if (throughput.lo >= 1.0f) {
+            mi |= MATERIAL_TRANSPARENT_BIT;
+        }
+    };
+
+    const vertex_data_t vertices = vertex_data();
+
+    const mesh_t &m = meshes_[mesh_index];
+    for (uint32_t tri = (m.vert_index / 3); tri < (m.vert_index + m.vert_count) / 3; ++tri) {
+        tri_mat_data_t &tri_mat = tri_materials_[tri];
+        if (!reclassify && (tri_mat.front_mi & MATERIAL_SOLID_BIT) && (tri_mat.back_mi & MATERIAL_SOLID_BIT)) {
+            continue;
+        }
+
+        float uv_min[2] = {FLT_MAX, FLT_MAX}, uv_max[2] = {-FLT_MAX, -FLT_MAX};
+        for (int j = 0; j < 3; ++j) {
+            const vertex_t &v = vertices[vtx_indices_[tri * 3 + j]];
+            for (int k = 0; k < 2; ++k) {
+                uv_min[k] = fminf(uv_min[k], v.t[k]);
+                uv_max[k] = fmaxf(uv_max[k], v.t[k]);
+            }
+        }
+
+        classify(tri_mat.front_mi, uv_min, uv_max);
+        classify(tri_mat.back_mi, uv_min, uv_max);
+    }
+}
+
+std::shared_ptr<const Ray::texel_map_t> Ray::Cpu::Scene::GetTexelMap(const uint32_t mi_index, const uint32_t uv_layer,
+                                                                     const int w, const int h) const {
+    // atlas map does not belong to any mesh, it is invalidated explicitly
+    const uint32_t mesh_index = (mi_index != 0xffffffff) ? mesh_instances_[mi_index].mesh_index : 0xffffffff;
+
+    std::lock_guard<std::mutex> _(texel_maps_mtx_);
+
+    for (auto it = begin(texel_maps_); it != end(texel_maps_); ++it) {
+        const texel_map_t &m = **it;
+        if (m.mi_index == mi_index && m.mesh_index == mesh_index && m.uv_layer == uv_layer && m.w == w && m.h == h) {
+            std::rotate(it, it + 1, end(texel_maps_));
+            return texel_maps_.back();
+        }
+    }
+
+    const uint64_t t1 = Ray::GetTimeMs();
+
+    auto new_map = std::make_shared<texel_map_t>();
+    new_map->mi_index = mi_index;
+    new_map->mesh_index = mesh_index;
+    new_map->uv_layer = uv_layer;
+
+    texel_sample_t empty_texel = {};
+    empty_texel.prim_index = 0xffffffff;
+    std::vector<texel_sample_t> texels(size_t(w) * h, empty_texel);
+    if (mi_index != 0xffffffff) {
+        Ref::RasterizeMeshUVs(meshes_[mesh_index], mi_index, int(uv_layer), &vtx_indices_[0], vertex_data(),
+                              rect_t{0, 0, w, h}, w, texels.data());
+    } else {
+        for (const atlas_item_desc_t &item : lightmap_atlas_) {
+            // parts of rectangle that are outside of framebuffer are dropped
+            const int x_end = std::min(item.rect.x + item.rect.w, w), y_end = std::min(item.rect.y + item.rect.h, h);
+            if (item.rect.x < 0 || item.rect.y < 0 || item.rect.x >= x_end || item.rect.y >= y_end) {
+                continue;
+            }
+            const mesh_instance_t &mi = mesh_instances_[item.mi._index];
+            Ref::RasterizeMeshUVs(meshes_[mi.mesh_index], item.mi._index, int(uv_layer), &vtx_indices_[0],
+                                  vertex_data(), item.rect, w, texels.data());
+        }
+    }
+    Ref::CompactTexelMap(texels.data(), w, h, *new_map);
+
+    log_->Info("Ray: Texel map (%ix%i, %i texels covered) built in %lldms", w, h, int(new_map->texels.size()),
+               (Ray::GetTimeMs() - t1));
+
+    if (int(texel_maps_.size()) >= MaxCachedTexelMaps) {
+        texel_maps_.erase(begin(texel_maps_));
+    }
+    texel_maps_.push_back(std::move(new_map));
+
+    return texel_maps_.back();
+}
+
+bool Ray::Cpu::Scene::SetLightmapAtlas(Span<const atlas_item_desc_t> items) {
+    std::unique_lock<std::shared_timed_mutex> lock(mtx_);
+
+    for (const atlas_item_desc_t &item : items) {
+        if (!mesh_instances_.Contains(item.mi._index, item.mi._block) || item.rect.w <= 0 || item.rect.h <= 0) {
+            log_->Error("Invalid lightmap atlas item (mesh instance %i)", int(item.mi._index));
+            return false;
+        }
+    }
+
+    lightmap_atlas_.assign(items.begin(), items.end());
+
+    std::lock_guard<std::mutex> _(texel_maps_mtx_);
+    texel_maps_.erase(std::remove_if(begin(texel_maps_), end(texel_maps_),
+                                     [](const std::shared_ptr<const texel_map_t> &m) {
+                                         return m->mi_index == 0xffffffff;
+                                     }),
+                      end(texel_maps_));
+
+    return true;
+}
+
 void Ray::Cpu::Scene::RemoveMesh_nolock(const MeshHandle i) {
     const mesh_t &m = meshes_[i._index];
 
+    { // maps may reference triangles of removed mesh
+        std::lock_guard<std::mutex> _(texel_maps_mtx_);
+        texel_maps_.clear();
+    }
+
     const uint32_t node_block = m.node_block;
     const uint32_t tris_block = m.tris_block;
     const uint32_t vert_block = m.vert_block, vert_data_block = m.vert_data_block;
 
     meshes_.Erase(i._block);
+    if (i._index < mesh_emissive_tris_.size()) {
+        mesh_emissive_tris_[i._index].ranges.clear();
+    }
 
     bool rebuild_required = false;
     for (auto it = mesh_instances_.begin(); it != mesh_instances_.end();) {
         mesh_instance_t &mi = *it;
         if (mi.mesh_index == i._index) {
             it = mesh_instances_.erase(it);
+            geometry_generation_ = 0;
             rebuild_required = true;
         } else {
             ++it;
@@ -565,7 +900,11 @@ void Ray::Cpu::Scene::RemoveMesh_nolock(const MeshHandle i) {
     mtris_.Erase(tris_block);
     tri_indices_.Erase(tris_block);
     tri_materials_.Erase(tris_block);
-    vertices_.Erase(vert_data_block);
+    if (use_vtx_compression_) {
+        packed_vertices_.Erase(vert_data_block);
+    } else {
+        vertices_.Erase(vert_data_block);
+    }
     vtx_indices_.Erase(vert_block);
     if (use_wide_bvh_) {
         wnodes_.Erase(node_block);
@@ -674,8 +1013,8 @@ Ray::LightHandle Ray::Cpu::Scene::AddLight(const rect_light_desc_t &_l, const fl
 
     l.rect.area = _l.width * _l.height;
 
-    const Ref::fvec4 uvec = _l.width * TransformDirection(Ref::fvec4{1.0f, 0.0f, 0.0f, 0.0f}, xform);
-    const Ref::fvec4 vvec = _l.height * TransformDirection(Ref::fvec4{0.0f, 0.0f, 1.0f, 0.0f}, xform);
+    const Ref::fvec4 uvec = _l.width * Ref::fvec4{xform[0], xform[1], xform[2], 0.0f};
+    const Ref::fvec4 vvec = _l.height * Ref::fvec4{xform[8], xform[9], xform[10], 0.0f};
 
     memcpy(l.rect.u, value_ptr(uvec), 3 * sizeof(float));
     memcpy(l.rect.v, value_ptr(vvec), 3 * sizeof(float));
@@ -709,8 +1048,8 @@ Ray::LightHandle Ray::Cpu::Scene::AddLight(const disk_light_desc_t &_l, const fl
 
     l.disk.area = 0.25f * PI * _l.size_x * _l.size_y;
 
-    const Ref::fvec4 uvec = _l.size_x * TransformDirection(Ref::fvec4{1.0f, 0.0f, 0.0f, 0.0f}, xform);
-    const Ref::fvec4 vvec = _l.size_y * TransformDirection(Ref::fvec4{0.0f, 0.0f, 1.0f, 0.0f}, xform);
+    const Ref::fvec4 uvec = _l.size_x * Ref::fvec4{xform[0], xform[1], xform[2], 0.0f};
+    const Ref::fvec4 vvec = _l.size_y * Ref::fvec4{xform[8], xform[9], xform[10], 0.0f};
 
     memcpy(l.disk.u, value_ptr(uvec), 3 * sizeof(float));
     memcpy(l.disk.v, value_ptr(vvec), 3 * sizeof(float));
@@ -740,8 +1079,8 @@ Ray::LightHandle Ray::Cpu::Scene::AddLight(const line_light_desc_t &_l, const fl
 
     l.line.area = 2.0f * PI * _l.radius * _l.height;
 
-    const Ref::fvec4 uvec = TransformDirection(Ref::fvec4{1.0f, 0.0f, 0.0f, 0.0f}, xform);
-    const Ref::fvec4 vvec = TransformDirection(Ref::fvec4{0.0f, 1.0f, 0.0f, 0.0f}, xform);
+    const Ref::fvec4 uvec = Ref::fvec4{xform[0], xform[1], xform[2], 0.0f};
+    const Ref::fvec4 vvec = Ref::fvec4{xform[4], xform[5], xform[6], 0.0f};
 
     memcpy(l.line.u, value_ptr(uvec), 3 * sizeof(float));
     l.line.radius = _l.radius;
@@ -755,116 +1094,220 @@ Ray::LightHandle Ray::Cpu::Scene::AddLight(const line_light_desc_t &_l, const fl
 }
 
 Ray::MeshInstanceHandle Ray::Cpu::Scene::AddMeshInstance(const mesh_instance_desc_t &mi_desc) {
+    const uint32_t ray_visibility = CalcRayVisibility(mi_desc);
+
+    // create emitters for emissive triangles (ranges were found when mesh was added)
+    std::vector<emissive_tris_t> ranges;
+    std::vector<light_t> new_lights;
+    uint32_t materials_generation;
+    {
+        std::shared_lock<std::shared_timed_mutex> lock(mtx_);
+        materials_generation = materials_generation_;
+        GetEmissiveTris_nolock(mi_desc.mesh._index, ranges);
+        new_lights.resize(CountEmissiveTris(ranges));
+        CreateEmissiveLights_nolock(ranges, ray_visibility, new_lights.data());
+    }
+
     std::unique_lock<std::shared_timed_mutex> lock(mtx_);
 
-    const std::pair<uint32_t, uint32_t> mi_index = mesh_instances_.emplace();
+    if (materials_generation != materials_generation_) {
+        // material was removed in between
+        GetEmissiveTris_nolock(mi_desc.mesh._index, ranges);
+        new_lights.resize(CountEmissiveTris(ranges));
+        CreateEmissiveLights_nolock(ranges, ray_visibility, new_lights.data());
+    }
+    StoreEmissiveTris_nolock(mi_desc.mesh._index, ranges);
 
-    mesh_instance_t &mi = mesh_instances_.at(mi_index.first);
-    mi.mesh_index = mi_desc.mesh._index;
-    mi.mesh_block = mi_desc.mesh._block;
-    mi.lights_index = 0xffffffff;
-
-    mi.ray_visibility = 0;
-    mi.ray_visibility |= (mi_desc.camera_visibility << RAY_TYPE_CAMERA);
-    mi.ray_visibility |= (mi_desc.diffuse_visibility << RAY_TYPE_DIFFUSE);
-    mi.ray_visibility |= (mi_desc.specular_visibility << RAY_TYPE_SPECULAR);
-    mi.ray_visibility |= (mi_desc.refraction_visibility << RAY_TYPE_REFR);
-    mi.ray_visibility |= (mi_desc.shadow_visibility << RAY_TYPE_SHADOW);
-
-    { // find emissive triangles and add them as light emitters
-        std::vector<light_t> new_lights;
-
-        const mesh_t &m = meshes_[mi_desc.mesh._index];
-        for (uint32_t tri = (m.vert_index / 3); tri < (m.vert_index + m.vert_count) / 3; ++tri) {
-            const tri_mat_data_t &tri_mat = tri_materials_[tri];
-
-            SmallVector<uint16_t, 64> mat_indices;
-            mat_indices.push_back(tri_mat.front_mi & MATERIAL_INDEX_BITS);
-
-            uint16_t front_emissive = 0xffff;
-            for (int i = 0; i < int(mat_indices.size()); ++i) {
-                const material_t &mat = materials_[mat_indices[i]];
-                if (mat.type == eShadingNode::Emissive && (mat.flags & MAT_FLAG_IMP_SAMPLE)) {
-                    front_emissive = mat_indices[i];
-                    break;
-                } else if (mat.type == eShadingNode::Mix) {
-                    mat_indices.push_back(mat.textures[MIX_MAT1]);
-                    mat_indices.push_back(mat.textures[MIX_MAT2]);
-                }
-            }
+    const MeshInstanceHandle ret = AddMeshInstance_nolock(mi_desc.mesh, ray_visibility, new_lights);
+    SetMeshInstanceTransform_nolock(ret, mi_desc.xform);
 
-            mat_indices.clear();
-            if (tri_mat.back_mi != 0xffff) {
-                mat_indices.push_back(tri_mat.back_mi & MATERIAL_INDEX_BITS);
-            }
+    return ret;
+}
 
-            uint16_t back_emissive = 0xffff;
-            for (int i = 0; i < int(mat_indices.size()); ++i) {
-                const material_t &mat = materials_[mat_indices[i]];
-                if (mat.type == eShadingNode::Emissive && (mat.flags & MAT_FLAG_IMP_SAMPLE)) {
-                    back_emissive = mat_indices[i];
-                    break;
-                } else if (mat.type == eShadingNode::Mix) {
-                    mat_indices.push_back(mat.textures[MIX_MAT1]);
-                    mat_indices.push_back(mat.textures[MIX_MAT2]);
-                }
-            }
+void Ray::Cpu::Scene::AddMeshInstances(Span<const mesh_instance_desc_t> mi_descs,
+                                       Span<MeshInstanceHandle> out_handles,
+                                       const std::function<void(int, int, ParallelForFunction &&)> &parallel_for) {
+    assert(out_handles.size() >= mi_descs.size());
+
+    // Emitters of all instances are created in parallel under shared lock (into one array), exclusive lock is taken
+    // only to publish them together with instances
+    std::vector<uint32_t> meshes;
+    meshes.reserve(mi_descs.size());
+    for (const mesh_instance_desc_t &mi_desc : mi_descs) {
+        meshes.push_back(mi_desc.mesh._index);
+    }
+    std::sort(begin(meshes), end(meshes));
+    meshes.erase(std::unique(begin(meshes), end(meshes)), end(meshes));
+
+    std::vector<std::vector<emissive_tris_t>> mesh_ranges(meshes.size());
+    std::vector<uint32_t> lights_offset(mi_descs.size() + 1, 0);
+    std::vector<light_t> new_lights;
+
+    auto create_emissive_lights = [&]() {
+        parallel_for(0, int(meshes.size()), [&](const int i) { GetEmissiveTris_nolock(meshes[i], mesh_ranges[i]); });
+        auto get_ranges = [&](const uint32_t mesh_index) -> const std::vector<emissive_tris_t> & {
+            return mesh_ranges[std::lower_bound(begin(meshes), end(meshes), mesh_index) - begin(meshes)];
+        };
+        for (ptrdiff_t i = 0; i < mi_descs.size(); ++i) {
+            lights_offset[i + 1] = lights_offset[i] + CountEmissiveTris(get_ranges(mi_descs[i].mesh._index));
+        }
+        new_lights.resize(lights_offset.back());
+        parallel_for(0, int(mi_descs.size()), [&](const int i) {
+            CreateEmissiveLights_nolock(get_ranges(mi_descs[i].mesh._index), CalcRayVisibility(mi_descs[i]),
+                                        new_lights.data() + lights_offset[i]);
+        });
+    };
 
-            if (front_emissive != 0xffff) {
-                const material_t &mat = materials_[front_emissive];
-
-                new_lights.emplace_back();
-                light_t &new_light = new_lights.back();
-                new_light.type = LIGHT_TYPE_TRI;
-                new_light.doublesided = (back_emissive != 0xffff) ? 1 : 0;
-                new_light.cast_shadow = 1;
-                new_light.visible = 0;
-                new_light.sky_portal = 0;
-                new_light.ray_visibility = mi.ray_visibility;
-                new_light.ray_visibility &= ~RAY_TYPE_CAMERA_BIT;
-                new_light.ray_visibility &= ~RAY_TYPE_SHADOW_BIT;
-                new_light.tri.tri_index = tri;
-                new_light.tri.mi_index = mi_index.first;
-                new_light.tri.tex_index = mat.textures[BASE_TEXTURE];
-                new_light.col[0] = mat.base_color[0] * mat.strength;
-                new_light.col[1] = mat.base_color[1] * mat.strength;
-                new_light.col[2] = mat.base_color[2] * mat.strength;
-            }
+    uint32_t materials_generation;
+    {
+        std::shared_lock<std::shared_timed_mutex> lock(mtx_);
+        materials_generation = materials_generation_;
+        create_emissive_lights();
+    }
+
+    std::unique_lock<std::shared_timed_mutex> lock(mtx_);
+
+    if (materials_generation != materials_generation_) {
+        // material was removed in between
+        create_emissive_lights();
+    }
+    for (size_t i = 0; i < meshes.size(); ++i) {
+        StoreEmissiveTris_nolock(meshes[i], mesh_ranges[i]);
+    }
+
+    // compiled scene must not depend on whether instances were added in bulk
+    mesh_instances_.reserve_more(uint32_t(mi_descs.size()));
+
+    for (ptrdiff_t i = 0; i < mi_descs.size(); ++i) {
+        const Span<light_t> mi_lights(new_lights.data() + lights_offset[i], new_lights.data() + lights_offset[i + 1]);
+        out_handles[i] = AddMeshInstance_nolock(mi_descs[i].mesh, CalcRayVisibility(mi_descs[i]), mi_lights);
+    }
+
+    // NOTE: TLAS is not touched here, it will be rebuilt during Finalize
+    parallel_for(0, int(mi_descs.size()),
+                 [&](const int i) { SetMeshInstanceTransform_nolock(out_handles[i], mi_descs[i].xform); });
+}
+
+void Ray::Cpu::Scene::SetMeshInstanceTransforms(
+    Span<const MeshInstanceHandle> mis, const float *xforms,
+    const std::function<void(int, int, ParallelForFunction &&)> &parallel_for) {
+#ifndef NDEBUG
+    { // the same instance would be written concurrently
+        std::vector<uint32_t> indices(mis.size());
+        for (ptrdiff_t i = 0; i < mis.size(); ++i) {
+            indices[i] = mis[i]._index;
         }
+        std::sort(begin(indices), end(indices));
+        assert(std::adjacent_find(begin(indices), end(indices)) == end(indices) && "Duplicate handles!");
+    }
+#endif
 
-        if (!new_lights.empty()) {
-            const std::pair<uint32_t, uint32_t> lights_index = lights_.Allocate(uint32_t(new_lights.size()));
-            for (uint32_t i = 0; i < uint32_t(new_lights.size()); ++i) {
-                lights_[lights_index.first + i] = new_lights[i];
-            }
+    std::unique_lock<std::shared_timed_mutex> lock(mtx_);
+    parallel_for(0, int(mis.size()), [&](const int i) { SetMeshInstanceTransform_nolock(mis[i], &xforms[16 * i]); });
+    geometry_generation_ = 0;
+}
+
+uint32_t Ray::Cpu::Scene::CalcRayVisibility(const mesh_instance_desc_t &mi_desc) {
+    uint32_t ray_visibility = 0;
+    ray_visibility |= (mi_desc.camera_visibility << RAY_TYPE_CAMERA);
+    ray_visibility |= (mi_desc.diffuse_visibility << RAY_TYPE_DIFFUSE);
+    ray_visibility |= (mi_desc.specular_visibility << RAY_TYPE_SPECULAR);
+    ray_visibility |= (mi_desc.refraction_visibility << RAY_TYPE_REFR);
+    ray_visibility |= (mi_desc.shadow_visibility << RAY_TYPE_SHADOW);
+    return ray_visibility;
+}
+
+uint32_t Ray::Cpu::Scene::CountEmissiveTris(Span<const emissive_tris_t> ranges) {
+    uint32_t count = 0;
+    for (const emissive_tris_t &r : ranges) {
+        count += r.tri_count;
+    }
+    return count;
+}
 
-            mi.lights_index = lights_index.first;
-            assert(lights_index.second <= 0xffffff);
-            mi.ray_visibility |= (lights_index.second << 8);
+void Ray::Cpu::Scene::CreateEmissiveLights_nolock(Span<const emissive_tris_t> ranges, const uint32_t ray_visibility,
+                                                  light_t *out_lights) const {
+    for (const emissive_tris_t &r : ranges) {
+        const material_t &mat = materials_[r.front_mi];
+
+        light_t new_light = {};
+        new_light.type = LIGHT_TYPE_TRI;
+        new_light.doublesided = r.doublesided;
+        new_light.cast_shadow = 1;
+        new_light.visible = 0;
+        new_light.sky_portal = 0;
+        new_light.ray_visibility = ray_visibility;
+        new_light.ray_visibility &= ~RAY_TYPE_CAMERA_BIT;
+        new_light.ray_visibility &= ~RAY_TYPE_SHADOW_BIT;
+        new_light.tri.tex_index = mat.textures[BASE_TEXTURE];
+        new_light.col[0] = mat.base_color[0] * mat.strength;
+        new_light.col[1] = mat.base_color[1] * mat.strength;
+        new_light.col[2] = mat.base_color[2] * mat.strength;
+
+        for (uint32_t i = 0; i < r.tri_count; ++i) {
+            new_light.tri.tri_index = r.tri_index + i;
+            *out_lights++ = new_light;
         }
     }
+}
 
-    const MeshInstanceHandle ret = {mi_index.first, mi_index.second};
-    SetMeshInstanceTransform_nolock(ret, mi_desc.xform);
+Ray::MeshInstanceHandle Ray::Cpu::Scene::AddMeshInstance_nolock(const MeshHandle mesh, const uint32_t ray_visibility,
+                                                                Span<light_t> new_lights) {
+    const std::pair<uint32_t, uint32_t> mi_index = mesh_instances_.emplace();
+    geometry_generation_ = 0;
 
-    return ret;
+    mesh_instance_t &mi = mesh_instances_.at(mi_index.first);
+    mi.mesh_index = mesh._index;
+    mi.ray_visibility = ray_visibility | (0xffffffu << 8);
+
+    if (!new_lights.empty()) {
+        for (light_t &l : new_lights) {
+            l.tri.mi_index = mi_index.first;
+        }
+
+        const std::pair<uint32_t, uint32_t> lights_index = lights_.Allocate(uint32_t(new_lights.size()));
+        memcpy(&lights_[lights_index.first], new_lights.data(), new_lights.size() * sizeof(light_t));
+
+        assert(lights_index.second < 0xffffff);
+        mi.ray_visibility = ray_visibility | (lights_index.second << 8);
+    }
+
+    return MeshInstanceHandle{mi_index.first, mi_index.second};
 }
 
 void Ray::Cpu::Scene::SetMeshInstanceTransform_nolock(const MeshInstanceHandle mi_handle, const float *xform) {
     mesh_instance_t &mi = mesh_instances_[mi_handle._index];
 
-    memcpy(mi.xform, xform, 16 * sizeof(float));
-    InverseMatrix(mi.xform, mi.inv_xform);
+    float inv_xform[16];
+    InverseMatrix(xform, inv_xform);
+    for (int c = 0; c < 4; ++c) {
+        for (int r = 0; r < 3; ++r) {
+            mi.inv_xform[3 * c + r] = inv_xform[4 * c + r];
+        }
+    }
 
     const mesh_t &m = meshes_[mi.mesh_index];
-    TransformBoundingBox(m.bbox_min, m.bbox_max, xform, mi.bbox_min, mi.bbox_max);
+    Cpu::TransformBoundingBox(m.bbox_min, m.bbox_max, xform, mi.bbox_min, mi.bbox_max);
 }
 
 void Ray::Cpu::Scene::RemoveMeshInstance_nolock(const MeshInstanceHandle i) {
     mesh_instance_t &mi = mesh_instances_[i._index];
+    geometry_generation_ = 0;
+
+    {
+        std::lock_guard<std::mutex> _(texel_maps_mtx_);
+        texel_maps_.erase(std::remove_if(begin(texel_maps_), end(texel_maps_),
+                                         [&](const std::shared_ptr<const texel_map_t> &m) {
+                                             return m->mi_index == i._index || m->mi_index == 0xffffffff;
+                                         }),
+                          end(texel_maps_));
+    }
+    lightmap_atlas_.erase(std::remove_if(begin(lightmap_atlas_), end(lightmap_atlas_),
+                                         [&](const atlas_item_desc_t &item) { return item.mi._index == i._index; }),
+                          end(lightmap_atlas_));
 
-    if (mi.lights_index != 0xffffffff) {
-        const uint32_t light_block = (mi.ray_visibility >> 8);
+    const uint32_t light_block = (mi.ray_visibility >> 8);
+    if (light_block != 0xffffff) {
         lights_.Erase(light_block);
     }
     mesh_instances_.Erase(i._block);
@@ -873,6 +1316,16 @@ void Ray::Cpu::Scene::RemoveMeshInstance_nolock(const MeshInstanceHandle i) {
 void Ray::Cpu::Scene::Finalize(const std::function<void(int, int, ParallelForFunction &&)> &parallel_for) {
     std::unique_lock<std::shared_timed_mutex> lock(mtx_);
 
+    for (auto it = meshes_.begin(); it != meshes_.end(); ++it) {
+        if (it.index() >= mesh_opacity_generation_.size() ||
+            mesh_opacity_generation_[it.index()] != materials_generation_) {
+            // material was removed after mesh was added, shadow rays must not rely on stale classification
+            UpdateMeshTriOpacity_nolock(it.index(), true /* reclassify */);
+            // cached primary hits may now land on triangles that have become transparent
+            geometry_generation_ = 0;
+        }
+    }
+
     if (env_map_light_ != InvalidLightHandle) {
         lights_.Erase(env_map_light_._block);
     }
@@ -889,7 +1342,7 @@ void Ray::Cpu::Scene::Finalize(const std::function<void(int, int, ParallelForFun
 
     if (env_.importance_sample && env_.env_col[0] > 0.0f && env_.env_col[1] > 0.0f && env_.env_col[2] > 0.0f) {
         if (env_.env_map != InvalidTextureHandle._index) {
-            PrepareEnvMapQTree_nolock();
+            PrepareEnvMapQTree_nolock(parallel_for);
         }
         { // add env light source
             light_t l = {};
@@ -909,10 +1362,15 @@ void Ray::Cpu::Scene::Finalize(const std::function<void(int, int, ParallelForFun
     }
 
     RebuildTLAS_nolock();
-    RebuildLightTree_nolock();
+    RebuildLightTree_nolock(parallel_for);
+
+    finalize_generation_ = NextGeometryGeneration();
 }
 
 void Ray::Cpu::Scene::RebuildTLAS_nolock() {
+    if (geometry_generation_ == 0) {
+        geometry_generation_ = NextGeometryGeneration();
+    }
     if (tlas_root_ != 0xffffffff) {
         if (use_wide_bvh_) {
             wnodes_.Erase(tlas_block_);
@@ -1021,7 +1479,8 @@ void Ray::Cpu::Scene::PrepareSkyEnvMap_nolock(
     log_->Info("PrepareSkyEnvMap (%ix%i) done in %lldms", SkyEnvRes[0], SkyEnvRes[1], GetTimeMs() - t1);
 }
 
-void Ray::Cpu::Scene::PrepareEnvMapQTree_nolock() {
+void Ray::Cpu::Scene::PrepareEnvMapQTree_nolock(
+    const std::function<void(int, int, ParallelForFunction &&)> &parallel_for) {
     const int tex = int(env_.env_map & 0x00ffffff);
     Ref::ivec2 size;
     tex_storage_rgba_.GetIRes(tex, 0, value_ptr(size));
@@ -1048,46 +1507,49 @@ void Ray::Cpu::Scene::PrepareEnvMapQTree_nolock() {
                                                  {1 / 273.0f, 4 / 273.0f, 7 / 273.0f, 4 / 273.0f, 1 / 273.0f}};
         static const float FilterSize = 0.5f;
 
-        for (int qy = 0; qy < cur_res; ++qy) {
-            for (int qx = 0; qx < cur_res; ++qx) {
-                for (int jj = -2; jj <= 2; ++jj) {
-                    for (int ii = -2; ii <= 2; ++ii) {
-                        const Ref::fvec2 q = {Ref::fract(1.0f + (float(qx) + 0.5f + ii * FilterSize) / cur_res),
-                                              Ref::fract(1.0f + (float(qy) + 0.5f + jj * FilterSize) / cur_res)};
-                        Ref::fvec4 dir;
-                        CanonicalToDir(value_ptr(q), 0.0f, value_ptr(dir));
-
-                        const float theta = acosf(clamp(dir.get<1>(), -1.0f, 1.0f)) / PI;
-                        float phi = atan2f(dir.get<2>(), dir.get<0>());
-                        if (phi < 0) {
-                            phi += 2 * PI;
+        // Each task fills single row of the first level (two rows of filtered samples)
+        parallel_for(0, cur_res / 2, [&](const int _qy) {
+            for (int qy = 2 * _qy; qy < 2 * _qy + 2; ++qy) {
+                for (int qx = 0; qx < cur_res; ++qx) {
+                    for (int jj = -2; jj <= 2; ++jj) {
+                        for (int ii = -2; ii <= 2; ++ii) {
+                            const Ref::fvec2 q = {Ref::fract(1.0f + (float(qx) + 0.5f + ii * FilterSize) / cur_res),
+                                                  Ref::fract(1.0f + (float(qy) + 0.5f + jj * FilterSize) / cur_res)};
+                            Ref::fvec4 dir;
+                            CanonicalToDir(value_ptr(q), 0.0f, value_ptr(dir));
+
+                            const float theta = acosf(clamp(dir.get<1>(), -1.0f, 1.0f)) / PI;
+                            float phi = atan2f(dir.get<2>(), dir.get<0>());
+                            if (phi < 0) {
+                                phi += 2 * PI;
+                            }
+                            if (phi > 2 * PI) {
+                                phi -= 2 * PI;
+                            }
+
+                            const float u = Ref::fract(0.5f * phi / PI);
+
+                            const Ref::fvec2 uvs = Ref::fvec2{u, theta} * Ref::fvec2(size);
+                            const Ref::ivec2 iuvs = clamp(Ref::ivec2(uvs), Ref::ivec2(0), size - 1);
+
+                            const color_rgba8_t col_rgbe =
+                                tex_storage_rgba_.Get(tex, iuvs.get<0>(), iuvs.get<1>(), 0);
+                            const Ref::fvec4 col_rgb = Ref::rgbe_to_rgb(col_rgbe);
+                            const float cur_lum = (col_rgb.get<0>() + col_rgb.get<1>() + col_rgb.get<2>());
+
+                            int index = 0;
+                            index |= (qx & 1) << 0;
+                            index |= (qy & 1) << 1;
+
+                            const int _qx = (qx / 2);
+
+                            auto &qvec = env_map_qtree_.mips[0][_qy * cur_res / 2 + _qx];
+                            qvec.set(index, qvec[index] + cur_lum * FilterWeights[ii + 2][jj + 2]);
                         }
-                        if (phi > 2 * PI) {
-                            phi -= 2 * PI;
-                        }
-
-                        const float u = Ref::fract(0.5f * phi / PI);
-
-                        const Ref::fvec2 uvs = Ref::fvec2{u, theta} * Ref::fvec2(size);
-                        const Ref::ivec2 iuvs = clamp(Ref::ivec2(uvs), Ref::ivec2(0), size - 1);
-
-                        const color_rgba8_t col_rgbe = tex_storage_rgba_.Get(tex, iuvs.get<0>(), iuvs.get<1>(), 0);
-                        const Ref::fvec4 col_rgb = Ref::rgbe_to_rgb(col_rgbe);
-                        const float cur_lum = (col_rgb.get<0>() + col_rgb.get<1>() + col_rgb.get<2>());
-
-                        int index = 0;
-                        index |= (qx & 1) << 0;
-                        index |= (qy & 1) << 1;
-
-                        const int _qx = (qx / 2);
-                        const int _qy = (qy / 2);
-
-                        auto &qvec = env_map_qtree_.mips[0][_qy * cur_res / 2 + _qx];
-                        qvec.set(index, qvec[index] + cur_lum * FilterWeights[ii + 2][jj + 2]);
                     }
                 }
             }
-        }
+        });
 
         for (const Ref::fvec4 &v : env_map_qtree_.mips[0]) {
             total_lum += hsum(v);
@@ -1102,21 +1564,24 @@ void Ray::Cpu::Scene::PrepareEnvMapQTree_nolock() {
         env_map_qtree_.mips.emplace_back(cur_res * cur_res / 4, 0.0f);
         const auto &prev_mip = env_map_qtree_.mips[env_map_qtree_.mips.size() - 2];
 
-        for (int y = 0; y < cur_res; ++y) {
-            for (int x = 0; x < cur_res; ++x) {
-                const float res_lum = prev_mip[y * cur_res + x][0] + prev_mip[y * cur_res + x][1] +
-                                      prev_mip[y * cur_res + x][2] + prev_mip[y * cur_res + x][3];
+        auto &cur_mip = env_map_qtree_.mips.back();
+
+        parallel_for(0, cur_res / 2, [&](const int qy) {
+            for (int y = 2 * qy; y < 2 * qy + 2; ++y) {
+                for (int x = 0; x < cur_res; ++x) {
+                    const float res_lum = prev_mip[y * cur_res + x][0] + prev_mip[y * cur_res + x][1] +
+                                          prev_mip[y * cur_res + x][2] + prev_mip[y * cur_res + x][3];
 
-                int index = 0;
-                index |= (x & 1) << 0;
-                index |= (y & 1) << 1;
+                    int index = 0;
+                    index |= (x & 1) << 0;
+                    index |= (y & 1) << 1;
 
-                const int qx = (x / 2);
-                const int qy = (y / 2);
+                    const int qx = (x / 2);
 
-                env_map_qtree_.mips.back()[qy * cur_res / 2 + qx].set(index, res_lum);
+                    cur_mip[qy * cur_res / 2 + qx].set(index, res_lum);
+                }
             }
-        }
+        });
 
         cur_res /= 2;
     }
@@ -1172,17 +1637,8 @@ void Ray::Cpu::Scene::PrepareEnvMapQTree_nolock() {
     log_->Info("Env map qtree res is %i", env_map_qtree_.res);
 }
 
-void Ray::Cpu::Scene::RebuildLightTree_nolock() {
-    aligned_vector<prim_t> primitives;
-    primitives.reserve(lights_.size());
-
-    struct additional_data_t {
-        Ref::fvec4 axis;
-        float flux, omega_n, omega_e;
-    };
-    aligned_vector<additional_data_t> additional_data;
-    additional_data.reserve(lights_.size());
-
+void Ray::Cpu::Scene::RebuildLightTree_nolock(
+    const std::function<void(int, int, ParallelForFunction &&)> &parallel_for) {
     visible_lights_count_ = blocker_lights_count_ = 0;
     li_indices_.clear();
 
@@ -1192,10 +1648,11 @@ void Ray::Cpu::Scene::RebuildLightTree_nolock() {
             // Directional lights are already 'baked' into sky texture
             continue;
         }
-
-        Ref::fvec4 bbox_min = 0.0f, bbox_max = 0.0f, axis = {0.0f, 1.0f, 0.0f, 0.0f};
-        float area = 1.0f, omega_n = 0.0f, omega_e = 0.0f;
-        float lum = l.col[0] + l.col[1] + l.col[2];
+        if (l.type != LIGHT_TYPE_SPHERE && l.type != LIGHT_TYPE_DIR && l.type != LIGHT_TYPE_LINE &&
+            l.type != LIGHT_TYPE_RECT && l.type != LIGHT_TYPE_DISK && l.type != LIGHT_TYPE_TRI &&
+            l.type != LIGHT_TYPE_ENV) {
+            continue;
+        }
 
         li_indices_.push_back(it.index());
         if (l.visible) {
@@ -1204,6 +1661,25 @@ void Ray::Cpu::Scene::RebuildLightTree_nolock() {
         if ((l.ray_visibility & RAY_TYPE_SHADOW_BIT) != 0) {
             ++blocker_lights_count_;
         }
+    }
+
+    aligned_vector<prim_t> primitives(li_indices_.size());
+
+    struct additional_data_t {
+        Ref::fvec4 axis;
+        float flux, omega_n, omega_e;
+    };
+    aligned_vector<additional_data_t> additional_data(li_indices_.size());
+
+    const vertex_data_t vertices = vertex_data();
+
+    // Per-light bounds and emission cones are independent
+    parallel_for(0, int(li_indices_.size()), [&](const int i) {
+        const light_t &l = lights_[li_indices_[i]];
+
+        Ref::fvec4 bbox_min = 0.0f, bbox_max = 0.0f, axis = {0.0f, 1.0f, 0.0f, 0.0f};
+        float area = 1.0f, omega_n = 0.0f, omega_e = 0.0f;
+        float lum = l.col[0] + l.col[1] + l.col[2];
 
         switch (l.type) {
         case LIGHT_TYPE_SPHERE: {
@@ -1281,16 +1757,19 @@ void Ray::Cpu::Scene::RebuildLightTree_nolock() {
             const mesh_instance_t &lmi = mesh_instances_[l.tri.mi_index];
             const uint32_t ltri_index = l.tri.tri_index;
 
-            const vertex_t &v1 = vertices_[vtx_indices_[ltri_index * 3 + 0]];
-            const vertex_t &v2 = vertices_[vtx_indices_[ltri_index * 3 + 1]];
-            const vertex_t &v3 = vertices_[vtx_indices_[ltri_index * 3 + 2]];
+            const vertex_t &v1 = vertices[vtx_indices_[ltri_index * 3 + 0]];
+            const vertex_t &v2 = vertices[vtx_indices_[ltri_index * 3 + 1]];
+            const vertex_t &v3 = vertices[vtx_indices_[ltri_index * 3 + 2]];
 
             auto p1 = Ref::fvec4(v1.p[0], v1.p[1], v1.p[2], 0.0f), p2 = Ref::fvec4(v2.p[0], v2.p[1], v2.p[2], 0.0f),
                  p3 = Ref::fvec4(v3.p[0], v3.p[1], v3.p[2], 0.0f);
 
-            p1 = TransformPoint(p1, lmi.xform);
-            p2 = TransformPoint(p2, lmi.xform);
-            p3 = TransformPoint(p3, lmi.xform);
+            float lxform[12];
+            InverseAffineMatrix(lmi.inv_xform, lxform);
+
+            p1 = TransformPoint(p1, lxform);
+            p2 = TransformPoint(p2, lxform);
+            p3 = TransformPoint(p3, lxform);
 
             bbox_min = min(p1, min(p2, p3));
             bbox_max = max(p1, max(p2, p3));
@@ -1310,121 +1789,109 @@ void Ray::Cpu::Scene::RebuildLightTree_nolock() {
             omega_e = PI / 2.0f;
         } break;
         default:
-            continue;
+            break;
         }
 
-        primitives.push_back({0, 0, 0, bbox_min, bbox_max});
+        primitives[i] = {0, 0, 0, bbox_min, bbox_max};
 
         const float flux = lum * area;
-        additional_data.push_back({axis, flux, omega_n, omega_e});
-    }
+        additional_data[i] = {axis, flux, omega_n, omega_e};
+    });
 
     light_nodes_.clear();
     light_wnodes_.clear();
     light_cwnodes_.clear();
 
     if (primitives.empty()) {
+        light_tree_.nodes.clear();
+        light_tree_.li_indices.clear();
         return;
     }
 
-    std::vector<uint32_t> prim_indices;
-    prim_indices.reserve(primitives.size());
-
-    std::vector<bvh_node_t> temp_nodes;
-
-    bvh_settings_t s;
-    s.oversplit_threshold = -1.0f;
-    s.allow_spatial_splits = false;
-    s.min_primitives_in_leaf = 1;
-    PreprocessPrims_SAH(primitives, {}, s, temp_nodes, prim_indices);
-
-    light_nodes_.resize(temp_nodes.size(), light_bvh_node_t{});
-    for (uint32_t i = 0; i < temp_nodes.size(); ++i) {
-        static_cast<bvh_node_t &>(light_nodes_[i]) = temp_nodes[i];
-        if ((temp_nodes[i].prim_index & LEAF_NODE_BIT) != 0) {
-            const uint32_t prim_index = prim_indices[temp_nodes[i].prim_index & PRIM_INDEX_BITS];
-            memcpy(light_nodes_[i].axis, value_ptr(additional_data[prim_index].axis), 3 * sizeof(float));
-            light_nodes_[i].flux = additional_data[prim_index].flux;
-            light_nodes_[i].omega_n = additional_data[prim_index].omega_n;
-            light_nodes_[i].omega_e = additional_data[prim_index].omega_e;
-        }
-    }
-
-    std::vector<uint32_t> parent_indices(light_nodes_.size());
-    parent_indices[0] = 0xffffffff; // root node has no parent
-
-    std::vector<uint32_t> leaf_indices;
-    leaf_indices.reserve(primitives.size());
-
-    SmallVector<uint32_t, 128> stack;
-    stack.push_back(0);
-    while (!stack.empty()) {
-        const uint32_t i = stack.back();
-        stack.pop_back();
-
-        if ((light_nodes_[i].prim_index & LEAF_NODE_BIT) == 0) {
-            const uint32_t left_child = (light_nodes_[i].left_child & LEFT_CHILD_BITS),
-                           right_child = (light_nodes_[i].right_child & RIGHT_CHILD_BITS);
-            parent_indices[left_child] = parent_indices[right_child] = i;
-
-            stack.push_back(left_child);
-            stack.push_back(right_child);
-        } else {
-            leaf_indices.push_back(i);
+    // Topology can be reused when only light parameters (intensity, transform etc.) were changed
+    const bool refit = !light_tree_.nodes.empty() && light_tree_.li_indices == li_indices_;
+    if (!refit) {
+        std::vector<bvh_node_t> temp_nodes;
+        light_tree_.prim_indices.clear();
+        light_tree_.prim_indices.reserve(primitives.size());
+
+        bvh_settings_t s;
+        s.oversplit_threshold = -1.0f;
+        s.allow_spatial_splits = false;
+        s.min_primitives_in_leaf = 1;
+        PreprocessPrims_SAH(primitives, {}, s, temp_nodes, light_tree_.prim_indices);
+
+        light_tree_.nodes.resize(temp_nodes.size(), light_bvh_node_t{});
+        for (uint32_t i = 0; i < temp_nodes.size(); ++i) {
+            static_cast<bvh_node_t &>(light_tree_.nodes[i]) = temp_nodes[i];
         }
+        light_tree_.li_indices = li_indices_;
     }
 
-    // Propagate flux and cone up the hierarchy
-    std::vector<uint32_t> to_process;
-    to_process.reserve(light_nodes_.size());
-    to_process.insert(end(to_process), begin(leaf_indices), end(leaf_indices));
-    for (uint32_t i = 0; i < uint32_t(to_process.size()); ++i) {
-        const uint32_t n = to_process[i];
-        const uint32_t parent = parent_indices[n];
-        if (parent == 0xffffffff) {
+    light_nodes_ = light_tree_.nodes;
+
+    // NOTE: children are always placed after their parent, so reverse order is enough to propagate data upwards
+    for (int i = int(light_nodes_.size()) - 1; i >= 0; --i) {
+        light_bvh_node_t &n = light_nodes_[i];
+        if ((n.prim_index & LEAF_NODE_BIT) != 0) {
+            const uint32_t prim_index = light_tree_.prim_indices[n.prim_index & PRIM_INDEX_BITS];
+            memcpy(n.bbox_min, value_ptr(primitives[prim_index].bbox_min), 3 * sizeof(float));
+            memcpy(n.bbox_max, value_ptr(primitives[prim_index].bbox_max), 3 * sizeof(float));
+            memcpy(n.axis, value_ptr(additional_data[prim_index].axis), 3 * sizeof(float));
+            n.flux = additional_data[prim_index].flux;
+            n.omega_n = additional_data[prim_index].omega_n;
+            n.omega_e = additional_data[prim_index].omega_e;
             continue;
         }
 
-        light_nodes_[parent].flux += light_nodes_[n].flux;
-        if (light_nodes_[parent].axis[0] == 0.0f && light_nodes_[parent].axis[1] == 0.0f &&
-            light_nodes_[parent].axis[2] == 0.0f) {
-            memcpy(light_nodes_[parent].axis, light_nodes_[n].axis, 3 * sizeof(float));
-            light_nodes_[parent].omega_n = light_nodes_[n].omega_n;
-        } else {
-            auto axis1 = Ref::fvec4{light_nodes_[parent].axis}, axis2 = Ref::fvec4{light_nodes_[n].axis};
-            axis1.set<3>(0.0f);
-            axis2.set<3>(0.0f);
-
-            const float angle_between = acosf(clamp(dot(axis1, axis2), -1.0f, 1.0f));
+        n.flux = 0.0f;
+        n.axis[0] = n.axis[1] = n.axis[2] = 0.0f;
+        n.omega_n = n.omega_e = 0.0f;
+
+        const uint32_t children[] = {(n.left_child & LEFT_CHILD_BITS), (n.right_child & RIGHT_CHILD_BITS)};
+        for (int k = 0; k < 2; ++k) {
+            const light_bvh_node_t &ch = light_nodes_[children[k]];
+            if (refit) {
+                for (int j = 0; j < 3; ++j) {
+                    n.bbox_min[j] = (k == 0) ? ch.bbox_min[j] : fminf(n.bbox_min[j], ch.bbox_min[j]);
+                    n.bbox_max[j] = (k == 0) ? ch.bbox_max[j] : fmaxf(n.bbox_max[j], ch.bbox_max[j]);
+                }
+            }
 
-            axis1 += axis2;
-            const float axis_length = length(axis1);
-            if (axis_length != 0.0f) {
-                axis1 /= axis_length;
+            // Propagate flux and cone up the hierarchy
+            n.flux += ch.flux;
+            if (n.axis[0] == 0.0f && n.axis[1] == 0.0f && n.axis[2] == 0.0f) {
+                memcpy(n.axis, ch.axis, 3 * sizeof(float));
+                n.omega_n = ch.omega_n;
             } else {
-                axis1 = Ref::fvec4{0.0f, 1.0f, 0.0f, 0.0f};
-            }
+                auto axis1 = Ref::fvec4{n.axis[0], n.axis[1], n.axis[2], 0.0f},
+                     axis2 = Ref::fvec4{ch.axis[0], ch.axis[1], ch.axis[2], 0.0f};
 
-            memcpy(light_nodes_[parent].axis, value_ptr(axis1), 3 * sizeof(float));
+                const float angle_between = acosf(clamp(dot(axis1, axis2), -1.0f, 1.0f));
 
-            light_nodes_[parent].omega_n =
-                fminf(0.5f * (light_nodes_[parent].omega_n +
-                              fmaxf(light_nodes_[parent].omega_n, angle_between + light_nodes_[n].omega_n)),
-                      PI);
-        }
-        light_nodes_[parent].omega_e = fmaxf(light_nodes_[parent].omega_e, light_nodes_[n].omega_e);
-        if ((light_nodes_[parent].left_child & LEFT_CHILD_BITS) == n) {
-            to_process.push_back(parent);
+                axis1 += axis2;
+                const float axis_length = length(axis1);
+                if (axis_length != 0.0f) {
+                    axis1 /= axis_length;
+                } else {
+                    axis1 = Ref::fvec4{0.0f, 1.0f, 0.0f, 0.0f};
+                }
+
+                memcpy(n.axis, value_ptr(axis1), 3 * sizeof(float));
+
+                n.omega_n = fminf(0.5f * (n.omega_n + fmaxf(n.omega_n, angle_between + ch.omega_n)), PI);
+            }
+            n.omega_e = fmaxf(n.omega_e, ch.omega_e);
         }
     }
 
     // Remove indices indirection
-    for (uint32_t i = 0; i < leaf_indices.size(); ++i) {
-        light_bvh_node_t &n = light_nodes_[leaf_indices[i]];
-        assert((n.prim_index & LEAF_NODE_BIT) != 0);
-        const uint32_t li_index = li_indices_[prim_indices[n.prim_index & PRIM_INDEX_BITS]];
-        n.prim_index &= ~PRIM_INDEX_BITS;
-        n.prim_index |= li_index;
+    for (light_bvh_node_t &n : light_nodes_) {
+        if ((n.prim_index & LEAF_NODE_BIT) != 0) {
+            const uint32_t li_index = li_indices_[light_tree_.prim_indices[n.prim_index & PRIM_INDEX_BITS]];
+            n.prim_index &= ~PRIM_INDEX_BITS;
+            n.prim_index |= li_index;
+        }
     }
 
     if (use_wide_bvh_) {
@@ -1455,6 +1922,7 @@ void Ray::Cpu::Scene::RebuildLightTree_nolock() {
             }
         }
         std::vector<uint32_t> compacted_indices;
+        compacted_indices.reserve(should_remove.size());
         uint32_t cur_index = 0;
         for (const bool b : should_remove) {
             compacted_indices.push_back(cur_index);
@@ -1462,20 +1930,25 @@ void Ray::Cpu::Scene::RebuildLightTree_nolock() {
                 ++cur_index;
             }
         }
-        for (int i = int(light_cwnodes_.size() - 1); i >= 0; --i) {
+        // Compact in a single pass (erasing one by one is quadratic)
+        for (uint32_t i = 0; i < uint32_t(light_cwnodes_.size()); ++i) {
             if (should_remove[i]) {
-                light_cwnodes_.erase(begin(light_cwnodes_) + i);
-            } else {
-                for (int j = 0; j < 8; ++j) {
-                    if (light_cwnodes_[i].child[j] == 0x7fffffff) {
-                        continue;
-                    }
-                    if ((light_cwnodes_[i].child[j] & LEAF_NODE_BIT) == 0) {
-                        light_cwnodes_[i].child[j] = compacted_indices[light_cwnodes_[i].child[j]];
-                    }
+                continue;
+            }
+            light_cwbvh_node_t &n = light_cwnodes_[compacted_indices[i]];
+            if (compacted_indices[i] != i) {
+                n = light_cwnodes_[i];
+            }
+            for (int j = 0; j < 8; ++j) {
+                if (n.child[j] == 0x7fffffff) {
+                    continue;
+                }
+                if ((n.child[j] & LEAF_NODE_BIT) == 0) {
+                    n.child[j] = compacted_indices[n.child[j]];
                 }
             }
         }
+        light_cwnodes_.resize(cur_index);
     }
 }
 
@@ -1525,3 +1998,292 @@ void Ray::Cpu::Scene::GetBounds(float bbox_min[3], float bbox_max[3]) const {
         }
     }
 }
+
+namespace Ray {
+namespace Cpu {
+const uint32_t CompiledSceneMagic = 0x53594152; // 'RAYS'
+// Must be incremented whenever layout or meaning of serialized data changes (sizes below only catch the obvious cases)
+const uint32_t CompiledSceneVersion = 3;
+
+struct compiled_scene_header_t {
+    uint32_t magic, version;
+    uint32_t use_wide_bvh, use_tex_compression;
+    // sizes of core structures to catch layout changes
+    uint32_t sizes[8];
+};
+static_assert(sizeof(compiled_scene_header_t) == 48, "!");
+
+void FillCompiledSceneHeader(const bool use_wide_bvh, const bool use_tex_compression, const bool use_vtx_compression,
+                             compiled_scene_header_t &out_header) {
+    out_header.magic = CompiledSceneMagic;
+    out_header.version = CompiledSceneVersion;
+    out_header.use_wide_bvh = use_wide_bvh ? 1 : 0;
+    out_header.use_tex_compression = use_tex_compression ? 1 : 0;
+    out_header.sizes[0] = sizeof(bvh_node_t);
+    out_header.sizes[1] = sizeof(wbvh_node_t);
+    out_header.sizes[2] = sizeof(tri_accel_t);
+    out_header.sizes[3] = sizeof(mesh_t);
+    out_header.sizes[4] = sizeof(mesh_instance_t);
+    out_header.sizes[5] = use_vtx_compression ? sizeof(packed_vertex_t) : sizeof(vertex_t);
+    out_header.sizes[6] = sizeof(material_t);
+    out_header.sizes[7] = sizeof(light_t);
+}
+} // namespace Cpu
+} // namespace Ray
+
+bool Ray::Cpu::Scene::SaveCompiled(std::vector<uint8_t> &out_data) const {
+    std::shared_lock<std::shared_timed_mutex> lock(mtx_);
+
+    const uint64_t t1 = Ray::GetTimeMs();
+
+    BinaryWriter out(out_data);
+
+    compiled_scene_header_t header = {};
+    FillCompiledSceneHeader(use_wide_bvh_, use_tex_compression_, use_vtx_compression_, header);
+    out.Write(header);
+
+    // Common data
+    cams_.Serialize(out);
+    out.Write(current_cam_);
+    { // pointers to quadtree mips are restored on load, they must not make compiled data differ
+        environment_t env = env_;
+        std::fill(std::begin(env.qtree_mips), std::end(env.qtree_mips), nullptr);
+        out.Write(env);
+    }
+    out.WriteArray(Span<const float>(sky_transmittance_lut_));
+    out.WriteArray(Span<const float>(sky_multiscatter_lut_));
+
+    // Geometry
+    nodes_.Serialize(out);
+    wnodes_.Serialize(out);
+    tris_.Serialize(out);
+    tri_indices_.Serialize(out);
+    mtris_.Serialize(out);
+    tri_materials_.Serialize(out);
+    meshes_.Serialize(out);
+    mesh_instances_.Serialize(out);
+    out.WriteArray(Span<const uint32_t>(mi_indices_));
+    if (use_vtx_compression_) {
+        packed_vertices_.Serialize(out);
+    } else {
+        vertices_.Serialize(out);
+    }
+    vtx_indices_.Serialize(out);
+    out.Write(tlas_root_);
+    out.Write(tlas_block_);
+
+    materials_.Serialize(out);
+
+    // Textures
+    tex_storage_rgba_.Serialize(out);
+    tex_storage_rgb_.Serialize(out);
+    tex_storage_rg_.Serialize(out);
+    tex_storage_r_.Serialize(out);
+    tex_storage_bc1_.Serialize(out);
+    tex_storage_bc3_.Serialize(out);
+    tex_storage_bc4_.Serialize(out);
+    tex_storage_bc5_.Serialize(out);
+
+    // Lights
+    lights_.Serialize(out);
+    out.WriteArray(Span<const uint32_t>(li_indices_));
+    out.WriteArray(Span<const uint32_t>(dir_lights_));
+    out.Write(visible_lights_count_);
+    out.Write(blocker_lights_count_);
+    out.WriteArray(Span<const light_bvh_node_t>(light_nodes_));
+    out.WriteArray(Span<const light_wbvh_node_t>(light_wnodes_));
+    out.WriteArray(Span<const light_cwbvh_node_t>(light_cwnodes_));
+
+    // Environment
+    out.Write(env_map_light_);
+    out.Write(physical_sky_texture_);
+    out.Write(env_map_qtree_.res);
+    out.Write(env_map_qtree_.medium_lum);
+    out.Write(uint32_t(env_map_qtree_.mips.size()));
+    for (const aligned_vector<Ref::fvec4> &mip : env_map_qtree_.mips) {
+        out.WriteArray(mip.empty() ? nullptr : value_ptr(mip[0]), uint32_t(4 * mip.size()));
+    }
+
+    log_->Info("Ray: Compiled scene saved (%.2f MB) in %lldms", double(out_data.size()) / (1024.0 * 1024.0),
+               (Ray::GetTimeMs() - t1));
+
+    return true;
+}
+
+void Ray::Cpu::Scene::ResetCompiled_nolock() {
+    // drop everything that LoadCompiled could have partially filled
+    cams_.Reset();
+    current_cam_ = InvalidCameraHandle;
+    nodes_.Reset();
+    wnodes_.Reset();
+    tris_.Reset();
+    tri_indices_.Reset();
+    mtris_.Reset();
+    tri_materials_.Reset();
+    meshes_.Reset();
+    mesh_instances_.Reset();
+    mi_indices_.clear();
+    vertices_.Reset();
+    packed_vertices_.Reset();
+    vtx_indices_.Reset();
+    tlas_root_ = tlas_block_ = 0xffffffff;
+    materials_.Reset();
+    tex_storage_rgba_.Clear();
+    tex_storage_rgb_.Clear();
+    tex_storage_rg_.Clear();
+    tex_storage_r_.Clear();
+    tex_storage_bc1_.Clear();
+    tex_storage_bc3_.Clear();
+    tex_storage_bc4_.Clear();
+    tex_storage_bc5_.Clear();
+    lights_.Reset();
+    li_indices_.clear();
+    dir_lights_.clear();
+    visible_lights_count_ = blocker_lights_count_ = 0;
+    light_nodes_.clear();
+    light_wnodes_.clear();
+    light_cwnodes_.clear();
+    mesh_emissive_tris_.clear();
+    mesh_opacity_generation_.clear();
+}
+
+bool Ray::Cpu::Scene::LoadCompiled(Span<const uint8_t> data) {
+    std::unique_lock<std::shared_timed_mutex> lock(mtx_);
+
+    const uint64_t t1 = Ray::GetTimeMs();
+
+    if (!meshes_.empty() || !mesh_instances_.empty() || !materials_.empty() || !lights_.empty() ||
+        tlas_root_ != 0xffffffff) {
+        log_->Error("Ray: Compiled scene can only be loaded into empty scene!");
+        return false;
+    }
+
+    BinaryReader in(data);
+
+    compiled_scene_header_t header = {}, expected_header = {};
+    FillCompiledSceneHeader(use_wide_bvh_, use_tex_compression_, use_vtx_compression_, expected_header);
+    if (!in.Read(header) || memcmp(&header, &expected_header, sizeof(compiled_scene_header_t)) != 0) {
+        log_->Error("Ray: Compiled scene is incompatible (version or settings mismatch)!");
+        return false;
+    }
+
+    // Environment is restored if blob turns out to be broken, everything else was empty anyway. Quadtree mips are
+    // moved out, so that pointers of env_ stay valid
+    const environment_t prev_env = env_;
+    const atmosphere_params_t prev_sky_lut_params = sky_lut_params_;
+    aligned_vector<float, 16> prev_transmittance_lut = std::move(sky_transmittance_lut_),
+                              prev_multiscatter_lut = std::move(sky_multiscatter_lut_);
+    decltype(env_map_qtree_) prev_qtree = std::move(env_map_qtree_);
+    env_map_qtree_.mips.clear();
+    const LightHandle prev_env_map_light = env_map_light_;
+    const TextureHandle prev_sky_texture = physical_sky_texture_;
+
+    cams_.clear();
+    bool ok = cams_.Deserialize(in);
+    ok &= in.Read(current_cam_);
+    ok &= in.Read(env_);
+    ok &= in.ReadArray(sky_transmittance_lut_);
+    ok &= in.ReadArray(sky_multiscatter_lut_);
+    sky_lut_params_ = env_.atmosphere;
+
+    ok &= nodes_.Deserialize(in);
+    ok &= wnodes_.Deserialize(in);
+    ok &= tris_.Deserialize(in);
+    ok &= tri_indices_.Deserialize(in);
+    ok &= mtris_.Deserialize(in);
+    ok &= tri_materials_.Deserialize(in);
+    ok &= meshes_.Deserialize(in);
+    ok &= mesh_instances_.Deserialize(in);
+    ok &= in.ReadArray(mi_indices_);
+    if (use_vtx_compression_) {
+        ok &= packed_vertices_.Deserialize(in);
+    } else {
+        ok &= vertices_.Deserialize(in);
+    }
+    ok &= vtx_indices_.Deserialize(in);
+    ok &= in.Read(tlas_root_);
+    ok &= in.Read(tlas_block_);
+
+    ok &= materials_.Deserialize(in);
+
+    ok &= tex_storage_rgba_.Deserialize(in);
+    ok &= tex_storage_rgb_.Deserialize(in);
+    ok &= tex_storage_rg_.Deserialize(in);
+    ok &= tex_storage_r_.Deserialize(in);
+    ok &= tex_storage_bc1_.Deserialize(in);
+    ok &= tex_storage_bc3_.Deserialize(in);
+    ok &= tex_storage_bc4_.Deserialize(in);
+    ok &= tex_storage_bc5_.Deserialize(in);
+
+    ok &= lights_.Deserialize(in);
+    ok &= in.ReadArray(li_indices_);
+    ok &= in.ReadArray(dir_lights_);
+    ok &= in.Read(visible_lights_count_);
+    ok &= in.Read(blocker_lights_count_);
+    ok &= in.ReadArray(light_nodes_);
+    ok &= in.ReadArray(light_wnodes_);
+    ok &= in.ReadArray(light_cwnodes_);
+
+    ok &= in.Read(env_map_light_);
+    ok &= in.Read(physical_sky_texture_);
+    ok &= in.Read(env_map_qtree_.res);
+    ok &= in.Read(env_map_qtree_.medium_lum);
+    uint32_t qtree_levels = 0;
+    ok &= in.Read(qtree_levels);
+    ok &= (qtree_levels <= countof(env_.qtree_mips));
+    env_map_qtree_.mips.resize(ok ? qtree_levels : 0);
+    for (aligned_vector<Ref::fvec4> &mip : env_map_qtree_.mips) {
+        const Span<const float> mip_data = in.ReadArray<float>();
+        mip.resize(mip_data.size() / 4);
+        if (!mip.empty()) {
+            memcpy(value_ptr(mip[0]), mip_data.data(), mip.size() * sizeof(Ref::fvec4));
+        }
+    }
+
+    // indices that are used without checks during rendering
+    if (ok && !in.failed()) {
+        const uint32_t nodes_capacity = use_wide_bvh_ ? wnodes_.capacity() : nodes_.capacity();
+        ok &= (tlas_root_ == 0xffffffff || tlas_root_ < nodes_capacity);
+        ok &= (current_cam_._index == 0xffffffff || current_cam_._index < cams_.capacity());
+        for (const uint32_t i : mi_indices_) {
+            ok &= (i < mesh_instances_.capacity());
+        }
+        for (const uint32_t i : li_indices_) {
+            ok &= (i < lights_.capacity());
+        }
+    }
+
+    if (!ok || in.failed() || !in.at_end()) {
+        log_->Error("Ray: Compiled scene is corrupted!");
+        ResetCompiled_nolock();
+        env_ = prev_env;
+        sky_lut_params_ = prev_sky_lut_params;
+        sky_transmittance_lut_ = std::move(prev_transmittance_lut);
+        sky_multiscatter_lut_ = std::move(prev_multiscatter_lut);
+        env_map_qtree_ = std::move(prev_qtree);
+        env_map_light_ = prev_env_map_light;
+        physical_sky_texture_ = prev_sky_texture;
+        return false;
+    }
+
+    // Restore pointers
+    env_.qtree_levels = int(env_map_qtree_.mips.size());
+    for (int i = 0; i < countof(env_.qtree_mips); ++i) {
+        const bool has_mip = (i < env_.qtree_levels) && !env_map_qtree_.mips[i].empty();
+        env_.qtree_mips[i] = has_mip ? value_ptr(env_map_qtree_.mips[i][0]) : nullptr;
+    }
+
+    // Emissive ranges are cheap to recover, there is no need to store them
+    for (auto it = meshes_.begin(); it != meshes_.end(); ++it) {
+        UpdateMeshEmissiveTris_nolock(it.index());
+    }
+    // triangle classification bits are stored as is
+    mesh_opacity_generation_.assign(meshes_.capacity(), materials_generation_);
+
+    geometry_generation_ = NextGeometryGeneration();
+    finalize_generation_ = NextGeometryGeneration();
+
+    log_->Info("Ray: Compiled scene loaded in %lldms", (Ray::GetTimeMs() - t1));
+
+    return true;
+}
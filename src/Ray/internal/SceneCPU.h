@@ -1,5 +1,7 @@
 #pragma once
 
+#include <memory>
+#include <mutex>
 #include <vector>
 
 #include "CoreRef.h"
@@ -47,7 +49,7 @@ class Scene : public SceneCommon {
     friend class Cpu::Renderer<Avx512::SIMDPolicy>;
     friend class Cpu::Renderer<Neon::SIMDPolicy>;
 
-    bool use_wide_bvh_, use_tex_compression_;
+    bool use_wide_bvh_, use_tex_compression_, use_vtx_compression_;
 
     SparseStorage<bvh_node_t> nodes_;
     SparseStorage<wbvh_node_t> wnodes_;
@@ -57,8 +59,20 @@ class Scene : public SceneCommon {
     SparseStorage<tri_mat_data_t> tri_materials_;
     SparseStorage<mesh_t> meshes_;
     SparseStorage<mesh_instance_t> mesh_instances_;
+    struct emissive_tris_t {
+        uint32_t tri_index, tri_count;
+        uint16_t front_mi, doublesided;
+    };
+    struct mesh_emissive_tris_t {
+        uint32_t materials_generation = 0; // value of materials_generation_ when ranges were found
+        std::vector<emissive_tris_t> ranges;
+    };
+    std::vector<mesh_emissive_tris_t> mesh_emissive_tris_; // ranges of emissive triangles (per mesh)
+    uint32_t materials_generation_ = 0; // incremented when material slot is freed (and can be reused)
+    std::vector<uint32_t> mesh_opacity_generation_; // materials_generation_ at the time triangles were classified
     std::vector<uint32_t> mi_indices_;
     SparseStorage<vertex_t> vertices_;
+    SparseStorage<packed_vertex_t> packed_vertices_; // used instead of vertices_ when compression is enabled
     SparseStorage<uint32_t> vtx_indices_;
 
     SparseStorage<material_t> materials_;
@@ -83,6 +97,10 @@ class Scene : public SceneCommon {
     std::vector<light_bvh_node_t> light_nodes_;
     aligned_vector<light_wbvh_node_t> light_wnodes_;
     aligned_vector<light_cwbvh_node_t> light_cwnodes_;
+    struct {
+        std::vector<light_bvh_node_t> nodes; // binary tree (leafs point to prim_indices)
+        std::vector<uint32_t> prim_indices, li_indices;
+    } light_tree_; // cached topology of light tree (allows to refit when lights are not added/removed)
 
     LightHandle env_map_light_ = InvalidLightHandle;
     TextureHandle physical_sky_texture_ = InvalidTextureHandle;
@@ -96,21 +114,59 @@ class Scene : public SceneCommon {
     mutable aligned_vector<packed_cache_voxel_t, 16> spatial_cache_voxels_curr_, spatial_cache_voxels_prev_;
     mutable float spatial_cache_cam_pos_prev_[3] = {};
 
+    // UV-space rasterization of geometry camera targets (built on first use, most recently used one is last)
+    mutable std::mutex texel_maps_mtx_;
+    mutable std::vector<std::shared_ptr<const texel_map_t>> texel_maps_;
+    // Instances rendered by geometry camera without mesh instance (in atlas texels of full framebuffer)
+    std::vector<atlas_item_desc_t> lightmap_atlas_;
+
     uint32_t tlas_root_ = 0xffffffff, tlas_block_ = 0xffffffff;
+    // Identifies state of instanced geometry (unique across scenes), it is reset to zero on instance change and
+    // assigned again when TLAS is rebuilt
+    uint32_t geometry_generation_ = 0;
+    // Identifies state of the whole scene (including materials and lights) as of last Finalize
+    uint32_t finalize_generation_ = 0;
+
+    vertex_data_t vertex_data() const {
+        vertex_data_t ret;
+        if (use_vtx_compression_) {
+            ret.packed_vertices = packed_vertices_.empty() ? nullptr : &packed_vertices_[0];
+        } else {
+            ret.vertices = vertices_.empty() ? nullptr : &vertices_[0];
+        }
+        return ret;
+    }
+
+    // Scene lock must be held by caller (shared lock is enough)
+    std::shared_ptr<const texel_map_t> GetTexelMap(uint32_t mi_index, uint32_t uv_layer, int w, int h) const;
 
     void RemoveMesh_nolock(MeshHandle m);
+    void FindEmissiveTris_nolock(uint32_t mesh_index, std::vector<emissive_tris_t> &out_ranges) const;
+    void GetEmissiveTris_nolock(uint32_t mesh_index, std::vector<emissive_tris_t> &out_ranges) const;
+    void UpdateMeshEmissiveTris_nolock(uint32_t mesh_index);
+    void StoreEmissiveTris_nolock(uint32_t mesh_index, const std::vector<emissive_tris_t> &ranges);
+    void UpdateMeshTriOpacity_nolock(uint32_t mesh_index, bool reclassify = false);
     void RemoveMeshInstance_nolock(MeshInstanceHandle i);
     void RebuildTLAS_nolock();
-    void RebuildLightTree_nolock();
+    void ResetCompiled_nolock();
+    void RebuildLightTree_nolock(const std::function<void(int, int, ParallelForFunction &&)> &parallel_for);
 
     void PrepareSkyEnvMap_nolock(const std::function<void(int, int, ParallelForFunction &&)> &parallel_for);
-    void PrepareEnvMapQTree_nolock();
+    void PrepareEnvMapQTree_nolock(const std::function<void(int, int, ParallelForFunction &&)> &parallel_for);
 
     MaterialHandle AddMaterial_nolock(const shading_node_desc_t &m);
     void SetMeshInstanceTransform_nolock(MeshInstanceHandle mi, const float *xform);
 
+    static uint32_t CalcRayVisibility(const mesh_instance_desc_t &mi);
+    static uint32_t CountEmissiveTris(Span<const emissive_tris_t> ranges);
+    // Only reads scene data, shared lock is enough
+    void CreateEmissiveLights_nolock(Span<const emissive_tris_t> ranges, uint32_t ray_visibility,
+                                     light_t *out_lights) const;
+    MeshInstanceHandle AddMeshInstance_nolock(MeshHandle mesh, uint32_t ray_visibility, Span<light_t> new_lights);
+
   public:
-    Scene(ILog *log, bool use_wide_bvh, bool use_tex_compression, bool use_spatial_cache);
+    Scene(ILog *log, bool use_wide_bvh, bool use_tex_compression, bool use_vtx_compression, bool use_spatial_cache,
+          IntegrateSkyRowFunction integrate_sky_row = nullptr);
     ~Scene() override;
 
     TextureHandle AddTexture(const tex_desc_t &t) override;
@@ -127,6 +183,8 @@ class Scene : public SceneCommon {
     void RemoveMaterial(const MaterialHandle m) override {
         std::unique_lock<std::shared_timed_mutex> lock(mtx_);
         materials_.Erase(m._block);
+        // cached per-mesh classification might refer to this material
+        ++materials_generation_;
     }
 
     MeshHandle AddMesh(const mesh_desc_t &m) override;
@@ -147,10 +205,17 @@ class Scene : public SceneCommon {
     }
 
     MeshInstanceHandle AddMeshInstance(const mesh_instance_desc_t &mi) override;
+    void AddMeshInstances(Span<const mesh_instance_desc_t> mis, Span<MeshInstanceHandle> out_handles,
+                          const std::function<void(int, int, ParallelForFunction &&)> &parallel_for =
+                              parallel_for_serial) override;
     void SetMeshInstanceTransform(MeshInstanceHandle mi, const float *xform) override {
         std::unique_lock<std::shared_timed_mutex> lock(mtx_);
         SetMeshInstanceTransform_nolock(mi, xform);
+        geometry_generation_ = 0;
     }
+    void SetMeshInstanceTransforms(Span<const MeshInstanceHandle> mis, const float *xforms,
+                                   const std::function<void(int, int, ParallelForFunction &&)> &parallel_for =
+                                       parallel_for_serial) override;
     void RemoveMeshInstance(MeshInstanceHandle mi) override {
         std::unique_lock<std::shared_timed_mutex> lock(mtx_);
         RemoveMeshInstance_nolock(mi);
@@ -160,6 +225,11 @@ class Scene : public SceneCommon {
 
     void GetBounds(float bbox_min[3], float bbox_max[3]) const;
 
+    bool SaveCompiled(std::vector<uint8_t> &out_data) const override;
+    bool LoadCompiled(Span<const uint8_t> data) override;
+
+    bool SetLightmapAtlas(Span<const atlas_item_desc_t> items) override;
+
     uint32_t triangle_count() const override {
         std::shared_lock<std::shared_timed_mutex> lock(mtx_);
         return uint32_t(tris_.size());
@@ -1,5 +1,7 @@
 #include "SceneCommon.h"
 
+#include <cstring>
+
 #include "AtmosphereRef.h"
 #include "Core.h"
 
@@ -15,6 +17,20 @@ Ref::fvec4 rgb_to_rgbe(const Ref::fvec4 &rgb) {
 
     return Ref::fvec4{rgb.get<0>() * factor, rgb.get<1>() * factor, rgb.get<2>() * factor, float(exponent + 128)};
 }
+
+// Checks parameters that affect transmittance and multiscattering LUTs (sun, moon and clouds do not)
+bool SkyLUTParamsEqual(const atmosphere_params_t &lhs, const atmosphere_params_t &rhs) {
+    return lhs.planet_radius == rhs.planet_radius && lhs.atmosphere_height == rhs.atmosphere_height &&
+           lhs.rayleigh_height == rhs.rayleigh_height && lhs.mie_height == rhs.mie_height &&
+           lhs.ozone_height_center == rhs.ozone_height_center && lhs.ozone_half_width == rhs.ozone_half_width &&
+           lhs.atmosphere_density == rhs.atmosphere_density &&
+           memcmp(lhs.rayleigh_scattering, rhs.rayleigh_scattering, sizeof(lhs.rayleigh_scattering)) == 0 &&
+           memcmp(lhs.mie_scattering, rhs.mie_scattering, sizeof(lhs.mie_scattering)) == 0 &&
+           memcmp(lhs.mie_extinction, rhs.mie_extinction, sizeof(lhs.mie_extinction)) == 0 &&
+           memcmp(lhs.mie_absorption, rhs.mie_absorption, sizeof(lhs.mie_absorption)) == 0 &&
+           memcmp(lhs.ozone_absorbtion, rhs.ozone_absorbtion, sizeof(lhs.ozone_absorbtion)) == 0 &&
+           memcmp(lhs.ground_albedo, rhs.ground_albedo, sizeof(lhs.ground_albedo)) == 0;
+}
 } // namespace Ray
 
 void Ray::SceneCommon::GetEnvironment(environment_desc_t &env) {
@@ -44,8 +60,13 @@ void Ray::SceneCommon::SetEnvironment(const environment_desc_t &env) {
     env_.envmap_resolution = env.envmap_resolution;
     env_.atmosphere = env.atmosphere;
 
-    UpdateSkyTransmittanceLUT(env_.atmosphere);
-    UpdateMultiscatterLUT(env_.atmosphere);
+    // LUTs are independent from sun direction, so time-of-day changes can skip this step
+    if (sky_transmittance_lut_.empty() || sky_multiscatter_lut_.empty() ||
+        !SkyLUTParamsEqual(sky_lut_params_, env_.atmosphere)) {
+        UpdateSkyTransmittanceLUT(env_.atmosphere);
+        UpdateMultiscatterLUT(env_.atmosphere);
+        sky_lut_params_ = env_.atmosphere;
+    }
 }
 
 Ray::CameraHandle Ray::SceneCommon::AddCamera(const camera_desc_t &c) {
@@ -291,41 +312,56 @@ Ray::SceneCommon::CalcSkyEnvTexture(const atmosphere_params_t &params, const int
     std::vector<color_rgb_t> rgb_pixels(res[0] * res[1]);
 #endif
 
-    parallel_for(0, res[1], [&](const int y) {
-        const float theta = PI * float(y) / float(res[1]);
-        for (int x = 0; x < res[0]; ++x) {
-            const uint32_t px_hash = Ref::hash((x << 16)| y);
+    struct sky_light_t {
+        float dir[3], col[3];
+        float angle;
+    };
+    std::vector<sky_light_t> sky_lights;
+    // Light parameters are the same for all pixels
+    for (const uint32_t li_index : dir_lights) {
+        const light_t &l = lights[li_index];
+
+        sky_lights.emplace_back();
+        sky_light_t &sl = sky_lights.back();
+        memcpy(sl.dir, l.dir.dir, 3 * sizeof(float));
+        memcpy(sl.col, l.col, 3 * sizeof(float));
+        sl.angle = l.dir.angle;
+        if (l.dir.angle != 0.0f) {
+            const float radius = tanf(l.dir.angle);
+            for (float &c : sl.col) {
+                c *= (PI * radius * radius);
+            }
+        }
+    }
+    if (sky_lights.empty() && params.stars_brightness > 0.0f) {
+        // Use fake lightsource (to light up the moon)
+        sky_lights.push_back({{0.0f, -1.0f, 0.0f}, {144809.866891f, 129443.618266f, 127098.894121f}, 0.0f});
+    }
 
-            const float phi = 2.0f * PI * (x + 0.5f) / float(res[0]);
-            auto ray_dir = Ref::fvec4{sinf(theta) * cosf(phi), cosf(theta), sinf(theta) * sinf(phi), 0.0f};
+    // Horizontal angle is the same for each row
+    std::vector<float> cos_phi(res[0]), sin_phi(res[0]);
+    for (int x = 0; x < res[0]; ++x) {
+        const float phi = 2.0f * PI * (x + 0.5f) / float(res[0]);
+        cos_phi[x] = cosf(phi);
+        sin_phi[x] = sinf(phi);
+    }
 
-            Ref::fvec4 color = 0.0f;
+    // SIMD backends integrate several columns at once
+    const IntegrateSkyRowFunction integrate_row = integrate_sky_row_ ? integrate_sky_row_ : Ref::IntegrateSkyRow;
 
-            // Evaluate light sources
-            if (!dir_lights.empty()) {
-                for (const uint32_t li_index : dir_lights) {
-                    const light_t &l = lights[li_index];
+    parallel_for(0, res[1], [&](const int y) {
+        const float theta = PI * float(y) / float(res[1]);
+        const float cos_theta = cosf(theta), sin_theta = sinf(theta);
 
-                    const Ref::fvec4 light_dir = {l.dir.dir[0], l.dir.dir[1], l.dir.dir[2], 0.0f};
-                    Ref::fvec4 light_col = {l.col[0], l.col[1], l.col[2], 0.0f};
-                    if (l.dir.angle != 0.0f) {
-                        const float radius = tanf(l.dir.angle);
-                        light_col *= (PI * radius * radius);
-                    }
+        // Evaluate light sources
+        std::vector<float> row_color(3 * res[0], 0.0f);
+        for (const sky_light_t &sl : sky_lights) {
+            integrate_row(params, sky_transmittance_lut_, sky_multiscatter_lut_, sl.dir, sl.angle, sl.col, y,
+                          cos_theta, sin_theta, cos_phi, sin_phi, row_color.data());
+        }
 
-                    color += IntegrateScattering(params, Ref::fvec4{0.0f, params.viewpoint_height, 0.0f, 0.0f}, ray_dir,
-                                                 MAX_DIST, light_dir, l.dir.angle, light_col, sky_transmittance_lut_,
-                                                 sky_multiscatter_lut_, px_hash);
-                }
-            } else if (params.stars_brightness > 0.0f) {
-                // Use fake lightsource (to light up the moon)
-                const Ref::fvec4 light_dir = {0.0f, -1.0f, 0.0f, 0.0f},
-                                 light_col = {144809.866891f, 129443.618266f, 127098.894121f, 0.0f};
-
-                color += IntegrateScattering(params, Ref::fvec4{0.0f, params.viewpoint_height, 0.0f, 0.0f}, ray_dir,
-                                             MAX_DIST, light_dir, 0.0f, light_col, sky_transmittance_lut_,
-                                             sky_multiscatter_lut_, px_hash);
-            }
+        for (int x = 0; x < res[0]; ++x) {
+            auto color = Ref::fvec4{row_color[3 * x + 0], row_color[3 * x + 1], row_color[3 * x + 2], 0.0f};
 
 #ifdef DUMP_SKY_ENV
             rgb_pixels[y * res[0] + x].v[0] = color.get<0>();
@@ -8,7 +8,6 @@
 #include "SparseStorageCPU.h"
 
 namespace Ray {
-struct atmosphere_params_t;
 class SceneCommon : public SceneBase {
   protected:
     mutable std::shared_timed_mutex mtx_;
@@ -17,8 +16,17 @@ class SceneCommon : public SceneBase {
 
     CameraHandle current_cam_ = InvalidCameraHandle;
 
-    environment_t env_;
+    environment_t env_ = {};
     aligned_vector<float, 16> sky_transmittance_lut_, sky_multiscatter_lut_;
+    atmosphere_params_t sky_lut_params_; // parameters used to calculate LUTs
+
+    // Backend-specific version of Ref::IntegrateSkyRow (scalar code is used when not set)
+    using IntegrateSkyRowFunction = void (*)(const atmosphere_params_t &params, Span<const float> transmittance_lut,
+                                             Span<const float> multiscatter_lut, const float light_dir[3],
+                                             float light_angle, const float light_col[3], int y, float cos_theta,
+                                             float sin_theta, Span<const float> cos_phi, Span<const float> sin_phi,
+                                             float inout_color[]);
+    IntegrateSkyRowFunction integrate_sky_row_ = nullptr;
 
     void UpdateSkyTransmittanceLUT(const atmosphere_params_t &params);
     void UpdateMultiscatterLUT(const atmosphere_params_t &params);
@@ -322,7 +322,7 @@ void Ray::Dx::Scene::Rebuild_HWRT_TLAS_nolock() {
     std::vector<D3D12_RAYTRACING_INSTANCE_DESC> tlas_instances;
 
     for (auto it = mesh_instances_.cbegin(); it != mesh_instances_.cend(); ++it) {
-        const mesh_instance_t &instance = *it;
+        const gpu_mesh_instance_t &instance = *it;
         const mesh_t &m = meshes_[instance.mesh_index];
 
         auto &blas = rt_mesh_blases_[m.node_index];
@@ -64,7 +64,7 @@ class Scene : public SceneCommon {
     SparseStorage<uint32_t, false /* Replicate */> tri_indices_;
     SparseStorage<tri_mat_data_t> tri_materials_;
     SparseStorage<mesh_t> meshes_;
-    SparseStorage<mesh_instance_t> mesh_instances_;
+    SparseStorage<gpu_mesh_instance_t> mesh_instances_;
     Vector<uint32_t> mi_indices_;
     SparseStorage<vertex_t> vertices_;
     SparseStorage<uint32_t> vtx_indices_;
@@ -1150,7 +1150,7 @@ inline void Ray::NS::Scene::RemoveMesh_nolock(const MeshHandle i) {
 
     bool rebuild_required = false;
     for (auto it = mesh_instances_.begin(); it != mesh_instances_.end();) {
-        mesh_instance_t &mi = *it;
+        gpu_mesh_instance_t &mi = *it;
         if (mi.mesh_index == i._index) {
             it = mesh_instances_.erase(it);
             rebuild_required = true;
@@ -1276,8 +1276,8 @@ inline Ray::LightHandle Ray::NS::Scene::AddLight(const rect_light_desc_t &_l, co
 
     l.rect.area = _l.width * _l.height;
 
-    const Ref::fvec4 uvec = _l.width * TransformDirection(Ref::fvec4{1.0f, 0.0f, 0.0f, 0.0f}, xform);
-    const Ref::fvec4 vvec = _l.height * TransformDirection(Ref::fvec4{0.0f, 0.0f, 1.0f, 0.0f}, xform);
+    const Ref::fvec4 uvec = _l.width * TransformDirection4x4(Ref::fvec4{1.0f, 0.0f, 0.0f, 0.0f}, xform);
+    const Ref::fvec4 vvec = _l.height * TransformDirection4x4(Ref::fvec4{0.0f, 0.0f, 1.0f, 0.0f}, xform);
 
     memcpy(l.rect.u, value_ptr(uvec), 3 * sizeof(float));
     memcpy(l.rect.v, value_ptr(vvec), 3 * sizeof(float));
@@ -1311,8 +1311,8 @@ inline Ray::LightHandle Ray::NS::Scene::AddLight(const disk_light_desc_t &_l, co
 
     l.disk.area = 0.25f * PI * _l.size_x * _l.size_y;
 
-    const Ref::fvec4 uvec = _l.size_x * TransformDirection(Ref::fvec4{1.0f, 0.0f, 0.0f, 0.0f}, xform);
-    const Ref::fvec4 vvec = _l.size_y * TransformDirection(Ref::fvec4{0.0f, 0.0f, 1.0f, 0.0f}, xform);
+    const Ref::fvec4 uvec = _l.size_x * TransformDirection4x4(Ref::fvec4{1.0f, 0.0f, 0.0f, 0.0f}, xform);
+    const Ref::fvec4 vvec = _l.size_y * TransformDirection4x4(Ref::fvec4{0.0f, 0.0f, 1.0f, 0.0f}, xform);
 
     memcpy(l.disk.u, value_ptr(uvec), 3 * sizeof(float));
     memcpy(l.disk.v, value_ptr(vvec), 3 * sizeof(float));
@@ -1342,8 +1342,8 @@ inline Ray::LightHandle Ray::NS::Scene::AddLight(const line_light_desc_t &_l, co
 
     l.line.area = 2.0f * PI * _l.radius * _l.height;
 
-    const Ref::fvec4 uvec = TransformDirection(Ref::fvec4{1.0f, 0.0f, 0.0f, 0.0f}, xform);
-    const Ref::fvec4 vvec = TransformDirection(Ref::fvec4{0.0f, 1.0f, 0.0f, 0.0f}, xform);
+    const Ref::fvec4 uvec = TransformDirection4x4(Ref::fvec4{1.0f, 0.0f, 0.0f, 0.0f}, xform);
+    const Ref::fvec4 vvec = TransformDirection4x4(Ref::fvec4{0.0f, 1.0f, 0.0f, 0.0f}, xform);
 
     memcpy(l.line.u, value_ptr(uvec), 3 * sizeof(float));
     l.line.radius = _l.radius;
@@ -1359,7 +1359,7 @@ inline Ray::LightHandle Ray::NS::Scene::AddLight(const line_light_desc_t &_l, co
 inline Ray::MeshInstanceHandle Ray::NS::Scene::AddMeshInstance(const mesh_instance_desc_t &mi_desc) {
     std::unique_lock<std::shared_timed_mutex> lock(mtx_);
 
-    mesh_instance_t mi = {};
+    gpu_mesh_instance_t mi = {};
     mi.mesh_index = mi_desc.mesh._index;
     mi.lights_index = 0xffffffff;
 
@@ -1452,7 +1452,7 @@ inline Ray::MeshInstanceHandle Ray::NS::Scene::AddMeshInstance(const mesh_instan
 }
 
 inline void Ray::NS::Scene::SetMeshInstanceTransform_nolock(const MeshInstanceHandle mi_handle, const float *xform) {
-    mesh_instance_t mi = mesh_instances_[mi_handle._index];
+    gpu_mesh_instance_t mi = mesh_instances_[mi_handle._index];
 
     memcpy(mi.xform, xform, 16 * sizeof(float));
     InverseMatrix(mi.xform, mi.inv_xform);
@@ -1464,7 +1464,7 @@ inline void Ray::NS::Scene::SetMeshInstanceTransform_nolock(const MeshInstanceHa
 }
 
 inline void Ray::NS::Scene::RemoveMeshInstance_nolock(const MeshInstanceHandle i) {
-    const mesh_instance_t &mi = mesh_instances_[i._index];
+    const gpu_mesh_instance_t &mi = mesh_instances_[i._index];
 
     if (mi.lights_index != 0xffffffff) {
         const uint32_t light_block = (mi.ray_visibility >> 8);
@@ -2296,7 +2296,7 @@ inline void Ray::NS::Scene::RebuildLightTree_nolock() {
             omega_e = PI / 2.0f;
         } break;
         case LIGHT_TYPE_TRI: {
-            const mesh_instance_t &lmi = mesh_instances_[l.tri.mi_index];
+            const gpu_mesh_instance_t &lmi = mesh_instances_[l.tri.mi_index];
             const uint32_t ltri_index = l.tri.tri_index;
 
             const vertex_t &v1 = vertices_[vtx_indices_[ltri_index * 3 + 0]];
@@ -2306,9 +2306,9 @@ inline void Ray::NS::Scene::RebuildLightTree_nolock() {
             auto p1 = Ref::fvec4(v1.p[0], v1.p[1], v1.p[2], 0.0f), p2 = Ref::fvec4(v2.p[0], v2.p[1], v2.p[2], 0.0f),
                  p3 = Ref::fvec4(v3.p[0], v3.p[1], v3.p[2], 0.0f);
 
-            p1 = TransformPoint(p1, lmi.xform);
-            p2 = TransformPoint(p2, lmi.xform);
-            p3 = TransformPoint(p3, lmi.xform);
+            p1 = TransformPoint4x4(p1, lmi.xform);
+            p2 = TransformPoint4x4(p2, lmi.xform);
+            p3 = TransformPoint4x4(p3, lmi.xform);
 
             bbox_min = min(p1, min(p2, p3));
             bbox_max = max(p1, max(p2, p3));
@@ -1497,9 +1497,12 @@ Ray::color_rgba_t Ray::Ref::ShadeSurface(const pass_settings_t &ps, const float
 
             const auto p1 = make_fvec3(v1.p), p2 = make_fvec3(v2.p), p3 = make_fvec3(v3.p);
 
+            float xform[12];
+            InverseAffineMatrix(mi->inv_xform, xform);
+
             float light_forward_len;
             fvec4 light_forward =
-                normalize_len(TransformDirection(cross(p2 - p1, p3 - p1), mi->xform), light_forward_len);
+                normalize_len(TransformDirection(cross(p2 - p1, p3 - p1), xform), light_forward_len);
             const float tri_area = 0.5f * light_forward_len;
 
             const float cos_theta = fabsf(dot(I, light_forward)); // abs for doublesided light
@@ -5,7 +5,9 @@
 #include <cstdint>
 
 #include <memory>
+#include <type_traits>
 
+#include "BinaryIO.h"
 #include "Core.h"
 #include "FreelistAlloc.h"
 #include "simd/aligned_allocator.h"
@@ -108,6 +110,11 @@ template <typename T> class SparseStorage {
 
     uint32_t GetCount(const uint32_t block_index) { return alloc_->GetBlockRange(block_index).size; }
 
+    // Checks that handle still refers to live element (block may have been freed and reused)
+    bool Contains(const uint32_t index, const uint32_t block_index) const {
+        return alloc_ && alloc_->IsOccupied(block_index) && alloc_->GetBlockRange(block_index).offset == index;
+    }
+
     void Erase(const uint32_t block_index) {
         const FreelistAlloc::Range r = alloc_->GetBlockRange(block_index);
         for (uint32_t i = r.offset; i < r.offset + r.size; ++i) {
@@ -117,7 +124,8 @@ template <typename T> class SparseStorage {
         alloc_->Free(block_index);
     }
 
-    template <class... Args> std::pair<uint32_t, uint32_t> Allocate(const uint32_t count, Args &&...args) {
+    // Makes room for count more elements, capacity grows the same way as with one-by-one insertion
+    void reserve_more(const uint32_t count) {
         if (size_ + count > capacity_) {
             uint32_t new_capacity = std::max(capacity_, InitialNonZeroCapacity);
             while (new_capacity < size_ + count) {
@@ -125,6 +133,10 @@ template <typename T> class SparseStorage {
             }
             reserve(new_capacity);
         }
+    }
+
+    template <class... Args> std::pair<uint32_t, uint32_t> Allocate(const uint32_t count, Args &&...args) {
+        reserve_more(count);
 
         FreelistAlloc::Allocation al = alloc_->Alloc(count);
         while (al.offset == 0xffffffff) {
@@ -250,6 +262,81 @@ template <typename T> class SparseStorage {
     }
 
     bool IntegrityCheck() const { return alloc_->IntegrityCheck(); }
+
+    // Writes allocator state along with occupied elements (indices and blocks are preserved on reload)
+    void Serialize(BinaryWriter &out) const {
+        static_assert(std::is_trivially_copyable<T>::value, "!");
+        out.Write(capacity_);
+        out.Write(size_);
+        if (!alloc_) {
+            return;
+        }
+        alloc_->Serialize(out);
+        FreelistAlloc::Range r = alloc_->GetFirstOccupiedBlock(0);
+        while (r.size) {
+            out.WriteArray(&data_[r.offset], r.size);
+            r = alloc_->GetNextOccupiedBlock(r.block);
+        }
+    }
+
+    // Destroys elements and releases all memory (storage becomes the same as newly created one)
+    void Reset() {
+        clear();
+        alloc_ = nullptr;
+        aligned_free(data_);
+        data_ = nullptr;
+        capacity_ = 0;
+    }
+
+    // Restores state written by Serialize (storage is expected to be empty), storage is left empty on failure
+    bool Deserialize(BinaryReader &in) {
+        static_assert(std::is_trivially_copyable<T>::value, "!");
+        assert(size_ == 0);
+
+        // elements are trivially copyable, so memory is released without calling destructors
+        const auto fail = [&]() {
+            in.SetFailed();
+            alloc_ = nullptr;
+            aligned_free(data_);
+            data_ = nullptr;
+            capacity_ = size_ = 0;
+            return false;
+        };
+
+        uint32_t capacity = 0, size = 0;
+        in.Read(capacity);
+        in.Read(size);
+        if (in.failed() || size > capacity) {
+            return fail();
+        }
+        if (!capacity) {
+            return true;
+        }
+
+        aligned_free(data_);
+        data_ = (T *)aligned_malloc(capacity * sizeof(T), alignof(T));
+        capacity_ = capacity;
+
+        alloc_ = std::make_unique<FreelistAlloc>();
+        if (!alloc_->Deserialize(in)) {
+            return fail();
+        }
+        FreelistAlloc::Range r = alloc_->GetFirstOccupiedBlock(0);
+        while (r.size) {
+            const Span<const T> elements = in.ReadArray<T>();
+            if (uint32_t(elements.size()) != r.size || r.offset + r.size > capacity_ || size_ + r.size > size) {
+                return fail();
+            }
+            memcpy(&data_[r.offset], elements.data(), r.size * sizeof(T));
+            size_ += r.size;
+            r = alloc_->GetNextOccupiedBlock(r.block);
+        }
+
+        if (size_ != size) {
+            return fail();
+        }
+        return true;
+    }
 };
 
 template <typename T> const uint32_t SparseStorage<T>::InitialNonZeroCapacity;
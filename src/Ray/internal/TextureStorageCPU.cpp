@@ -303,6 +303,67 @@ template <typename T, int N> bool Ray::Cpu::TexStorageSwizzled<T, N>::Free(const
     return true;
 }
 
+template <typename T, int N> void Ray::Cpu::TexStorageSwizzled<T, N>::Serialize(BinaryWriter &out) const {
+    out.Write(uint32_t(images_.size()));
+    for (const ImgData &p : images_) {
+        const uint8_t is_occupied = p.pixels ? 1 : 0;
+        out.Write(is_occupied);
+        if (!is_occupied) {
+            continue;
+        }
+        out.Write(p.res);
+        out.Write(p.tile_y_stride);
+        out.Write(p.lod_offsets);
+
+        const int last = NUM_MIP_LEVELS - 1;
+        const int total_size =
+            p.lod_offsets[last] + p.tile_y_stride[last] * ((p.res[last][1] + OuterTileH - 1) / OuterTileH);
+        out.WriteArray(p.pixels.get(), uint32_t(total_size));
+    }
+}
+
+template <typename T, int N> bool Ray::Cpu::TexStorageSwizzled<T, N>::Deserialize(BinaryReader &in) {
+    uint32_t images_count = 0;
+    if (!in.Read(images_count)) {
+        return false;
+    }
+
+    images_.clear();
+    images_.resize(images_count);
+    free_slots_.clear();
+
+    for (uint32_t i = 0; i < images_count; ++i) {
+        ImgData &p = images_[i];
+
+        uint8_t is_occupied = 0;
+        in.Read(is_occupied);
+        if (!is_occupied) {
+            free_slots_.push_back(int(i));
+            continue;
+        }
+        in.Read(p.res);
+        in.Read(p.tile_y_stride);
+        in.Read(p.lod_offsets);
+
+        const Span<const ColorType> pixels = in.ReadArray<ColorType>();
+        if (in.failed()) {
+            return false;
+        }
+        // image layout must agree with the amount of stored data, otherwise fetches go out of bounds
+        const int last = NUM_MIP_LEVELS - 1;
+        const int64_t total_size = int64_t(p.lod_offsets[last]) +
+                                   int64_t(p.tile_y_stride[last]) * ((p.res[last][1] + OuterTileH - 1) / OuterTileH);
+        if (total_size != int64_t(pixels.size())) {
+            in.SetFailed();
+            return false;
+        }
+        p.pixels = std::make_unique<ColorType[]>(pixels.size());
+        memcpy(p.pixels.get(), pixels.data(), pixels.size() * sizeof(ColorType));
+    }
+
+    return !in.failed();
+}
+
 template class Ray::Cpu::TexStorageSwizzled<uint8_t, 4>;
 template class Ray::Cpu::TexStorageSwizzled<uint8_t, 3>;
 template class Ray::Cpu::TexStorageSwizzled<uint8_t, 2>;
@@ -476,6 +537,65 @@ int Ray::Cpu::TexStorageBCn<N>::AllocateRaw(Span<const uint8_t> data, const int
     return index;
 }
 
+template <int N> void Ray::Cpu::TexStorageBCn<N>::Serialize(BinaryWriter &out) const {
+    out.Write(uint32_t(images_.size()));
+    for (const ImgData &p : images_) {
+        const uint8_t is_occupied = p.pixels ? 1 : 0;
+        out.Write(is_occupied);
+        if (!is_occupied) {
+            continue;
+        }
+        out.Write(p.res);
+        out.Write(p.res_in_tiles);
+        out.Write(p.lod_offsets);
+
+        const int last = NUM_MIP_LEVELS - 1;
+        const int total_size = p.lod_offsets[last] + GetRequiredMemory_BCn<N>(p.res[last][0], p.res[last][1], 1);
+        out.WriteArray(p.pixels.get(), uint32_t(total_size));
+    }
+}
+
+template <int N> bool Ray::Cpu::TexStorageBCn<N>::Deserialize(BinaryReader &in) {
+    uint32_t images_count = 0;
+    if (!in.Read(images_count)) {
+        return false;
+    }
+
+    images_.clear();
+    images_.resize(images_count);
+    free_slots_.clear();
+
+    for (uint32_t i = 0; i < images_count; ++i) {
+        ImgData &p = images_[i];
+
+        uint8_t is_occupied = 0;
+        in.Read(is_occupied);
+        if (!is_occupied) {
+            free_slots_.push_back(int(i));
+            continue;
+        }
+        in.Read(p.res);
+        in.Read(p.res_in_tiles);
+        in.Read(p.lod_offsets);
+
+        const Span<const uint8_t> pixels = in.ReadArray<uint8_t>();
+        if (in.failed()) {
+            return false;
+        }
+        const int last = NUM_MIP_LEVELS - 1;
+        if (int64_t(p.lod_offsets[last]) + GetRequiredMemory_BCn<N>(p.res[last][0], p.res[last][1], 1) !=
+            int64_t(pixels.size())) {
+            in.SetFailed();
+            return false;
+        }
+        // NOTE: 1 byte is added due to BC4/BC5 compression write outside of memory block
+        p.pixels = std::make_unique<uint8_t[]>(pixels.size() + 1);
+        memcpy(p.pixels.get(), pixels.data(), pixels.size());
+    }
+
+    return !in.failed();
+}
+
 template class Ray::Cpu::TexStorageBCn<1>;
 template class Ray::Cpu::TexStorageBCn<2>;
 template class Ray::Cpu::TexStorageBCn<3>;
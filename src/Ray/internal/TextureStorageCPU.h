@@ -3,6 +3,7 @@
 #include <cmath>
 #include <memory>
 
+#include "BinaryIO.h"
 #include "Core.h"
 #include "TextureSplitter.h"
 #include "TextureUtils.h"
@@ -326,6 +327,14 @@ template <typename T, int N> class TexStorageSwizzled : public TexStorageBase {
 
     int Allocate(Span<const ColorType> data, const int res[2], bool mips);
     bool Free(int index) override;
+    // Releases all images at once
+    void Clear() {
+        images_.clear();
+        free_slots_.clear();
+    }
+
+    void Serialize(BinaryWriter &out) const;
+    bool Deserialize(BinaryReader &in);
 };
 
 extern template class TexStorageSwizzled<uint8_t, 4>;
@@ -605,6 +614,13 @@ template <int N> class TexStorageBCn : public TexStorageBase {
     int Allocate(Span<const InColorType> data, const int res[2], bool mips);
     int AllocateRaw(Span<const uint8_t> data, const int res[2], int mips_count, bool flip_vertical, bool invert_green);
     bool Free(int index) override { return true; }
+    void Clear() {
+        images_.clear();
+        free_slots_.clear();
+    }
+
+    void Serialize(BinaryWriter &out) const;
+    bool Deserialize(BinaryReader &in);
 };
 
 extern template class TexStorageBCn<1>;
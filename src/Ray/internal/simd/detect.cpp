@@ -1,10 +1,29 @@
 #include "detect.h"
 
+#include <cstdio>
+#include <cstring>
+
 #include <mutex>
 
+#if defined(__arm__) || defined(__aarch64__) || defined(_M_ARM) || defined(_M_ARM64)
+#if defined(_WIN32)
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#elif defined(__APPLE__)
+#include <sys/sysctl.h>
+#elif defined(__linux__)
+#include <fstream>
+#include <string>
+#endif
+#endif
+
 namespace Ray {
 std::once_flag g_cpu_features_init_flag;
 CpuFeatures g_cpu_features;
+std::once_flag g_cpu_model_init_flag;
+char g_cpu_model_name[64];
 } // namespace Ray
 
 #if defined(_WIN32) && !defined(_M_ARM) && !defined(_M_ARM64)
@@ -100,4 +119,77 @@ Ray::CpuFeatures Ray::GetCpuFeatures() {
     return g_cpu_features;
 }
 
+const char *Ray::GetCpuModelName() {
+    std::call_once(g_cpu_model_init_flag, []() {
+#if !defined(__arm__) && !defined(__aarch64__) && !defined(_M_ARM) && !defined(_M_ARM64) &&                            \
+    !defined(__EMSCRIPTEN__) && !defined(__ANDROID__)
+        int info[4];
+        cpuid(info, 0x80000000);
+        const unsigned ex_ids_count = unsigned(info[0]);
+        if (ex_ids_count >= 0x80000004) {
+            // brand string is returned in 3 parts, 16 bytes each
+            for (int i = 0; i < 3; ++i) {
+                cpuid(info, 0x80000002 + i);
+                memcpy(&g_cpu_model_name[16 * i], info, sizeof(info));
+            }
+            g_cpu_model_name[48] = '\0';
+
+            // strip leading and trailing spaces
+            const char *beg = g_cpu_model_name;
+            while (*beg == ' ') {
+                ++beg;
+            }
+            memmove(g_cpu_model_name, beg, strlen(beg) + 1);
+            for (int i = int(strlen(g_cpu_model_name)) - 1; i >= 0 && g_cpu_model_name[i] == ' '; --i) {
+                g_cpu_model_name[i] = '\0';
+            }
+        }
+#elif defined(_WIN32) && (defined(_M_ARM) || defined(_M_ARM64))
+        DWORD size = sizeof(g_cpu_model_name);
+        if (RegGetValueA(HKEY_LOCAL_MACHINE, "HARDWARE\\DESCRIPTION\\System\\CentralProcessor\\0",
+                         "ProcessorNameString", RRF_RT_REG_SZ, nullptr, g_cpu_model_name, &size) != ERROR_SUCCESS) {
+            g_cpu_model_name[0] = '\0';
+        }
+#elif defined(__APPLE__) && (defined(__arm__) || defined(__aarch64__))
+        size_t size = sizeof(g_cpu_model_name);
+        if (sysctlbyname("machdep.cpu.brand_string", g_cpu_model_name, &size, nullptr, 0) != 0) {
+            g_cpu_model_name[0] = '\0';
+        }
+#elif defined(__linux__) && (defined(__arm__) || defined(__aarch64__))
+        // Usually there is no model name, cores are identified by implementer and part numbers instead (several
+        // different parts are listed for big.LITTLE configurations)
+        std::ifstream in("/proc/cpuinfo");
+        std::string line, model_name, implementer, parts;
+        while (std::getline(in, line)) {
+            const size_t colon = line.find(':');
+            if (colon == std::string::npos || colon + 2 > line.size()) {
+                continue;
+            }
+            const std::string value = line.substr(colon + 2);
+            if (line.compare(0, 10, "model name") == 0) {
+                model_name = value;
+            } else if (line.compare(0, 15, "CPU implementer") == 0) {
+                implementer = value;
+            } else if (line.compare(0, 8, "CPU part") == 0 && parts.find(value) == std::string::npos) {
+                parts += parts.empty() ? value : ("/" + value);
+            }
+        }
+        if (!implementer.empty()) {
+            snprintf(g_cpu_model_name, sizeof(g_cpu_model_name), "ARM %s part %s", implementer.c_str(),
+                     parts.c_str());
+        } else if (!model_name.empty()) {
+            snprintf(g_cpu_model_name, sizeof(g_cpu_model_name), "%s", model_name.c_str());
+        }
+#endif
+        if (g_cpu_model_name[0] == '\0') {
+#if defined(__arm__) || defined(__aarch64__) || defined(_M_ARM) || defined(_M_ARM64)
+            strcpy(g_cpu_model_name, "Unknown ARM CPU");
+#else
+            strcpy(g_cpu_model_name, "Unknown x86 CPU");
+#endif
+        }
+    });
+    return g_cpu_model_name;
+}
+
 #undef cpuid
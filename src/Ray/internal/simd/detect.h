@@ -12,4 +12,6 @@ namespace Ray {
     };
 
     CpuFeatures GetCpuFeatures();
+    // Returns processor brand string (or generic name if it is not available)
+    const char *GetCpuModelName();
 }
@@ -22,7 +22,22 @@ void test_sparse_storage();
 void test_tex_storage();
 
 void test_aux_channels(const char *arch_list[], const char *preferred_device);
+void test_compiled_scene(const char *arch_list[], const char *preferred_device);
+void test_bulk_instances(const char *arch_list[], const char *preferred_device, bool full);
+void test_vtx_compression(const char *arch_list[], const char *preferred_device);
+void test_compact_framebuffer(const char *arch_list[], const char *preferred_device);
+void test_tiled_render(const char *arch_list[], const char *preferred_device);
+void test_cpu_calibration(const char *arch_list[], const char *preferred_device);
+void test_ray_sort(const char *arch_list[], const char *preferred_device);
+void test_raster_primary(const char *arch_list[], const char *preferred_device);
+void test_primary_cache(const char *arch_list[], const char *preferred_device);
+void test_preview(const char *arch_list[], const char *preferred_device);
+void test_frame_budget(const char *arch_list[], const char *preferred_device);
+void test_reprojection(const char *arch_list[], const char *preferred_device);
+void test_geo_cam(const char *arch_list[], const char *preferred_device);
+void test_lightmap_bake(const char *arch_list[], const char *preferred_device);
 void test_ray_flags(const char *arch_list[], const char *preferred_device);
+void test_transparent_shadows(const char *arch_list[], const char *preferred_device);
 void test_two_sided_mat(const char *arch_list[], const char *preferred_device);
 void test_oren_mat0(const char *arch_list[], const char *preferred_device);
 void test_oren_mat1(const char *arch_list[], const char *preferred_device);
@@ -246,7 +261,22 @@ int main(int argc, char *argv[]) {
         std::vector<std::future<void>> futures;
 
         futures.push_back(mt_run_pool.Enqueue(test_aux_channels, arch_list, device_name));
+        futures.push_back(mt_run_pool.Enqueue(test_compiled_scene, arch_list, device_name));
+        futures.push_back(mt_run_pool.Enqueue(test_bulk_instances, arch_list, device_name, full_tests));
+        futures.push_back(mt_run_pool.Enqueue(test_vtx_compression, arch_list, device_name));
+        futures.push_back(mt_run_pool.Enqueue(test_compact_framebuffer, arch_list, device_name));
+        futures.push_back(mt_run_pool.Enqueue(test_tiled_render, arch_list, device_name));
+        futures.push_back(mt_run_pool.Enqueue(test_cpu_calibration, arch_list, device_name));
+        futures.push_back(mt_run_pool.Enqueue(test_ray_sort, arch_list, device_name));
+        futures.push_back(mt_run_pool.Enqueue(test_geo_cam, arch_list, device_name));
+        futures.push_back(mt_run_pool.Enqueue(test_lightmap_bake, arch_list, device_name));
+        futures.push_back(mt_run_pool.Enqueue(test_raster_primary, arch_list, device_name));
+        futures.push_back(mt_run_pool.Enqueue(test_primary_cache, arch_list, device_name));
+        futures.push_back(mt_run_pool.Enqueue(test_preview, arch_list, device_name));
+        futures.push_back(mt_run_pool.Enqueue(test_frame_budget, arch_list, device_name));
+        futures.push_back(mt_run_pool.Enqueue(test_reprojection, arch_list, device_name));
         futures.push_back(mt_run_pool.Enqueue(test_ray_flags, arch_list, device_name));
+        futures.push_back(mt_run_pool.Enqueue(test_transparent_shadows, arch_list, device_name));
         futures.push_back(mt_run_pool.Enqueue(test_two_sided_mat, arch_list, device_name));
         futures.push_back(mt_run_pool.Enqueue(test_complex_mat0, arch_list, device_name));
         futures.push_back(mt_run_pool.Enqueue(test_complex_mat1, arch_list, device_name));
@@ -0,0 +1,145 @@
+#include "test_common.h"
+
+#include <cstring>
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include "../Ray.h"
+
+#include "test_scene.h"
+#include "thread_pool.h"
+
+extern std::mutex g_stdout_mtx;
+
+void test_bulk_instances(const char *arch_list[], const char *preferred_device, const bool full) {
+    using namespace std::chrono;
+
+    ThreadPool threads(std::max(std::thread::hardware_concurrency(), 1u));
+
+    // ThreadPool::ParallelFor spawns one task per index, split work into larger chunks instead
+    auto parallel_for = [&threads](const int from, const int to, Ray::ParallelForFunction &&f) {
+        const int chunks_count = std::max(int(threads.workers_count()), 1);
+        const int chunk_size = (to - from + chunks_count - 1) / chunks_count;
+        threads.ParallelFor(0, chunks_count, [&](const int chunk) {
+            for (int i = from + chunk * chunk_size; i < std::min(from + (chunk + 1) * chunk_size, to); ++i) {
+                f(i);
+            }
+        });
+    };
+
+    // default run is kept fast, full run measures construction of a scene with million instances
+    const int InstancesCount = full ? 1000000 : 100000, CompareInstancesCount = 5000;
+
+    std::vector<float> xforms(16 * InstancesCount);
+    for (int i = 0; i < InstancesCount; ++i) {
+        float *xform = &xforms[16 * i];
+        memset(xform, 0, 16 * sizeof(float));
+        const float scale = 0.5f + float(i % 7) * 0.25f;
+        xform[0] = xform[5] = xform[10] = scale;
+        xform[15] = 1.0f;
+        xform[12] = float(i % 1000) * 3.0f;
+        xform[13] = float((i / 1000) % 7);
+        xform[14] = float(i / 1000) * 3.0f;
+    }
+
+    Ray::settings_t s;
+    s.w = s.h = 64;
+    s.preferred_device = preferred_device;
+
+    std::string details;
+
+    for (const char **arch = arch_list; *arch; ++arch) {
+        const auto rt = Ray::RendererTypeFromName(*arch);
+        if (!Ray::RendererSupportsMultithreading(rt)) {
+            // bulk API is only specialized for CPU backends
+            continue;
+        }
+
+        auto renderer = std::unique_ptr<Ray::RendererBase>(Ray::CreateRenderer(s, &g_log_err, rt));
+        if (!renderer || renderer->type() != rt) {
+            continue;
+        }
+
+        auto setup_mesh = [&](Ray::SceneBase &scene, const bool emissive) {
+            Ray::shading_node_desc_t mat_desc;
+            mat_desc.type = emissive ? Ray::eShadingNode::Emissive : Ray::eShadingNode::Diffuse;
+            mat_desc.strength = 2.0f;
+            mat_desc.importance_sample = true;
+            return add_quad_mesh(scene, scene.AddMaterial(mat_desc));
+        };
+
+        auto fill_descs = [&](const Ray::MeshHandle mesh, const int count) {
+            std::vector<Ray::mesh_instance_desc_t> descs(count);
+            for (int i = 0; i < count; ++i) {
+                descs[i].mesh = mesh;
+                descs[i].xform = &xforms[16 * i];
+                descs[i].shadow_visibility = (i % 3) != 0;
+            }
+            return descs;
+        };
+
+        { // bulk path must produce exactly the same scene as one-by-one insertion
+            auto scene1 = std::unique_ptr<Ray::SceneBase>(renderer->CreateScene());
+            auto scene2 = std::unique_ptr<Ray::SceneBase>(renderer->CreateScene());
+
+            const Ray::MeshHandle mesh1 = setup_mesh(*scene1, true), mesh2 = setup_mesh(*scene2, true);
+
+            const std::vector<Ray::mesh_instance_desc_t> descs1 = fill_descs(mesh1, CompareInstancesCount),
+                                                         descs2 = fill_descs(mesh2, CompareInstancesCount);
+
+            std::vector<Ray::MeshInstanceHandle> handles1, handles2(CompareInstancesCount);
+            for (const Ray::mesh_instance_desc_t &desc : descs1) {
+                handles1.push_back(scene1->AddMeshInstance(desc));
+            }
+            scene2->AddMeshInstances(descs2, handles2, parallel_for);
+            require(handles1 == handles2);
+
+            // move every second instance
+            std::vector<Ray::MeshInstanceHandle> to_move;
+            for (int i = 0; i < CompareInstancesCount; i += 2) {
+                scene1->SetMeshInstanceTransform(handles1[i], &xforms[16 * (CompareInstancesCount + i)]);
+                to_move.push_back(handles2[i]);
+            }
+            std::vector<float> new_xforms(16 * to_move.size());
+            for (int i = 0; i < int(to_move.size()); ++i) {
+                memcpy(&new_xforms[16 * i], &xforms[16 * (CompareInstancesCount + 2 * i)], 16 * sizeof(float));
+            }
+            scene2->SetMeshInstanceTransforms(to_move, new_xforms.data(), parallel_for);
+
+            scene1->Finalize(parallel_for);
+            scene2->Finalize(parallel_for);
+
+            std::vector<uint8_t> data1, data2;
+            require(scene1->SaveCompiled(data1));
+            require(scene2->SaveCompiled(data2));
+            require(data1 == data2);
+        }
+
+        { // construction of large scene
+            auto scene = std::unique_ptr<Ray::SceneBase>(renderer->CreateScene());
+            const Ray::MeshHandle mesh = setup_mesh(*scene, false);
+            const std::vector<Ray::mesh_instance_desc_t> descs = fill_descs(mesh, InstancesCount);
+
+            std::vector<Ray::MeshInstanceHandle> handles(InstancesCount);
+
+            const auto t1 = high_resolution_clock::now();
+            scene->AddMeshInstances(descs, handles, parallel_for);
+            const auto t2 = high_resolution_clock::now();
+            scene->Finalize(parallel_for);
+            const auto t3 = high_resolution_clock::now();
+
+            char buf[256];
+            snprintf(buf, sizeof(buf), "(%s: %i instances added in %.1fms, finalized in %.1fms) ", *arch,
+                     InstancesCount, duration<double, std::milli>(t2 - t1).count(),
+                     duration<double, std::milli>(t3 - t2).count());
+            details += buf;
+        }
+    }
+
+    std::lock_guard<std::mutex> _(g_stdout_mtx);
+    printf("Test bulk_instances     | %sOK\n", details.c_str());
+}
@@ -0,0 +1,132 @@
+#include "test_common.h"
+
+#include <cstdarg>
+#include <cstring>
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "../Log.h"
+#include "../Ray.h"
+
+#include "test_scene.h"
+
+namespace {
+class LogFramebufferSize final : public Ray::ILog {
+  public:
+    double bytes_per_pixel = 0.0;
+
+    void Info(const char *fmt, ...) override {
+        if (strncmp(fmt, "Framebuffer", 11) == 0) {
+            va_list vl;
+            va_start(vl, fmt);
+            bytes_per_pixel = va_arg(vl, double);
+            va_end(vl);
+        }
+    }
+    void Warning(const char *fmt, ...) override {}
+    void Error(const char *fmt, ...) override {
+        va_list vl;
+        va_start(vl, fmt);
+        vprintf(fmt, vl);
+        va_end(vl);
+        putc('\n', stdout);
+    }
+};
+} // namespace
+
+extern std::mutex g_stdout_mtx;
+
+void test_compact_framebuffer(const char *arch_list[], const char *preferred_device) {
+    std::string details;
+
+    const int ImgRes = 128, SamplesCount = 16;
+
+    for (const char **arch = arch_list; *arch; ++arch) {
+        const auto rt = Ray::RendererTypeFromName(*arch);
+        if (!Ray::RendererSupportsMultithreading(rt)) {
+            // compact framebuffer is only supported by CPU backends
+            continue;
+        }
+
+        double bytes_per_pixel[2] = {};
+        std::vector<float> raw_pixels[2], final_pixels[2];
+
+        for (int compact = 0; compact < 2; ++compact) {
+            LogFramebufferSize log;
+
+            Ray::settings_t s;
+            s.w = s.h = ImgRes;
+            s.preferred_device = preferred_device;
+            s.use_compact_framebuffer = (compact != 0);
+
+            auto renderer = std::unique_ptr<Ray::RendererBase>(Ray::CreateRenderer(s, &log, rt));
+            if (!renderer || renderer->type() != rt) {
+                break;
+            }
+            bytes_per_pixel[compact] = log.bytes_per_pixel;
+
+            auto scene = std::unique_ptr<Ray::SceneBase>(renderer->CreateScene());
+
+            Ray::camera_desc_t cam_desc;
+            cam_desc.filter = Ray::ePixelFilter::Box;
+            cam_desc.origin[2] = 3.0f;
+            cam_desc.fwd[2] = -1.0f;
+            cam_desc.fov = 45.0f;
+            setup_sphere_scene(*scene, 64, 32, cam_desc);
+
+            Ray::RegionContext region({0, 0, ImgRes, ImgRes});
+            for (int i = 0; i < SamplesCount; ++i) {
+                renderer->RenderScene(*scene, region);
+            }
+
+            const Ray::color_data_rgba_t raw = renderer->get_raw_pixels_ref();
+            const Ray::color_data_rgba_t tonemapped = renderer->get_pixels_ref();
+            require_return(raw.ptr != nullptr && tonemapped.ptr != nullptr);
+            for (int y = 0; y < ImgRes; ++y) {
+                for (int x = 0; x < ImgRes; ++x) {
+                    const float *p = raw.ptr[y * raw.pitch + x].v;
+                    raw_pixels[compact].insert(end(raw_pixels[compact]), p, p + 3);
+                    const float *f = tonemapped.ptr[y * tonemapped.pitch + x].v;
+                    final_pixels[compact].insert(end(final_pixels[compact]), f, f + 3);
+                }
+            }
+
+            // second read returns the same image
+            const Ray::color_data_rgba_t tonemapped2 = renderer->get_pixels_ref();
+            require(tonemapped2.ptr == tonemapped.ptr);
+            require(memcmp(tonemapped2.ptr[(ImgRes - 1) * tonemapped2.pitch + ImgRes - 1].v,
+                           &final_pixels[compact][final_pixels[compact].size() - 3], 3 * sizeof(float)) == 0);
+
+            if (compact) {
+                // aux buffers are not allocated until denoising is requested
+                const Ray::color_data_rgba_t base_color = renderer->get_aux_pixels_ref(Ray::eAUXBuffer::BaseColor);
+                require(base_color.ptr == nullptr && base_color.pitch == 0);
+            }
+
+            // denoising must work with lazily allocated buffers
+            renderer->DenoiseImage(region);
+            require(renderer->get_raw_pixels_ref().ptr != nullptr);
+        }
+
+        if (raw_pixels[1].empty()) {
+            continue;
+        }
+
+        // fp16 half buffer only affects adaptive sampling, accumulated image must match exactly
+        require(raw_pixels[0] == raw_pixels[1]);
+        require(final_pixels[0] == final_pixels[1]);
+        // final buffer is counted in both modes (compact one allocates it on the first read)
+        require(bytes_per_pixel[1] < 0.55 * bytes_per_pixel[0]);
+
+        char buf[128];
+        snprintf(buf, sizeof(buf), "(%s: %.1f -> %.1f bytes per pixel) ", *arch, bytes_per_pixel[0],
+                 bytes_per_pixel[1]);
+        details += buf;
+    }
+
+    std::lock_guard<std::mutex> _(g_stdout_mtx);
+    printf("Test compact_fb         | %sOK\n", details.c_str());
+}
@@ -0,0 +1,200 @@
+#include "test_common.h"
+
+#include <cstdio>
+#include <cstring>
+
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "../Ray.h"
+
+#include "test_scene.h"
+
+extern std::mutex g_stdout_mtx;
+
+namespace {
+void setup_compiled_test_scene(Ray::SceneBase &scene) {
+    const float positions[] = {-1.0f, 0.0f, -1.0f, 1.0f, 0.0f, -1.0f, 1.0f, 0.0f, 1.0f, -1.0f, 0.0f, 1.0f};
+    const float normals[] = {0.0f, 1.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 1.0f, 0.0f};
+    const float uvs[] = {0.0f, 0.0f, 1.0f, 0.0f, 1.0f, 1.0f, 0.0f, 1.0f};
+    const uint32_t indices[] = {0, 2, 1, 0, 3, 2};
+
+    Ray::shading_node_desc_t mat_desc;
+    mat_desc.type = Ray::eShadingNode::Diffuse;
+    mat_desc.base_color[0] = 0.7f;
+    mat_desc.base_color[1] = mat_desc.base_color[2] = 0.4f;
+    const Ray::MaterialHandle mat = scene.AddMaterial(mat_desc);
+
+    Ray::mesh_desc_t mesh_desc;
+    mesh_desc.prim_type = Ray::ePrimType::TriangleList;
+    mesh_desc.vtx_positions = {positions, 0, 3};
+    mesh_desc.vtx_normals = {normals, 0, 3};
+    mesh_desc.vtx_uvs = {uvs, 0, 2};
+    mesh_desc.vtx_indices = indices;
+
+    const Ray::mat_group_desc_t groups[] = {{mat, 0, 6}};
+    mesh_desc.groups = groups;
+    const Ray::MeshHandle mesh = scene.AddMesh(mesh_desc);
+
+    static const float identity[16] = {1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f,
+                                       0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f};
+    static const float shifted[16] = {0.5f, 0.0f, 0.0f, 0.0f, 0.0f, 0.5f, 0.0f, 0.0f,
+                                      0.0f, 0.0f, 0.5f, 0.0f, 0.0f, 0.5f, 0.0f, 1.0f};
+    scene.AddMeshInstance(mesh, identity);
+    scene.AddMeshInstance(mesh, shifted);
+
+    Ray::sphere_light_desc_t light_desc;
+    light_desc.position[1] = 2.0f;
+    light_desc.radius = 0.25f;
+    light_desc.color[0] = light_desc.color[1] = light_desc.color[2] = 10.0f;
+    scene.AddLight(light_desc);
+
+    Ray::environment_desc_t env_desc;
+    env_desc.env_col[0] = env_desc.env_col[1] = env_desc.env_col[2] = 0.25f;
+    scene.SetEnvironment(env_desc);
+
+    Ray::camera_desc_t cam_desc;
+    cam_desc.origin[1] = 1.0f;
+    cam_desc.origin[2] = 3.0f;
+    cam_desc.fwd[1] = -0.31622776f;
+    cam_desc.fwd[2] = -0.94868330f;
+    cam_desc.fov = 45.0f;
+    cam_desc.max_diff_depth = 2;
+    cam_desc.max_total_depth = 2;
+    scene.set_current_cam(scene.AddCamera(cam_desc));
+
+    scene.Finalize();
+}
+
+std::vector<float> render_pixels(Ray::RendererBase &renderer, const Ray::SceneBase &scene, const int res,
+                                 const int samples) {
+    renderer.Clear({});
+    Ray::RegionContext region({0, 0, res, res});
+    for (int i = 0; i < samples; ++i) {
+        renderer.RenderScene(scene, region);
+    }
+
+    std::vector<float> pixels;
+    const Ray::color_data_rgba_t raw = renderer.get_raw_pixels_ref();
+    for (int y = 0; y < res; ++y) {
+        for (int x = 0; x < res; ++x) {
+            const float *p = raw.ptr[y * raw.pitch + x].v;
+            pixels.insert(end(pixels), p, p + 3);
+        }
+    }
+    return pixels;
+}
+
+// Blob is expected to be 16-byte aligned
+struct aligned_blob_t {
+    struct alignas(16) chunk_t {
+        uint8_t data[16];
+    };
+    std::vector<chunk_t> chunks;
+    size_t size = 0;
+
+    explicit aligned_blob_t(const std::vector<uint8_t> &data) : chunks((data.size() + 15) / 16), size(data.size()) {
+        memcpy(chunks.data(), data.data(), data.size());
+    }
+
+    Ray::Span<const uint8_t> span(const size_t part = 1) const {
+        return Ray::Span<const uint8_t>(reinterpret_cast<const uint8_t *>(chunks.data()), size / part);
+    }
+};
+} // namespace
+
+void test_compiled_scene(const char *arch_list[], const char *preferred_device) {
+    const int ImgRes = 32, SamplesCount = 4;
+
+    // failed loads are expected here, they must not be reported as errors
+    Ray::LogNull log;
+
+    for (const char **arch = arch_list; *arch; ++arch) {
+        const auto rt = Ray::RendererTypeFromName(*arch);
+        if (!Ray::RendererSupportsMultithreading(rt)) {
+            // compiled scenes are only supported by CPU backends
+            continue;
+        }
+
+        for (const bool use_vtx_compression : {false, true}) {
+            Ray::settings_t s;
+            s.w = s.h = ImgRes;
+            s.preferred_device = preferred_device;
+            s.use_vtx_compression = use_vtx_compression;
+
+            auto renderer = std::unique_ptr<Ray::RendererBase>(Ray::CreateRenderer(s, &log, rt));
+            if (!renderer || renderer->type() != rt) {
+                continue;
+            }
+
+            auto scene = std::unique_ptr<Ray::SceneBase>(renderer->CreateScene());
+            setup_compiled_test_scene(*scene);
+
+            std::vector<uint8_t> data;
+            require(scene->SaveCompiled(data));
+            require(!data.empty());
+
+            const aligned_blob_t blob(data);
+
+            auto loaded_scene = std::unique_ptr<Ray::SceneBase>(renderer->CreateScene());
+            require(loaded_scene->LoadCompiled(blob.span()));
+            require(loaded_scene->triangle_count() == scene->triangle_count());
+            require(loaded_scene->node_count() == scene->node_count());
+
+            // saving loaded scene gives the same blob size
+            std::vector<uint8_t> data2;
+            require(loaded_scene->SaveCompiled(data2));
+            require(data2.size() == data.size());
+
+            // loaded scene renders exactly the same image
+            const std::vector<float> ref_pixels = render_pixels(*renderer, *scene, ImgRes, SamplesCount);
+            const std::vector<float> loaded_pixels = render_pixels(*renderer, *loaded_scene, ImgRes, SamplesCount);
+            require(ref_pixels == loaded_pixels);
+
+            // truncated blob is rejected and nothing of it is left in the scene
+            auto broken_scene = std::unique_ptr<Ray::SceneBase>(renderer->CreateScene());
+            for (const size_t part : {2, 3, 5}) {
+                require(!broken_scene->LoadCompiled(blob.span(part)));
+                require(broken_scene->triangle_count() == 0);
+                require(broken_scene->node_count() == 0);
+            }
+
+            { // trailing garbage is rejected too
+                std::vector<uint8_t> padded_data = data;
+                padded_data.resize(padded_data.size() + 16, 0xff);
+                require(!broken_scene->LoadCompiled(aligned_blob_t{padded_data}.span()));
+                require(broken_scene->triangle_count() == 0);
+            }
+
+            // the same scene object accepts valid blob afterwards
+            require(broken_scene->LoadCompiled(blob.span()));
+            require(broken_scene->triangle_count() == scene->triangle_count());
+
+            // blob can not be loaded on top of existing data
+            require(!scene->LoadCompiled(blob.span()));
+        }
+
+        { // settings mismatch is detected
+            Ray::settings_t s;
+            s.w = s.h = ImgRes;
+            s.preferred_device = preferred_device;
+
+            auto renderer = std::unique_ptr<Ray::RendererBase>(Ray::CreateRenderer(s, &log, rt));
+            auto scene = std::unique_ptr<Ray::SceneBase>(renderer->CreateScene());
+            setup_compiled_test_scene(*scene);
+
+            std::vector<uint8_t> data;
+            require(scene->SaveCompiled(data));
+
+            s.use_vtx_compression = true;
+            auto other_renderer = std::unique_ptr<Ray::RendererBase>(Ray::CreateRenderer(s, &log, rt));
+            auto other_scene = std::unique_ptr<Ray::SceneBase>(other_renderer->CreateScene());
+
+            require(!other_scene->LoadCompiled(aligned_blob_t{data}.span()));
+        }
+    }
+
+    std::lock_guard<std::mutex> _(g_stdout_mtx);
+    printf("Test compiled_scene     | OK\n");
+}
@@ -0,0 +1,90 @@
+#include "test_common.h"
+
+#include <cstdio>
+
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include "../Ray.h"
+
+#include "test_scene.h"
+#include "thread_pool.h"
+
+extern std::mutex g_stdout_mtx;
+
+void test_cpu_calibration(const char *arch_list[], const char *preferred_device) {
+    ThreadPool threads(4);
+    auto parallel_for = [&threads](const int from, const int to, Ray::ParallelForFunction &&f) {
+        threads.ParallelFor(from, to, f);
+    };
+
+    Ray::Bitmask<Ray::eRendererType> enabled_types;
+    for (const char **arch = arch_list; *arch; ++arch) {
+        const auto rt = Ray::RendererTypeFromName(*arch);
+        if (Ray::RendererSupportsMultithreading(rt)) {
+            enabled_types |= rt;
+        }
+    }
+
+    const char *CachePath = "test_cpu_calibration.txt";
+    remove(CachePath);
+
+    Ray::cpu_benchmark_result_t results[8];
+    const int results_count =
+        Ray::CalibrateCPURenderers(&g_log_err, enabled_types, CachePath, results, 8, parallel_for);
+    if (results_count == 0) {
+        // no CPU backends were requested
+        std::lock_guard<std::mutex> _(g_stdout_mtx);
+        printf("Test cpu_calibration    | OK\n");
+        return;
+    }
+
+    for (int i = 0; i < results_count; ++i) {
+        require(enabled_types & results[i].type);
+        require(results[i].rays_per_second > 0.0);
+        require(i == 0 || results[i - 1].rays_per_second >= results[i].rays_per_second);
+    }
+
+    { // every measured backend is written into cache file
+        std::ifstream in(CachePath);
+        int lines_count = 0;
+        std::string line;
+        while (std::getline(in, line)) {
+            ++lines_count;
+        }
+        require(lines_count == results_count);
+    }
+
+    { // repeated calibration reuses measured values
+        Ray::cpu_benchmark_result_t cached_results[8];
+        require(Ray::CalibrateCPURenderers(&g_log_err, enabled_types, CachePath, cached_results, 8) == results_count);
+        for (int i = 0; i < results_count; ++i) {
+            require(cached_results[i].type == results[i].type);
+        }
+    }
+
+    { // renderer creation picks the fastest backend, AVX512 one is measured even if it was not requested
+        Ray::cpu_benchmark_result_t fastest;
+        require(Ray::CalibrateCPURenderers(&g_log_err, enabled_types | Ray::eRendererType::SIMD_AVX512, CachePath,
+                                           &fastest, 1, parallel_for) == 1);
+
+        Ray::settings_t s;
+        s.w = s.h = 64;
+        s.preferred_device = preferred_device;
+        s.use_cpu_calibration = true;
+        s.cpu_calibration_cache = CachePath;
+
+        auto renderer = std::unique_ptr<Ray::RendererBase>(
+            Ray::CreateRenderer(s, &g_log_err, enabled_types, parallel_for));
+        require(renderer && renderer->type() == fastest.type);
+    }
+
+    remove(CachePath);
+
+    // measured while other tests are running, so the number is only indicative
+    std::lock_guard<std::mutex> _(g_stdout_mtx);
+    printf("Test cpu_calibration    | (fastest %s: %.2f Mrays/sec) OK\n", Ray::RendererTypeName(results[0].type),
+           results[0].rays_per_second * 1e-6);
+}
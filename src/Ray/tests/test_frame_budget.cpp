@@ -0,0 +1,167 @@
+#include "test_common.h"
+
+#include <cstdio>
+
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "../Ray.h"
+
+#include "test_scene.h"
+#include "thread_pool.h"
+
+extern std::mutex g_stdout_mtx;
+
+void test_frame_budget(const char *arch_list[], const char *preferred_device) {
+    // test runs next to others in shared pool, few threads are enough to render regions in parallel
+    ThreadPool threads(4);
+    auto parallel_for = [&threads](const int from, const int to, Ray::ParallelForFunction &&f) {
+        threads.ParallelFor(from, to, f);
+    };
+
+    const float positions[] = {-1.0f, 0.0f, -1.0f, 1.0f, 0.0f, -1.0f, 1.0f, 0.0f, 1.0f, -1.0f, 0.0f, 1.0f};
+    const float normals[] = {0.0f, 1.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 1.0f, 0.0f};
+    const float uvs[] = {0.0f, 0.0f, 1.0f, 0.0f, 1.0f, 1.0f, 0.0f, 1.0f};
+    const uint32_t indices[] = {0, 2, 1, 0, 3, 2};
+
+    const int ImgRes = 64, TileSize = 16, TilesCount = (ImgRes / TileSize) * (ImgRes / TileSize);
+
+    for (const char **arch = arch_list; *arch; ++arch) {
+        const auto rt = Ray::RendererTypeFromName(*arch);
+        if (!Ray::RendererSupportsMultithreading(rt)) {
+            // regions are rendered in parallel
+            continue;
+        }
+
+        Ray::settings_t s;
+        s.w = s.h = ImgRes;
+        s.preferred_device = preferred_device;
+
+        auto renderer = std::unique_ptr<Ray::RendererBase>(Ray::CreateRenderer(s, &g_log_err, rt));
+        if (!renderer || renderer->type() != rt) {
+            continue;
+        }
+        auto scene = std::unique_ptr<Ray::SceneBase>(renderer->CreateScene());
+
+        Ray::shading_node_desc_t mat_desc;
+        mat_desc.type = Ray::eShadingNode::Diffuse;
+        mat_desc.base_color[0] = mat_desc.base_color[1] = mat_desc.base_color[2] = 0.5f;
+        const Ray::MaterialHandle mat = scene->AddMaterial(mat_desc);
+
+        Ray::mesh_desc_t mesh_desc;
+        mesh_desc.prim_type = Ray::ePrimType::TriangleList;
+        mesh_desc.vtx_positions = {positions, 0, 3};
+        mesh_desc.vtx_normals = {normals, 0, 3};
+        mesh_desc.vtx_uvs = {uvs, 0, 2};
+        mesh_desc.vtx_indices = indices;
+
+        const Ray::mat_group_desc_t groups[] = {{mat, 0, 6}};
+        mesh_desc.groups = groups;
+
+        static const float identity[16] = {1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f,
+                                           0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f};
+        scene->AddMeshInstance(scene->AddMesh(mesh_desc), identity);
+
+        Ray::environment_desc_t env_desc;
+        env_desc.env_col[0] = env_desc.env_col[1] = env_desc.env_col[2] = 1.0f;
+        scene->SetEnvironment(env_desc);
+
+        Ray::camera_desc_t cam_desc;
+        cam_desc.origin[1] = 1.0f;
+        cam_desc.origin[2] = 3.0f;
+        cam_desc.fwd[1] = -0.31622776f;
+        cam_desc.fwd[2] = -0.94868330f;
+        cam_desc.fov = 45.0f;
+        cam_desc.max_diff_depth = 2;
+        cam_desc.max_total_depth = 2;
+        scene->set_current_cam(scene->AddCamera(cam_desc));
+
+        scene->Finalize();
+
+        std::vector<Ray::RegionContext> regions;
+        for (int y = 0; y < ImgRes; y += TileSize) {
+            for (int x = 0; x < ImgRes; x += TileSize) {
+                regions.emplace_back(Ray::rect_t{x, y, TileSize, TileSize});
+            }
+        }
+        std::vector<Ray::RegionContext *> region_ptrs;
+        for (Ray::RegionContext &region : regions) {
+            region_ptrs.push_back(&region);
+        }
+
+        const auto restart = [&]() {
+            renderer->Clear({});
+            for (Ray::RegionContext &region : regions) {
+                region.Clear();
+            }
+        };
+
+        { // tight budget, single region sample per frame, lagging regions go first
+            Ray::frame_budget_desc_t desc;
+            desc.budget_ms = 0.001f;
+            Ray::FrameBudgetController controller(desc);
+
+            // cost is not known yet, every region is measured
+            require(controller.RenderFrame(*renderer, *scene, region_ptrs));
+            require(controller.stats().regions_rendered == TilesCount);
+            require(controller.stats().pixel_samples == ImgRes * ImgRes);
+            require(controller.stats().predicted_ms == 0.0f);
+
+            for (int i = 0; i < TilesCount; ++i) {
+                require(controller.RenderFrame(*renderer, *scene, region_ptrs));
+                require(controller.stats().region_samples == 1);
+                require(controller.stats().regions_deferred == TilesCount - 1);
+            }
+            for (const Ray::RegionContext &region : regions) {
+                require(region.iteration == 2);
+            }
+            require(controller.stats().frames_count == TilesCount + 1);
+            require(controller.stats().overruns_count == TilesCount + 1);
+        }
+
+        restart();
+
+        { // generous budget, number of samples per frame is limited
+            Ray::frame_budget_desc_t desc;
+            desc.budget_ms = 1000000.0f;
+            desc.max_samples = 8;
+            desc.max_frame_samples = 4;
+            Ray::FrameBudgetController controller(desc);
+
+            require(controller.RenderFrame(*renderer, *scene, region_ptrs, parallel_for));
+            require(controller.RenderFrame(*renderer, *scene, region_ptrs, parallel_for));
+            require(controller.stats().predicted_ms > 0.0f);
+            require(controller.stats().region_samples == 4 * TilesCount);
+            require(controller.stats().samples_per_second > 0.0);
+            require(controller.stats().overruns_count == 0);
+            for (const Ray::RegionContext &region : regions) {
+                require(region.iteration == 5);
+            }
+
+            // converged region is skipped
+            regions[3].active_pixels = 0;
+            require(controller.RenderFrame(*renderer, *scene, region_ptrs, parallel_for));
+            require(controller.stats().regions_skipped == 1);
+            require(regions[3].iteration == 5);
+
+            int frames_left = 10;
+            while (controller.RenderFrame(*renderer, *scene, region_ptrs, parallel_for)) {
+                require(--frames_left > 0);
+            }
+            require(controller.stats().regions_skipped == TilesCount);
+            for (int i = 0; i < TilesCount; ++i) {
+                require(regions[i].iteration == (i == 3 ? 5 : desc.max_samples));
+            }
+
+            // restarted accumulation is rendered again with known cost
+            restart();
+            require(controller.RenderFrame(*renderer, *scene, region_ptrs, parallel_for));
+            require(controller.stats().regions_rendered == TilesCount);
+            require(controller.stats().predicted_ms > 0.0f);
+        }
+    }
+
+    std::lock_guard<std::mutex> _(g_stdout_mtx);
+    printf("Test frame_budget       | OK\n");
+}
@@ -0,0 +1,96 @@
+#include "test_common.h"
+
+#include <cstdio>
+
+#include <memory>
+#include <mutex>
+
+#include "../Ray.h"
+
+#include "test_scene.h"
+
+extern std::mutex g_stdout_mtx;
+
+void test_geo_cam(const char *arch_list[], const char *preferred_device) {
+    // Single triangle that covers lower-left half of UV space
+    const float positions[] = {-1.0f, 0.0f, 1.0f, 1.0f, 0.0f, 1.0f, -1.0f, 0.0f, -1.0f};
+    const float normals[] = {0.0f, 1.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 1.0f, 0.0f};
+    const float uvs[] = {0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 1.0f};
+    const uint32_t indices[] = {0, 1, 2};
+
+    const int ImgRes = 32, SamplesCount = 4;
+
+    for (const char **arch = arch_list; *arch; ++arch) {
+        const auto rt = Ray::RendererTypeFromName(*arch);
+        if (!Ray::RendererSupportsMultithreading(rt)) {
+            // texel map is only used by CPU backends
+            continue;
+        }
+
+        Ray::settings_t s;
+        s.w = s.h = ImgRes;
+        s.preferred_device = preferred_device;
+
+        auto renderer = std::unique_ptr<Ray::RendererBase>(Ray::CreateRenderer(s, &g_log_err, rt));
+        if (!renderer || renderer->type() != rt) {
+            continue;
+        }
+        auto scene = std::unique_ptr<Ray::SceneBase>(renderer->CreateScene());
+
+        Ray::shading_node_desc_t mat_desc;
+        mat_desc.type = Ray::eShadingNode::Diffuse;
+        mat_desc.base_color[0] = mat_desc.base_color[1] = mat_desc.base_color[2] = 0.5f;
+        const Ray::MaterialHandle mat = scene->AddMaterial(mat_desc);
+
+        Ray::mesh_desc_t mesh_desc;
+        mesh_desc.prim_type = Ray::ePrimType::TriangleList;
+        mesh_desc.vtx_positions = {positions, 0, 3};
+        mesh_desc.vtx_normals = {normals, 0, 3};
+        mesh_desc.vtx_uvs = {uvs, 0, 2};
+        mesh_desc.vtx_indices = indices;
+
+        const Ray::mat_group_desc_t groups[] = {{mat, 0, 3}};
+        mesh_desc.groups = groups;
+
+        const Ray::MeshHandle mesh = scene->AddMesh(mesh_desc);
+
+        static const float identity[16] = {1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f,
+                                           0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f};
+        const Ray::MeshInstanceHandle mi = scene->AddMeshInstance(mesh, identity);
+
+        Ray::environment_desc_t env_desc;
+        env_desc.env_col[0] = env_desc.env_col[1] = env_desc.env_col[2] = 1.0f;
+        scene->SetEnvironment(env_desc);
+
+        Ray::camera_desc_t cam_desc;
+        cam_desc.type = Ray::eCamType::Geo;
+        cam_desc.mi_index = mi._index;
+        cam_desc.uv_index = 0;
+        scene->set_current_cam(scene->AddCamera(cam_desc));
+
+        scene->Finalize();
+
+        // texel map is built on the first iteration and reused after that
+        Ray::RegionContext region({0, 0, ImgRes, ImgRes});
+        for (int i = 0; i < SamplesCount; ++i) {
+            renderer->RenderScene(*scene, region);
+        }
+
+        const Ray::color_data_rgba_t raw = renderer->get_raw_pixels_ref();
+        for (int y = 0; y < ImgRes; ++y) {
+            for (int x = 0; x < ImgRes; ++x) {
+                const float *p = raw.ptr[y * raw.pitch + x].v;
+                if (x + 1 < y) {
+                    // lit by environment
+                    require(p[0] > 0.1f && p[1] > 0.1f && p[2] > 0.1f);
+                } else if (x > y + 1) {
+                    // uncovered texels stay black
+                    require(p[0] == 0.0f && p[1] == 0.0f && p[2] == 0.0f);
+                }
+            }
+        }
+    }
+
+    std::lock_guard<std::mutex> _(g_stdout_mtx);
+    printf("Test geo_cam            | OK\n");
+}
@@ -0,0 +1,125 @@
+#include "test_common.h"
+
+#include <cmath>
+#include <cstdio>
+
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "../Ray.h"
+
+#include "test_scene.h"
+
+extern std::mutex g_stdout_mtx;
+
+namespace {
+void setup_preview_scene(Ray::SceneBase &scene) {
+    Ray::camera_desc_t cam_desc;
+    cam_desc.origin[0] = 1.0f;
+    cam_desc.origin[1] = 1.5f;
+    cam_desc.origin[2] = 2.5f;
+    cam_desc.fwd[0] = -0.32f;
+    cam_desc.fwd[1] = -0.38f;
+    cam_desc.fwd[2] = -0.87f;
+    cam_desc.fov = 50.0f;
+    cam_desc.max_diff_depth = 2;
+    cam_desc.max_total_depth = 2;
+    setup_box_scene(scene, cam_desc);
+}
+} // namespace
+
+void test_preview(const char *arch_list[], const char *preferred_device) {
+    const int ImgRes = 64, SamplesCount = 4;
+
+    for (const char **arch = arch_list; *arch; ++arch) {
+        const auto rt = Ray::RendererTypeFromName(*arch);
+        if (!Ray::RendererSupportsMultithreading(rt)) {
+            // preview is only implemented for CPU backends
+            continue;
+        }
+
+        Ray::settings_t s;
+        s.w = s.h = ImgRes;
+        s.preferred_device = preferred_device;
+
+        // odd split makes blocks cross region borders
+        const Ray::rect_t rects[] = {{0, 0, 37, ImgRes}, {37, 0, ImgRes - 37, ImgRes}};
+
+        std::vector<float> reference, preview;
+        { // plain accumulation
+            auto renderer = std::unique_ptr<Ray::RendererBase>(Ray::CreateRenderer(s, &g_log_err, rt));
+            if (!renderer || renderer->type() != rt) {
+                continue;
+            }
+            auto scene = std::unique_ptr<Ray::SceneBase>(renderer->CreateScene());
+            setup_preview_scene(*scene);
+
+            Ray::RegionContext regions[] = {Ray::RegionContext{rects[0]}, Ray::RegionContext{rects[1]}};
+            for (int i = 0; i < SamplesCount; ++i) {
+                for (Ray::RegionContext &region : regions) {
+                    renderer->RenderScene(*scene, region);
+                }
+            }
+            read_pixels(*renderer, ImgRes, reference);
+        }
+
+        s.preview_levels = 2;
+        { // every level gets single frame
+            auto renderer = std::unique_ptr<Ray::RendererBase>(Ray::CreateRenderer(s, &g_log_err, rt));
+            auto scene = std::unique_ptr<Ray::SceneBase>(renderer->CreateScene());
+            setup_preview_scene(*scene);
+
+            Ray::RegionContext regions[] = {Ray::RegionContext{rects[0]}, Ray::RegionContext{rects[1]}};
+            for (int level = 2; level > 0; --level) {
+                for (Ray::RegionContext &region : regions) {
+                    renderer->RenderScene(*scene, region);
+                    require(region.iteration == 0);
+                    require(region.preview_level == level - 1);
+                }
+
+                // whole image is covered already (only few pixels in contact shadow may stay black)
+                read_pixels(*renderer, ImgRes, preview);
+                int black_count = 0;
+                for (const float v : preview) {
+                    require(std::isfinite(v) && v >= 0.0f);
+                    black_count += (v == 0.0f) ? 1 : 0;
+                }
+                require(black_count < int(preview.size() / 20));
+            }
+
+            // preview samples do not leak into accumulation
+            for (int i = 0; i < SamplesCount; ++i) {
+                for (Ray::RegionContext &region : regions) {
+                    renderer->RenderScene(*scene, region);
+                }
+            }
+            require(regions[0].iteration == SamplesCount && regions[1].iteration == SamplesCount);
+            read_pixels(*renderer, ImgRes, preview);
+            require(preview == reference);
+        }
+
+        s.preview_budget_ms = 0.001f;
+        { // coarsest level is kept while budget is exceeded
+            auto renderer = std::unique_ptr<Ray::RendererBase>(Ray::CreateRenderer(s, &g_log_err, rt));
+            auto scene = std::unique_ptr<Ray::SceneBase>(renderer->CreateScene());
+            setup_preview_scene(*scene);
+
+            Ray::RegionContext region({0, 0, ImgRes, ImgRes});
+            for (int i = 1; i < 4; ++i) {
+                renderer->RenderScene(*scene, region);
+                require(region.preview_level == 2 && region.preview_iteration == i);
+            }
+            // after four samples finer level is not more expensive
+            renderer->RenderScene(*scene, region);
+            require(region.preview_level == 1 && region.preview_iteration == 0);
+
+            region.Clear();
+            renderer->RenderScene(*scene, region);
+            require(region.preview_level == 2 && region.preview_iteration == 1);
+        }
+    }
+
+    std::lock_guard<std::mutex> _(g_stdout_mtx);
+    printf("Test preview            | OK\n");
+}
@@ -0,0 +1,190 @@
+#include "test_common.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "../Ray.h"
+
+#include "test_scene.h"
+
+extern std::mutex g_stdout_mtx;
+
+namespace {
+struct primary_cache_scene_t {
+    Ray::MeshInstanceHandle sphere;
+    Ray::MaterialHandle sphere_mat;
+};
+
+Ray::shading_node_desc_t sphere_mat_desc(const bool transparent) {
+    Ray::shading_node_desc_t mat_desc;
+    mat_desc.type = transparent ? Ray::eShadingNode::Transparent : Ray::eShadingNode::Diffuse;
+    mat_desc.base_color[0] = 0.2f;
+    mat_desc.base_color[1] = 0.5f;
+    mat_desc.base_color[2] = 0.8f;
+    return mat_desc;
+}
+
+primary_cache_scene_t setup_primary_cache_scene(Ray::SceneBase &scene, const float env_col[3],
+                                                const bool transparent_spheres) {
+    primary_cache_scene_t ret;
+    ret.sphere_mat = scene.AddMaterial(sphere_mat_desc(transparent_spheres));
+
+    const Ray::MeshHandle sphere_mesh = add_sphere_mesh(scene, ret.sphere_mat, 16, 8, 0.5f);
+    for (int x = 0; x < 3; ++x) {
+        const float xform[16] = {1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f,
+                                 0.0f, -1.2f + 1.2f * float(x), 0.5f, -0.5f * float(x), 1.0f};
+        ret.sphere = scene.AddMeshInstance(sphere_mesh, xform);
+    }
+
+    // floor and semi-transparent plane (its hits are never cached)
+    add_floor_and_glass(scene, scene.AddMaterial(sphere_mat_desc(false)), 0.8f);
+
+    Ray::environment_desc_t env_desc;
+    memcpy(env_desc.env_col, env_col, 3 * sizeof(float));
+    scene.SetEnvironment(env_desc);
+
+    Ray::camera_desc_t cam_desc;
+    cam_desc.origin[1] = 1.5f;
+    cam_desc.origin[2] = 3.0f;
+    cam_desc.fwd[1] = -0.37139067f;
+    cam_desc.fwd[2] = -0.92847669f;
+    cam_desc.fov = 60.0f;
+    cam_desc.max_diff_depth = 2;
+    cam_desc.max_total_depth = 2;
+    scene.set_current_cam(scene.AddCamera(cam_desc));
+
+    scene.Finalize();
+
+    return ret;
+}
+
+void accumulate(Ray::RendererBase &renderer, const Ray::SceneBase &scene, const int res, const int samples,
+                std::vector<float> &out_pixels, unsigned long long &out_primary_trace_us) {
+    renderer.ResetStats();
+
+    Ray::RegionContext region({0, 0, res, res});
+    for (int i = 0; i < samples; ++i) {
+        renderer.RenderScene(scene, region);
+    }
+
+    Ray::RendererBase::stats_t st;
+    renderer.GetStats(st);
+    out_primary_trace_us = st.time_primary_trace_us;
+
+    out_pixels.clear();
+    const Ray::color_data_rgba_t raw = renderer.get_raw_pixels_ref();
+    for (int y = 0; y < res; ++y) {
+        for (int x = 0; x < res; ++x) {
+            const float *p = raw.ptr[y * raw.pitch + x].v;
+            out_pixels.insert(end(out_pixels), p, p + 3);
+        }
+    }
+}
+
+int count_mismatches(const std::vector<float> &ref, const std::vector<float> &val) {
+    int mismatched_count = 0;
+    for (size_t i = 0; i < ref.size(); ++i) {
+        if (fabsf(ref[i] - val[i]) > 1e-4f * std::max(1.0f, fabsf(ref[i]))) {
+            ++mismatched_count;
+        }
+    }
+    return mismatched_count;
+}
+} // namespace
+
+void test_primary_cache(const char *arch_list[], const char *preferred_device) {
+    std::string details;
+
+    const int ImgRes = 64, SamplesCount = 8;
+    const float EnvCol1[3] = {1.0f, 1.0f, 1.0f}, EnvCol2[3] = {0.2f, 0.4f, 1.5f};
+    const float MovedXform[16] = {1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f,
+                                  0.0f, 0.0f, 1.0f, 0.0f, 0.6f, 0.8f, -0.2f, 1.0f};
+
+    for (const char **arch = arch_list; *arch; ++arch) {
+        const auto rt = Ray::RendererTypeFromName(*arch);
+        if (!Ray::RendererSupportsMultithreading(rt)) {
+            // hit cache is only implemented for CPU backends
+            continue;
+        }
+
+        Ray::settings_t s;
+        s.w = s.h = ImgRes;
+        s.preferred_device = preferred_device;
+
+        // renderer without cache is recreated for every reference image
+        const auto render_reference = [&](const float env_col[3], const bool move_sphere, const bool transparent_spheres,
+                                          std::vector<float> &out) {
+            auto renderer = std::unique_ptr<Ray::RendererBase>(Ray::CreateRenderer(s, &g_log_err, rt));
+            auto scene = std::unique_ptr<Ray::SceneBase>(renderer->CreateScene());
+            const primary_cache_scene_t sc = setup_primary_cache_scene(*scene, env_col, transparent_spheres);
+            if (move_sphere) {
+                scene->SetMeshInstanceTransform(sc.sphere, MovedXform);
+                scene->Finalize();
+            }
+            unsigned long long trace_us = 0;
+            accumulate(*renderer, *scene, ImgRes, SamplesCount, out, trace_us);
+        };
+
+        s.primary_hit_cache_samples = SamplesCount;
+        auto renderer = std::unique_ptr<Ray::RendererBase>(Ray::CreateRenderer(s, &g_log_err, rt));
+        if (!renderer || renderer->type() != rt) {
+            continue;
+        }
+        s.primary_hit_cache_samples = 0;
+
+        auto scene = std::unique_ptr<Ray::SceneBase>(renderer->CreateScene());
+        const primary_cache_scene_t sc = setup_primary_cache_scene(*scene, EnvCol1, false);
+
+        std::vector<float> first, relit, moved, swapped, reference;
+        unsigned long long first_us = 0, relit_us = 0, moved_us = 0, swapped_us = 0;
+        accumulate(*renderer, *scene, ImgRes, SamplesCount, first, first_us);
+
+        { // lighting change reshades cached hits
+            Ray::environment_desc_t env_desc;
+            memcpy(env_desc.env_col, EnvCol2, 3 * sizeof(float));
+            scene->SetEnvironment(env_desc);
+            scene->Finalize();
+
+            accumulate(*renderer, *scene, ImgRes, SamplesCount, relit, relit_us);
+            render_reference(EnvCol2, false, false, reference);
+            require(count_mismatches(reference, relit) <= int(reference.size() / 1000));
+            require(count_mismatches(first, relit) > int(first.size() / 2));
+        }
+
+        { // geometry change invalidates cache
+            scene->SetMeshInstanceTransform(sc.sphere, MovedXform);
+            scene->Finalize();
+
+            accumulate(*renderer, *scene, ImgRes, SamplesCount, moved, moved_us);
+            render_reference(EnvCol2, true, false, reference);
+            require(count_mismatches(reference, moved) <= int(reference.size() / 1000));
+            require(count_mismatches(relit, moved) > 0);
+        }
+
+        { // material slot reused by transparent material, cached hits on spheres become invalid
+            scene->RemoveMaterial(sc.sphere_mat);
+            require(scene->AddMaterial(sphere_mat_desc(true)) == sc.sphere_mat);
+            scene->Finalize();
+
+            accumulate(*renderer, *scene, ImgRes, SamplesCount, swapped, swapped_us);
+            render_reference(EnvCol2, true, true, reference);
+            require(count_mismatches(reference, swapped) <= int(reference.size() / 1000));
+            require(count_mismatches(moved, swapped) > 0);
+        }
+
+        char buf[128];
+        snprintf(buf, sizeof(buf), "(%s: trace %.2fms, cached %.2fms) ", *arch, double(first_us) * 1e-3,
+                 double(relit_us) * 1e-3);
+        details += buf;
+    }
+
+    std::lock_guard<std::mutex> _(g_stdout_mtx);
+    printf("Test primary_cache      | %sOK\n", details.c_str());
+}
@@ -0,0 +1,181 @@
+#include "test_common.h"
+
+#include <cmath>
+#include <cstdio>
+
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "../Ray.h"
+
+#include "test_scene.h"
+
+extern std::mutex g_stdout_mtx;
+
+namespace {
+struct ray_sort_policy_t {
+    const char *name;
+    bool enabled;
+    int origin_bits, dir_bits;
+};
+
+struct ray_sort_result_t {
+    std::vector<float> pixels;
+    unsigned long long sort_us[4] = {}, trace_us[4] = {};
+};
+
+void setup_ray_sort_scene(Ray::SceneBase &scene) {
+    // Grid of spheres inside of open box, diffuse interreflections produce incoherent secondary rays
+    Ray::shading_node_desc_t mat_desc;
+    mat_desc.type = Ray::eShadingNode::Diffuse;
+    mat_desc.base_color[0] = mat_desc.base_color[1] = mat_desc.base_color[2] = 0.8f;
+    const Ray::MaterialHandle mat = scene.AddMaterial(mat_desc);
+
+    const Ray::MeshHandle sphere_mesh = add_sphere_mesh(scene, mat, 24, 12, 0.4f);
+
+    for (int z = 0; z < 4; ++z) {
+        for (int x = 0; x < 4; ++x) {
+            const float xform[16] = {1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f,
+                                     -1.5f + float(x), 0.4f, -1.5f + float(z), 1.0f};
+            scene.AddMeshInstance(sphere_mesh, xform);
+        }
+    }
+
+    // floor and three walls
+    const float box_positions[] = {-3.0f, 0.0f, -3.0f, 3.0f, 0.0f, -3.0f, -3.0f, 0.0f, 3.0f, 3.0f, 0.0f, 3.0f,
+                                   -3.0f, 3.0f, -3.0f, 3.0f, 3.0f, -3.0f, -3.0f, 3.0f, 3.0f, 3.0f, 3.0f, 3.0f};
+    const float box_normals[] = {0.0f, 1.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 1.0f, 0.0f,
+                                 0.0f, 1.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 1.0f, 0.0f};
+    const float box_uvs[16] = {};
+    const uint32_t box_indices[] = {0, 2, 1, 1, 2, 3, 0, 1, 4, 4, 1, 5, 0, 4, 2, 2, 4, 6, 1, 3, 5, 5, 3, 7};
+
+    Ray::mesh_desc_t box_desc;
+    box_desc.prim_type = Ray::ePrimType::TriangleList;
+    box_desc.vtx_positions = {box_positions, 0, 3};
+    box_desc.vtx_normals = {box_normals, 0, 3};
+    box_desc.vtx_uvs = {box_uvs, 0, 2};
+    box_desc.vtx_indices = box_indices;
+
+    const Ray::mat_group_desc_t box_groups[] = {{mat, 0, 24}};
+    box_desc.groups = box_groups;
+
+    static const float identity[16] = {1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f,
+                                       0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f};
+    scene.AddMeshInstance(scene.AddMesh(box_desc), identity);
+
+    Ray::environment_desc_t env_desc;
+    env_desc.env_col[0] = env_desc.env_col[1] = env_desc.env_col[2] = 1.0f;
+    scene.SetEnvironment(env_desc);
+
+    Ray::camera_desc_t cam_desc;
+    cam_desc.filter = Ray::ePixelFilter::Box;
+    cam_desc.origin[1] = 2.0f;
+    cam_desc.origin[2] = 5.0f;
+    cam_desc.fwd[1] = -0.37139067f;
+    cam_desc.fwd[2] = -0.92847669f;
+    cam_desc.fov = 50.0f;
+    cam_desc.max_diff_depth = 4;
+    cam_desc.max_total_depth = 4;
+    scene.set_current_cam(scene.AddCamera(cam_desc));
+
+    scene.Finalize();
+}
+} // namespace
+
+void test_ray_sort(const char *arch_list[], const char *preferred_device) {
+    std::string details;
+
+    const int ImgRes = 64, SamplesCount = 16;
+
+    // last policy is out of range and gets clamped by renderer
+    const ray_sort_policy_t Policies[] = {{"off", false, 0, 0},
+                                          {"default", true, 8, 4},
+                                          {"origin", true, 8, 0},
+                                          {"dir", true, 0, 8},
+                                          {"clamped", true, 9, 9}};
+    const int PoliciesCount = int(sizeof(Policies) / sizeof(Policies[0]));
+
+    for (const char **arch = arch_list; *arch; ++arch) {
+        const auto rt = Ray::RendererTypeFromName(*arch);
+        if (!Ray::RendererSupportsMultithreading(rt)) {
+            // sorting policy only affects CPU backends
+            continue;
+        }
+
+        ray_sort_result_t results[PoliciesCount];
+
+        for (int i = 0; i < PoliciesCount; ++i) {
+            Ray::settings_t s;
+            s.w = s.h = ImgRes;
+            s.preferred_device = preferred_device;
+            s.use_ray_sort = Policies[i].enabled;
+            s.ray_sort_origin_bits = Policies[i].origin_bits;
+            s.ray_sort_dir_bits = Policies[i].dir_bits;
+
+            auto renderer = std::unique_ptr<Ray::RendererBase>(Ray::CreateRenderer(s, &g_log_err, rt));
+            if (!renderer || renderer->type() != rt) {
+                break;
+            }
+            auto scene = std::unique_ptr<Ray::SceneBase>(renderer->CreateScene());
+            setup_ray_sort_scene(*scene);
+
+            Ray::RegionContext region({0, 0, ImgRes, ImgRes});
+            for (int j = 0; j < SamplesCount; ++j) {
+                renderer->RenderScene(*scene, region);
+            }
+
+            Ray::RendererBase::stats_t st;
+            renderer->GetStats(st);
+            for (int b = 0; b < 4; ++b) {
+                results[i].sort_us[b] = st.secondary_bounce_sort_us[b];
+                results[i].trace_us[b] = st.secondary_bounce_trace_us[b];
+            }
+
+            const Ray::color_data_rgba_t raw = renderer->get_raw_pixels_ref();
+            for (int y = 0; y < ImgRes; ++y) {
+                for (int x = 0; x < ImgRes; ++x) {
+                    const float *p = raw.ptr[y * raw.pitch + x].v;
+                    results[i].pixels.insert(end(results[i].pixels), p, p + 3);
+                }
+            }
+        }
+
+        if (results[PoliciesCount - 1].pixels.empty()) {
+            continue;
+        }
+
+        // order of rays must not affect the result
+        for (int i = 1; i < PoliciesCount; ++i) {
+            for (size_t j = 0; j < results[0].pixels.size(); ++j) {
+                const float ref = results[0].pixels[j], val = results[i].pixels[j];
+                require(fabsf(ref - val) <= 1e-4f * std::max(1.0f, fabsf(ref)));
+            }
+        }
+
+        // sorting pays for itself when saved traversal time exceeds its own cost
+        char buf[64];
+        snprintf(buf, sizeof(buf), "(%s:", *arch);
+        details += buf;
+        for (int i = 1; i < PoliciesCount - 1; ++i) {
+            snprintf(buf, sizeof(buf), " %s [", Policies[i].name);
+            details += buf;
+            for (int b = 0; b < 4; ++b) {
+                // speedup of traversal and sorting time relative to traversal time of unsorted rays
+                const double trace_speedup =
+                    results[i].trace_us[b] ? double(results[0].trace_us[b]) / double(results[i].trace_us[b]) : 1.0;
+                const double sort_cost =
+                    results[0].trace_us[b] ? double(results[i].sort_us[b]) / double(results[0].trace_us[b]) : 0.0;
+                snprintf(buf, sizeof(buf), b ? " %.2fx/%.0f%%" : "%.2fx/%.0f%%", trace_speedup, 100.0 * sort_cost);
+                details += buf;
+            }
+            details += "]";
+        }
+        details += ") ";
+    }
+
+    std::lock_guard<std::mutex> _(g_stdout_mtx);
+    printf("Test ray_sort           | %sOK\n", details.c_str());
+}
@@ -0,0 +1,122 @@
+#include "test_common.h"
+
+#include <cmath>
+#include <cstdio>
+
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "../Ray.h"
+
+#include "test_scene.h"
+
+extern std::mutex g_stdout_mtx;
+
+namespace {
+double mean_error(const std::vector<float> &pixels, const std::vector<float> &reference) {
+    double error = 0.0;
+    for (size_t i = 0; i < pixels.size(); ++i) {
+        error += std::abs(double(pixels[i]) - double(reference[i]));
+    }
+    return error / double(pixels.size());
+}
+} // namespace
+
+void test_reprojection(const char *arch_list[], const char *preferred_device) {
+    const int ImgRes = 64, HistorySamples = 16, ReferenceSamples = 64;
+
+    Ray::camera_desc_t cam_desc;
+    cam_desc.origin[0] = 1.0f;
+    cam_desc.origin[1] = 1.5f;
+    cam_desc.origin[2] = 2.5f;
+    cam_desc.fwd[0] = -0.32f;
+    cam_desc.fwd[1] = -0.38f;
+    cam_desc.fwd[2] = -0.87f;
+    cam_desc.fov = 50.0f;
+    cam_desc.max_diff_depth = 2;
+    cam_desc.max_total_depth = 2;
+
+    // small sideways step, most of the image stays visible
+    Ray::camera_desc_t moved_cam_desc = cam_desc;
+    moved_cam_desc.origin[0] = 1.1f;
+
+    for (const char **arch = arch_list; *arch; ++arch) {
+        const auto rt = Ray::RendererTypeFromName(*arch);
+        if (!Ray::RendererSupportsMultithreading(rt)) {
+            // reprojection is only implemented for CPU backends
+            continue;
+        }
+
+        Ray::settings_t s;
+        s.w = s.h = ImgRes;
+        s.preferred_device = preferred_device;
+
+        std::vector<float> reference, noisy;
+        { // converged and single-sample images of moved view
+            auto renderer = std::unique_ptr<Ray::RendererBase>(Ray::CreateRenderer(s, &g_log_err, rt));
+            if (!renderer || renderer->type() != rt) {
+                continue;
+            }
+            auto scene = std::unique_ptr<Ray::SceneBase>(renderer->CreateScene());
+            setup_box_scene(*scene, moved_cam_desc);
+
+            Ray::RegionContext region({0, 0, ImgRes, ImgRes});
+            renderer->RenderScene(*scene, region);
+            read_pixels(*renderer, ImgRes, noisy);
+            for (int i = 1; i < ReferenceSamples; ++i) {
+                renderer->RenderScene(*scene, region);
+            }
+            read_pixels(*renderer, ImgRes, reference);
+        }
+
+        s.reprojection_max_samples = HistorySamples;
+
+        std::vector<float> reprojected;
+        { // history of previous view is carried over
+            auto renderer = std::unique_ptr<Ray::RendererBase>(Ray::CreateRenderer(s, &g_log_err, rt));
+            auto scene = std::unique_ptr<Ray::SceneBase>(renderer->CreateScene());
+            setup_box_scene(*scene, cam_desc);
+
+            Ray::RegionContext region({0, 0, ImgRes, ImgRes});
+            for (int i = 0; i < HistorySamples; ++i) {
+                renderer->RenderScene(*scene, region);
+            }
+
+            scene->SetCamera(scene->current_cam(), moved_cam_desc);
+            renderer->Clear({});
+            region.Clear();
+
+            renderer->RenderScene(*scene, region);
+            require(region.iteration == 1);
+            read_pixels(*renderer, ImgRes, reprojected);
+            for (const float v : reprojected) {
+                require(std::isfinite(v) && v >= 0.0f);
+            }
+            require(mean_error(reprojected, reference) < 0.5 * mean_error(noisy, reference));
+        }
+
+        { // history is dropped when scene is changed
+            auto renderer = std::unique_ptr<Ray::RendererBase>(Ray::CreateRenderer(s, &g_log_err, rt));
+            auto scene = std::unique_ptr<Ray::SceneBase>(renderer->CreateScene());
+            setup_box_scene(*scene, cam_desc);
+
+            Ray::RegionContext region({0, 0, ImgRes, ImgRes});
+            for (int i = 0; i < HistorySamples; ++i) {
+                renderer->RenderScene(*scene, region);
+            }
+
+            scene->SetCamera(scene->current_cam(), moved_cam_desc);
+            scene->Finalize();
+            renderer->Clear({});
+            region.Clear();
+
+            renderer->RenderScene(*scene, region);
+            read_pixels(*renderer, ImgRes, reprojected);
+            require(reprojected == noisy);
+        }
+    }
+
+    std::lock_guard<std::mutex> _(g_stdout_mtx);
+    printf("Test reprojection       | OK\n");
+}
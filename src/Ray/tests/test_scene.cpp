@@ -1,5 +1,6 @@
 #include "test_scene.h"
 
+#include <cmath>
 #include <cstring>
 
 #include "test_common.h"
@@ -1184,3 +1185,163 @@ void schedule_render_jobs(ThreadPool &threads, Ray::RendererBase &renderer, cons
         }
     }
 }
+
+void setup_box_scene(Ray::SceneBase &scene, const Ray::camera_desc_t &cam_desc) {
+    // Box standing on a floor, lit by white environment
+    const float positions[] = {-0.5f, 0.0f, -0.5f, 0.5f, 0.0f, -0.5f, 0.5f, 1.0f, -0.5f, -0.5f, 1.0f, -0.5f,
+                               -0.5f, 0.0f, 0.5f,  0.5f, 0.0f, 0.5f,  0.5f, 1.0f, 0.5f,  -0.5f, 1.0f, 0.5f};
+    const float normals[] = {-0.57f, -0.57f, -0.57f, 0.57f, -0.57f, -0.57f, 0.57f, 0.57f, -0.57f, -0.57f, 0.57f, -0.57f,
+                             -0.57f, -0.57f, 0.57f,  0.57f, -0.57f, 0.57f,  0.57f, 0.57f, 0.57f,  -0.57f, 0.57f, 0.57f};
+    const float uvs[16] = {};
+    const uint32_t indices[] = {0, 2, 1, 0, 3, 2, 4, 5, 6, 4, 6, 7, 0, 4, 7, 0, 7, 3,
+                                1, 2, 6, 1, 6, 5, 3, 7, 6, 3, 6, 2, 0, 1, 5, 0, 5, 4};
+
+    Ray::shading_node_desc_t mat_desc;
+    mat_desc.type = Ray::eShadingNode::Diffuse;
+    mat_desc.base_color[0] = 0.8f;
+    mat_desc.base_color[1] = 0.3f;
+    mat_desc.base_color[2] = 0.3f;
+    const Ray::MaterialHandle box_mat = scene.AddMaterial(mat_desc);
+    mat_desc.base_color[0] = mat_desc.base_color[1] = mat_desc.base_color[2] = 0.5f;
+    const Ray::MaterialHandle floor_mat = scene.AddMaterial(mat_desc);
+
+    Ray::mesh_desc_t box_desc;
+    box_desc.prim_type = Ray::ePrimType::TriangleList;
+    box_desc.vtx_positions = {positions, 0, 3};
+    box_desc.vtx_normals = {normals, 0, 3};
+    box_desc.vtx_uvs = {uvs, 0, 2};
+    box_desc.vtx_indices = indices;
+
+    const Ray::mat_group_desc_t box_groups[] = {{box_mat, 0, 36}};
+    box_desc.groups = box_groups;
+    const Ray::MeshHandle box_mesh = scene.AddMesh(box_desc);
+
+    const float floor_positions[] = {-4.0f, 0.0f, -4.0f, 4.0f, 0.0f, -4.0f, -4.0f, 0.0f, 4.0f, 4.0f, 0.0f, 4.0f};
+    const float floor_normals[] = {0.0f, 1.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 1.0f, 0.0f};
+    const uint32_t floor_indices[] = {0, 2, 1, 1, 2, 3};
+
+    Ray::mesh_desc_t floor_desc;
+    floor_desc.prim_type = Ray::ePrimType::TriangleList;
+    floor_desc.vtx_positions = {floor_positions, 0, 3};
+    floor_desc.vtx_normals = {floor_normals, 0, 3};
+    floor_desc.vtx_uvs = {uvs, 0, 2};
+    floor_desc.vtx_indices = floor_indices;
+
+    const Ray::mat_group_desc_t floor_groups[] = {{floor_mat, 0, 6}};
+    floor_desc.groups = floor_groups;
+    const Ray::MeshHandle floor_mesh = scene.AddMesh(floor_desc);
+
+    static const float identity[16] = {1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f,
+                                       0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f};
+    scene.AddMeshInstance(box_mesh, identity);
+    scene.AddMeshInstance(floor_mesh, identity);
+
+    Ray::environment_desc_t env_desc;
+    env_desc.env_col[0] = env_desc.env_col[1] = env_desc.env_col[2] = 1.0f;
+    scene.SetEnvironment(env_desc);
+
+    scene.set_current_cam(scene.AddCamera(cam_desc));
+
+    scene.Finalize();
+}
+
+void read_pixels(const Ray::RendererBase &renderer, const int res, std::vector<float> &out_pixels) {
+    out_pixels.clear();
+    const Ray::color_data_rgba_t raw = renderer.get_raw_pixels_ref();
+    for (int y = 0; y < res; ++y) {
+        for (int x = 0; x < res; ++x) {
+            const float *p = raw.ptr[y * raw.pitch + x].v;
+            out_pixels.insert(end(out_pixels), p, p + 3);
+        }
+    }
+}
+
+Ray::MeshHandle add_sphere_mesh(Ray::SceneBase &scene, const Ray::MaterialHandle mat, const int segments_x,
+                                const int segments_y, const float radius) {
+    std::vector<float> positions, normals, uvs;
+    std::vector<uint32_t> indices;
+    for (int j = 0; j <= segments_y; ++j) {
+        const float theta = 3.14159265f * float(j) / float(segments_y);
+        for (int i = 0; i <= segments_x; ++i) {
+            const float phi = 2.0f * 3.14159265f * float(i) / float(segments_x);
+            const float n[3] = {sinf(theta) * cosf(phi), cosf(theta), sinf(theta) * sinf(phi)};
+            positions.insert(end(positions), {radius * n[0], radius * n[1], radius * n[2]});
+            normals.insert(end(normals), n, n + 3);
+            uvs.push_back(float(i) / float(segments_x));
+            uvs.push_back(float(j) / float(segments_y));
+        }
+    }
+    for (int j = 0; j < segments_y; ++j) {
+        for (int i = 0; i < segments_x; ++i) {
+            const uint32_t i0 = j * (segments_x + 1) + i, i1 = i0 + 1, i2 = i0 + segments_x + 1, i3 = i2 + 1;
+            indices.insert(end(indices), {i0, i1, i2, i2, i1, i3});
+        }
+    }
+
+    Ray::mesh_desc_t sphere_desc;
+    sphere_desc.prim_type = Ray::ePrimType::TriangleList;
+    sphere_desc.vtx_positions = {positions, 0, 3};
+    sphere_desc.vtx_normals = {normals, 0, 3};
+    sphere_desc.vtx_uvs = {uvs, 0, 2};
+    sphere_desc.vtx_indices = indices;
+
+    const Ray::mat_group_desc_t groups[] = {{mat, 0, indices.size()}};
+    sphere_desc.groups = groups;
+
+    return scene.AddMesh(sphere_desc);
+}
+
+Ray::MeshHandle add_quad_mesh(Ray::SceneBase &scene, const Ray::MaterialHandle mat) {
+    const float positions[] = {-1.0f, 0.0f, -1.0f, 1.0f, 0.0f, -1.0f, -1.0f, 0.0f, 1.0f, 1.0f, 0.0f, 1.0f};
+    const float normals[] = {0.0f, 1.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 1.0f, 0.0f};
+    const float uvs[] = {0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 1.0f, 1.0f, 1.0f};
+    const uint32_t indices[] = {0, 2, 1, 1, 2, 3};
+
+    Ray::mesh_desc_t quad_desc;
+    quad_desc.prim_type = Ray::ePrimType::TriangleList;
+    quad_desc.vtx_positions = {positions, 0, 3};
+    quad_desc.vtx_normals = {normals, 0, 3};
+    quad_desc.vtx_uvs = {uvs, 0, 2};
+    quad_desc.vtx_indices = indices;
+
+    const Ray::mat_group_desc_t groups[] = {{mat, 0, 6}};
+    quad_desc.groups = groups;
+
+    return scene.AddMesh(quad_desc);
+}
+
+void add_floor_and_glass(Ray::SceneBase &scene, const Ray::MaterialHandle floor_mat, const float glass_z) {
+    Ray::shading_node_desc_t transp_desc;
+    transp_desc.type = Ray::eShadingNode::Transparent;
+    transp_desc.base_color[0] = transp_desc.base_color[1] = transp_desc.base_color[2] = 0.5f;
+    const Ray::MaterialHandle transp_mat = scene.AddMaterial(transp_desc);
+
+    const float floor_xform[16] = {4.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f,
+                                   0.0f, 0.0f, 4.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f};
+    scene.AddMeshInstance(add_quad_mesh(scene, floor_mat), floor_xform);
+
+    // quad is rotated to face +Z
+    const float glass_xform[16] = {1.0f, 0.0f, 0.0f, 0.0f, 0.0f,  0.0f, 1.0f,    0.0f,
+                                   0.0f, 1.0f, 0.0f, 0.0f, -1.0f, 1.0f, glass_z, 1.0f};
+    scene.AddMeshInstance(add_quad_mesh(scene, transp_mat), glass_xform);
+}
+
+void setup_sphere_scene(Ray::SceneBase &scene, const int segments_x, const int segments_y,
+                        const Ray::camera_desc_t &cam_desc) {
+    Ray::shading_node_desc_t mat_desc;
+    mat_desc.type = Ray::eShadingNode::Diffuse;
+    mat_desc.base_color[0] = mat_desc.base_color[1] = mat_desc.base_color[2] = 0.5f;
+    const Ray::MaterialHandle mat = scene.AddMaterial(mat_desc);
+
+    static const float identity[16] = {1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f,
+                                       0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f};
+    scene.AddMeshInstance(add_sphere_mesh(scene, mat, segments_x, segments_y, 1.0f), identity);
+
+    Ray::environment_desc_t env_desc;
+    env_desc.env_col[0] = env_desc.env_col[1] = env_desc.env_col[2] = 1.0f;
+    scene.SetEnvironment(env_desc);
+
+    scene.set_current_cam(scene.AddCamera(cam_desc));
+
+    scene.Finalize();
+}
@@ -5,8 +5,10 @@
 
 #include <atomic>
 #include <mutex>
+#include <vector>
 
 #include "../Log.h"
+#include "../SceneBase.h"
 
 enum class eTestScene {
     Standard,
@@ -36,6 +38,7 @@ namespace Ray {
 class RendererBase;
 class SceneBase;
 
+struct camera_desc_t;
 struct settings_t;
 } // namespace Ray
 
@@ -80,4 +83,19 @@ void setup_test_scene(ThreadPool &threads, Ray::SceneBase &scene, int min_sample
 
 void schedule_render_jobs(ThreadPool &threads, Ray::RendererBase &renderer, const Ray::SceneBase *scene,
                           const Ray::settings_t &settings, int max_samples, eDenoiseMethod denoise, bool partial,
-                          const char *log_str);
\ No newline at end of file
+                          const char *log_str);
+
+// Small scene with diffuse box on a floor, used by tests that compare images of nearby views
+void setup_box_scene(Ray::SceneBase &scene, const Ray::camera_desc_t &cam_desc);
+// RGB values of top-left res x res pixels of accumulated image
+void read_pixels(const Ray::RendererBase &renderer, int res, std::vector<float> &out_pixels);
+
+// UV sphere centered at origin
+Ray::MeshHandle add_sphere_mesh(Ray::SceneBase &scene, Ray::MaterialHandle mat, int segments_x, int segments_y,
+                                float radius);
+// Quad that spans [-1; 1] in XZ plane and faces +Y
+Ray::MeshHandle add_quad_mesh(Ray::SceneBase &scene, Ray::MaterialHandle mat);
+// Floor of 8x8 units and vertical semi-transparent plane at given depth (covers left part of the view)
+void add_floor_and_glass(Ray::SceneBase &scene, Ray::MaterialHandle floor_mat, float glass_z);
+// Single diffuse sphere of unit radius lit by white environment
+void setup_sphere_scene(Ray::SceneBase &scene, int segments_x, int segments_y, const Ray::camera_desc_t &cam_desc);
\ No newline at end of file
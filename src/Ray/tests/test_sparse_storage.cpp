@@ -163,5 +163,50 @@ void test_sparse_storage() {
         s1.clear();
     }
 
+    { // Serialization
+        Ray::Cpu::SparseStorage<int> s1;
+
+        std::vector<std::pair<uint32_t, uint32_t>> allocs;
+        for (int i = 0; i < 100; i++) {
+            allocs.push_back(s1.Allocate(i + 1, i));
+        }
+        for (int i = 0; i < 100; i += 3) {
+            s1.Erase(allocs[i].second);
+        }
+
+        std::vector<uint8_t> blob;
+        Ray::BinaryWriter out(blob);
+        s1.Serialize(out);
+
+        Ray::Cpu::SparseStorage<int> s2;
+        Ray::BinaryReader in(blob);
+        require(s2.Deserialize(in));
+        require(in.at_end());
+        require(s2.IntegrityCheck());
+        require(s2.size() == s1.size());
+        require(s2.capacity() == s1.capacity());
+
+        for (int i = 0; i < 100; i++) {
+            if ((i % 3) == 0) {
+                continue;
+            }
+            require(s2.GetCount(allocs[i].second) == uint32_t(i + 1));
+            for (int j = 0; j < i + 1; ++j) {
+                require(s2[allocs[i].first + j] == i);
+            }
+        }
+
+        // blocks must remain valid
+        for (int i = 1; i < 100; i += 3) {
+            s2.Erase(allocs[i].second);
+            require(s2.IntegrityCheck());
+        }
+        const std::pair<uint32_t, uint32_t> new_alloc = s2.Allocate(8, 42);
+        require(s2.IntegrityCheck());
+        for (uint32_t j = 0; j < 8; ++j) {
+            require(s2[new_alloc.first + j] == 42);
+        }
+    }
+
     printf("OK\n");
 }
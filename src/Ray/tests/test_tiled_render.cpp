@@ -0,0 +1,152 @@
+#include "test_common.h"
+
+#include <cstdio>
+
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "../Ray.h"
+
+#include "test_scene.h"
+
+extern std::mutex g_stdout_mtx;
+
+void test_tiled_render(const char *arch_list[], const char *preferred_device) {
+    std::string details;
+
+    // Output image is larger than framebuffer of tiled renderer and is not multiple of tile size
+    const int ImgW = 96, ImgH = 72, TileSize = 16, SamplesCount = 64;
+    const char *FilePath = "test_tiled_render.bin";
+
+    for (const char **arch = arch_list; *arch; ++arch) {
+        const auto rt = Ray::RendererTypeFromName(*arch);
+        if (!Ray::RendererSupportsMultithreading(rt)) {
+            // tiled rendering is only supported by CPU backends
+            continue;
+        }
+
+        std::vector<float> pixels[2];
+
+        for (int tiled = 0; tiled < 2; ++tiled) {
+            Ray::settings_t s;
+            s.w = tiled ? 2 * TileSize : ImgW;
+            s.h = tiled ? 2 * TileSize : ImgH;
+            s.preferred_device = preferred_device;
+
+            auto renderer = std::unique_ptr<Ray::RendererBase>(Ray::CreateRenderer(s, &g_log_err, rt));
+            if (!renderer || renderer->type() != rt) {
+                break;
+            }
+            auto scene = std::unique_ptr<Ray::SceneBase>(renderer->CreateScene());
+
+            Ray::camera_desc_t cam_desc;
+            cam_desc.filter = Ray::ePixelFilter::Box;
+            cam_desc.origin[0] = 0.3f;
+            cam_desc.origin[2] = 3.0f;
+            cam_desc.fwd[2] = -1.0f;
+            cam_desc.shift[0] = 0.1f;
+            cam_desc.fov = 45.0f;
+            setup_sphere_scene(*scene, 64, 32, cam_desc);
+
+            if (tiled) {
+                remove(FilePath);
+
+                Ray::tiled_render_desc_t desc;
+                desc.w = ImgW;
+                desc.h = ImgH;
+                desc.tile_size = TileSize;
+                desc.max_samples = SamplesCount;
+                desc.file_path = FilePath;
+                require(Ray::RenderTiled(*renderer, *scene, desc));
+
+                Ray::tiled_image_info_t info;
+                require(Ray::ReadTiledImageInfo(FilePath, info));
+                require(info.tiles_finished == info.tiles_total);
+
+                // finished render is resumed without tracing anything
+                renderer->ResetStats();
+                require(Ray::RenderTiled(*renderer, *scene, desc));
+                Ray::RendererBase::stats_t st;
+                renderer->GetStats(st);
+                require(st.primary_rays_count == 0);
+
+                std::vector<Ray::color_rgba_t> tiled_pixels(ImgW * ImgH);
+                require(Ray::ReadTiledImageRegion(FilePath, Ray::rect_t{0, 0, ImgW, ImgH}, tiled_pixels.data()));
+                for (const Ray::color_rgba_t &p : tiled_pixels) {
+                    pixels[tiled].insert(end(pixels[tiled]), p.v, p.v + 3);
+                }
+
+                remove(FilePath);
+            } else {
+                Ray::RegionContext region({0, 0, ImgW, ImgH});
+                for (int i = 0; i < SamplesCount; ++i) {
+                    renderer->RenderScene(*scene, region);
+                }
+
+                const Ray::color_data_rgba_t raw = renderer->get_raw_pixels_ref();
+                for (int y = 0; y < ImgH; ++y) {
+                    for (int x = 0; x < ImgW; ++x) {
+                        const float *p = raw.ptr[y * raw.pitch + x].v;
+                        pixels[tiled].insert(end(pixels[tiled]), p, p + 3);
+                    }
+                }
+            }
+        }
+
+        if (pixels[1].empty()) {
+            continue;
+        }
+
+        // tiles use decorrelated random sequences, so images are compared after averaging of noise in 8x8 blocks
+        double max_diff = 0.0;
+        for (int by = 0; by < ImgH; by += 8) {
+            for (int bx = 0; bx < ImgW; bx += 8) {
+                double diff[3] = {};
+                for (int y = by; y < by + 8; ++y) {
+                    for (int x = bx; x < bx + 8; ++x) {
+                        for (int c = 0; c < 3; ++c) {
+                            diff[c] += pixels[0][3 * (y * ImgW + x) + c] - pixels[1][3 * (y * ImgW + x) + c];
+                        }
+                    }
+                }
+                for (int c = 0; c < 3; ++c) {
+                    max_diff = std::max(max_diff, fabs(diff[c]) / 64.0);
+                }
+            }
+        }
+        require(max_diff < 0.02);
+
+        { // region camera is only derived for perspective projection, e.g. lightmap baking is rejected
+            Ray::LogNull log;
+
+            Ray::settings_t s;
+            s.w = s.h = 2 * TileSize;
+            s.preferred_device = preferred_device;
+
+            auto renderer = std::unique_ptr<Ray::RendererBase>(Ray::CreateRenderer(s, &log, rt));
+            auto scene = std::unique_ptr<Ray::SceneBase>(renderer->CreateScene());
+
+            Ray::camera_desc_t cam_desc;
+            cam_desc.type = Ray::eCamType::Geo;
+            cam_desc.mi_index = 0;
+            setup_sphere_scene(*scene, 16, 8, cam_desc);
+
+            Ray::tiled_render_desc_t desc;
+            desc.w = ImgW;
+            desc.h = ImgH;
+            desc.tile_size = TileSize;
+            desc.file_path = FilePath;
+            require(!Ray::RenderTiled(*renderer, *scene, desc));
+        }
+
+        char buf[64];
+        snprintf(buf, sizeof(buf), "(%s: max block diff %.4f) ", *arch, max_diff);
+        details += buf;
+    }
+
+    std::lock_guard<std::mutex> _(g_stdout_mtx);
+    printf("Test tiled_render       | %sOK\n", details.c_str());
+}
@@ -0,0 +1,160 @@
+#include "test_common.h"
+
+#include <cmath>
+#include <cstdio>
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "../Ray.h"
+
+#include "test_scene.h"
+
+extern std::mutex g_stdout_mtx;
+
+namespace {
+const int LayersCount = 4;     // of each kind
+const float LayerColor = 0.8f; // transmittance of tinted layers
+
+void setup_transparent_shadows_scene(Ray::SceneBase &scene, const int max_transp_depth) {
+    // Diffuse floor lit from above through stack of (invisible to camera) layers that cover upper half of the image:
+    // tinted transparent, clear transparent and alpha-tested (cutout in the right half)
+    Ray::shading_node_desc_t diff_desc;
+    diff_desc.type = Ray::eShadingNode::Diffuse;
+    diff_desc.base_color[0] = diff_desc.base_color[1] = diff_desc.base_color[2] = 0.5f;
+    const Ray::MaterialHandle diff_mat = scene.AddMaterial(diff_desc);
+
+    Ray::shading_node_desc_t tinted_desc;
+    tinted_desc.type = Ray::eShadingNode::Transparent;
+    tinted_desc.base_color[0] = tinted_desc.base_color[1] = tinted_desc.base_color[2] = LayerColor;
+    const Ray::MaterialHandle tinted_mat = scene.AddMaterial(tinted_desc);
+
+    Ray::shading_node_desc_t clear_desc;
+    clear_desc.type = Ray::eShadingNode::Transparent;
+    const Ray::MaterialHandle clear_mat = scene.AddMaterial(clear_desc);
+
+    // left half of texture is transparent, right half is opaque (triangles are classified as mixed)
+    const int AlphaRes = 64;
+    std::vector<uint8_t> alpha(AlphaRes * AlphaRes);
+    for (int y = 0; y < AlphaRes; ++y) {
+        for (int x = 0; x < AlphaRes; ++x) {
+            alpha[y * AlphaRes + x] = (x < AlphaRes / 2) ? 0 : 255;
+        }
+    }
+
+    Ray::tex_desc_t tex_desc;
+    tex_desc.format = Ray::eTextureFormat::R8;
+    tex_desc.data = alpha;
+    tex_desc.w = tex_desc.h = AlphaRes;
+    tex_desc.is_srgb = false;
+    tex_desc.force_no_compression = true;
+    const Ray::TextureHandle alpha_tex = scene.AddTexture(tex_desc);
+
+    Ray::shading_node_desc_t cutout_desc;
+    cutout_desc.type = Ray::eShadingNode::Mix;
+    cutout_desc.base_texture = alpha_tex;
+    cutout_desc.mix_materials[0] = clear_mat;
+    cutout_desc.mix_materials[1] = diff_mat;
+    const Ray::MaterialHandle cutout_mat = scene.AddMaterial(cutout_desc);
+
+    const float floor_xform[16] = {4.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f,
+                                   0.0f, 0.0f, 4.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f};
+    scene.AddMeshInstance(add_quad_mesh(scene, diff_mat), floor_xform);
+
+    const Ray::MaterialHandle layer_mats[] = {tinted_mat, clear_mat, cutout_mat};
+    for (int i = 0; i < 3 * LayersCount; ++i) {
+        const float layer_xform[16] = {3.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f,  0.0f, 0.0f,
+                                       0.0f, 0.0f, 1.5f, 0.0f, 0.0f, 0.2f + 0.1f * float(i), -1.5f, 1.0f};
+        Ray::mesh_instance_desc_t mi_desc;
+        mi_desc.xform = layer_xform;
+        mi_desc.mesh = add_quad_mesh(scene, layer_mats[i % 3]);
+        mi_desc.camera_visibility = false;
+        scene.AddMeshInstance(mi_desc);
+    }
+
+    Ray::directional_light_desc_t light_desc;
+    light_desc.direction[0] = light_desc.direction[2] = 0.0f;
+    light_desc.direction[1] = -1.0f;
+    scene.AddLight(light_desc);
+
+    Ray::camera_desc_t cam_desc;
+    cam_desc.origin[1] = 4.0f;
+    cam_desc.fwd[1] = -1.0f;
+    cam_desc.up[2] = -1.0f;
+    cam_desc.fov = 60.0f;
+    cam_desc.filter = Ray::ePixelFilter::Box;
+    cam_desc.max_diff_depth = 0;
+    cam_desc.max_spec_depth = 0;
+    cam_desc.max_refr_depth = 0;
+    cam_desc.max_total_depth = 0;
+    cam_desc.max_transp_depth = uint8_t(max_transp_depth);
+    scene.set_current_cam(scene.AddCamera(cam_desc));
+
+    scene.Finalize();
+}
+} // namespace
+
+void test_transparent_shadows(const char *arch_list[], const char *preferred_device) {
+    std::string details;
+
+    const int ImgRes = 64, SamplesCount = 4;
+
+    for (const char **arch = arch_list; *arch; ++arch) {
+        const auto rt = Ray::RendererTypeFromName(*arch);
+
+        Ray::settings_t s;
+        s.w = s.h = ImgRes;
+        s.preferred_device = preferred_device;
+
+        auto renderer = std::unique_ptr<Ray::RendererBase>(Ray::CreateRenderer(s, &g_log_err, rt));
+        if (!renderer || renderer->type() != rt) {
+            continue;
+        }
+
+        // Stack has more surfaces than single traversal collects, so shadow rays have to continue behind the first
+        // batch of hits. Result must match the one of restarting traversal after each surface: tinted layers
+        // attenuate light, clear layers only count towards transparency depth, opaque part of cutout blocks light.
+        for (const int max_transp_depth : {3 * LayersCount, 3 * LayersCount - 1}) {
+            auto scene = std::unique_ptr<Ray::SceneBase>(renderer->CreateScene());
+            setup_transparent_shadows_scene(*scene, max_transp_depth);
+
+            renderer->Clear({0, 0, 0, 0});
+            Ray::RegionContext region({0, 0, ImgRes, ImgRes});
+            for (int i = 0; i < SamplesCount; ++i) {
+                renderer->RenderScene(*scene, region);
+            }
+
+            std::vector<float> pixels;
+            read_pixels(*renderer, ImgRes, pixels);
+
+            // average of image quarter (with margins around stack edges and image borders excluded)
+            auto quarter_average = [&](const int qx, const int qy) {
+                double sum = 0.0;
+                int count = 0;
+                for (int y = qy * ImgRes / 2 + 4; y < (qy + 1) * ImgRes / 2 - 4; ++y) {
+                    for (int x = qx * ImgRes / 2 + 4; x < (qx + 1) * ImgRes / 2 - 4; ++x) {
+                        sum += pixels[3 * (y * ImgRes + x) + 1];
+                        ++count;
+                    }
+                }
+                return float(sum / count);
+            };
+
+            const float lit = quarter_average(0, 1);
+            require(lit > 0.01f);
+            require(fabsf(quarter_average(1, 1) - lit) < 1e-4f * lit);
+
+            const float expected = (max_transp_depth >= 3 * LayersCount) ? powf(LayerColor, float(LayersCount)) : 0.0f;
+            require(fabsf(quarter_average(0, 0) - expected * lit) < 1e-3f * lit);
+            require(quarter_average(1, 0) < 1e-6f);
+        }
+
+        details += *arch;
+        details += " ";
+    }
+
+    std::lock_guard<std::mutex> _(g_stdout_mtx);
+    printf("Test transparent_shadows | %sOK\n", details.c_str());
+}
@@ -0,0 +1,131 @@
+#include "test_common.h"
+
+#include <cmath>
+#include <cstring>
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "../Ray.h"
+#include "../internal/Core.h"
+
+#include "test_scene.h"
+
+extern std::mutex g_stdout_mtx;
+
+void test_vtx_compression(const char *arch_list[], const char *preferred_device) {
+    using namespace std::chrono;
+
+    { // pack/unpack roundtrip, directions close to -Z must not turn into zero vector
+        const float dirs[][3] = {{0.0f, 0.0f, -1.0f},    {-0.001f, -0.001f, -1.0f}, {0.001f, -0.001f, -1.0f},
+                                 {-0.001f, 0.001f, -1.0f}, {0.0f, 0.0f, 1.0f},        {-1.0f, 0.0f, 0.0f},
+                                 {0.0f, -1.0f, 0.0f},      {0.577f, -0.577f, -0.577f}};
+        for (const auto &d : dirs) {
+            const float len = std::sqrt(d[0] * d[0] + d[1] * d[1] + d[2] * d[2]);
+
+            Ray::vertex_t v = {};
+            for (int i = 0; i < 3; ++i) {
+                v.n[i] = v.b[i] = d[i] / len;
+            }
+
+            Ray::packed_vertex_t packed;
+            Ray::PackVertex(v, packed);
+            require(packed.n != 0 && packed.b != 0);
+
+            Ray::vertex_t unpacked;
+            Ray::UnpackVertex(packed, unpacked);
+            require(v.n[0] * unpacked.n[0] + v.n[1] * unpacked.n[1] + v.n[2] * unpacked.n[2] > 0.9999f);
+            require(v.b[0] * unpacked.b[0] + v.b[1] * unpacked.b[1] + v.b[2] * unpacked.b[2] > 0.9999f);
+        }
+
+        // zero vector is still preserved
+        Ray::vertex_t v = {};
+        Ray::packed_vertex_t packed;
+        Ray::PackVertex(v, packed);
+        require(packed.n == 0 && packed.b == 0);
+
+        Ray::vertex_t unpacked;
+        Ray::UnpackVertex(packed, unpacked);
+        require(unpacked.n[0] == 0.0f && unpacked.n[1] == 0.0f && unpacked.n[2] == 0.0f);
+    }
+
+    std::string details;
+
+    // Tessellated sphere
+    const int SegmentsX = 512, SegmentsY = 256;
+
+    const int ImgRes = 128, SamplesCount = 16;
+
+    for (const char **arch = arch_list; *arch; ++arch) {
+        const auto rt = Ray::RendererTypeFromName(*arch);
+        if (!Ray::RendererSupportsMultithreading(rt)) {
+            // compact vertices are only supported by CPU backends
+            continue;
+        }
+
+        size_t compiled_size[2] = {};
+        double render_time[2] = {};
+        std::vector<float> pixels[2];
+
+        for (int compressed = 0; compressed < 2; ++compressed) {
+            Ray::settings_t s;
+            s.w = s.h = ImgRes;
+            s.preferred_device = preferred_device;
+            s.use_vtx_compression = (compressed != 0);
+
+            auto renderer = std::unique_ptr<Ray::RendererBase>(Ray::CreateRenderer(s, &g_log_err, rt));
+            if (!renderer || renderer->type() != rt) {
+                break;
+            }
+            auto scene = std::unique_ptr<Ray::SceneBase>(renderer->CreateScene());
+
+            Ray::camera_desc_t cam_desc;
+            cam_desc.filter = Ray::ePixelFilter::Box;
+            cam_desc.origin[2] = 3.0f;
+            cam_desc.fwd[2] = -1.0f;
+            cam_desc.fov = 45.0f;
+            setup_sphere_scene(*scene, SegmentsX, SegmentsY, cam_desc);
+
+            std::vector<uint8_t> data;
+            require(scene->SaveCompiled(data));
+            compiled_size[compressed] = data.size();
+
+            Ray::RegionContext region({0, 0, ImgRes, ImgRes});
+            const auto t1 = high_resolution_clock::now();
+            for (int i = 0; i < SamplesCount; ++i) {
+                renderer->RenderScene(*scene, region);
+            }
+            render_time[compressed] = duration<double, std::milli>(high_resolution_clock::now() - t1).count();
+
+            read_pixels(*renderer, ImgRes, pixels[compressed]);
+        }
+
+        if (pixels[1].empty()) {
+            continue;
+        }
+
+        // compact format keeps positions as is, only normals and uvs are quantized
+        const size_t vertices_count = size_t(SegmentsX + 1) * (SegmentsY + 1);
+        require(compiled_size[0] - compiled_size[1] >= vertices_count * 20);
+
+        double diff = 0.0;
+        for (size_t i = 0; i < pixels[0].size(); ++i) {
+            diff += fabs(pixels[0][i] - pixels[1][i]);
+        }
+        diff /= double(pixels[0].size());
+        require(diff < 0.005);
+
+        char buf[128];
+        snprintf(buf, sizeof(buf), "(%s: %.1fMB -> %.1fMB, %.1fms -> %.1fms) ", *arch,
+                 double(compiled_size[0]) / (1024.0 * 1024.0), double(compiled_size[1]) / (1024.0 * 1024.0),
+                 render_time[0], render_time[1]);
+        details += buf;
+    }
+
+    std::lock_guard<std::mutex> _(g_stdout_mtx);
+    printf("Test vtx_compression    | %sOK\n", details.c_str());
+}
@@ -0,0 +1,170 @@
+#include "SWbinning.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "SWframebuffer.h"
+#include "SWrasterize.h"
+
+typedef struct SWbin_job {
+    SWbinner *b;
+    SWprogram *p;
+    SWframebuffer *f;
+    SWint interp_mode, b_depth_test, b_depth_write, b_blend;
+} SWbin_job;
+
+static void _swRasterizeBin(void *job_data, const SWint i) {
+    const SWbin_job *job = (const SWbin_job *)job_data;
+    const SWbinner *b = job->b;
+    SWframebuffer *f = job->f;
+
+    const SWint bin = b->active_bins[i];
+    const SWint rect_min[2] = {(bin % b->bins_w) * SW_BIN_SIZE,
+                               (bin / b->bins_w) * SW_BIN_SIZE};
+    const SWint rect_max[2] = {sw_min(rect_min[0] + SW_BIN_SIZE, f->w) - 1,
+                               sw_min(rect_min[1] + SW_BIN_SIZE, f->h) - 1};
+
+    /* triangles are stored in submission order, so result matches immediate rasterization */
+    for (SWuint j = b->bin_offsets[bin]; j < b->bin_offsets[bin + 1]; j++) {
+        SWfloat(*vs_out)[SW_MAX_VTX_ATTRIBS] = &b->vertices[3 * b->bin_tris[j]];
+        if (job->interp_mode == 0) {
+            _swProcessTriangleRect_nocorrect(job->p, f, vs_out, 0, 1, 2, rect_min, rect_max,
+                                             job->b_depth_test, job->b_depth_write,
+                                             job->b_blend);
+        } else if (job->interp_mode == 1) {
+            _swProcessTriangleRect_correct(job->p, f, vs_out, 0, 1, 2, rect_min, rect_max,
+                                           job->b_depth_test, job->b_depth_write,
+                                           job->b_blend);
+        } else {
+            _swProcessTriangleRect_fast(job->p, f, vs_out, 0, 1, 2, rect_min, rect_max,
+                                        job->b_depth_test, job->b_depth_write,
+                                        job->b_blend);
+        }
+    }
+}
+
+void swBinnerDestroy(SWbinner *b) {
+    free(b->vertices);
+    free(b->tri_bins);
+    free(b->bin_offsets);
+    free(b->bin_tris);
+    free(b->active_bins);
+    memset(b, 0, sizeof(SWbinner));
+}
+
+void swBinnerBegin(SWbinner *b, const SWframebuffer *f) {
+    b->num_tris = 0;
+    b->bins_w = (f->w + SW_BIN_SIZE - 1) / SW_BIN_SIZE;
+    b->bins_h = (f->h + SW_BIN_SIZE - 1) / SW_BIN_SIZE;
+}
+
+void swBinnerAddTriangle(SWbinner *b, const SWframebuffer *f,
+                         SWfloat vs_out[][SW_MAX_VTX_ATTRIBS], const SWint _0,
+                         const SWint _1, const SWint _2, const SWint v_out_size) {
+    SWint p0[2], p1[2], p2[2];
+    _swProjectOnScreen(f, vs_out[_0], p0);
+    _swProjectOnScreen(f, vs_out[_1], p1);
+    _swProjectOnScreen(f, vs_out[_2], p2);
+
+    /* triangles that rasterizer would skip anyway are not stored */
+    const SWint area =
+        (p0[0] - p1[0]) * (p2[1] - p0[1]) - (p2[0] - p0[0]) * (p0[1] - p1[1]);
+    if (area <= 0) {
+        return;
+    }
+
+    SWint min[2], max[2];
+    min[0] = sw_min(p0[0], sw_min(p1[0], p2[0]));
+    min[1] = sw_min(p0[1], sw_min(p1[1], p2[1]));
+    max[0] = sw_max(p0[0], sw_max(p1[0], p2[0]));
+    max[1] = sw_max(p0[1], sw_max(p1[1], p2[1]));
+
+    if (min[0] >= f->w || min[1] >= f->h || max[0] < 0 || max[1] < 0) {
+        return;
+    }
+
+    if (b->num_tris == b->tris_capacity) {
+        b->tris_capacity = sw_max(2 * b->tris_capacity, 256);
+        b->vertices =
+            realloc(b->vertices, 3 * b->tris_capacity * SW_MAX_VTX_ATTRIBS * sizeof(SWfloat));
+        b->tri_bins = realloc(b->tri_bins, 4 * b->tris_capacity * sizeof(SWint));
+    }
+
+    memcpy(b->vertices[3 * b->num_tris + 0], vs_out[_0], v_out_size * sizeof(SWfloat));
+    memcpy(b->vertices[3 * b->num_tris + 1], vs_out[_1], v_out_size * sizeof(SWfloat));
+    memcpy(b->vertices[3 * b->num_tris + 2], vs_out[_2], v_out_size * sizeof(SWfloat));
+
+    SWint *bins = &b->tri_bins[4 * b->num_tris];
+    bins[0] = sw_max(min[0], 0) / SW_BIN_SIZE;
+    bins[1] = sw_max(min[1], 0) / SW_BIN_SIZE;
+    bins[2] = sw_min(max[0], f->w - 1) / SW_BIN_SIZE;
+    bins[3] = sw_min(max[1], f->h - 1) / SW_BIN_SIZE;
+
+    b->num_tris++;
+}
+
+void swBinnerRasterize(SWbinner *b, SWprogram *p, SWframebuffer *f,
+                       const SWint interp_mode, const SWint b_depth_test,
+                       const SWint b_depth_write, const SWint b_blend,
+                       parallel_for_proc parallel_for, void *userdata) {
+    const SWuint num_bins = (SWuint)(b->bins_w * b->bins_h);
+    SWuint i, num_refs = 0, num_active_bins = 0;
+
+    if (!b->num_tris) {
+        return;
+    }
+
+    if (num_bins + 1 > b->bins_capacity) {
+        b->bins_capacity = num_bins + 1;
+        b->bin_offsets = realloc(b->bin_offsets, b->bins_capacity * sizeof(SWuint));
+        b->active_bins = realloc(b->active_bins, b->bins_capacity * sizeof(SWint));
+    }
+    memset(b->bin_offsets, 0, (num_bins + 1) * sizeof(SWuint));
+
+    /* counting sort of triangle references by bin */
+    for (i = 0; i < b->num_tris; i++) {
+        const SWint *bins = &b->tri_bins[4 * i];
+        for (SWint y = bins[1]; y <= bins[3]; y++) {
+            for (SWint x = bins[0]; x <= bins[2]; x++) {
+                b->bin_offsets[y * b->bins_w + x]++;
+            }
+        }
+    }
+    for (i = 0; i < num_bins; i++) {
+        const SWuint count = b->bin_offsets[i];
+        b->bin_offsets[i] = num_refs;
+        num_refs += count;
+        if (count) {
+            b->active_bins[num_active_bins++] = (SWint)i;
+        }
+    }
+    b->bin_offsets[num_bins] = num_refs;
+
+    if (num_refs > b->bin_tris_capacity) {
+        b->bin_tris_capacity = sw_max(num_refs, 2 * b->bin_tris_capacity);
+        b->bin_tris = realloc(b->bin_tris, b->bin_tris_capacity * sizeof(SWuint));
+    }
+
+    /* offsets are used as write cursors and shifted back afterwards */
+    for (i = 0; i < b->num_tris; i++) {
+        const SWint *bins = &b->tri_bins[4 * i];
+        for (SWint y = bins[1]; y <= bins[3]; y++) {
+            for (SWint x = bins[0]; x <= bins[2]; x++) {
+                b->bin_tris[b->bin_offsets[y * b->bins_w + x]++] = i;
+            }
+        }
+    }
+    memmove(&b->bin_offsets[1], &b->bin_offsets[0], num_bins * sizeof(SWuint));
+    b->bin_offsets[0] = 0;
+
+    SWbin_job job = {b, p, f, interp_mode, b_depth_test, b_depth_write, b_blend};
+    if (parallel_for) {
+        (*parallel_for)(userdata, (SWint)num_active_bins, _swRasterizeBin, &job);
+    } else {
+        for (i = 0; i < num_active_bins; i++) {
+            _swRasterizeBin(&job, (SWint)i);
+        }
+    }
+
+    b->num_tris = 0;
+}
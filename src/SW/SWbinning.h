@@ -0,0 +1,34 @@
+#ifndef SW_BINNING_H
+#define SW_BINNING_H
+
+#include "SWcore.h"
+#include "SWprogram.h"
+
+#define SW_BIN_SIZE 64
+
+struct SWframebuffer;
+
+/* Triangles of single draw call sorted into screen bins, bins are rasterized independently */
+typedef struct SWbinner {
+    SWfloat (*vertices)[SW_MAX_VTX_ATTRIBS]; /* clipped vertices (3 per triangle) */
+    SWint *tri_bins;                         /* bin range of each triangle (x0, y0, x1, y1) */
+    SWuint num_tris, tris_capacity;
+
+    SWuint *bin_offsets; /* triangles of bin i are in [bin_offsets[i], bin_offsets[i + 1]) */
+    SWuint *bin_tris;
+    SWint *active_bins;
+    SWuint bins_capacity, bin_tris_capacity;
+    SWint bins_w, bins_h;
+} SWbinner;
+
+void swBinnerDestroy(SWbinner *b);
+
+void swBinnerBegin(SWbinner *b, const struct SWframebuffer *f);
+void swBinnerAddTriangle(SWbinner *b, const struct SWframebuffer *f,
+                         SWfloat vs_out[][SW_MAX_VTX_ATTRIBS], SWint _0, SWint _1, SWint _2,
+                         SWint v_out_size);
+void swBinnerRasterize(SWbinner *b, SWprogram *p, struct SWframebuffer *f,
+                       SWint interp_mode, SWint b_depth_test, SWint b_depth_write,
+                       SWint b_blend, parallel_for_proc parallel_for, void *userdata);
+
+#endif /* SW_BINNING_H */
@@ -32,6 +32,7 @@ void swCtxInit(SWcontext *ctx, const SWint w, const SWint h) {
     ctx->binded_buffers[1] = -1;
 
     swCPUInfoInit(&ctx->cpu_info);
+    swPacketProcsInit(&ctx->packet_procs, &ctx->cpu_info);
 
     extern SWfloat _sw_ubyte_to_float_table[256];
     if (_sw_ubyte_to_float_table[1] == 0) {
@@ -55,6 +56,7 @@ void swCtxDestroy(SWcontext *ctx) {
     for (SWint i = 0; i < ctx->num_textures; i++) {
         swCtxDeleteTexture(ctx, i);
     }
+    swBinnerDestroy(&ctx->binner);
     swCPUInfoDestroy(&ctx->cpu_info);
     memset(ctx, 0, sizeof(SWcontext));
 }
@@ -269,6 +271,12 @@ void swCtxInitProgram(SWcontext *ctx, vtx_shader_proc v_proc, frag_shader_proc f
     swProgInit(p, ctx->uniform_buf, v_proc, f_proc, v_out_floats);
 }
 
+void swCtxInitProgramPacket(SWcontext *ctx, frag_packet_shader_proc fp_proc) {
+    SWprogram *p = &ctx->programs[ctx->cur_program];
+    p->fp_proc = fp_proc;
+    p->fp_interp_proc = ctx->packet_procs.interp_proc;
+}
+
 void swCtxDeleteProgram(SWcontext *ctx, const SWint program) {
     SWprogram *p = &ctx->programs[program];
     swProgDestroy(p);
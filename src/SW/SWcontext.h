@@ -1,6 +1,7 @@
 #ifndef SW_CONTEXT_H
 #define SW_CONTEXT_H
 
+#include "SWbinning.h"
 #include "SWbuffer.h"
 #include "SWcore.h"
 #include "SWcpu.h"
@@ -14,6 +15,7 @@
 #define BLEND_ENABLED (1 << 2)
 #define PERSPECTIVE_CORRECTION_ENABLED (1 << 3)
 #define FAST_PERSPECTIVE_CORRECTION (1 << 4)
+#define BINNED_RASTERIZATION_ENABLED (1 << 5)
 
 #define DEFAULT_RENDER_FLAGS                                                             \
     (DEPTH_TEST_ENABLED | DEPTH_WRITE_ENABLED | PERSPECTIVE_CORRECTION_ENABLED)
@@ -39,7 +41,12 @@ struct SWcontext {
 
     SWfloat curve_tolerance;
 
+    SWbinner binner;
+    parallel_for_proc parallel_for;
+    void *parallel_for_userdata;
+
     SWcpu_info cpu_info;
+    SWpacket_procs packet_procs;
 };
 
 void swCtxInit(SWcontext *ctx, SWint w, SWint h);
@@ -84,6 +91,7 @@ void swCtxTexImage2DConst(SWcontext *ctx, SWenum mode, SWenum type, SWint w, SWi
 SWint swCtxCreateProgram(SWcontext *ctx);
 void swCtxInitProgram(SWcontext *ctx, vtx_shader_proc v_proc, frag_shader_proc f_proc,
                       SWint v_out_floats);
+void swCtxInitProgramPacket(SWcontext *ctx, frag_packet_shader_proc fp_proc);
 void swCtxDeleteProgram(SWcontext *ctx, SWint program);
 void swCtxUseProgram(SWcontext *ctx, SWint program);
 void swCtxRegisterUniform(SWcontext *ctx, SWint index, SWenum type);
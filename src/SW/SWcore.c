@@ -110,6 +110,11 @@ void swTexture(const SWint slot, const SWfloat *uv, SWfloat *col) {
     swTexGetColorFloat_RGBA(t, uv[0], uv[1], col);
 }
 
+void swTexturePacket(const SWint slot, const SWfloat *u, const SWfloat *v, SWfloat *rgba) {
+    const SWtexture *t = &sw_cur_context->textures[sw_cur_context->binded_textures[slot]];
+    (*sw_cur_context->packet_procs.tex_proc)(t, u, v, rgba);
+}
+
 /***************************************************************************************/
 
 SWint swCreateProgram() { return swCtxCreateProgram(sw_cur_context); }
@@ -118,6 +123,10 @@ void swInitProgram(vtx_shader_proc v_proc, frag_shader_proc f_proc, SWint v_out_
     swCtxInitProgram(sw_cur_context, v_proc, f_proc, v_out_floats);
 }
 
+void swInitProgramPacket(frag_packet_shader_proc fp_proc) {
+    swCtxInitProgramPacket(sw_cur_context, fp_proc);
+}
+
 void swDeleteProgram(const SWint program) { swCtxDeleteProgram(sw_cur_context, program); }
 
 void swUseProgram(const SWint program) { swCtxUseProgram(sw_cur_context, program); }
@@ -135,6 +144,8 @@ void swEnable(SWenum func) {
         sw_cur_context->render_flags |= PERSPECTIVE_CORRECTION_ENABLED;
     } else if (func == SW_FAST_PERSPECTIVE_CORRECTION) {
         sw_cur_context->render_flags |= FAST_PERSPECTIVE_CORRECTION;
+    } else if (func == SW_BINNED_RASTERIZATION) {
+        sw_cur_context->render_flags |= BINNED_RASTERIZATION_ENABLED;
     }
 }
 
@@ -149,6 +160,8 @@ void swDisable(const SWenum func) {
         sw_cur_context->render_flags &= ~PERSPECTIVE_CORRECTION_ENABLED;
     } else if (func == SW_FAST_PERSPECTIVE_CORRECTION) {
         sw_cur_context->render_flags &= ~FAST_PERSPECTIVE_CORRECTION;
+    } else if (func == SW_BINNED_RASTERIZATION) {
+        sw_cur_context->render_flags &= ~BINNED_RASTERIZATION_ENABLED;
     }
 }
 
@@ -163,6 +176,8 @@ SWint swIsEnabled(const SWenum func) {
         return sw_cur_context->render_flags & PERSPECTIVE_CORRECTION_ENABLED;
     } else if (func == SW_FAST_PERSPECTIVE_CORRECTION) {
         return sw_cur_context->render_flags & FAST_PERSPECTIVE_CORRECTION;
+    } else if (func == SW_BINNED_RASTERIZATION) {
+        return sw_cur_context->render_flags & BINNED_RASTERIZATION_ENABLED;
     }
     return 0;
 }
@@ -211,4 +226,9 @@ void swSetFloat(const SWenum what, const SWfloat val) {
     if (what == SW_CURVE_TOLERANCE) {
         sw_cur_context->curve_tolerance = val;
     }
+}
+
+void swParallelFor(parallel_for_proc proc, void *userdata) {
+    sw_cur_context->parallel_for = proc;
+    sw_cur_context->parallel_for_userdata = userdata;
 }
\ No newline at end of file
@@ -42,6 +42,7 @@ typedef enum SWenum {
     SW_BLEND,
     SW_PERSPECTIVE_CORRECTION,
     SW_FAST_PERSPECTIVE_CORRECTION,
+    SW_BINNED_RASTERIZATION,
 
     /* buffer types */
     SW_ARRAY_BUFFER,
@@ -99,6 +100,8 @@ void swTexImage2D(SWenum mode, SWenum type, SWint w, SWint h, const void *pixels
 void swTexImage2DMove_malloced(SWenum mode, SWenum type, SWint w, SWint h, void *pixels);
 void swTexImage2DConst(SWenum mode, SWenum type, SWint w, SWint h, void *pixels);
 void swTexture(SWint slot, const SWfloat *uv, SWfloat *col);
+/* u, v and rgba hold SW_PACKET_SIZE values per component (packet shader layout) */
+void swTexturePacket(SWint slot, const SWfloat *u, const SWfloat *v, SWfloat *rgba);
 
 /* SWtexture.h should be included for these */
 #define swTexture_RGB888(slot, uv, col)                                                  \
@@ -111,6 +114,9 @@ void swTexture(SWint slot, const SWfloat *uv, SWfloat *col);
 /* Program operations */
 SWint swCreateProgram();
 void swInitProgram(vtx_shader_proc v_proc, frag_shader_proc f_proc, SWint v_out_floats);
+/* Sets packet version of fragment shader for current program, it must produce the same
+   result as per-pixel shader which is still used for lines and non-perspective modes */
+void swInitProgramPacket(frag_packet_shader_proc fp_proc);
 void swDeleteProgram(SWint program);
 void swUseProgram(SWint program);
 
@@ -128,4 +134,7 @@ const char *swGetString(SWenum what);
 
 void swSetFloat(SWenum what, SWfloat val);
 
+/* Function used to rasterize screen bins in parallel (when SW_BINNED_RASTERIZATION is enabled) */
+void swParallelFor(parallel_for_proc proc, void *userdata);
+
 #endif /* SW_CORE_H */
@@ -17,6 +17,9 @@ SWint _swCullCtxTestRect_NEON(const SWcull_ctx *ctx, const SWfloat p_min[2], con
                               const SWfloat w_min);
 void _swCullCtxClearBuf_NEON(SWcull_ctx *ctx);
 void _swCullCtxDebugDepth_NEON(const SWcull_ctx *ctx, SWfloat *out_depth);
+void _swBinTrianglesIndexed_NEON(SWcull_ctx *ctx, const void *attribs, const SWuint *indices, SWuint stride,
+                                 SWuint index_count, const SWfloat *xform, SWcull_tri_buf *out_tris);
+void _swRasterizeBin_NEON(SWcull_ctx *ctx, const SWcull_tri_buf *tri_bufs, SWuint tri_bufs_count, SWint bin);
 #else // defined(__aarch64__) || defined(_M_ARM) || defined(_M_ARM64)
 SWint _swProcessTrianglesIndexed_SSE2(SWcull_ctx *ctx, const void *attribs, const SWuint *indices, SWuint stride,
                                       SWuint index_count, const SWfloat *xform, SWint is_occluder);
@@ -34,6 +37,14 @@ void _swCullCtxClearBuf_AVX2(SWcull_ctx *ctx);
 void _swCullCtxDebugDepth_SSE2(const SWcull_ctx *ctx, SWfloat *out_depth);
 void _swCullCtxDebugDepth_AVX2(const SWcull_ctx *ctx, SWfloat *out_depth);
 
+void _swBinTrianglesIndexed_SSE2(SWcull_ctx *ctx, const void *attribs, const SWuint *indices, SWuint stride,
+                                 SWuint index_count, const SWfloat *xform, SWcull_tri_buf *out_tris);
+void _swBinTrianglesIndexed_AVX2(SWcull_ctx *ctx, const void *attribs, const SWuint *indices, SWuint stride,
+                                 SWuint index_count, const SWfloat *xform, SWcull_tri_buf *out_tris);
+
+void _swRasterizeBin_SSE2(SWcull_ctx *ctx, const SWcull_tri_buf *tri_bufs, SWuint tri_bufs_count, SWint bin);
+void _swRasterizeBin_AVX2(SWcull_ctx *ctx, const SWcull_tri_buf *tri_bufs, SWuint tri_bufs_count, SWint bin);
+
 #if !defined(_MSC_VER) || _MSC_VER > 1916
 SWint _swProcessTrianglesIndexed_AVX512(SWcull_ctx *ctx, const void *attribs, const SWuint *indices, SWuint stride,
                                         SWuint index_count, const SWfloat *xform, SWint is_occluder);
@@ -41,6 +52,9 @@ SWint _swCullCtxTestRect_AVX512(const SWcull_ctx *ctx, const SWfloat p_min[2], c
                                 const SWfloat w_min);
 void _swCullCtxClearBuf_AVX512(SWcull_ctx *ctx);
 void _swCullCtxDebugDepth_AVX512(const SWcull_ctx *ctx, SWfloat *out_depth);
+void _swBinTrianglesIndexed_AVX512(SWcull_ctx *ctx, const void *attribs, const SWuint *indices, SWuint stride,
+                                   SWuint index_count, const SWfloat *xform, SWcull_tri_buf *out_tris);
+void _swRasterizeBin_AVX512(SWcull_ctx *ctx, const SWcull_tri_buf *tri_bufs, SWuint tri_bufs_count, SWint bin);
 #endif
 #endif // defined(__aarch64__) || defined(_M_ARM) || defined(_M_ARM64)
 
@@ -48,6 +62,16 @@ void swCullCtxInit(SWcull_ctx *ctx, const SWint w, const SWint h, SWfloat near_c
     swCPUInfoInit(&ctx->cpu_info);
 
     ctx->ztiles = NULL;
+
+    ctx->parallel_for = NULL;
+    ctx->parallel_for_userdata = NULL;
+
+    ctx->pending_surfs = ctx->sorted_surfs = NULL;
+    ctx->pending_count = ctx->pending_capacity = 0;
+
+    ctx->tri_bufs = NULL;
+    ctx->tri_bufs_capacity = 0;
+
     swCullCtxResize(ctx, w, h, near_clip);
 
     swCullCtxClear(ctx);
@@ -56,6 +80,12 @@ void swCullCtxInit(SWcull_ctx *ctx, const SWint w, const SWint h, SWfloat near_c
 void swCullCtxDestroy(SWcull_ctx *ctx) {
     swCPUInfoDestroy(&ctx->cpu_info);
     sw_aligned_free(ctx->ztiles);
+    free(ctx->pending_surfs);
+    free(ctx->sorted_surfs);
+    for (SWuint i = 0; i < ctx->tri_bufs_capacity; i++) {
+        free(ctx->tri_bufs[i].tris);
+    }
+    free(ctx->tri_bufs);
     memset(ctx, 0, sizeof(SWcull_ctx));
 }
 
@@ -77,6 +107,8 @@ void swCullCtxResize(SWcull_ctx *ctx, const SWint w, const SWint h, SWfloat near
     ctx->test_rect_proc = &_swCullCtxTestRect_NEON;
     ctx->clear_buf_proc = &_swCullCtxClearBuf_NEON;
     ctx->debug_depth_proc = (SWCullDebugDepthProcType)&_swCullCtxDebugDepth_NEON;
+    ctx->bin_tri_indexed_proc = &_swBinTrianglesIndexed_NEON;
+    ctx->rast_bin_proc = &_swRasterizeBin_NEON;
 #else
 #if !defined(_MSC_VER) || _MSC_VER > 1916
     if (ctx->cpu_info.avx512_supported) {
@@ -86,6 +118,8 @@ void swCullCtxResize(SWcull_ctx *ctx, const SWint w, const SWint h, SWfloat near
         ctx->test_rect_proc = &_swCullCtxTestRect_AVX512;
         ctx->clear_buf_proc = &_swCullCtxClearBuf_AVX512;
         ctx->debug_depth_proc = (SWCullDebugDepthProcType)&_swCullCtxDebugDepth_AVX512;
+        ctx->bin_tri_indexed_proc = &_swBinTrianglesIndexed_AVX512;
+        ctx->rast_bin_proc = &_swRasterizeBin_AVX512;
     } else
 #endif
 	if (ctx->cpu_info.avx2_supported) {
@@ -95,6 +129,8 @@ void swCullCtxResize(SWcull_ctx *ctx, const SWint w, const SWint h, SWfloat near
         ctx->test_rect_proc = &_swCullCtxTestRect_AVX2;
         ctx->clear_buf_proc = &_swCullCtxClearBuf_AVX2;
         ctx->debug_depth_proc = (SWCullDebugDepthProcType)&_swCullCtxDebugDepth_AVX2;
+        ctx->bin_tri_indexed_proc = &_swBinTrianglesIndexed_AVX2;
+        ctx->rast_bin_proc = &_swRasterizeBin_AVX2;
     } else if (ctx->cpu_info.sse2_supported) {
         ctx->tile_size_y = 4;
         ctx->subtile_size_y = 4;
@@ -102,6 +138,8 @@ void swCullCtxResize(SWcull_ctx *ctx, const SWint w, const SWint h, SWfloat near
         ctx->test_rect_proc = &_swCullCtxTestRect_SSE2;
         ctx->clear_buf_proc = &_swCullCtxClearBuf_SSE2;
         ctx->debug_depth_proc = (SWCullDebugDepthProcType)&_swCullCtxDebugDepth_SSE2;
+        ctx->bin_tri_indexed_proc = &_swBinTrianglesIndexed_SSE2;
+        ctx->rast_bin_proc = &_swRasterizeBin_SSE2;
     } else
 #endif
     {
@@ -111,6 +149,8 @@ void swCullCtxResize(SWcull_ctx *ctx, const SWint w, const SWint h, SWfloat near
         ctx->test_rect_proc = &_swCullCtxTestRect_Ref;
         ctx->clear_buf_proc = &_swCullCtxClearBuf_Ref;
         ctx->debug_depth_proc = (SWCullDebugDepthProcType)&_swCullCtxDebugDepth_Ref;
+        ctx->bin_tri_indexed_proc = NULL;
+        ctx->rast_bin_proc = NULL;
     }
 
     assert((w % SW_CULL_SUBTILE_X == 0) && (h % ctx->subtile_size_y == 0));
@@ -118,6 +158,9 @@ void swCullCtxResize(SWcull_ctx *ctx, const SWint w, const SWint h, SWfloat near
     ctx->tile_w = (w + (SW_CULL_TILE_SIZE_X - 1)) / SW_CULL_TILE_SIZE_X;
     ctx->tile_h = (h + (ctx->tile_size_y - 1)) / ctx->tile_size_y;
 
+    ctx->bin_tile_w = (ctx->tile_w + SW_CULL_BINS_X - 1) / SW_CULL_BINS_X;
+    ctx->bin_tile_h = (ctx->tile_h + SW_CULL_BINS_Y - 1) / SW_CULL_BINS_Y;
+
     const int tile_size = SW_CULL_TILE_SIZE_X * ctx->tile_size_y / 8 + 2 * sizeof(float) *
                                                                            (SW_CULL_TILE_SIZE_X / SW_CULL_SUBTILE_X) *
                                                                            (ctx->tile_size_y / ctx->subtile_size_y);
@@ -150,24 +193,149 @@ void swCullCtxResize(SWcull_ctx *ctx, const SWint w, const SWint h, SWfloat near
 
 void swCullCtxClear(SWcull_ctx *ctx) { (*ctx->clear_buf_proc)(ctx); }
 
+static SWint _swCullSurfIsIndexedTris(const SWcull_surf *s) {
+    if (s->indices) {
+        if (s->prim_type == SW_TRIANGLES) {
+            if (s->index_type == SW_UNSIGNED_INT) {
+                return 1;
+            } else {
+                assert(0);
+            }
+        }
+    } else {
+    }
+    return 0;
+}
+
+static void _swCullCtxProcessSurf(SWcull_ctx *ctx, SWcull_surf *s) {
+    if (_swCullSurfIsIndexedTris(s)) {
+        s->visible = (*ctx->tri_indexed_proc)(ctx, s->attribs, (const SWuint *)s->indices, s->stride, s->count,
+                                              s->xform, (s->type == SW_OCCLUDER));
+    }
+}
+
 void swCullCtxSubmitCullSurfs(SWcull_ctx *ctx, SWcull_surf *surfs, const SWuint count) {
+    if (ctx->parallel_for) {
+        swCullCtxSubmitCullSurfsAsync(ctx, surfs, count);
+        swCullCtxFlush(ctx);
+        return;
+    }
+
     for (SWuint i = 0; i < count; i++) {
-        SWcull_surf *s = &surfs[i];
-
-        if (s->indices) {
-            if (s->prim_type == SW_TRIANGLES) {
-                if (s->index_type == SW_UNSIGNED_INT) {
-                    s->visible = (*ctx->tri_indexed_proc)(ctx, s->attribs, (const SWuint *)s->indices, s->stride,
-                                                          s->count, s->xform, (s->type == SW_OCCLUDER));
-                } else {
-                    assert(0);
-                }
-            }
-        } else {
+        _swCullCtxProcessSurf(ctx, &surfs[i]);
+    }
+}
+
+void swCullCtxParallelFor(SWcull_ctx *ctx, parallel_for_proc proc, void *userdata) {
+    ctx->parallel_for = proc;
+    ctx->parallel_for_userdata = userdata;
+}
+
+void swCullCtxSubmitCullSurfsAsync(SWcull_ctx *ctx, SWcull_surf *surfs, const SWuint count) {
+    if (ctx->pending_count + count > ctx->pending_capacity) {
+        ctx->pending_capacity = sw_max(ctx->pending_count + count, 2 * ctx->pending_capacity);
+        ctx->pending_surfs = realloc(ctx->pending_surfs, ctx->pending_capacity * sizeof(SWcull_surf *));
+        ctx->sorted_surfs = realloc(ctx->sorted_surfs, ctx->pending_capacity * sizeof(SWcull_surf *));
+    }
+    for (SWuint i = 0; i < count; i++) {
+        ctx->pending_surfs[ctx->pending_count++] = &surfs[i];
+    }
+}
+
+typedef struct SWcull_job {
+    SWcull_ctx *ctx;
+    SWuint occluders_count, occludees_count;
+} SWcull_job;
+
+static void _swCullCtxRunJobs(SWcull_ctx *ctx, const SWint count, job_proc job, void *job_data) {
+    if (!count) {
+        return;
+    }
+    if (ctx->parallel_for) {
+        (*ctx->parallel_for)(ctx->parallel_for_userdata, count, job, job_data);
+    } else {
+        for (SWint i = 0; i < count; i++) {
+            job(job_data, i);
+        }
+    }
+}
+
+static void _swCullBinOccluders(void *job_data, const SWint i) {
+    const SWcull_job *job = (const SWcull_job *)job_data;
+    SWcull_ctx *ctx = job->ctx;
+
+    SWcull_tri_buf *buf = &ctx->tri_bufs[i];
+    buf->count = 0;
+
+    const SWuint beg = i * SW_CULL_JOB_SURFS;
+    const SWuint end = sw_min(beg + SW_CULL_JOB_SURFS, job->occluders_count);
+    for (SWuint j = beg; j < end; j++) {
+        SWcull_surf *s = ctx->sorted_surfs[j];
+        if (_swCullSurfIsIndexedTris(s)) {
+            (*ctx->bin_tri_indexed_proc)(ctx, s->attribs, (const SWuint *)s->indices, s->stride, s->count,
+                                         s->xform, buf);
+            s->visible = 1;
         }
     }
 }
 
+static void _swCullRasterizeBin(void *job_data, const SWint i) {
+    const SWcull_job *job = (const SWcull_job *)job_data;
+    /* each bin owns separate set of tiles, so no synchronization is needed */
+    const SWuint tri_bufs_count = (job->occluders_count + SW_CULL_JOB_SURFS - 1) / SW_CULL_JOB_SURFS;
+    (*job->ctx->rast_bin_proc)(job->ctx, job->ctx->tri_bufs, tri_bufs_count, i);
+}
+
+static void _swCullTestOccludees(void *job_data, const SWint i) {
+    const SWcull_job *job = (const SWcull_job *)job_data;
+    SWcull_surf **occludees = job->ctx->sorted_surfs + job->occluders_count;
+
+    const SWuint beg = i * SW_CULL_JOB_SURFS;
+    const SWuint end = sw_min(beg + SW_CULL_JOB_SURFS, job->occludees_count);
+    for (SWuint j = beg; j < end; j++) {
+        _swCullCtxProcessSurf(job->ctx, occludees[j]);
+    }
+}
+
+void swCullCtxFlush(SWcull_ctx *ctx) {
+    SWcull_job job = {ctx, 0, 0};
+
+    /* occluders go first, relative order is kept */
+    for (SWuint i = 0; i < ctx->pending_count; i++) {
+        if (ctx->pending_surfs[i]->type == SW_OCCLUDER) {
+            ctx->sorted_surfs[job.occluders_count++] = ctx->pending_surfs[i];
+        }
+    }
+    for (SWuint i = 0; i < ctx->pending_count; i++) {
+        if (ctx->pending_surfs[i]->type != SW_OCCLUDER) {
+            ctx->sorted_surfs[job.occluders_count + job.occludees_count++] = ctx->pending_surfs[i];
+        }
+    }
+    ctx->pending_count = 0;
+
+    if (ctx->parallel_for && ctx->bin_tri_indexed_proc) {
+        const SWuint tri_bufs_count = (job.occluders_count + SW_CULL_JOB_SURFS - 1) / SW_CULL_JOB_SURFS;
+        if (tri_bufs_count > ctx->tri_bufs_capacity) {
+            ctx->tri_bufs = realloc(ctx->tri_bufs, tri_bufs_count * sizeof(SWcull_tri_buf));
+            memset(&ctx->tri_bufs[ctx->tri_bufs_capacity], 0,
+                   (tri_bufs_count - ctx->tri_bufs_capacity) * sizeof(SWcull_tri_buf));
+            ctx->tri_bufs_capacity = tri_bufs_count;
+        }
+
+        /* transform and clip occluders, then rasterize each screen bin on its own */
+        _swCullCtxRunJobs(ctx, (SWint)tri_bufs_count, _swCullBinOccluders, &job);
+        _swCullCtxRunJobs(ctx, SW_CULL_BINS_X * SW_CULL_BINS_Y, _swCullRasterizeBin, &job);
+    } else {
+        for (SWuint i = 0; i < job.occluders_count; i++) {
+            _swCullCtxProcessSurf(ctx, ctx->sorted_surfs[i]);
+        }
+    }
+
+    /* depth buffer is read-only at this point */
+    _swCullCtxRunJobs(ctx, (SWint)((job.occludees_count + SW_CULL_JOB_SURFS - 1) / SW_CULL_JOB_SURFS),
+                      _swCullTestOccludees, &job);
+}
+
 SWint swCullCtxTestRect(SWcull_ctx *ctx, const SWfloat p_min[2], const SWfloat p_max[3], const SWfloat w_min) {
     return (*ctx->test_rect_proc)(ctx, p_min, p_max, w_min);
 }
@@ -203,4 +371,11 @@ SWint _swClipPolygon(const __m128 in_vtx[], const SWint in_vtx_count, const __m1
     return out_vtx_count;
 }
 
+void _swCullTriBufReserve(SWcull_tri_buf *buf, const SWuint count) {
+    if (buf->count + count > buf->capacity) {
+        buf->capacity = sw_max(buf->count + count, 2 * buf->capacity);
+        buf->tris = realloc(buf->tris, buf->capacity * sizeof(SWcull_tri));
+    }
+}
+
 void swCullCtxDebugDepth(SWcull_ctx *ctx, SWfloat *out_depth) { (*ctx->debug_depth_proc)(ctx, out_depth); }
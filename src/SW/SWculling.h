@@ -12,6 +12,12 @@
 
 #define SW_CULL_QUICK_MASK
 
+/* screen is split into SW_CULL_BINS_X x SW_CULL_BINS_Y bins for parallel rasterization */
+#define SW_CULL_BINS_X 4
+#define SW_CULL_BINS_Y 4
+/* number of surfaces processed by single job */
+#define SW_CULL_JOB_SURFS 16
+
 typedef enum SWsurf_type { SW_OCCLUDER = 0, SW_OCCLUDEE } SWsurf_type;
 
 typedef struct SWcull_surf {
@@ -25,6 +31,17 @@ typedef struct SWcull_surf {
     SWint visible;
 } SWcull_surf;
 
+/* Clipped and projected occluder triangle waiting for binned rasterization */
+typedef struct SWcull_tri {
+    SWfloat x[3], y[3], w[3];
+    SWuint bin_mask; /* bit per each overlapped bin */
+} SWcull_tri;
+
+typedef struct SWcull_tri_buf {
+    SWcull_tri *tris;
+    SWuint count, capacity;
+} SWcull_tri_buf;
+
 /************************************************************************/
 
 struct SWcull_ctx;
@@ -38,6 +55,14 @@ typedef SWint (*SWCullRectProcType)(const struct SWcull_ctx *ctx, const SWfloat
 typedef void (*SWCullClearBufferProcType)(struct SWcull_ctx *ctx);
 typedef void (*SWCullDebugDepthProcType)(const struct SWcull_ctx *ctx,
                                          SWfloat *out_depth);
+typedef void (*SWCullBinTrianglesIndexedProcType)(struct SWcull_ctx *ctx,
+                                                  const void *attribs,
+                                                  const SWuint *indices, SWuint stride,
+                                                  SWuint index_count, const SWfloat *xform,
+                                                  SWcull_tri_buf *out_tris);
+typedef void (*SWCullRasterizeBinProcType)(struct SWcull_ctx *ctx,
+                                           const SWcull_tri_buf *tri_bufs,
+                                           SWuint tri_bufs_count, SWint bin);
 
 enum eClipPlane { Left, Right, Top, Bottom, Near, _PlanesCount };
 
@@ -57,6 +82,22 @@ typedef struct SWcull_ctx {
     SWCullRectProcType test_rect_proc;
     SWCullClearBufferProcType clear_buf_proc;
     SWCullDebugDepthProcType debug_depth_proc;
+    /* NULL when binned rasterization is not available for current cpu */
+    SWCullBinTrianglesIndexedProcType bin_tri_indexed_proc;
+    SWCullRasterizeBinProcType rast_bin_proc;
+
+    SWint bin_tile_w, bin_tile_h; /* size of one bin in tiles */
+
+    parallel_for_proc parallel_for;
+    void *parallel_for_userdata;
+
+    /* surfaces queued with swCullCtxSubmitCullSurfsAsync */
+    SWcull_surf **pending_surfs, **sorted_surfs;
+    SWuint pending_count, pending_capacity;
+
+    /* binned triangles of each occluder job */
+    SWcull_tri_buf *tri_bufs;
+    SWuint tri_bufs_capacity;
 
     ALIGNED(SWint size_ivec4[4], 16);
     ALIGNED(SWfloat half_size_vec4[4], 16);
@@ -71,6 +112,15 @@ void swCullCtxResize(SWcull_ctx *ctx, SWint w, SWint h, SWfloat near_clip);
 void swCullCtxClear(SWcull_ctx *ctx);
 void swCullCtxSubmitCullSurfs(SWcull_ctx *ctx, SWcull_surf *surfs, SWuint count);
 
+/* Enables multithreaded culling, passing NULL makes it serial again */
+void swCullCtxParallelFor(SWcull_ctx *ctx, parallel_for_proc proc, void *userdata);
+
+/* Queues surfaces without processing them, they must stay valid until swCullCtxFlush.
+   On flush all occluders are rasterized first and then occludees are tested, so the
+   order of submission does not matter. */
+void swCullCtxSubmitCullSurfsAsync(SWcull_ctx *ctx, SWcull_surf *surfs, SWuint count);
+void swCullCtxFlush(SWcull_ctx *ctx);
+
 SWint swCullCtxTestRect(SWcull_ctx *ctx, const SWfloat p_min[2], const SWfloat p_max[3],
                         SWfloat w_min);
 
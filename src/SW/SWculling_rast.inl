@@ -260,7 +260,8 @@ void NAME(_swComputeDepthPlane)(const __mXXX vX[3], const __mXXX vY[3],
 #endif
 
 SWint NAME(_swProcessTriangleBatch)(SWcull_ctx *ctx, __mXXX vX[3], __mXXX vY[3],
-                                    __mXXX vZ[3], SWuint tri_mask, SWint is_occluder) {
+                                    __mXXX vZ[3], SWuint tri_mask, const SWint scissor[4],
+                                    SWint is_occluder) {
     // find triangle bounds
     __mXXXi bb_px_min_x =
         _mmXXX_cvttps_epi32(_mmXXX_min_ps(vX[0], _mmXXX_min_ps(vX[1], vX[2])));
@@ -271,13 +272,11 @@ SWint NAME(_swProcessTriangleBatch)(SWcull_ctx *ctx, __mXXX vX[3], __mXXX vY[3],
     __mXXXi bb_px_max_y =
         _mmXXX_cvttps_epi32(_mmXXX_max_ps(vY[0], _mmXXX_max_ps(vY[1], vY[2])));
 
-    // clamp to frame bounds
-    bb_px_min_x = _mmXXX_max_epi32(bb_px_min_x, _mmXXX_set1_epi32(0));
-    bb_px_max_x = _mmXXX_min_epi32(bb_px_max_x,
-                                   _mmXXX_set1_epi32(ctx->tile_w * SW_CULL_TILE_SIZE_X));
-    bb_px_min_y = _mmXXX_max_epi32(bb_px_min_y, _mmXXX_set1_epi32(0));
-    bb_px_max_y = _mmXXX_min_epi32(bb_px_max_y,
-                                   _mmXXX_set1_epi32(ctx->tile_h * SW_CULL_TILE_SIZE_Y));
+    // clamp to scissor rect (whole frame or single bin, always tile aligned)
+    bb_px_min_x = _mmXXX_max_epi32(bb_px_min_x, _mmXXX_set1_epi32(scissor[0]));
+    bb_px_max_x = _mmXXX_min_epi32(bb_px_max_x, _mmXXX_set1_epi32(scissor[2]));
+    bb_px_min_y = _mmXXX_max_epi32(bb_px_min_y, _mmXXX_set1_epi32(scissor[1]));
+    bb_px_max_y = _mmXXX_min_epi32(bb_px_max_y, _mmXXX_set1_epi32(scissor[3]));
 
     // snap to tiles (min % TILE_SIZE_, (max + TILE_SIZE_ - 1) % TILE_SIZE_)
     bb_px_min_x =
@@ -554,12 +553,53 @@ SWint NAME(_swProcessTriangleBatch)(SWcull_ctx *ctx, __mXXX vX[3], __mXXX vY[3],
 SWint _swClipPolygon(const __m128 in_vtx[], const SWint in_vtx_count, const __m128 plane,
                      __m128 out_vtx[]);
 
+void _swCullTriBufReserve(SWcull_tri_buf *buf, SWuint count);
+
 #define SW_MAX_CLIPPED (8 * SIMD_WIDTH)
 
-SWint NAME(_swProcessTrianglesIndexed)(SWcull_ctx *ctx, const void *attribs,
-                                       const SWuint *indices, const SWuint stride,
-                                       const SWuint index_count, const SWfloat *xform,
-                                       const SWint is_occluder) {
+static SWuint NAME(_swTriangleBinMask)(const SWcull_ctx *ctx, const SWcull_tri *tri) {
+    // same bounds as in _swProcessTriangleBatch
+    const SWint px_min_x =
+        sw_max((SWint)sw_min(tri->x[0], sw_min(tri->x[1], tri->x[2])), 0);
+    const SWint px_min_y =
+        sw_max((SWint)sw_min(tri->y[0], sw_min(tri->y[1], tri->y[2])), 0);
+    const SWint px_max_x = sw_min((SWint)sw_max(tri->x[0], sw_max(tri->x[1], tri->x[2])),
+                                  ctx->tile_w * SW_CULL_TILE_SIZE_X);
+    const SWint px_max_y = sw_min((SWint)sw_max(tri->y[0], sw_max(tri->y[1], tri->y[2])),
+                                  ctx->tile_h * SW_CULL_TILE_SIZE_Y);
+
+    const SWint tile_min_x = px_min_x >> SW_CULL_TILE_WIDTH_SHIFT;
+    const SWint tile_min_y = px_min_y >> SW_CULL_TILE_HEIGHT_SHIFT;
+    const SWint tile_max_x =
+        (px_max_x + SW_CULL_TILE_SIZE_X - 1) >> SW_CULL_TILE_WIDTH_SHIFT;
+    const SWint tile_max_y =
+        (px_max_y + SW_CULL_TILE_SIZE_Y - 1) >> SW_CULL_TILE_HEIGHT_SHIFT;
+    if (tile_max_x <= tile_min_x || tile_max_y <= tile_min_y) {
+        return 0;
+    }
+
+    SWuint bin_mask = 0;
+    for (SWint by = tile_min_y / ctx->bin_tile_h; by <= (tile_max_y - 1) / ctx->bin_tile_h;
+         by++) {
+        for (SWint bx = tile_min_x / ctx->bin_tile_w;
+             bx <= (tile_max_x - 1) / ctx->bin_tile_w; bx++) {
+            bin_mask |= (1u << (by * SW_CULL_BINS_X + bx));
+        }
+    }
+    return bin_mask;
+}
+
+// Triangles are either rasterized right away or, when out_tris is not NULL, stored in
+// screen space for binned rasterization
+static SWint NAME(_swTransformTrianglesIndexed)(SWcull_ctx *ctx, const void *attribs,
+                                                const SWuint *indices, const SWuint stride,
+                                                const SWuint index_count,
+                                                const SWfloat *xform,
+                                                const SWint is_occluder,
+                                                SWcull_tri_buf *out_tris) {
+    const SWint scissor[4] = {0, 0, ctx->tile_w * SW_CULL_TILE_SIZE_X,
+                              ctx->tile_h * SW_CULL_TILE_SIZE_Y};
+
     union {
         __m128 vec;
         float f32[4];
@@ -781,8 +821,28 @@ SWint NAME(_swProcessTrianglesIndexed)(SWcull_ctx *ctx, const void *attribs,
             continue;
         }
 
+        if (out_tris) {
+            _swCullTriBufReserve(out_tris, SIMD_WIDTH);
+            while (tri_mask) {
+                const SWint tri_ndx = _swGetFirstBit(tri_mask);
+                tri_mask &= tri_mask - 1;
+
+                SWcull_tri *tri = &out_tris->tris[out_tris->count];
+                for (SWint i = 0; i < 3; i++) {
+                    tri->x[i] = vX[i].f32[tri_ndx];
+                    tri->y[i] = vY[i].f32[tri_ndx];
+                    tri->w[i] = vW[i].f32[tri_ndx];
+                }
+                tri->bin_mask = NAME(_swTriangleBinMask)(ctx, tri);
+                if (tri->bin_mask) {
+                    out_tris->count++;
+                }
+            }
+            continue;
+        }
+
         const SWint res = NAME(_swProcessTriangleBatch)(
-            ctx, &vX[0].vec, &vY[0].vec, &vW[0].vec, tri_mask, is_occluder);
+            ctx, &vX[0].vec, &vY[0].vec, &vW[0].vec, tri_mask, scissor, is_occluder);
         if (res && !is_occluder) {
             return 1;
         }
@@ -791,6 +851,73 @@ SWint NAME(_swProcessTrianglesIndexed)(SWcull_ctx *ctx, const void *attribs,
     return is_occluder;
 }
 
+SWint NAME(_swProcessTrianglesIndexed)(SWcull_ctx *ctx, const void *attribs,
+                                       const SWuint *indices, const SWuint stride,
+                                       const SWuint index_count, const SWfloat *xform,
+                                       const SWint is_occluder) {
+    return NAME(_swTransformTrianglesIndexed)(ctx, attribs, indices, stride, index_count,
+                                              xform, is_occluder, NULL);
+}
+
+void NAME(_swBinTrianglesIndexed)(SWcull_ctx *ctx, const void *attribs,
+                                  const SWuint *indices, const SWuint stride,
+                                  const SWuint index_count, const SWfloat *xform,
+                                  SWcull_tri_buf *out_tris) {
+    NAME(_swTransformTrianglesIndexed)(ctx, attribs, indices, stride, index_count, xform,
+                                       1, out_tris);
+}
+
+void NAME(_swRasterizeBin)(SWcull_ctx *ctx, const SWcull_tri_buf *tri_bufs,
+                           const SWuint tri_bufs_count, const SWint bin) {
+    const SWint bin_x = bin % SW_CULL_BINS_X, bin_y = bin / SW_CULL_BINS_X;
+    const SWint scissor[4] = {
+        bin_x * ctx->bin_tile_w * SW_CULL_TILE_SIZE_X,
+        bin_y * ctx->bin_tile_h * SW_CULL_TILE_SIZE_Y,
+        sw_min((bin_x + 1) * ctx->bin_tile_w, ctx->tile_w) * SW_CULL_TILE_SIZE_X,
+        sw_min((bin_y + 1) * ctx->bin_tile_h, ctx->tile_h) * SW_CULL_TILE_SIZE_Y};
+    if (scissor[0] >= scissor[2] || scissor[1] >= scissor[3]) {
+        return;
+    }
+
+    const SWuint bin_bit = (1u << bin);
+
+    union {
+        __mXXX vec;
+        SWfloat f32[SIMD_WIDTH];
+    } vX[3], vY[3], vW[3];
+    SWint lanes_count = 0;
+
+    // triangles are visited in submission order, so every tile gets the same sequence
+    // of updates as with serial rasterization
+    for (SWuint i = 0; i < tri_bufs_count; i++) {
+        const SWcull_tri_buf *buf = &tri_bufs[i];
+        for (SWuint j = 0; j < buf->count; j++) {
+            const SWcull_tri *tri = &buf->tris[j];
+            if (!(tri->bin_mask & bin_bit)) {
+                continue;
+            }
+
+            for (SWint k = 0; k < 3; k++) {
+                vX[k].f32[lanes_count] = tri->x[k];
+                vY[k].f32[lanes_count] = tri->y[k];
+                vW[k].f32[lanes_count] = tri->w[k];
+            }
+
+            if (++lanes_count == SIMD_WIDTH) {
+                NAME(_swProcessTriangleBatch)
+                (ctx, &vX[0].vec, &vY[0].vec, &vW[0].vec, (1u << SIMD_WIDTH) - 1, scissor,
+                 1);
+                lanes_count = 0;
+            }
+        }
+    }
+
+    if (lanes_count) {
+        NAME(_swProcessTriangleBatch)
+        (ctx, &vX[0].vec, &vY[0].vec, &vW[0].vec, (1u << lanes_count) - 1, scissor, 1);
+    }
+}
+
 SWint NAME(_swCullCtxTestRect)(const SWcull_ctx *ctx, const SWfloat p_min[2],
                                const SWfloat p_max[3], const SWfloat w_min) {
 #define SIMD_TILE_PAD                                                                    \
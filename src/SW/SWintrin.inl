@@ -1,3 +1,6 @@
+#ifndef SW_INTRIN_INL
+#define SW_INTRIN_INL
+
 #if defined(__aarch64__) || defined(_M_ARM) || defined(_M_ARM64)
 #include <float.h>
 #include <arm_neon.h>
@@ -35,6 +38,10 @@ typedef __m128i __mXXXi;
 #define _mmXXX_set1_epi32 _mm_set1_epi32
 #define _mmXXX_setr_epi32 _mm_setr_epi32
 
+#define _mmXXX_loadu_ps _mm_loadu_ps
+#define _mmXXX_loadu_siXXX(p) _mm_loadu_si128((const __m128i *)(p))
+#define _mmXXX_storeu_ps _mm_storeu_ps
+
 #define _mmXXX_add_ps _mm_add_ps
 #define _mmXXX_add_epi32 _mm_add_epi32
 #define _mmXXX_sub_ps _mm_sub_ps
@@ -166,6 +173,10 @@ typedef __m256i __mXXXi;
 #define _mmXXX_set1_epi32 _mm256_set1_epi32
 #define _mmXXX_setr_epi32 _mm256_setr_epi32
 
+#define _mmXXX_loadu_ps _mm256_loadu_ps
+#define _mmXXX_loadu_siXXX(p) _mm256_loadu_si256((const __m256i *)(p))
+#define _mmXXX_storeu_ps _mm256_storeu_ps
+
 #define _mmXXX_add_ps _mm256_add_ps
 #define _mmXXX_add_epi32 _mm256_add_epi32
 #define _mmXXX_sub_ps _mm256_sub_ps
@@ -212,6 +223,10 @@ typedef __m256i __mXXXi;
 #define _mmXXX_slli_epi32 _mm256_slli_epi32
 #define _mmXXX_srli_epi32 _mm256_srli_epi32
 #define _mmXXX_srai_epi32 _mm256_srai_epi32
+#define _mmXXX_srlv_epi32 _mm256_srlv_epi32
+
+#define _mmXXX_i32gather_epi32(base, vindex, scale)                                      \
+    _mm256_i32gather_epi32((const int *)(base), vindex, scale)
 
 #define _mmXXX_blendv_ps _mm256_blendv_ps
 
@@ -246,6 +261,10 @@ typedef __m512i __mXXXi;
 #define _mmXXX_set1_epi32 _mm512_set1_epi32
 #define _mmXXX_setr_epi32 _mm512_setr_epi32
 
+#define _mmXXX_loadu_ps _mm512_loadu_ps
+#define _mmXXX_loadu_siXXX(p) _mm512_loadu_si512((const void *)(p))
+#define _mmXXX_storeu_ps _mm512_storeu_ps
+
 #define _mmXXX_add_ps _mm512_add_ps
 #define _mmXXX_add_epi32 _mm512_add_epi32
 #define _mmXXX_sub_ps _mm512_sub_ps
@@ -319,6 +338,10 @@ static __mmask16 _mmXXX_movemask_ps(const __m512 a) {
 #define _mmXXX_slli_epi32 _mm512_slli_epi32
 #define _mmXXX_srli_epi32 _mm512_srli_epi32
 #define _mmXXX_srai_epi32 _mm512_srai_epi32
+#define _mmXXX_srlv_epi32 _mm512_srlv_epi32
+
+#define _mmXXX_i32gather_epi32(base, vindex, scale)                                      \
+    _mm512_i32gather_epi32(vindex, (const void *)(base), scale)
 
 static __m512 _mmXXX_blendv_ps(const __m512 a, const __m512 b, const __m512 c) {
     __mmask16 mask = _mmXXX_movemask_ps(c);
@@ -381,6 +404,10 @@ force_inline int32x4_t _mmXXX_setr_epi32(int32_t w, int32_t z, int32_t y, int32_
     return vld1q_s32(data);
 }
 
+#define _mmXXX_loadu_ps vld1q_f32
+#define _mmXXX_loadu_siXXX(p) vld1q_s32((const int32_t *)(p))
+#define _mmXXX_storeu_ps vst1q_f32
+
 #define _mmXXX_add_ps vaddq_f32
 #define _mmXXX_add_epi32 vaddq_s32
 #define _mmXXX_sub_ps vsubq_f32
@@ -658,3 +685,5 @@ force_inline float32x4_t _mm128_dp4_ps(const float32x4_t a, const float32x4_t b)
 #endif
 
 #undef force_inline
+
+#endif // SW_INTRIN_INL
@@ -0,0 +1,56 @@
+#include "SWpacket.h"
+
+const SWint _sw_packet_lane_x[SW_PACKET_SIZE] = {0, 1, 0, 1, 2, 3, 2, 3,
+                                                 0, 1, 0, 1, 2, 3, 2, 3};
+const SWint _sw_packet_lane_y[SW_PACKET_SIZE] = {0, 0, 1, 1, 0, 0, 1, 1,
+                                                 2, 2, 3, 3, 2, 2, 3, 3};
+
+#if defined(__aarch64__) || defined(_M_ARM) || defined(_M_ARM64)
+SWuint _swInterpolatePacket_NEON(const SWpacket_tri *tri, SWint x, SWint y, const SWint c[3],
+                                 SWuint mask, const SWfloat *zbuf, SWfloat *out);
+void _swTexGetColorPacket_NEON(const struct SWtexture *t, const SWfloat *u, const SWfloat *v,
+                               SWfloat *rgba);
+#else
+SWuint _swInterpolatePacket_SSE2(const SWpacket_tri *tri, SWint x, SWint y, const SWint c[3],
+                                 SWuint mask, const SWfloat *zbuf, SWfloat *out);
+SWuint _swInterpolatePacket_AVX2(const SWpacket_tri *tri, SWint x, SWint y, const SWint c[3],
+                                 SWuint mask, const SWfloat *zbuf, SWfloat *out);
+
+void _swTexGetColorPacket_SSE2(const struct SWtexture *t, const SWfloat *u, const SWfloat *v,
+                               SWfloat *rgba);
+void _swTexGetColorPacket_AVX2(const struct SWtexture *t, const SWfloat *u, const SWfloat *v,
+                               SWfloat *rgba);
+
+#if !defined(_MSC_VER) || _MSC_VER > 1916
+SWuint _swInterpolatePacket_AVX512(const SWpacket_tri *tri, SWint x, SWint y, const SWint c[3],
+                                   SWuint mask, const SWfloat *zbuf, SWfloat *out);
+void _swTexGetColorPacket_AVX512(const struct SWtexture *t, const SWfloat *u, const SWfloat *v,
+                                 SWfloat *rgba);
+#endif
+#endif
+
+void swPacketProcsInit(SWpacket_procs *procs, const SWcpu_info *cpu_info) {
+    ((void)cpu_info);
+#if defined(__aarch64__) || defined(_M_ARM) || defined(_M_ARM64)
+    procs->interp_proc = &_swInterpolatePacket_NEON;
+    procs->tex_proc = &_swTexGetColorPacket_NEON;
+#else
+#if !defined(_MSC_VER) || _MSC_VER > 1916
+    if (cpu_info->avx512_supported) {
+        procs->interp_proc = &_swInterpolatePacket_AVX512;
+        procs->tex_proc = &_swTexGetColorPacket_AVX512;
+    } else
+#endif
+    if (cpu_info->avx2_supported) {
+        procs->interp_proc = &_swInterpolatePacket_AVX2;
+        procs->tex_proc = &_swTexGetColorPacket_AVX2;
+    } else if (cpu_info->sse2_supported) {
+        procs->interp_proc = &_swInterpolatePacket_SSE2;
+        procs->tex_proc = &_swTexGetColorPacket_SSE2;
+    } else
+#endif
+    {
+        procs->interp_proc = &_swInterpolatePacket_Ref;
+        procs->tex_proc = &_swTexGetColorPacket_Ref;
+    }
+}
@@ -0,0 +1,40 @@
+#ifndef SWPACKET_H
+#define SWPACKET_H
+
+#include "SWcore.h"
+#include "SWcpu.h"
+
+struct SWtexture;
+
+/* Triangle data shared by all packets (perspective-correct interpolation) */
+typedef struct SWpacket_tri {
+    const SWfloat *v0, *v1, *v2;
+    SWint num_attrs;
+    SWfloat inv_area;
+    SWint c_offsets[3][SW_PACKET_SIZE]; /* edge function values of each lane relative to packet origin */
+} SWpacket_tri;
+
+/* Interpolates attributes of packet located at (x, y) into SoA array, c holds edge functions at (x, y).
+   Returns mask of lanes that passed coverage, depth range and depth buffer (if zbuf is not NULL) tests,
+   attributes of lanes that failed are undefined */
+typedef SWuint (*SWPacketInterpProcType)(const SWpacket_tri *tri, SWint x, SWint y, const SWint c[3],
+                                         SWuint mask, const SWfloat *zbuf, SWfloat *out);
+/* Fetches texture color for each lane (nearest filtering), output is stored as SoA */
+typedef void (*SWPacketTexProcType)(const struct SWtexture *t, const SWfloat *u, const SWfloat *v,
+                                    SWfloat *rgba);
+
+typedef struct SWpacket_procs {
+    SWPacketInterpProcType interp_proc;
+    SWPacketTexProcType tex_proc;
+} SWpacket_procs;
+
+extern const SWint _sw_packet_lane_x[SW_PACKET_SIZE], _sw_packet_lane_y[SW_PACKET_SIZE];
+
+void swPacketProcsInit(SWpacket_procs *procs, const SWcpu_info *cpu_info);
+
+SWuint _swInterpolatePacket_Ref(const SWpacket_tri *tri, SWint x, SWint y, const SWint c[3],
+                                SWuint mask, const SWfloat *zbuf, SWfloat *out);
+void _swTexGetColorPacket_Ref(const struct SWtexture *t, const SWfloat *u, const SWfloat *v,
+                              SWfloat *rgba);
+
+#endif /* SWPACKET_H */
@@ -0,0 +1,167 @@
+#include "SWintrin.inl"
+
+#ifndef NAME
+#define PASTER(x, y) x##_##y
+#define EVALUATOR(x, y) PASTER(x, y)
+#define NAME(fun) EVALUATOR(fun, POSTFIX)
+#endif
+
+#define SIMD_LANES_MASK ((SWuint)((1ull << SIMD_WIDTH) - 1))
+
+/* Multiplications and additions are kept separate (no fma), so results match scalar path */
+
+SWuint NAME(_swInterpolatePacket)(const SWpacket_tri *tri, const SWint x, const SWint y,
+                                  const SWint c[3], const SWuint mask, const SWfloat *zbuf,
+                                  SWfloat *out) {
+    const SWfloat *v0 = tri->v0, *v1 = tri->v1, *v2 = tri->v2;
+
+    const __mXXX zero = _mmXXX_setzero_ps(), one = _mmXXX_set1_ps(1.0f);
+    const __mXXX inv_area = _mmXXX_set1_ps(tri->inv_area);
+
+    SWuint out_mask = 0;
+
+    for (SWint l = 0; l < SW_PACKET_SIZE; l += SIMD_WIDTH) {
+        SWuint lanes = (mask >> l) & SIMD_LANES_MASK;
+
+        const __mXXX c1 = _mmXXX_cvtepi32_ps(_mmXXX_add_epi32(
+            _mmXXX_set1_epi32(c[0]), _mmXXX_loadu_siXXX(&tri->c_offsets[0][l])));
+        const __mXXX c2 = _mmXXX_cvtepi32_ps(_mmXXX_add_epi32(
+            _mmXXX_set1_epi32(c[1]), _mmXXX_loadu_siXXX(&tri->c_offsets[1][l])));
+        const __mXXX c3 = _mmXXX_cvtepi32_ps(_mmXXX_add_epi32(
+            _mmXXX_set1_epi32(c[2]), _mmXXX_loadu_siXXX(&tri->c_offsets[2][l])));
+
+        /* conversion keeps the sign, so coverage test can be done in floating point */
+        lanes &= _mmXXX_movemask_ps(_mmXXX_cmpgt_ps(c1, zero)) &
+                 _mmXXX_movemask_ps(_mmXXX_cmpgt_ps(c2, zero)) &
+                 _mmXXX_movemask_ps(_mmXXX_cmpgt_ps(c3, zero));
+
+        __mXXX u1 = _mmXXX_mul_ps(c3, inv_area), u2 = _mmXXX_mul_ps(c1, inv_area);
+        __mXXX u0 = _mmXXX_sub_ps(_mmXXX_sub_ps(one, u1), u2);
+
+        const __mXXX z = _mmXXX_add_ps(
+            _mmXXX_add_ps(_mmXXX_mul_ps(u0, _mmXXX_set1_ps(v0[2])),
+                          _mmXXX_mul_ps(u1, _mmXXX_set1_ps(v1[2]))),
+            _mmXXX_mul_ps(u2, _mmXXX_set1_ps(v2[2])));
+
+        /* depth bounds test */
+        lanes &= ~(_mmXXX_movemask_ps(_mmXXX_cmpgt_ps(zero, z)) |
+                   _mmXXX_movemask_ps(_mmXXX_cmpgt_ps(z, one)));
+        /* depth buffer test */
+        if (zbuf) {
+            lanes &= _mmXXX_movemask_ps(_mmXXX_cmpge_ps(_mmXXX_loadu_ps(&zbuf[l]), z));
+        }
+
+        if (!lanes) {
+            /* keep dead lanes initialized, shader still processes them */
+            for (SWint i = 0; i < tri->num_attrs; i++) {
+                _mmXXX_storeu_ps(&out[i * SW_PACKET_SIZE + l], zero);
+            }
+            continue;
+        }
+
+        const __mXXX inv_w = _mmXXX_div_ps(
+            one, _mmXXX_add_ps(_mmXXX_add_ps(_mmXXX_mul_ps(u0, _mmXXX_set1_ps(v0[3])),
+                                             _mmXXX_mul_ps(u1, _mmXXX_set1_ps(v1[3]))),
+                               _mmXXX_mul_ps(u2, _mmXXX_set1_ps(v2[3]))));
+        u0 = _mmXXX_mul_ps(u0, inv_w);
+        u1 = _mmXXX_mul_ps(u1, inv_w);
+        u2 = _mmXXX_mul_ps(u2, inv_w);
+
+        _mmXXX_storeu_ps(&out[0 * SW_PACKET_SIZE + l],
+                         _mmXXX_cvtepi32_ps(_mmXXX_add_epi32(
+                             _mmXXX_set1_epi32(x), _mmXXX_loadu_siXXX(&_sw_packet_lane_x[l]))));
+        _mmXXX_storeu_ps(&out[1 * SW_PACKET_SIZE + l],
+                         _mmXXX_cvtepi32_ps(_mmXXX_add_epi32(
+                             _mmXXX_set1_epi32(y), _mmXXX_loadu_siXXX(&_sw_packet_lane_y[l]))));
+        _mmXXX_storeu_ps(&out[2 * SW_PACKET_SIZE + l], z);
+        _mmXXX_storeu_ps(&out[3 * SW_PACKET_SIZE + l], inv_w);
+
+        for (SWint i = 4; i < tri->num_attrs; i++) {
+            const __mXXX val =
+                _mmXXX_add_ps(_mmXXX_add_ps(_mmXXX_mul_ps(u0, _mmXXX_set1_ps(v0[i])),
+                                            _mmXXX_mul_ps(u1, _mmXXX_set1_ps(v1[i]))),
+                              _mmXXX_mul_ps(u2, _mmXXX_set1_ps(v2[i])));
+            _mmXXX_storeu_ps(&out[i * SW_PACKET_SIZE + l], val);
+        }
+
+        out_mask |= (lanes << l);
+    }
+
+    return out_mask;
+}
+
+void NAME(_swTexGetColorPacket)(const SWtexture *t, const SWfloat *u, const SWfloat *v,
+                                SWfloat *rgba) {
+    if (t->type != SW_UNSIGNED_BYTE) {
+        _swTexGetColorPacket_Ref(t, u, v, rgba);
+        return;
+    }
+
+    const SWubyte *pixels = (const SWubyte *)t->pixels;
+    const SWint channels = (t->mode == SW_RGBA) ? 4 : 3;
+
+    const __mXXX w = _mmXXX_set1_ps((SWfloat)t->w), h = _mmXXX_set1_ps((SWfloat)t->h);
+    const __mXXXi w_mask = _mmXXX_set1_epi32(t->w - 1), h_mask = _mmXXX_set1_epi32(t->h - 1);
+    const __mXXX ubyte_max = _mmXXX_set1_ps(255.0f);
+
+#if defined(USE_AVX2) || defined(USE_AVX512)
+    if (channels * t->w * t->h < 4) {
+        /* gathered dword would not fit into image */
+        _swTexGetColorPacket_Ref(t, u, v, rgba);
+        return;
+    }
+
+    const __mXXXi row_pitch = _mmXXX_set1_epi32(t->w), byte_mask = _mmXXX_set1_epi32(0xff);
+    /* RGB texels are read as dwords too, the last one is taken one byte earlier to stay inside of image */
+    const __mXXXi last_offset = _mmXXX_set1_epi32(channels * t->w * t->h - 4);
+#endif
+
+    for (SWint l = 0; l < SW_PACKET_SIZE; l += SIMD_WIDTH) {
+        union {
+            __mXXXi vec;
+            SWint i32[SIMD_WIDTH];
+        } ix, iy, col[4];
+
+        /* texel coordinates are wrapped the same way as in swTexGetColorFloat_RGBA */
+        ix.vec = _mmXXX_and_siXXX(_mmXXX_cvttps_epi32(_mmXXX_mul_ps(_mmXXX_loadu_ps(&u[l]), w)),
+                                  w_mask);
+        iy.vec = _mmXXX_and_siXXX(_mmXXX_cvttps_epi32(_mmXXX_mul_ps(_mmXXX_loadu_ps(&v[l]), h)),
+                                  h_mask);
+
+#if defined(USE_AVX2) || defined(USE_AVX512)
+        const __mXXXi texel = _mmXXX_add_epi32(_mmXXX_mullo_epi32(iy.vec, row_pitch), ix.vec);
+
+        __mXXXi texel_data;
+        if (channels == 4) {
+            texel_data = _mmXXX_i32gather_epi32(pixels, texel, 4);
+        } else {
+            const __mXXXi offset = _mmXXX_mullo_epi32(texel, _mmXXX_set1_epi32(3));
+            const __mXXXi clamped_offset = _mmXXX_min_epi32(offset, last_offset);
+            texel_data = _mmXXX_srlv_epi32(
+                _mmXXX_i32gather_epi32(pixels, clamped_offset, 1),
+                _mmXXX_slli_epi32(_mmXXX_sub_epi32(offset, clamped_offset), 3));
+            texel_data = _mmXXX_or_siXXX(texel_data, _mmXXX_set1_epi32((SWint)0xff000000));
+        }
+
+        col[0].vec = _mmXXX_and_siXXX(texel_data, byte_mask);
+        col[1].vec = _mmXXX_and_siXXX(_mmXXX_srli_epi32(texel_data, 8), byte_mask);
+        col[2].vec = _mmXXX_and_siXXX(_mmXXX_srli_epi32(texel_data, 16), byte_mask);
+        col[3].vec = _mmXXX_srli_epi32(texel_data, 24);
+#else
+        for (SWint j = 0; j < SIMD_WIDTH; j++) {
+            const SWubyte *p = &pixels[channels * (iy.i32[j] * t->w + ix.i32[j])];
+            col[0].i32[j] = p[0];
+            col[1].i32[j] = p[1];
+            col[2].i32[j] = p[2];
+            col[3].i32[j] = (channels == 4) ? p[3] : 255;
+        }
+#endif
+
+        for (SWint i = 0; i < 4; i++) {
+            _mmXXX_storeu_ps(&rgba[i * SW_PACKET_SIZE + l],
+                             _mmXXX_div_ps(_mmXXX_cvtepi32_ps(col[i].vec), ubyte_max));
+        }
+    }
+}
+
+#undef SIMD_LANES_MASK
@@ -0,0 +1,6 @@
+#include "SWpacket.h"
+#include "SWtexture.h"
+
+#define USE_AVX2
+#include "SWpacket.inl"
+#undef USE_AVX2
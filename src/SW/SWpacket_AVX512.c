@@ -0,0 +1,6 @@
+#include "SWpacket.h"
+#include "SWtexture.h"
+
+#define USE_AVX512
+#include "SWpacket.inl"
+#undef USE_AVX512
@@ -0,0 +1,6 @@
+#include "SWpacket.h"
+#include "SWtexture.h"
+
+#define USE_NEON
+#include "SWpacket.inl"
+#undef USE_NEON
@@ -0,0 +1,56 @@
+#include "SWpacket.h"
+
+#include "SWtexture.h"
+
+SWuint _swInterpolatePacket_Ref(const SWpacket_tri *tri, const SWint x, const SWint y,
+                                const SWint c[3], const SWuint mask, const SWfloat *zbuf,
+                                SWfloat *out) {
+    const SWfloat *v0 = tri->v0, *v1 = tri->v1, *v2 = tri->v2;
+    SWuint out_mask = 0;
+
+    for (SWint l = 0; l < SW_PACKET_SIZE; l++) {
+        const SWint c1 = c[0] + tri->c_offsets[0][l], c2 = c[1] + tri->c_offsets[1][l],
+                    c3 = c[2] + tri->c_offsets[2][l];
+
+        SWfloat uvw[3] = {0, c3 * tri->inv_area, c1 * tri->inv_area};
+        uvw[0] = 1 - uvw[1] - uvw[2];
+
+        const SWfloat z = uvw[0] * v0[2] + uvw[1] * v1[2] + uvw[2] * v2[2];
+
+        if (!((mask >> l) & 1) || c1 <= 0 || c2 <= 0 || c3 <= 0 || z < 0 || z > 1 ||
+            (zbuf && !(z <= zbuf[l]))) {
+            for (SWint i = 0; i < tri->num_attrs; i++) {
+                out[i * SW_PACKET_SIZE + l] = 0;
+            }
+            continue;
+        }
+
+        const SWfloat inv_w = 1 / (uvw[0] * v0[3] + uvw[1] * v1[3] + uvw[2] * v2[3]);
+        uvw[0] *= inv_w;
+        uvw[1] *= inv_w;
+        uvw[2] *= inv_w;
+
+        out[0 * SW_PACKET_SIZE + l] = (SWfloat)(x + _sw_packet_lane_x[l]);
+        out[1 * SW_PACKET_SIZE + l] = (SWfloat)(y + _sw_packet_lane_y[l]);
+        out[2 * SW_PACKET_SIZE + l] = z;
+        out[3 * SW_PACKET_SIZE + l] = inv_w;
+        for (SWint i = 4; i < tri->num_attrs; i++) {
+            out[i * SW_PACKET_SIZE + l] = uvw[0] * v0[i] + uvw[1] * v1[i] + uvw[2] * v2[i];
+        }
+
+        out_mask |= (1u << l);
+    }
+
+    return out_mask;
+}
+
+void _swTexGetColorPacket_Ref(const struct SWtexture *t, const SWfloat *u, const SWfloat *v,
+                              SWfloat *rgba) {
+    for (SWint l = 0; l < SW_PACKET_SIZE; l++) {
+        SWfloat col[4] = {0, 0, 0, 0};
+        swTexGetColorFloat_RGBA(t, u[l], v[l], col);
+        for (SWint i = 0; i < 4; i++) {
+            rgba[i * SW_PACKET_SIZE + l] = col[i];
+        }
+    }
+}
@@ -66,6 +66,26 @@ sw_inline SWfloat _swCurveTolerance(SWcontext *ctx, SWframebuffer *f) {
     return (ctx->curve_tolerance / f->w) * (ctx->curve_tolerance / f->h);
 }
 
+sw_inline void _swDrawTriangle(SWprogram *p, SWframebuffer *f, SWbinner *binner,
+                               SWfloat vs_out[][SW_MAX_VTX_ATTRIBS], const SWint _0,
+                               const SWint _1, const SWint _2, const SWint interp_mode,
+                               const SWint b_depth_test, const SWint b_depth_write,
+                               const SWint b_blend) {
+    if (binner) {
+        /* rasterization is deferred until the end of draw call */
+        swBinnerAddTriangle(binner, f, vs_out, _0, _1, _2, p->v_out_size);
+    } else if (interp_mode == 0) {
+        _swProcessTriangle_nocorrect(p, f, vs_out, _0, _1, _2, b_depth_test, b_depth_write,
+                                     b_blend);
+    } else if (interp_mode == 1) {
+        _swProcessTriangle_correct(p, f, vs_out, _0, _1, _2, b_depth_test, b_depth_write,
+                                   b_blend);
+    } else {
+        _swProcessTriangle_fast(p, f, vs_out, _0, _1, _2, b_depth_test, b_depth_write,
+                                b_blend);
+    }
+}
+
 /**************************************************************************************************/
 
 void swProgInit(SWprogram *p, SWubyte *uniform_buf, vtx_shader_proc v_proc,
@@ -428,6 +448,8 @@ void swProgDrawTrianglesArray(SWprogram *p, SWcontext *ctx, const SWuint first,
             ? ((ctx->render_flags & FAST_PERSPECTIVE_CORRECTION) ? 2 : 1)
             : 0;
     const SWint num_corr_attrs = (interp_mode == 0) ? 3 : p->v_out_size;
+    SWbinner *binner =
+        (ctx->render_flags & BINNED_RASTERIZATION_ENABLED) ? &ctx->binner : NULL;
 
     SWint i;
     SWuint j;
@@ -437,6 +459,10 @@ void swProgDrawTrianglesArray(SWprogram *p, SWcontext *ctx, const SWuint first,
         return;
     }
 
+    if (binner) {
+        swBinnerBegin(binner, f);
+    }
+
     for (j = first; j < first + count; j += 3) {
         /* transform vertices */
         (*p->v_proc)(p->vertex_attributes, j, p->uniforms, vs_out[0]);
@@ -449,21 +475,16 @@ void swProgDrawTrianglesArray(SWprogram *p, SWcontext *ctx, const SWuint first,
             vs_out, vs_out, 0, 1, 2, out_verts, p->v_out_size, num_corr_attrs);
 
         for (i = 1; i < num_verts - 1; i++) {
-            if (interp_mode == 0) {
-                _swProcessTriangle_nocorrect(p, f, vs_out, out_verts[0], out_verts[i],
-                                             out_verts[i + 1], b_depth_test,
-                                             b_depth_write, b_blend);
-            } else if (interp_mode == 1) {
-                _swProcessTriangle_correct(p, f, vs_out, out_verts[0], out_verts[i],
-                                           out_verts[i + 1], b_depth_test, b_depth_write,
-                                           b_blend);
-            } else {
-                _swProcessTriangle_fast(p, f, vs_out, out_verts[0], out_verts[i],
-                                        out_verts[i + 1], b_depth_test, b_depth_write,
-                                        b_blend);
-            }
+            _swDrawTriangle(p, f, binner, vs_out, out_verts[0], out_verts[i],
+                            out_verts[i + 1], interp_mode, b_depth_test, b_depth_write,
+                            b_blend);
         }
     }
+
+    if (binner) {
+        swBinnerRasterize(binner, p, f, interp_mode, b_depth_test, b_depth_write, b_blend,
+                          ctx->parallel_for, ctx->parallel_for_userdata);
+    }
 }
 
 void swProgDrawTriangleStripArray(SWprogram *p, SWcontext *ctx, const SWuint first,
@@ -477,6 +498,8 @@ void swProgDrawTriangleStripArray(SWprogram *p, SWcontext *ctx, const SWuint fir
             ? ((ctx->render_flags & FAST_PERSPECTIVE_CORRECTION) ? 2 : 1)
             : 0;
     const SWint num_corr_attrs = (interp_mode == 0) ? 3 : p->v_out_size;
+    SWbinner *binner =
+        (ctx->render_flags & BINNED_RASTERIZATION_ENABLED) ? &ctx->binner : NULL;
 
     SWfloat vs_out[3][SW_MAX_VTX_ATTRIBS];
     SWint _0 = 0, _1 = 1, _2 = 2, is_odd = 1;
@@ -487,6 +510,10 @@ void swProgDrawTriangleStripArray(SWprogram *p, SWcontext *ctx, const SWuint fir
         return;
     }
 
+    if (binner) {
+        swBinnerBegin(binner, f);
+    }
+
     for (SWuint j = first; j < first + count - 2; j++) {
         is_odd = !is_odd;
 
@@ -499,19 +526,9 @@ void swProgDrawTriangleStripArray(SWprogram *p, SWcontext *ctx, const SWuint fir
             vs_out, vs_out2, _0, _1, _2, out_verts, p->v_out_size, num_corr_attrs);
 
         for (SWint i = 1; i < num_verts - 1; i++) {
-            if (interp_mode == 0) {
-                _swProcessTriangle_nocorrect(p, f, vs_out2, out_verts[0], out_verts[i],
-                                             out_verts[i + 1], b_depth_test,
-                                             b_depth_write, b_blend);
-            } else if (interp_mode == 1) {
-                _swProcessTriangle_correct(p, f, vs_out2, out_verts[0], out_verts[i],
-                                           out_verts[i + 1], b_depth_test, b_depth_write,
-                                           b_blend);
-            } else {
-                _swProcessTriangle_fast(p, f, vs_out2, out_verts[0], out_verts[i],
-                                        out_verts[i + 1], b_depth_test, b_depth_write,
-                                        b_blend);
-            }
+            _swDrawTriangle(p, f, binner, vs_out2, out_verts[0], out_verts[i],
+                            out_verts[i + 1], interp_mode, b_depth_test, b_depth_write,
+                            b_blend);
         }
 
         if (is_odd) {
@@ -522,6 +539,11 @@ void swProgDrawTriangleStripArray(SWprogram *p, SWcontext *ctx, const SWuint fir
             sw_swap(_0, _1, SWint);
         }
     }
+
+    if (binner) {
+        swBinnerRasterize(binner, p, f, interp_mode, b_depth_test, b_depth_write, b_blend,
+                          ctx->parallel_for, ctx->parallel_for_userdata);
+    }
 }
 
 void swProgDrawTrianglesIndexed(SWprogram *p, SWcontext *ctx, const SWuint count,
@@ -536,6 +558,8 @@ void swProgDrawTrianglesIndexed(SWprogram *p, SWcontext *ctx, const SWuint count
             ? ((ctx->render_flags & FAST_PERSPECTIVE_CORRECTION) ? 2 : 1)
             : 0;
     const SWint num_corr_attrs = (interp_mode == 0) ? 3 : p->v_out_size;
+    SWbinner *binner =
+        (ctx->render_flags & BINNED_RASTERIZATION_ENABLED) ? &ctx->binner : NULL;
 
     SWuint index1 = 0, index2 = 0, index3 = 0;
     SWfloat vs_out[16][SW_MAX_VTX_ATTRIBS];
@@ -549,6 +573,10 @@ void swProgDrawTrianglesIndexed(SWprogram *p, SWcontext *ctx, const SWuint count
         indices = (char *)b->data + (uintptr_t)indices;
     }
 
+    if (binner) {
+        swBinnerBegin(binner, f);
+    }
+
     for (SWuint j = 0; j < count; j += 3) {
         if (index_type == SW_UNSIGNED_BYTE) {
             index1 = (SWuint) * ((SWubyte *)indices + j);
@@ -575,21 +603,16 @@ void swProgDrawTrianglesIndexed(SWprogram *p, SWcontext *ctx, const SWuint count
             vs_out, vs_out, 0, 1, 2, out_verts, p->v_out_size, num_corr_attrs);
 
         for (SWint i = 1; i < num_verts - 1; i++) {
-            if (interp_mode == 0) {
-                _swProcessTriangle_nocorrect(p, f, vs_out, out_verts[0], out_verts[i],
-                                             out_verts[i + 1], b_depth_test,
-                                             b_depth_write, b_blend);
-            } else if (interp_mode == 1) {
-                _swProcessTriangle_correct(p, f, vs_out, out_verts[0], out_verts[i],
-                                           out_verts[i + 1], b_depth_test, b_depth_write,
-                                           b_blend);
-            } else {
-                _swProcessTriangle_fast(p, f, vs_out, out_verts[0], out_verts[i],
-                                        out_verts[i + 1], b_depth_test, b_depth_write,
-                                        b_blend);
-            }
+            _swDrawTriangle(p, f, binner, vs_out, out_verts[0], out_verts[i],
+                            out_verts[i + 1], interp_mode, b_depth_test, b_depth_write,
+                            b_blend);
         }
     }
+
+    if (binner) {
+        swBinnerRasterize(binner, p, f, interp_mode, b_depth_test, b_depth_write, b_blend,
+                          ctx->parallel_for, ctx->parallel_for_userdata);
+    }
 }
 
 void swProgDrawTriangleStripIndexed(SWprogram *p, SWcontext *ctx, const SWuint count,
@@ -603,6 +626,8 @@ void swProgDrawTriangleStripIndexed(SWprogram *p, SWcontext *ctx, const SWuint c
             ? ((ctx->render_flags & FAST_PERSPECTIVE_CORRECTION) ? 2 : 1)
             : 0;
     const SWint num_corr_attrs = (interp_mode == 0) ? 3 : p->v_out_size;
+    SWbinner *binner =
+        (ctx->render_flags & BINNED_RASTERIZATION_ENABLED) ? &ctx->binner : NULL;
 
     SWuint index1 = 0, index2 = 0;
 
@@ -631,6 +656,10 @@ void swProgDrawTriangleStripIndexed(SWprogram *p, SWcontext *ctx, const SWuint c
     (*p->v_proc)(p->vertex_attributes, index1, p->uniforms, vs_out[0]);
     (*p->v_proc)(p->vertex_attributes, index2, p->uniforms, vs_out[1]);
 
+    if (binner) {
+        swBinnerBegin(binner, f);
+    }
+
     for (SWuint j = 0; j < count - 2; j++) {
         is_odd = !is_odd;
         SWuint index3 = _swGetIndex(index_type, j + 2, indices);
@@ -644,19 +673,9 @@ void swProgDrawTriangleStripIndexed(SWprogram *p, SWcontext *ctx, const SWuint c
             vs_out, vs_out2, _0, _1, _2, out_verts, p->v_out_size, num_corr_attrs);
 
         for (SWint i = 1; i < num_verts - 1; i++) {
-            if (interp_mode == 0) {
-                _swProcessTriangle_nocorrect(p, f, vs_out2, out_verts[0], out_verts[i],
-                                             out_verts[i + 1], b_depth_test,
-                                             b_depth_write, b_blend);
-            } else if (interp_mode == 1) {
-                _swProcessTriangle_correct(p, f, vs_out2, out_verts[0], out_verts[i],
-                                           out_verts[i + 1], b_depth_test, b_depth_write,
-                                           b_blend);
-            } else {
-                _swProcessTriangle_fast(p, f, vs_out2, out_verts[0], out_verts[i],
-                                        out_verts[i + 1], b_depth_test, b_depth_write,
-                                        b_blend);
-            }
+            _swDrawTriangle(p, f, binner, vs_out2, out_verts[0], out_verts[i],
+                            out_verts[i + 1], interp_mode, b_depth_test, b_depth_write,
+                            b_blend);
         }
 
         if (is_odd) {
@@ -667,4 +686,9 @@ void swProgDrawTriangleStripIndexed(SWprogram *p, SWcontext *ctx, const SWuint c
             sw_swap(_0, _1, SWint);
         }
     }
+
+    if (binner) {
+        swBinnerRasterize(binner, p, f, interp_mode, b_depth_test, b_depth_write, b_blend,
+                          ctx->parallel_for, ctx->parallel_for_userdata);
+    }
 }
@@ -2,6 +2,7 @@
 #define SW_PROGRAM_H
 
 #include "SWcore.h"
+#include "SWpacket.h"
 
 #define SW_MAX_VTX_ATTRIBS 16
 #define SW_MAX_UNIFORMS 32
@@ -10,6 +11,8 @@ typedef struct SWprogram {
     vtx_shader_proc v_proc;
     SWint v_out_size;
     frag_shader_proc f_proc;
+    frag_packet_shader_proc fp_proc; /* optional, used for perspective-correct triangles */
+    SWPacketInterpProcType fp_interp_proc;
     SWvtx_attribute vertex_attributes[SW_MAX_VTX_ATTRIBS];
     SWuint num_attributes;
     SWuniform uniforms[SW_MAX_UNIFORMS];
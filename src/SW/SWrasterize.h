@@ -3,6 +3,7 @@
 
 #include <assert.h>
 #include <math.h>
+#include <stddef.h>
 
 #include "SWframebuffer.h"
 #include "SWprogram.h"
@@ -180,10 +181,59 @@ sw_inline void _swProcessPixel_correct(SWprogram *p, SWframebuffer *f, SWint ix,
     }
 }
 
-sw_inline void _swProcessTriangle_correct(SWprogram *p, SWframebuffer *f,
-                                          SWfloat vs_out[3][SW_MAX_VTX_ATTRIBS], SWint _0,
-                                          SWint _1, SWint _2, SWint b_depth_test,
-                                          SWint b_depth_write, SWint b_blend) {
+sw_inline void _swProcessPacket_correct(SWprogram *p, SWframebuffer *f,
+                                        const SWpacket_tri *tri, SWint x, SWint y,
+                                        const SWint c[3], SWint x1, SWint y1,
+                                        SWint b_depth_test, SWint b_depth_write,
+                                        SWint b_blend) {
+    SWfloat zbuf[SW_PACKET_SIZE];
+    SWfloat fs_in[SW_MAX_VTX_ATTRIBS * SW_PACKET_SIZE], fs_out[4 * SW_PACKET_SIZE];
+    SWuint mask = 0;
+    SWint l;
+
+    /* skip pixels outside of tile (only happens at framebuffer borders) */
+    for (l = 0; l < SW_PACKET_SIZE; l++) {
+        const SWint ix = x + _sw_packet_lane_x[l], iy = y + _sw_packet_lane_y[l];
+        zbuf[l] = 0;
+        if (ix <= x1 && iy <= y1) {
+            if (b_depth_test) {
+                zbuf[l] = swZbufGetDepth(f->zbuf, ix, iy);
+            }
+            mask |= (1u << l);
+        }
+    }
+
+    mask = (*p->fp_interp_proc)(tri, x, y, c, mask, b_depth_test ? zbuf : NULL, fs_in);
+    if (!mask) {
+        return;
+    }
+
+    (*p->fp_proc)(fs_in, p->uniforms, fs_out, &mask);
+
+    for (l = 0; l < SW_PACKET_SIZE; l++) {
+        if (!(mask & (1u << l))) {
+            continue;
+        }
+        const SWint ix = x + _sw_packet_lane_x[l], iy = y + _sw_packet_lane_y[l];
+        SWfloat f_out[4] = {fs_out[0 * SW_PACKET_SIZE + l], fs_out[1 * SW_PACKET_SIZE + l],
+                            fs_out[2 * SW_PACKET_SIZE + l], fs_out[3 * SW_PACKET_SIZE + l]};
+        if (b_depth_write) {
+            swFbufSetDepth(f, ix, iy, fs_in[2 * SW_PACKET_SIZE + l]);
+        }
+        if (b_blend) {
+            _swBlendPixels(f, ix, iy, f_out);
+        }
+        swFbufSetPixel_FRGBA(f, ix, iy, f_out);
+    }
+}
+
+/* rasterizes part of triangle that is inside of rect (inclusive, aligned to SW_TILE_SIZE) */
+sw_inline void _swProcessTriangleRect_correct(SWprogram *p, SWframebuffer *f,
+                                              SWfloat vs_out[3][SW_MAX_VTX_ATTRIBS],
+                                              SWint _0, SWint _1, SWint _2,
+                                              const SWint rect_min[2],
+                                              const SWint rect_max[2], SWint b_depth_test,
+                                              SWint b_depth_write, SWint b_blend) {
     SWint x, y, p0[2], p1[2], p2[2];
     SWint min[2], max[2];
     SWfloat *pos0 = vs_out[_0], *pos1 = vs_out[_1], *pos2 = vs_out[_2];
@@ -203,17 +253,18 @@ sw_inline void _swProcessTriangle_correct(SWprogram *p, SWframebuffer *f,
     max[0] = sw_max(p0[0], sw_max(p1[0], p2[0]));
     max[1] = sw_max(p0[1], sw_max(p1[1], p2[1]));
 
-    if (min[0] >= f->w || min[1] >= f->h || max[0] < 0 || max[1] < 0)
+    if (min[0] > rect_max[0] || min[1] > rect_max[1] || max[0] < rect_min[0] ||
+        max[1] < rect_min[1])
         return;
 
-    if (min[0] < 0)
-        min[0] = 0;
-    if (min[1] < 0)
-        min[1] = 0;
-    if (max[0] >= f->w)
-        max[0] = f->w - 1;
-    if (max[1] >= f->h)
-        max[1] = f->h - 1;
+    if (min[0] < rect_min[0])
+        min[0] = rect_min[0];
+    if (min[1] < rect_min[1])
+        min[1] = rect_min[1];
+    if (max[0] > rect_max[0])
+        max[0] = rect_max[0];
+    if (max[1] > rect_max[1])
+        max[1] = rect_max[1];
 
     min[0] &= ~(SW_TILE_SIZE - 1);
     min[1] &= ~(SW_TILE_SIZE - 1);
@@ -243,6 +294,21 @@ sw_inline void _swProcessTriangle_correct(SWprogram *p, SWframebuffer *f,
     if (d20[1] < 0 || (d20[1] == 0 && d20[0] > 0))
         C3++;
 
+    SWpacket_tri tri;
+    if (p->fp_proc) {
+        tri.v0 = pos0;
+        tri.v1 = pos1;
+        tri.v2 = pos2;
+        tri.num_attrs = p->v_out_size;
+        tri.inv_area = inv_area;
+        for (SWint l = 0; l < SW_PACKET_SIZE; l++) {
+            const SWint lx = _sw_packet_lane_x[l], ly = _sw_packet_lane_y[l];
+            tri.c_offsets[0][l] = d01[0] * ly - d01[1] * lx;
+            tri.c_offsets[1][l] = d12[0] * ly - d12[1] * lx;
+            tri.c_offsets[2][l] = d20[0] * ly - d20[1] * lx;
+        }
+    }
+
     for (y = min[1]; y < max[1]; y += SW_TILE_SIZE) {
         for (x = min[0]; x < max[0]; x += SW_TILE_SIZE) {
             SWint x0 = x, x1 = sw_min(x + SW_TILE_SIZE - 1, f->w - 1), y0 = y,
@@ -270,6 +336,21 @@ sw_inline void _swProcessTriangle_correct(SWprogram *p, SWframebuffer *f,
             if (a == 0 || b == 0 || c == 0)
                 continue;
 
+            if (p->fp_proc) {
+                SWint px, py;
+                for (py = y; py <= y1; py += SW_PACKET_H) {
+                    for (px = x; px <= x1; px += SW_PACKET_W) {
+                        const SWint dx = px - x, dy = py - y;
+                        const SWint cp[3] = {Cy1 + d01[0] * dy - d01[1] * dx,
+                                             Cy2 + d12[0] * dy - d12[1] * dx,
+                                             Cy3 + d20[0] * dy - d20[1] * dx};
+                        _swProcessPacket_correct(p, f, &tri, px, py, cp, x1, y1,
+                                                 b_depth_test, b_depth_write, b_blend);
+                    }
+                }
+                continue;
+            }
+
             if (a == 15 && b == 15 && c == 15 && full_tile) {
                 SWint ix, iy;
                 for (iy = y; iy < y + SW_TILE_SIZE; iy++) {
@@ -332,6 +413,15 @@ sw_inline void _swProcessTriangle_correct(SWprogram *p, SWframebuffer *f,
     }
 }
 
+sw_inline void _swProcessTriangle_correct(SWprogram *p, SWframebuffer *f,
+                                          SWfloat vs_out[3][SW_MAX_VTX_ATTRIBS], SWint _0,
+                                          SWint _1, SWint _2, SWint b_depth_test,
+                                          SWint b_depth_write, SWint b_blend) {
+    const SWint rect_min[2] = {0, 0}, rect_max[2] = {f->w - 1, f->h - 1};
+    _swProcessTriangleRect_correct(p, f, vs_out, _0, _1, _2, rect_min, rect_max,
+                                   b_depth_test, b_depth_write, b_blend);
+}
+
 /******* Affine interpolation *******/
 
 sw_inline SWint _swIntepolateTri_nocorrect(SWframebuffer *f, SWint b_depth_test,
@@ -372,11 +462,13 @@ sw_inline void _swProcessPixel_nocorrect(SWprogram *p, SWframebuffer *f, SWint i
     }
 }
 
-sw_inline void _swProcessTriangle_nocorrect(SWprogram *p, SWframebuffer *f,
-                                            SWfloat vs_out[3][SW_MAX_VTX_ATTRIBS],
-                                            SWint _0, SWint _1, SWint _2,
-                                            SWint b_depth_test, SWint b_depth_write,
-                                            SWint b_blend) {
+sw_inline void _swProcessTriangleRect_nocorrect(SWprogram *p, SWframebuffer *f,
+                                                SWfloat vs_out[3][SW_MAX_VTX_ATTRIBS],
+                                                SWint _0, SWint _1, SWint _2,
+                                                const SWint rect_min[2],
+                                                const SWint rect_max[2],
+                                                SWint b_depth_test, SWint b_depth_write,
+                                                SWint b_blend) {
     SWint i, x, y, p0[2], p1[2], p2[2];
     SWint min[2], max[2];
     SWfloat *pos0 = vs_out[_0], *pos1 = vs_out[_1], *pos2 = vs_out[_2];
@@ -398,17 +490,18 @@ sw_inline void _swProcessTriangle_nocorrect(SWprogram *p, SWframebuffer *f,
     max[0] = sw_max(p0[0], sw_max(p1[0], p2[0]));
     max[1] = sw_max(p0[1], sw_max(p1[1], p2[1]));
 
-    if (min[0] >= f->w || min[1] >= f->h || max[0] < 0 || max[1] < 0)
+    if (min[0] > rect_max[0] || min[1] > rect_max[1] || max[0] < rect_min[0] ||
+        max[1] < rect_min[1])
         return;
 
-    if (min[0] < 0)
-        min[0] = 0;
-    if (min[1] < 0)
-        min[1] = 0;
-    if (max[0] >= f->w)
-        max[0] = f->w - 1;
-    if (max[1] >= f->h)
-        max[1] = f->h - 1;
+    if (min[0] < rect_min[0])
+        min[0] = rect_min[0];
+    if (min[1] < rect_min[1])
+        min[1] = rect_min[1];
+    if (max[0] > rect_max[0])
+        max[0] = rect_max[0];
+    if (max[1] > rect_max[1])
+        max[1] = rect_max[1];
 
     min[0] &= ~(SW_TILE_SIZE - 1);
     min[1] &= ~(SW_TILE_SIZE - 1);
@@ -570,6 +663,15 @@ sw_inline void _swProcessTriangle_nocorrect(SWprogram *p, SWframebuffer *f,
     }
 }
 
+sw_inline void _swProcessTriangle_nocorrect(SWprogram *p, SWframebuffer *f,
+                                            SWfloat vs_out[3][SW_MAX_VTX_ATTRIBS], SWint _0,
+                                            SWint _1, SWint _2, SWint b_depth_test,
+                                            SWint b_depth_write, SWint b_blend) {
+    const SWint rect_min[2] = {0, 0}, rect_max[2] = {f->w - 1, f->h - 1};
+    _swProcessTriangleRect_nocorrect(p, f, vs_out, _0, _1, _2, rect_min, rect_max,
+                                     b_depth_test, b_depth_write, b_blend);
+}
+
 /*******************************/
 
 sw_inline SWint _swIntepolateTri_fast(SWframebuffer *f, SWint b_depth_test,
@@ -608,10 +710,11 @@ sw_inline void _swProcessPixel_fast(SWprogram *p, SWframebuffer *f, SWint ix, SW
     }
 }
 
-sw_inline void _swProcessTriangle_fast(SWprogram *p, SWframebuffer *f,
-                                       SWfloat vs_out[3][SW_MAX_VTX_ATTRIBS], SWint _0,
-                                       SWint _1, SWint _2, SWint b_depth_test,
-                                       SWint b_depth_write, SWint b_blend) {
+sw_inline void _swProcessTriangleRect_fast(SWprogram *p, SWframebuffer *f,
+                                           SWfloat vs_out[3][SW_MAX_VTX_ATTRIBS], SWint _0,
+                                           SWint _1, SWint _2, const SWint rect_min[2],
+                                           const SWint rect_max[2], SWint b_depth_test,
+                                           SWint b_depth_write, SWint b_blend) {
     SWint i, x, y, p0[2], p1[2], p2[2];
     SWint min[2], max[2];
     SWfloat *pos0 = vs_out[_0], *pos1 = vs_out[_1], *pos2 = vs_out[_2];
@@ -633,17 +736,18 @@ sw_inline void _swProcessTriangle_fast(SWprogram *p, SWframebuffer *f,
     max[0] = sw_max(p0[0], sw_max(p1[0], p2[0]));
     max[1] = sw_max(p0[1], sw_max(p1[1], p2[1]));
 
-    if (min[0] >= f->w || min[1] >= f->h || max[0] < 0 || max[1] < 0)
+    if (min[0] > rect_max[0] || min[1] > rect_max[1] || max[0] < rect_min[0] ||
+        max[1] < rect_min[1])
         return;
 
-    if (min[0] < 0)
-        min[0] = 0;
-    if (min[1] < 0)
-        min[1] = 0;
-    if (max[0] >= f->w)
-        max[0] = f->w - 1;
-    if (max[1] >= f->h)
-        max[1] = f->h - 1;
+    if (min[0] < rect_min[0])
+        min[0] = rect_min[0];
+    if (min[1] < rect_min[1])
+        min[1] = rect_min[1];
+    if (max[0] > rect_max[0])
+        max[0] = rect_max[0];
+    if (max[1] > rect_max[1])
+        max[1] = rect_max[1];
 
     min[0] &= ~(SW_TILE_SIZE - 1);
     min[1] &= ~(SW_TILE_SIZE - 1);
@@ -846,6 +950,15 @@ sw_inline void _swProcessTriangle_fast(SWprogram *p, SWframebuffer *f,
     }
 }
 
+sw_inline void _swProcessTriangle_fast(SWprogram *p, SWframebuffer *f,
+                                       SWfloat vs_out[3][SW_MAX_VTX_ATTRIBS], SWint _0,
+                                       SWint _1, SWint _2, SWint b_depth_test,
+                                       SWint b_depth_write, SWint b_blend) {
+    const SWint rect_min[2] = {0, 0}, rect_max[2] = {f->w - 1, f->h - 1};
+    _swProcessTriangleRect_fast(p, f, vs_out, _0, _1, _2, rect_min, rect_max,
+                                b_depth_test, b_depth_write, b_blend);
+}
+
 #define PLANE_DOT(x, y)                                                                  \
     ((x)[0] * (y)[0] + (x)[1] * (y)[1] + (x)[2] * (y)[2] + (x)[3] * (y)[3])
 
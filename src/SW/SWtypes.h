@@ -94,6 +94,22 @@ extern "C" {
 #define F_POS_IN f_in_data
 #define F_FVARYING_IN(x) ((const SWfloat *)(f_in_data + 4 + x))
 
+/* Packet of pixels shaded together, lanes are grouped in 2x2 quads:
+   quad i covers pixels (2 * (i % 2), 2 * (i / 2)) to (2 * (i % 2) + 1, 2 * (i / 2) + 1) */
+#define SW_PACKET_W 4
+#define SW_PACKET_H 4
+#define SW_PACKET_SIZE (SW_PACKET_W * SW_PACKET_H)
+
+/* Packet shader data is stored as SoA (SW_PACKET_SIZE values of each component) */
+#define FS_PACKET_IN const SWfloat *RESTRICT f_in_data, SWuniform *RESTRICT uniforms
+#define FS_PACKET_OUT SWfloat *RESTRICT f_out_data, SWuint *RESTRICT live_mask
+
+#define FP_POS_IN(c) (f_in_data + (c) * SW_PACKET_SIZE)
+#define FP_FVARYING_IN(x, c) (f_in_data + (4 + (x) + (c)) * SW_PACKET_SIZE)
+#define FP_COL_OUT(c) (f_out_data + (c) * SW_PACKET_SIZE)
+#define FP_IS_LIVE(lane) (((*live_mask) >> (lane)) & 1)
+#define FP_DISCARD(lane) (*live_mask) &= ~(1u << (lane))
+
 #define I_UNIFORM(x) ((SWint *)uniforms[(x)].data)
 #define I_UNIFORM_S(x) (*(SWint *)uniforms[(x)].data)
 #define F_UNIFORM(x) ((SWfloat *)uniforms[(x)].data)
@@ -123,6 +139,11 @@ extern "C" {
 
 typedef void(FASTCALL *vtx_shader_proc)(VS_IN, VS_OUT);
 typedef void(FASTCALL *frag_shader_proc)(FS_IN, FS_OUT);
+typedef void(FASTCALL *frag_packet_shader_proc)(FS_PACKET_IN, FS_PACKET_OUT);
+
+typedef void (*job_proc)(void *job_data, SWint i);
+/* must call job for each i in [0, count) (possibly in parallel) and return after all of them finish */
+typedef void (*parallel_for_proc)(void *userdata, SWint count, job_proc job, void *job_data);
 
 #define VSHADER void FASTCALL
 #define FSHADER void FASTCALL
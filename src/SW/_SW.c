@@ -1,4 +1,5 @@
 
+#include "SWbinning.c"
 #include "SWbuffer.c"
 #include "SWcompress.c"
 #include "SWcontext.c"
@@ -6,6 +7,8 @@
 #include "SWcpu.c"
 #include "SWdraw.c"
 #include "SWframebuffer.c"
+#include "SWpacket.c"
+#include "SWpacket_Ref.c"
 #include "SWprogram.c"
 #include "SWrasterize.c"
 #include "SWtexture.c"
@@ -8,6 +8,7 @@
 #endif
 
 #include "SWculling_AVX2.c"
+#include "SWpacket_AVX2.c"
 
 unsigned long long get_xcr_feature_mask() {
     return _xgetbv(0);
@@ -10,6 +10,7 @@
 #endif
 
 #include "SWculling_AVX512.c"
+#include "SWpacket_AVX512.c"
 
 #ifdef __GNUC__
 #pragma clang attribute pop
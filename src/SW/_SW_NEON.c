@@ -1,3 +1,4 @@
 #if defined(__aarch64__) || defined(_M_ARM) || defined(_M_ARM64)
 #include "SWculling_NEON.c"
+#include "SWpacket_NEON.c"
 #endif
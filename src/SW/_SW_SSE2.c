@@ -6,6 +6,7 @@
 #endif
 
 #include "SWculling_SSE2.c"
+#include "SWpacket_SSE2.c"
 
 #ifdef __GNUC__
 #pragma GCC pop_options
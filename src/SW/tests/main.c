@@ -1,18 +1,24 @@
 
 #include <stdio.h>
 
+void test_binning();
 void test_buffer();
 void test_context();
+void test_culling();
 void test_framebuffer();
+void test_packet();
 void test_pixels();
 void test_program();
 void test_texture();
 void test_zbuffer();
 
 int main() {
+    test_binning();
     test_buffer();
     test_context();
+    test_culling();
     test_framebuffer();
+    test_packet();
     test_pixels();
     test_program();
     test_texture();
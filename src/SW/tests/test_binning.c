@@ -0,0 +1,128 @@
+#include "test_common.h"
+
+#include <string.h>
+#include <time.h>
+
+#include "../SW.h"
+
+#define BIN_TEST_RES_X 333
+#define BIN_TEST_RES_Y 197
+#define BIN_TEST_TRIS 4000
+
+enum { A_POS, A_COL };
+enum { V_COL };
+
+static VSHADER binning_test_vs(VS_IN, VS_OUT) {
+    const SWfloat *pos = V_FATTR(A_POS);
+    V_POS_OUT[0] = pos[0];
+    V_POS_OUT[1] = pos[1];
+    V_POS_OUT[2] = pos[2];
+    V_POS_OUT[3] = pos[3];
+
+    const SWfloat *col = V_FATTR(A_COL);
+    V_FVARYING(V_COL)[0] = col[0];
+    V_FVARYING(V_COL)[1] = col[1];
+    V_FVARYING(V_COL)[2] = col[2];
+}
+
+static FSHADER binning_test_fs(FS_IN, FS_OUT) {
+    F_COL_OUT[0] = F_FVARYING_IN(V_COL)[0];
+    F_COL_OUT[1] = F_FVARYING_IN(V_COL)[1];
+    F_COL_OUT[2] = F_FVARYING_IN(V_COL)[2];
+    F_COL_OUT[3] = 1.0f;
+    ((void)uniforms);
+    ((void)b_discard);
+}
+
+static double render_triangles(const SWfloat *positions, const SWfloat *colors,
+                               const SWint binned, const parallel_for_proc parallel_for,
+                               SWubyte *out_pixels, SWfloat *out_depth) {
+    if (binned) {
+        swEnable(SW_BINNED_RASTERIZATION);
+    } else {
+        swDisable(SW_BINNED_RASTERIZATION);
+    }
+    swParallelFor(parallel_for, NULL);
+
+    swClearColor(0, 0, 0, 0);
+    swClearDepth(1);
+
+    swVertexAttribPointer(A_POS, 4 * sizeof(SWfloat), 0, positions);
+    swVertexAttribPointer(A_COL, 3 * sizeof(SWfloat), 0, colors);
+
+    const double t1 = get_time_s();
+    swDrawArrays(SW_TRIANGLES, 0, 3 * BIN_TEST_TRIS);
+    const double t2 = get_time_s();
+
+    memcpy(out_pixels, swGetPixelDataRef(swGetCurFramebuffer()),
+           4 * BIN_TEST_RES_X * BIN_TEST_RES_Y);
+    memcpy(out_depth, swGetDepthDataRef(swGetCurFramebuffer()),
+           sizeof(SWfloat) * BIN_TEST_RES_X * BIN_TEST_RES_Y);
+
+    return t2 - t1;
+}
+
+void test_binning() {
+    SWcontext *ctx = swCreateContext(BIN_TEST_RES_X, BIN_TEST_RES_Y);
+    require(ctx != NULL);
+
+    SWint program = swCreateProgram();
+    swUseProgram(program);
+    swInitProgram(binning_test_vs, binning_test_fs, 3);
+
+    static SWfloat positions[3 * BIN_TEST_TRIS][4], colors[3 * BIN_TEST_TRIS][3];
+    static SWubyte ref_pixels[4 * BIN_TEST_RES_X * BIN_TEST_RES_Y],
+        pixels[4 * BIN_TEST_RES_X * BIN_TEST_RES_Y];
+    static SWfloat ref_depth[BIN_TEST_RES_X * BIN_TEST_RES_Y],
+        depth[BIN_TEST_RES_X * BIN_TEST_RES_Y];
+
+    { // random overlapping triangles, some of them are partially outside of screen
+        SWuint seed = 12345;
+        for (SWint i = 0; i < BIN_TEST_TRIS; i++) {
+            SWfloat center[2];
+            for (SWint k = 0; k < 2; k++) {
+                seed = seed * 1664525 + 1013904223;
+                center[k] = 2.4f * (SWfloat)(seed >> 8) / (1 << 24) - 1.2f;
+            }
+            for (SWint j = 0; j < 3; j++) {
+                SWfloat *v = positions[3 * i + j];
+                for (SWint k = 0; k < 3; k++) {
+                    seed = seed * 1664525 + 1013904223;
+                    v[k] = (SWfloat)(seed >> 8) / (1 << 24);
+                    colors[3 * i + j][k] = v[k];
+                }
+                v[0] = center[0] + 0.5f * v[0] - 0.25f;
+                v[1] = center[1] + 0.5f * v[1] - 0.25f;
+                v[3] = 1.0f;
+            }
+        }
+    }
+
+    const double ref_time = render_triangles(positions[0], colors[0], 0, NULL, ref_pixels,
+                                             ref_depth);
+    double serial_time = 0;
+
+    { // binned rasterization without parallel_for callback
+        serial_time = render_triangles(positions[0], colors[0], 1, NULL, pixels, depth);
+        require(memcmp(pixels, ref_pixels, sizeof(pixels)) == 0);
+        require(memcmp(depth, ref_depth, sizeof(depth)) == 0);
+    }
+
+    { // bins are processed by multiple threads, result must stay the same
+        const double time =
+            render_triangles(positions[0], colors[0], 1, test_parallel_for, pixels, depth);
+        require(memcmp(pixels, ref_pixels, sizeof(pixels)) == 0);
+        require(memcmp(depth, ref_depth, sizeof(depth)) == 0);
+
+        /* throughput of a single draw call, informative only */
+        printf("Binning throughput (Mtris/sec): immediate %.2f, binned %.2f, binned x%i %.2f\n",
+               ref_time > 0 ? 1e-6 * BIN_TEST_TRIS / ref_time : 0.0,
+               serial_time > 0 ? 1e-6 * BIN_TEST_TRIS / serial_time : 0.0, TEST_THREADS,
+               time > 0 ? 1e-6 * BIN_TEST_TRIS / time : 0.0);
+    }
+
+    swDisable(SW_BINNED_RASTERIZATION);
+    swParallelFor(NULL, NULL);
+    swDeleteProgram(program);
+    swDeleteContext(ctx);
+}
@@ -3,6 +3,13 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <time.h>
+
+#ifndef _WIN32
+#include <pthread.h>
+#endif
+
+#include "../SWtypes.h"
 
 static void handle_assert(int passed, const char* assert, const char* file, long line) {
     if (!passed) {
@@ -13,5 +20,67 @@ static void handle_assert(int passed, const char* assert, const char* file, long
 
 #define require(x) handle_assert((x) != 0, #x , __FILE__, __LINE__ )
 
+#if !defined(_WIN32) && defined(CLOCK_MONOTONIC)
+static double get_time_s() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + 1e-9 * (double)ts.tv_nsec;
+}
+#else
+static double get_time_s() { return (double)clock() / CLOCKS_PER_SEC; }
+#endif
+
+#define TEST_THREADS 4
+
+/* runs jobs one after another on calling thread (binned code paths are still taken) */
+static void test_serial_for(void *userdata, const SWint count, job_proc job, void *job_data) {
+    ((void)userdata);
+    for (SWint i = 0; i < count; i++) {
+        job(job_data, i);
+    }
+}
+
+/* simple parallel_for_proc, spawns TEST_THREADS workers for each call */
+#ifndef _WIN32
+typedef struct thread_pool_job {
+    pthread_mutex_t lock;
+    SWint next, count;
+    job_proc job;
+    void *job_data;
+} thread_pool_job;
+
+static void *thread_pool_worker(void *arg) {
+    thread_pool_job *j = (thread_pool_job *)arg;
+    for (;;) {
+        pthread_mutex_lock(&j->lock);
+        const SWint i = j->next++;
+        pthread_mutex_unlock(&j->lock);
+        if (i >= j->count) {
+            break;
+        }
+        j->job(j->job_data, i);
+    }
+    return NULL;
+}
+#endif
+
+static void test_parallel_for(void *userdata, const SWint count, job_proc job,
+                              void *job_data) {
+    ((void)userdata);
+#ifndef _WIN32
+    thread_pool_job j = {PTHREAD_MUTEX_INITIALIZER, 0, count, job, job_data};
+    pthread_t threads[TEST_THREADS];
+    for (int i = 0; i < TEST_THREADS; i++) {
+        pthread_create(&threads[i], NULL, thread_pool_worker, &j);
+    }
+    for (int i = 0; i < TEST_THREADS; i++) {
+        pthread_join(threads[i], NULL);
+    }
+#else
+    for (SWint i = 0; i < count; i++) {
+        job(job_data, i);
+    }
+#endif
+}
 
 #endif
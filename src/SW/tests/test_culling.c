@@ -0,0 +1,170 @@
+#include "test_common.h"
+
+#include <math.h>
+#include <string.h>
+
+#include "../SWculling.h"
+
+#define CULL_TEST_RES_X 320
+#define CULL_TEST_RES_Y 192
+#define CULL_TEST_OCCLUDERS 600
+#define CULL_TEST_OCCLUDEES 4000
+#define CULL_TEST_ITERATIONS 4
+
+static const SWfloat cube_positions[] = {-1, -1, -1, 1, -1, -1, 1, 1, -1, -1, 1, -1,
+                                         -1, -1, 1,  1, -1, 1,  1, 1, 1,  -1, 1, 1};
+static const SWuint cube_indices[] = {0, 1, 2, 0, 2, 3, 5, 4, 7, 5, 7, 6, 4, 0, 3, 4, 3, 7,
+                                      1, 5, 6, 1, 6, 2, 3, 2, 6, 3, 6, 7, 4, 5, 1, 4, 1, 0};
+
+static SWuint culling_test_rand(SWuint *seed) {
+    (*seed) = (*seed) * 1664525 + 1013904223;
+    return (*seed) >> 8;
+}
+
+static SWfloat culling_test_randf(SWuint *seed) {
+    return (SWfloat)culling_test_rand(seed) / (1 << 24);
+}
+
+/* combined projection and model matrix of cube with given center and half-size */
+static void make_cube_xform(const SWfloat center[3], const SWfloat size, SWfloat xform[16]) {
+    const SWfloat f = 1.0f / tanf(0.5f * 1.0472f), aspect = (SWfloat)CULL_TEST_RES_X / CULL_TEST_RES_Y;
+
+    memset(xform, 0, 16 * sizeof(SWfloat));
+    xform[0] = size * f / aspect;
+    xform[5] = size * f;
+    xform[11] = -size;
+    xform[12] = center[0] * f / aspect;
+    xform[13] = center[1] * f;
+    xform[15] = -center[2];
+}
+
+static void init_culling_ctx(SWcull_ctx *ctx, const char *isa) {
+    memset(ctx, 0, sizeof(SWcull_ctx));
+    /* start with minimal size to be able to pick code path before actual allocation */
+    swCullCtxInit(ctx, SW_CULL_SUBTILE_X, 4, 0.1f);
+    if (strcmp(isa, "SSE2") == 0) {
+        ctx->cpu_info.avx2_supported = ctx->cpu_info.avx512_supported = 0;
+    } else if (strcmp(isa, "AVX2") == 0) {
+        ctx->cpu_info.avx512_supported = 0;
+    }
+    swCullCtxResize(ctx, CULL_TEST_RES_X, CULL_TEST_RES_Y, 0.1f);
+    swCullCtxClear(ctx);
+}
+
+static double cull_surfaces(SWcull_ctx *ctx, SWcull_surf *surfs, const SWuint count,
+                            const SWint async) {
+    const double t1 = get_time_s();
+    swCullCtxClear(ctx);
+    if (async) {
+        /* submission order does not matter, occluders are always processed first */
+        swCullCtxSubmitCullSurfsAsync(ctx, surfs + CULL_TEST_OCCLUDERS, count - CULL_TEST_OCCLUDERS);
+        swCullCtxSubmitCullSurfsAsync(ctx, surfs, CULL_TEST_OCCLUDERS);
+        swCullCtxFlush(ctx);
+    } else {
+        swCullCtxSubmitCullSurfs(ctx, surfs, count);
+    }
+    return get_time_s() - t1;
+}
+
+void test_culling() {
+    const char *isa_names[] = {"SSE2", "AVX2", "AVX512"};
+
+    SWuint seed = 777;
+
+    static SWfloat xforms[CULL_TEST_OCCLUDERS + CULL_TEST_OCCLUDEES][16];
+    static SWcull_surf surfs[CULL_TEST_OCCLUDERS + CULL_TEST_OCCLUDEES];
+    const SWuint surfs_count = CULL_TEST_OCCLUDERS + CULL_TEST_OCCLUDEES;
+
+    for (SWuint i = 0; i < surfs_count; i++) {
+        const SWint is_occluder = (i < CULL_TEST_OCCLUDERS);
+
+        /* big occluders in front, small occludees scattered behind them */
+        const SWfloat z = is_occluder ? -4.0f - 8.0f * culling_test_randf(&seed)
+                                      : -6.0f - 24.0f * culling_test_randf(&seed);
+        const SWfloat center[3] = {(2.0f * culling_test_randf(&seed) - 1.0f) * 0.8f * -z,
+                                   (2.0f * culling_test_randf(&seed) - 1.0f) * 0.5f * -z, z};
+        const SWfloat size = is_occluder ? 0.1f + 0.3f * culling_test_randf(&seed)
+                                         : 0.05f + 0.1f * culling_test_randf(&seed);
+        make_cube_xform(center, size, xforms[i]);
+
+        SWcull_surf *s = &surfs[i];
+        memset(s, 0, sizeof(SWcull_surf));
+        s->type = is_occluder ? SW_OCCLUDER : SW_OCCLUDEE;
+        s->prim_type = SW_TRIANGLES;
+        s->index_type = SW_UNSIGNED_INT;
+        s->attribs = cube_positions;
+        s->indices = cube_indices;
+        s->stride = 3 * sizeof(SWfloat);
+        s->count = sizeof(cube_indices) / sizeof(cube_indices[0]);
+        s->xform = xforms[i];
+    }
+
+    static SWint ref_visible[CULL_TEST_OCCLUDERS + CULL_TEST_OCCLUDEES];
+    static SWfloat ref_depth[CULL_TEST_RES_X * CULL_TEST_RES_Y],
+        depth[CULL_TEST_RES_X * CULL_TEST_RES_Y];
+
+    for (int i = 0; i < 3; i++) {
+        SWcull_ctx ctx;
+        init_culling_ctx(&ctx, isa_names[i]);
+        if ((i == 1 && !ctx.cpu_info.avx2_supported) ||
+            (i == 2 && !ctx.cpu_info.avx512_supported) || !ctx.rast_bin_proc) {
+            swCullCtxDestroy(&ctx);
+            continue;
+        }
+
+        double serial_time = 0.0, parallel_time = 0.0;
+
+        for (int j = 0; j < CULL_TEST_ITERATIONS; j++) {
+            serial_time += cull_surfaces(&ctx, surfs, surfs_count, 0);
+        }
+
+        SWint visible_count = 0;
+        for (SWuint j = 0; j < surfs_count; j++) {
+            ref_visible[j] = surfs[j].visible;
+            visible_count += (j >= CULL_TEST_OCCLUDERS && surfs[j].visible);
+            surfs[j].visible = -1;
+        }
+        swCullCtxDebugDepth(&ctx, ref_depth);
+
+        /* scene is set up so that only part of occludees survive */
+        require(visible_count > 0 && visible_count < CULL_TEST_OCCLUDEES);
+
+        { // binned rasterization with serial job execution
+            swCullCtxParallelFor(&ctx, test_serial_for, NULL);
+            cull_surfaces(&ctx, surfs, surfs_count, 1);
+            for (SWuint j = 0; j < surfs_count; j++) {
+                require(surfs[j].visible == ref_visible[j]);
+                surfs[j].visible = -1;
+            }
+
+            swCullCtxDebugDepth(&ctx, depth);
+            for (SWint j = 0; j < CULL_TEST_RES_X * CULL_TEST_RES_Y; j++) {
+                require(fabsf(depth[j] - ref_depth[j]) <= 1e-5f * fabsf(ref_depth[j]) + 1e-6f);
+            }
+        }
+
+        swCullCtxParallelFor(&ctx, test_parallel_for, NULL);
+
+        for (int j = 0; j < CULL_TEST_ITERATIONS; j++) {
+            parallel_time += cull_surfaces(&ctx, surfs, surfs_count, (j % 2));
+            for (SWuint k = 0; k < surfs_count; k++) {
+                require(surfs[k].visible == ref_visible[k]);
+                surfs[k].visible = -1;
+            }
+        }
+
+        { // depth buffer differs only by depth plane setup relative to bin corner
+            swCullCtxDebugDepth(&ctx, depth);
+            for (SWint j = 0; j < CULL_TEST_RES_X * CULL_TEST_RES_Y; j++) {
+                require(fabsf(depth[j] - ref_depth[j]) <= 1e-5f * fabsf(ref_depth[j]) + 1e-6f);
+            }
+        }
+
+        printf("Culling %s (ms): serial %.2f, binned x%i %.2f (%i of %i occludees visible)\n",
+               isa_names[i], 1000.0 * serial_time / CULL_TEST_ITERATIONS, TEST_THREADS,
+               1000.0 * parallel_time / CULL_TEST_ITERATIONS, visible_count,
+               CULL_TEST_OCCLUDEES);
+
+        swCullCtxDestroy(&ctx);
+    }
+}
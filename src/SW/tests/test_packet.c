@@ -0,0 +1,229 @@
+#include "test_common.h"
+
+#include <math.h>
+#include <string.h>
+
+#include "../SW.h"
+
+#define PACKET_TEST_RES_X 251
+#define PACKET_TEST_RES_Y 167
+#define PACKET_TEST_TRIS 600
+#define PACKET_TEST_TEX_RES 64
+
+enum { A_POS, A_UV, A_COL };
+enum { V_UV = 0, V_COL = 2 };
+
+static VSHADER packet_test_vs(VS_IN, VS_OUT) {
+    const SWfloat *pos = V_FATTR(A_POS);
+    V_POS_OUT[0] = pos[0];
+    V_POS_OUT[1] = pos[1];
+    V_POS_OUT[2] = pos[2];
+    V_POS_OUT[3] = pos[3];
+
+    const SWfloat *uv = V_FATTR(A_UV), *col = V_FATTR(A_COL);
+    V_FVARYING(V_UV)[0] = uv[0];
+    V_FVARYING(V_UV)[1] = uv[1];
+    V_FVARYING(V_COL)[0] = col[0];
+    V_FVARYING(V_COL)[1] = col[1];
+    V_FVARYING(V_COL)[2] = col[2];
+}
+
+static FSHADER packet_test_fs(FS_IN, FS_OUT) {
+    SWfloat rgba[4];
+    TEXTURE(0, F_FVARYING_IN(V_UV), rgba);
+    if (rgba[3] < 0.25f) {
+        DISCARD;
+    }
+    F_COL_OUT[0] = rgba[0] * F_FVARYING_IN(V_COL)[0];
+    F_COL_OUT[1] = rgba[1] * F_FVARYING_IN(V_COL)[1];
+    F_COL_OUT[2] = rgba[2] * F_FVARYING_IN(V_COL)[2];
+    F_COL_OUT[3] = 1.0f;
+    ((void)uniforms);
+}
+
+static FSHADER packet_test_fs_packet(FS_PACKET_IN, FS_PACKET_OUT) {
+    SWfloat rgba[4 * SW_PACKET_SIZE];
+    swTexturePacket(0, FP_FVARYING_IN(V_UV, 0), FP_FVARYING_IN(V_UV, 1), rgba);
+    for (SWint l = 0; l < SW_PACKET_SIZE; l++) {
+        if (rgba[3 * SW_PACKET_SIZE + l] < 0.25f) {
+            FP_DISCARD(l);
+        }
+        FP_COL_OUT(0)[l] = rgba[0 * SW_PACKET_SIZE + l] * FP_FVARYING_IN(V_COL, 0)[l];
+        FP_COL_OUT(1)[l] = rgba[1 * SW_PACKET_SIZE + l] * FP_FVARYING_IN(V_COL, 1)[l];
+        FP_COL_OUT(2)[l] = rgba[2 * SW_PACKET_SIZE + l] * FP_FVARYING_IN(V_COL, 2)[l];
+        FP_COL_OUT(3)[l] = 1.0f;
+    }
+    ((void)uniforms);
+}
+
+static SWuint packet_test_rand(SWuint *seed) {
+    (*seed) = (*seed) * 1664525 + 1013904223;
+    return (*seed) >> 8;
+}
+
+static SWfloat packet_test_randf(SWuint *seed) {
+    return (SWfloat)packet_test_rand(seed) / (1 << 24);
+}
+
+static double render_packet_scene(SWubyte *out_pixels, SWfloat *out_depth) {
+    swClearColor(0, 0, 0, 0);
+    swClearDepth(1);
+
+    const double t1 = get_time_s();
+    swDrawArrays(SW_TRIANGLES, 0, 3 * PACKET_TEST_TRIS);
+    const double t2 = get_time_s();
+
+    memcpy(out_pixels, swGetPixelDataRef(swGetCurFramebuffer()),
+           4 * PACKET_TEST_RES_X * PACKET_TEST_RES_Y);
+    memcpy(out_depth, swGetDepthDataRef(swGetCurFramebuffer()),
+           sizeof(SWfloat) * PACKET_TEST_RES_X * PACKET_TEST_RES_Y);
+
+    return t2 - t1;
+}
+
+static void compare_packet_scene(const SWubyte *pixels, const SWfloat *depth,
+                                 const SWubyte *ref_pixels, const SWfloat *ref_depth) {
+    /* -ffast-math lets compiler fuse and reorder interpolation math differently in
+       each path, so allow off-by-one rounding */
+    for (SWint i = 0; i < PACKET_TEST_RES_X * PACKET_TEST_RES_Y; i++) {
+        for (SWint j = 0; j < 4; j++) {
+            const SWint diff = (SWint)pixels[4 * i + j] - (SWint)ref_pixels[4 * i + j];
+            require(diff >= -1 && diff <= 1);
+        }
+        require(fabsf(depth[i] - ref_depth[i]) < 1e-6f);
+    }
+}
+
+void test_packet() {
+    SWcontext *ctx = swCreateContext(PACKET_TEST_RES_X, PACKET_TEST_RES_Y);
+    require(ctx != NULL);
+
+    SWuint seed = 4242;
+
+    static SWubyte tex_pixels[4 * PACKET_TEST_TEX_RES * PACKET_TEST_TEX_RES];
+    for (SWint i = 0; i < 4 * PACKET_TEST_TEX_RES * PACKET_TEST_TEX_RES; i++) {
+        tex_pixels[i] = (SWubyte)(packet_test_rand(&seed) & 0xff);
+    }
+
+    SWint tex_rgba = swCreateTexture();
+    swActiveTexture(SW_TEXTURE0);
+    swBindTexture(tex_rgba);
+    swTexImage2D(SW_RGBA, SW_UNSIGNED_BYTE, PACKET_TEST_TEX_RES, PACKET_TEST_TEX_RES,
+                 tex_pixels);
+
+    SWint tex_rgb = swCreateTexture();
+    swBindTexture(tex_rgb);
+    swTexImage2D(SW_RGB, SW_UNSIGNED_BYTE, PACKET_TEST_TEX_RES, PACKET_TEST_TEX_RES,
+                 tex_pixels);
+
+    swBindTexture(tex_rgba);
+
+    static SWfloat positions[3 * PACKET_TEST_TRIS][4], uvs[3 * PACKET_TEST_TRIS][2],
+        colors[3 * PACKET_TEST_TRIS][3];
+    for (SWint i = 0; i < PACKET_TEST_TRIS; i++) {
+        const SWfloat center[2] = {2.4f * packet_test_randf(&seed) - 1.2f,
+                                   2.4f * packet_test_randf(&seed) - 1.2f};
+        for (SWint j = 0; j < 3; j++) {
+            /* varying w makes perspective correction matter */
+            const SWfloat w = 1.0f + 2.0f * packet_test_randf(&seed);
+            SWfloat *p = positions[3 * i + j];
+            p[0] = w * (center[0] + 0.6f * packet_test_randf(&seed) - 0.3f);
+            p[1] = w * (center[1] + 0.6f * packet_test_randf(&seed) - 0.3f);
+            p[2] = w * packet_test_randf(&seed);
+            p[3] = w;
+            uvs[3 * i + j][0] = 2 * packet_test_randf(&seed);
+            uvs[3 * i + j][1] = 2 * packet_test_randf(&seed);
+            colors[3 * i + j][0] = packet_test_randf(&seed);
+            colors[3 * i + j][1] = packet_test_randf(&seed);
+            colors[3 * i + j][2] = packet_test_randf(&seed);
+        }
+    }
+
+    SWint program = swCreateProgram();
+    swUseProgram(program);
+    swInitProgram(packet_test_vs, packet_test_fs, 5);
+
+    swVertexAttribPointer(A_POS, 4 * sizeof(SWfloat), 0, positions);
+    swVertexAttribPointer(A_UV, 2 * sizeof(SWfloat), 0, uvs);
+    swVertexAttribPointer(A_COL, 3 * sizeof(SWfloat), 0, colors);
+
+    static SWubyte ref_pixels[4 * PACKET_TEST_RES_X * PACKET_TEST_RES_Y],
+        pixels[4 * PACKET_TEST_RES_X * PACKET_TEST_RES_Y];
+    static SWfloat ref_depth[PACKET_TEST_RES_X * PACKET_TEST_RES_Y],
+        depth[PACKET_TEST_RES_X * PACKET_TEST_RES_Y];
+
+    const double ref_time = render_packet_scene(ref_pixels, ref_depth);
+
+    { // something was actually drawn
+        SWint covered = 0;
+        for (SWint i = 0; i < PACKET_TEST_RES_X * PACKET_TEST_RES_Y; i++) {
+            covered += (ref_depth[i] < 1.0f);
+        }
+        require(covered > PACKET_TEST_RES_X * PACKET_TEST_RES_Y / 2);
+    }
+
+    const char *isa_names[] = {"Ref", "SSE2", "AVX2", "AVX512"};
+    const SWcpu_info cpu_info = ctx->cpu_info;
+
+    for (int isa = 0; isa < 4; isa++) {
+        /* force code path the same way as if cpu did not support newer extensions */
+        SWcpu_info forced_info = cpu_info;
+        if (isa < 3) {
+            forced_info.avx512_supported = 0;
+        }
+        if (isa < 2) {
+            forced_info.avx2_supported = 0;
+        }
+        if (isa < 1) {
+            forced_info.sse2_supported = 0;
+        }
+        if ((isa == 1 && !cpu_info.sse2_supported) || (isa == 2 && !cpu_info.avx2_supported) ||
+            (isa == 3 && !cpu_info.avx512_supported)) {
+            continue;
+        }
+        swPacketProcsInit(&ctx->packet_procs, &forced_info);
+
+        { // packet texture fetch matches per-pixel one
+            const SWint textures[] = {tex_rgba, tex_rgb};
+            for (SWint t = 0; t < 2; t++) {
+                swBindTexture(textures[t]);
+                for (SWint k = 0; k < 16; k++) {
+                    SWfloat u[SW_PACKET_SIZE], v[SW_PACKET_SIZE], rgba[4 * SW_PACKET_SIZE];
+                    for (SWint l = 0; l < SW_PACKET_SIZE; l++) {
+                        u[l] = 4 * packet_test_randf(&seed);
+                        v[l] = 4 * packet_test_randf(&seed);
+                    }
+                    /* last texel of image, RGB fetch must not read past its end */
+                    u[0] = v[0] = 0.999f;
+                    swTexturePacket(0, u, v, rgba);
+                    for (SWint l = 0; l < SW_PACKET_SIZE; l++) {
+                        SWfloat ref[4];
+                        const SWfloat uv[2] = {u[l], v[l]};
+                        swTexture(0, uv, ref);
+                        for (SWint i = 0; i < 4; i++) {
+                            require(rgba[i * SW_PACKET_SIZE + l] == ref[i]);
+                        }
+                    }
+                }
+            }
+        }
+
+        swBindTexture(tex_rgba);
+        swInitProgramPacket(packet_test_fs_packet);
+
+        { // packet pipeline matches per-pixel one
+            const double time = render_packet_scene(pixels, depth);
+            compare_packet_scene(pixels, depth, ref_pixels, ref_depth);
+
+            printf("Packet shading %s: per-pixel %.2f ms, packet %.2f ms\n", isa_names[isa],
+                   1000.0 * ref_time, 1000.0 * time);
+        }
+    }
+
+    swPacketProcsInit(&ctx->packet_procs, &cpu_info);
+    swInitProgramPacket(NULL);
+    swDeleteProgram(program);
+    swDeleteTexture(tex_rgb);
+    swDeleteTexture(tex_rgba);
+    swDeleteContext(ctx);
+}